@@ -0,0 +1,4 @@
+#define cilk_for for
+#define cilk_spawn
+#define cilk_sync
+#define cilk_reducer(a,b)
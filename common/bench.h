@@ -0,0 +1,341 @@
+/**
+ * Copyright (c) 2014 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Small microbenchmark driver shared by the harnesses in this repository.
+//
+// A harness registers kernels by name, optionally over a geometric parameter
+// range, and calls bench_run_all().  For every (kernel, parameter) pair the
+// driver
+//
+//   1. calibrates an iteration count so that one sample lasts min_time,
+//   2. runs `warmup` discarded samples,
+//   3. collects `samples` samples of seconds per iteration,
+//   4. drops outliers outside the Tukey fences (1.5 IQR past the quartiles),
+//   5. reports min / median / mean / p99 / max of what is left,
+//
+// as a table and, if requested, as JSON so that runs from different commits
+// can be diffed mechanically.  The table goes to stdout, or to stderr when
+// the JSON does.
+//
+// A kernel receives a bench_state_t and must perform its operation
+// state->iterations times.  Per-iteration setup that should not count
+// (e.g. re-shuffling the input of a sort) goes between bench_pause() and
+// bench_resume().
+//
+// Options are read from the environment so they do not collide with the
+// getopt flags of each harness:
+//
+//   BENCH_FILTER    only run benchmarks whose name contains this string
+//   BENCH_MIN_TIME  target seconds per sample            (default 0.05)
+//   BENCH_SAMPLES   measured samples per benchmark       (default 15)
+//   BENCH_WARMUP    discarded samples per benchmark      (default 2)
+//   BENCH_JSON      write JSON results to this path ("-" for stdout)
+//
+// The registry is file-static: include this header from the harness's
+// main translation unit only.
+
+#ifndef INCLUDED_BENCH_DOT_H
+#define INCLUDED_BENCH_DOT_H
+
+#include "fasttime.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAX 64
+#define BENCH_MAX_SAMPLES 1000
+
+typedef struct {
+  int64_t param;       // current value from the registered range
+  int64_t iterations;  // how many times the kernel must run in this call
+  void* arg;           // pointer given at registration
+  fasttime_t paused_at;
+  double excluded;     // seconds spent between bench_pause/bench_resume
+} bench_state_t;
+
+typedef void (*bench_fn_t)(bench_state_t* state);
+
+typedef struct {
+  const char* name;
+  bench_fn_t fn;
+  void* arg;
+  int64_t param_min;
+  int64_t param_max;
+  int64_t param_mult;  // param_min, param_min * mult, ... up to param_max
+} bench_t;
+
+typedef struct {
+  const char* filter;
+  double min_time;
+  int samples;
+  int warmup;
+  const char* json;
+} bench_options_t;
+
+typedef struct {
+  double min;
+  double median;
+  double mean;
+  double p99;
+  double max;
+  int kept;
+  int rejected;
+} bench_stats_t;
+
+static bench_t bench_registry[BENCH_MAX];
+static int bench_count = 0;
+
+// Register a kernel over the parameter range [param_min, param_max],
+// stepping geometrically by param_mult (a multiplier below 2 runs param_min
+// only).  Returns -1 if the registry is full.
+static inline int bench_register_range(const char* name, bench_fn_t fn,
+                                       void* arg, int64_t param_min,
+                                       int64_t param_max, int64_t param_mult) {
+  if (bench_count == BENCH_MAX) {
+    fprintf(stderr, "bench: registry full, dropping %s\n", name);
+    return -1;
+  }
+  bench_t* b = &bench_registry[bench_count++];
+  b->name = name;
+  b->fn = fn;
+  b->arg = arg;
+  b->param_min = param_min;
+  b->param_max = param_max < param_min ? param_min : param_max;
+  b->param_mult = param_mult;
+  return 0;
+}
+
+// Register a kernel that takes a single parameter value.
+static inline int bench_register(const char* name, bench_fn_t fn, void* arg,
+                                 int64_t param) {
+  return bench_register_range(name, fn, arg, param, param, 1);
+}
+
+static inline void bench_pause(bench_state_t* state) {
+  state->paused_at = gettime();
+}
+
+static inline void bench_resume(bench_state_t* state) {
+  state->excluded += tdiff(state->paused_at, gettime());
+}
+
+static inline bench_options_t bench_options_from_env(void) {
+  bench_options_t opts = { NULL, 0.05, 15, 2, NULL };
+  const char* s;
+  if ((s = getenv("BENCH_FILTER")) != NULL && *s) {
+    opts.filter = s;
+  }
+  if ((s = getenv("BENCH_MIN_TIME")) != NULL && atof(s) > 0) {
+    opts.min_time = atof(s);
+  }
+  if ((s = getenv("BENCH_SAMPLES")) != NULL && atoi(s) > 0) {
+    opts.samples = atoi(s);
+  }
+  if ((s = getenv("BENCH_WARMUP")) != NULL && atoi(s) >= 0) {
+    opts.warmup = atoi(s);
+  }
+  if ((s = getenv("BENCH_JSON")) != NULL && *s) {
+    opts.json = s;
+  }
+  if (opts.samples > BENCH_MAX_SAMPLES) {
+    opts.samples = BENCH_MAX_SAMPLES;
+  }
+  return opts;
+}
+
+// Run one sample and return seconds per iteration.
+static inline double bench_sample(const bench_t* b, int64_t param,
+                                  int64_t iterations) {
+  bench_state_t state = { param, iterations, b->arg, { 0 }, 0.0 };
+  const fasttime_t start = gettime();
+  b->fn(&state);
+  const double elapsed = tdiff(start, gettime()) - state.excluded;
+  return elapsed / iterations;
+}
+
+// Grow the iteration count until one sample takes at least min_time.
+static inline int64_t bench_calibrate(const bench_t* b, int64_t param,
+                                      double min_time) {
+  int64_t iterations = 1;
+  for (;;) {
+    const double total = bench_sample(b, param, iterations) * iterations;
+    if (total >= min_time || iterations >= ((int64_t)1 << 40)) {
+      return iterations;
+    }
+    int64_t next = (total > 0) ? (int64_t)(iterations * 1.2 * min_time / total)
+                               : iterations * 100;
+    if (next > iterations * 100) {
+      next = iterations * 100;
+    }
+    iterations = (next > iterations) ? next : iterations + 1;
+  }
+}
+
+static inline int bench_cmp_double(const void* a, const void* b) {
+  const double x = *(const double*)a;
+  const double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Linear-interpolated quantile q of n sorted values.
+static inline double bench_quantile(const double* sorted, int n, double q) {
+  const double pos = q * (n - 1);
+  const int lo = (int)pos;
+  const int hi = (lo + 1 < n) ? lo + 1 : lo;
+  return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+// Sort the samples in place, drop Tukey outliers and summarize the rest.
+static inline bench_stats_t bench_summarize(double* samples, int n) {
+  bench_stats_t st;
+  qsort(samples, n, sizeof(double), bench_cmp_double);
+
+  const double q1 = bench_quantile(samples, n, 0.25);
+  const double q3 = bench_quantile(samples, n, 0.75);
+  const double lo = q1 - 1.5 * (q3 - q1);
+  const double hi = q3 + 1.5 * (q3 - q1);
+  int first = 0, last = n;
+  while (first < n && samples[first] < lo) {
+    first++;
+  }
+  while (last > first && samples[last - 1] > hi) {
+    last--;
+  }
+  const double* kept = samples + first;
+  const int k = last - first;
+
+  double sum = 0.0;
+  for (int i = 0; i < k; i++) {
+    sum += kept[i];
+  }
+  int rank = (int)(0.99 * k + 0.999999) - 1;  // nearest-rank percentile
+  if (rank < 0) {
+    rank = 0;
+  }
+
+  st.min = kept[0];
+  st.median = bench_quantile(kept, k, 0.5);
+  st.mean = sum / k;
+  st.p99 = kept[rank];
+  st.max = kept[k - 1];
+  st.kept = k;
+  st.rejected = n - k;
+  return st;
+}
+
+// Print seconds with a unit that keeps three significant digits readable.
+static inline void bench_print_time(FILE* out, double seconds) {
+  if (seconds < 1e-6) {
+    fprintf(out, " %10.2fns", seconds * 1e9);
+  } else if (seconds < 1e-3) {
+    fprintf(out, " %10.2fus", seconds * 1e6);
+  } else if (seconds < 1.0) {
+    fprintf(out, " %10.2fms", seconds * 1e3);
+  } else {
+    fprintf(out, " %10.3fs ", seconds);
+  }
+}
+
+static inline void bench_json_record(FILE* out, int first, const char* name,
+                                     int64_t param, int64_t iterations,
+                                     const bench_stats_t* st) {
+  fprintf(out,
+          "%s\n    {\"name\": \"%s\", \"param\": %lld, \"iterations\": %lld, "
+          "\"samples\": %d, \"rejected\": %d, \"min\": %.9g, "
+          "\"median\": %.9g, \"mean\": %.9g, \"p99\": %.9g, \"max\": %.9g}",
+          first ? "" : ",", name, (long long)param, (long long)iterations,
+          st->kept, st->rejected, st->min, st->median, st->mean, st->p99,
+          st->max);
+}
+
+// Run every registered benchmark that matches opts->filter.  Returns the
+// number of (benchmark, parameter) pairs that were measured.
+static inline int bench_run_all(const bench_options_t* opts) {
+  static double samples[BENCH_MAX_SAMPLES];
+  FILE* json = NULL;
+  FILE* table = stdout;
+  int measured = 0;
+
+  if (opts->json != NULL) {
+    json = (strcmp(opts->json, "-") == 0) ? stdout : fopen(opts->json, "w");
+    if (json == NULL) {
+      perror(opts->json);
+      return 0;
+    }
+    if (json == stdout) {
+      table = stderr;  // keep stdout parseable
+    }
+    fprintf(json, "{\n  \"context\": {\"clock\": \"monotonic\", "
+            "\"unit\": \"seconds/iteration\", \"min_time\": %g, "
+            "\"samples\": %d, \"warmup\": %d},\n  \"benchmarks\": [",
+            opts->min_time, opts->samples, opts->warmup);
+  }
+
+  fprintf(table, "%-40s %12s %12s %12s %12s %8s\n", "benchmark", "iterations",
+         "min", "median", "p99", "outliers");
+
+  for (int i = 0; i < bench_count; i++) {
+    const bench_t* b = &bench_registry[i];
+    if (opts->filter != NULL && strstr(b->name, opts->filter) == NULL) {
+      continue;
+    }
+    for (int64_t param = b->param_min; param <= b->param_max;
+         param = (b->param_mult > 1) ? param * b->param_mult
+                                     : b->param_max + 1) {
+      const int64_t iterations = bench_calibrate(b, param, opts->min_time);
+      for (int w = 0; w < opts->warmup; w++) {
+        bench_sample(b, param, iterations);
+      }
+      for (int s = 0; s < opts->samples; s++) {
+        samples[s] = bench_sample(b, param, iterations);
+      }
+      const bench_stats_t st = bench_summarize(samples, opts->samples);
+
+      char label[128];
+      snprintf(label, sizeof(label), "%s/%lld", b->name, (long long)param);
+      fprintf(table, "%-40s %12lld", label, (long long)iterations);
+      bench_print_time(table, st.min);
+      bench_print_time(table, st.median);
+      bench_print_time(table, st.p99);
+      fprintf(table, " %8d\n", st.rejected);
+      fflush(table);
+
+      if (json != NULL) {
+        bench_json_record(json, measured == 0, b->name, param, iterations,
+                          &st);
+      }
+      measured++;
+    }
+  }
+
+  if (json != NULL) {
+    fprintf(json, "\n  ]\n}\n");
+    if (json != stdout) {
+      fclose(json);
+    }
+  }
+  return measured;
+}
+
+#endif  // INCLUDED_BENCH_DOT_H
@@ -0,0 +1,421 @@
+/**
+ * Copyright (c) 2014 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Shared timing and measurement library for every harness in the repository.
+//
+// gettime()/tdiff() keep the interface of the per-assignment fasttime.h copies
+// this file replaces, and always measure wall time on a monotonic clock so
+// that numbers from different subsystems are comparable.  On top of that:
+//
+//   getcputime(), getthreadtime()  CPU time of the process / calling thread,
+//                                  returned as fasttime_t so tdiff() applies.
+//   tsc_now(), tsc_diff()          Raw time-stamp counter, converted to
+//                                  seconds with a one-off calibration against
+//                                  the monotonic clock.
+//   fasttimer_t, FASTTIME_SCOPE()  Accumulating timers on any of the clocks
+//                                  above; declare them __thread for
+//                                  per-thread timers.
+//   perfgroup_t                    Optional hardware counter group read
+//                                  through perf_event_open (Linux only).
+//
+// Everything is header-only; add the directory holding this file to the
+// include path (-I) and link with -lrt on older glibc.
+
+#ifndef INCLUDED_FASTTIME_DOT_H
+#define INCLUDED_FASTTIME_DOT_H
+
+// _GNU_SOURCE implies _POSIX_C_SOURCE 200809L ('struct timespec',
+// clock_gettime) and also exposes syscall() for perf_event_open.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define FASTTIME_HAVE_TSC 1
+#endif
+
+#ifdef __MACH__
+#include <mach/mach_time.h>  // mach_absolute_time
+#include <time.h>            // clock_gettime_nsec_np
+
+typedef uint64_t fasttime_t;
+
+// Return the current time.
+static inline fasttime_t gettime(void) {
+  return mach_absolute_time();
+}
+
+// Return the time different between the start and the end, as a float
+// in units of seconds.  This function does not need to be fast.
+// Implementation notes: See
+// https://developer.apple.com/library/mac/qa/qa1398/_index.html
+static inline double tdiff(fasttime_t start, fasttime_t end) {
+  static mach_timebase_info_data_t timebase;
+  int r = mach_timebase_info(&timebase);
+  assert(r == 0);
+  fasttime_t elapsed = end - start;
+  double ns = (double)elapsed * timebase.numer / timebase.denom;
+  return ns * 1e-9;
+}
+
+// Convert nanoseconds from one of the CPU clocks to mach_absolute_time units,
+// so that tdiff() works on all fasttime_t values alike.
+static inline fasttime_t fasttime_from_ns(uint64_t ns) {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  return (fasttime_t)((double)ns * timebase.denom / timebase.numer);
+}
+
+// Return the CPU time consumed so far by the whole process.
+static inline fasttime_t getcputime(void) {
+  return fasttime_from_ns(clock_gettime_nsec_np(CLOCK_PROCESS_CPUTIME_ID));
+}
+
+// Return the CPU time consumed so far by the calling thread.
+static inline fasttime_t getthreadtime(void) {
+  return fasttime_from_ns(clock_gettime_nsec_np(CLOCK_THREAD_CPUTIME_ID));
+}
+
+static inline unsigned int random_seed_from_clock(void) {
+  fasttime_t now = gettime();
+  return (now & 0xFFFFFFFF) + (now >> 32);
+}
+
+#else  // LINUX
+
+#include <time.h>
+
+typedef struct timespec fasttime_t;
+
+static inline fasttime_t fasttime_read(clockid_t clock) {
+  struct timespec s;
+#ifdef NDEBUG
+  clock_gettime(clock, &s);
+#else
+  int r = clock_gettime(clock, &s);
+  assert(r == 0);
+#endif
+  return s;
+}
+
+// Return the current time.
+static inline fasttime_t gettime(void) {
+  return fasttime_read(CLOCK_MONOTONIC);
+}
+
+// Return the CPU time consumed so far by the whole process.
+static inline fasttime_t getcputime(void) {
+  return fasttime_read(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// Return the CPU time consumed so far by the calling thread.
+static inline fasttime_t getthreadtime(void) {
+  return fasttime_read(CLOCK_THREAD_CPUTIME_ID);
+}
+
+// Return the time different between the start and the end, as a float
+// in units of seconds.  This function does not need to be fast.
+static inline double tdiff(fasttime_t start, fasttime_t end) {
+  return end.tv_sec - start.tv_sec + 1e-9 * (end.tv_nsec - start.tv_nsec);
+}
+
+static inline unsigned int random_seed_from_clock(void) {
+  fasttime_t now = gettime();
+  return now.tv_sec + now.tv_nsec;
+}
+
+// Poison these symbols to help find portability problems.
+int clock_gettime(clockid_t, struct timespec*) __attribute__((deprecated));
+time_t time(time_t*) __attribute__((deprecated));
+
+#endif  // LINUX
+
+
+// ===== Time-stamp counter =====
+
+// Return true if the TSC ticks at a constant rate regardless of frequency
+// scaling and sleep states, which is what makes tsc_diff() meaningful.
+static inline bool tsc_invariant(void) {
+#ifdef FASTTIME_HAVE_TSC
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+      eax < 0x80000007) {
+    return false;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx >> 8) & 1;
+#else
+  return false;
+#endif
+}
+
+// Read the time-stamp counter.  rdtscp waits for all earlier instructions
+// to retire, and the trailing fence keeps later ones from starting early.
+// Without a TSC this falls back to monotonic nanoseconds.
+static inline uint64_t tsc_now(void) {
+#ifdef FASTTIME_HAVE_TSC
+  unsigned int aux;
+  uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+#else
+  fasttime_t now = gettime();
+  return (uint64_t)(tdiff((fasttime_t){0}, now) * 1e9);
+#endif
+}
+
+// Return the TSC frequency in ticks per second.  The first call spins for
+// about 20ms against the monotonic clock; the result is cached afterwards.
+static inline double tsc_hz(void) {
+  static double hz = 0.0;
+  if (hz == 0.0) {
+#ifdef FASTTIME_HAVE_TSC
+    const fasttime_t t0 = gettime();
+    const uint64_t c0 = tsc_now();
+    fasttime_t t1;
+    do {
+      t1 = gettime();
+    } while (tdiff(t0, t1) < 0.02);
+    const uint64_t c1 = tsc_now();
+    hz = (c1 - c0) / tdiff(t0, t1);
+#else
+    hz = 1e9;
+#endif
+  }
+  return hz;
+}
+
+// Return the time between two tsc_now() readings in seconds.
+static inline double tsc_diff(uint64_t start, uint64_t end) {
+  return (end - start) / tsc_hz();
+}
+
+
+// ===== Accumulating timers =====
+
+typedef enum {
+  FASTTIME_WALL,     // gettime()
+  FASTTIME_PROCESS,  // getcputime()
+  FASTTIME_THREAD,   // getthreadtime()
+} fasttime_clock_t;
+
+// A named stopwatch that sums the time of every start/stop interval.  For a
+// per-thread timer declare it with __thread and use FASTTIME_THREAD.
+typedef struct {
+  const char* name;
+  fasttime_clock_t clock;
+  fasttime_t start;
+  double total;    // seconds accumulated over all intervals
+  uint64_t count;  // number of completed intervals
+} fasttimer_t;
+
+#define FASTTIMER_INIT(name, clock) { (name), (clock), { 0 }, 0.0, 0 }
+
+static inline fasttime_t fasttime_now(fasttime_clock_t clock) {
+  switch (clock) {
+    case FASTTIME_PROCESS:
+      return getcputime();
+    case FASTTIME_THREAD:
+      return getthreadtime();
+    default:
+      return gettime();
+  }
+}
+
+static inline void fasttimer_start(fasttimer_t* timer) {
+  timer->start = fasttime_now(timer->clock);
+}
+
+// Stop the current interval and return its length in seconds.
+static inline double fasttimer_stop(fasttimer_t* timer) {
+  const double elapsed = tdiff(timer->start, fasttime_now(timer->clock));
+  timer->total += elapsed;
+  timer->count++;
+  return elapsed;
+}
+
+static inline void fasttimer_reset(fasttimer_t* timer) {
+  timer->total = 0.0;
+  timer->count = 0;
+}
+
+static inline void fasttimer_print(FILE* out, const fasttimer_t* timer) {
+  fprintf(out, "%s: %.6fs total, %llu calls, %.3fus/call\n", timer->name,
+          timer->total, (unsigned long long)timer->count,
+          timer->count ? timer->total * 1e6 / timer->count : 0.0);
+}
+
+static inline fasttimer_t* fasttimer_scope_enter(fasttimer_t* timer) {
+  fasttimer_start(timer);
+  return timer;
+}
+
+static inline void fasttimer_scope_exit(fasttimer_t** timer) {
+  fasttimer_stop(*timer);
+}
+
+#define FASTTIME_CONCAT_(a, b) a##b
+#define FASTTIME_CONCAT(a, b) FASTTIME_CONCAT_(a, b)
+
+// Time the rest of the enclosing block into *timer.  The interval ends
+// however the block is left (fall-through, return, break or goto).
+#define FASTTIME_SCOPE(timer)                                \
+  fasttimer_t* FASTTIME_CONCAT(fasttime_scope_, __LINE__)    \
+      __attribute__((cleanup(fasttimer_scope_exit), unused)) \
+      = fasttimer_scope_enter(timer)
+
+
+// ===== Hardware counter groups =====
+
+#define PERFGROUP_MAX 8
+
+// Counters opened as one group are scheduled onto the PMU together, so
+// their values always describe the same interval.  When the kernel refuses
+// access (e.g. perf_event_paranoid, containers) perfgroup_open() fails and
+// the harness should carry on without counters.
+typedef struct {
+  int n;
+  int fds[PERFGROUP_MAX];
+  const char* names[PERFGROUP_MAX];
+  uint64_t values[PERFGROUP_MAX];
+} perfgroup_t;
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#define FASTTIME_HAVE_PERF 1
+#endif
+#endif
+
+#ifdef FASTTIME_HAVE_PERF
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// glibc only declares syscall() for _DEFAULT_SOURCE/_GNU_SOURCE, which a
+// strict -std=c99 build loses if a system header came before this one.
+long syscall(long number, ...);
+
+// Open the cycles/instructions/cache-misses/branch-misses group for the
+// calling thread.  Returns 0 on success and -1 if counters are unavailable.
+static inline int perfgroup_open(perfgroup_t* group) {
+  static const struct {
+    uint64_t config;
+    const char* name;
+  } events[] = {
+    { PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    { PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    { PERF_COUNT_HW_CACHE_MISSES, "cache-misses" },
+    { PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" },
+  };
+  const int num_events = sizeof(events) / sizeof(events[0]);
+
+  group->n = 0;
+  for (int i = 0; i < num_events; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = events[i].config;
+    attr.disabled = (i == 0);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    const int leader = (i == 0) ? -1 : group->fds[0];
+    const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (fd < 0) {
+      for (int j = 0; j < group->n; j++) {
+        close(group->fds[j]);
+      }
+      group->n = 0;
+      return -1;
+    }
+    group->fds[i] = fd;
+    group->names[i] = events[i].name;
+    group->values[i] = 0;
+    group->n++;
+  }
+  return 0;
+}
+
+static inline void perfgroup_start(perfgroup_t* group) {
+  if (group->n == 0) {
+    return;
+  }
+  ioctl(group->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(group->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+// Stop counting and load the counts since perfgroup_start() into values[].
+static inline void perfgroup_stop(perfgroup_t* group) {
+  if (group->n == 0) {
+    return;
+  }
+  ioctl(group->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  uint64_t buf[1 + PERFGROUP_MAX];
+  const ssize_t len = read(group->fds[0], buf, sizeof(buf));
+  for (int i = 0; i < group->n; i++) {
+    group->values[i] = (len > 0 && (uint64_t)i < buf[0]) ? buf[1 + i] : 0;
+  }
+}
+
+static inline void perfgroup_close(perfgroup_t* group) {
+  for (int i = 0; i < group->n; i++) {
+    close(group->fds[i]);
+  }
+  group->n = 0;
+}
+
+#else  // !FASTTIME_HAVE_PERF
+
+static inline int perfgroup_open(perfgroup_t* group) {
+  group->n = 0;
+  return -1;
+}
+static inline void perfgroup_start(perfgroup_t* group) { (void)group; }
+static inline void perfgroup_stop(perfgroup_t* group) { (void)group; }
+static inline void perfgroup_close(perfgroup_t* group) { group->n = 0; }
+
+#endif  // FASTTIME_HAVE_PERF
+
+static inline void perfgroup_print(FILE* out, const perfgroup_t* group) {
+  for (int i = 0; i < group->n; i++) {
+    fprintf(out, "%s%s=%llu", i ? " " : "", group->names[i],
+            (unsigned long long)group->values[i]);
+  }
+  if (group->n > 0) {
+    fprintf(out, "\n");
+  }
+}
+
+#endif  // INCLUDED_FASTTIME_DOT_H
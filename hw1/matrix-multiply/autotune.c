@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+/**
+ * autotune.c:
+ *
+ * This file searches for the blocking parameters that make
+ * matrix_multiply_run() fastest on this machine, and writes them to the
+ * configuration file that matrix_multiply_run() loads.
+ *
+ * The search starts from the cache-derived defaults and tries every
+ * register tile, then walks kc, mc and nc one at a time, keeping any
+ * change that makes the multiply clearly faster, until a whole round
+ * changes nothing.
+ **/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fasttime.h"
+#include "./matrix_multiply.h"
+
+// Candidate sizes for kc, mc and nc, tried in multiples of the tile.
+static const int kSizes[] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+                             768, 1024, 1536, 2048, 3072, 4096, 8192};
+static const int kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+// A change must gain this fraction of the time to be kept, so that noise
+// between trials does not keep the search going.
+static const double kMinGain = 0.03;
+static const int kMaxRounds = 4;
+
+static matrix* A;
+static matrix* B;
+static matrix* C;
+static int trials = 5;
+static int verbose = 0;
+
+static void fill_matrix(matrix* m, unsigned int* seed) {
+  for (int i = 0; i < m->rows; i++) {
+    for (int j = 0; j < m->cols; j++) {
+      m->values[i][j] = rand_r(seed) % 10;
+    }
+  }
+}
+
+static void clear_matrix(matrix* m) {
+  for (int i = 0; i < m->rows; i++) {
+    memset(m->values[i], 0, sizeof(int) * m->cols);
+  }
+}
+
+// Best time of trials runs of the multiply with config.
+static double time_config(const matrix_multiply_config* config) {
+  double best = 0;
+  for (int t = 0; t < trials; t++) {
+    clear_matrix(C);
+    fasttime_t start = gettime();
+    matrix_multiply_run_config(A, B, C, config);
+    const double elapsed = tdiff(start, gettime());
+    if (t == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (verbose) {
+    printf("  mc %4d kc %4d nc %4d tile %dx%-2d  %.4f sec\n", config->mc,
+           config->kc, config->nc, config->mr, config->nr, best);
+  }
+  return best;
+}
+
+// Try every candidate value of *param, rounded to a multiple of step, and
+// keep the fastest.  Returns whether *param changed.  Candidates of limit
+// and above all block the same, so only the first of them is tried.
+static int search(matrix_multiply_config* config, int* param, int step,
+                  int limit, double* best) {
+  const int start = *param;
+  int best_value = start;
+  for (int s = 0; s < kNumSizes; s++) {
+    const int value = (kSizes[s] + step - 1) / step * step;
+    if (value == best_value || (s > 0 && kSizes[s - 1] >= limit)) {
+      continue;
+    }
+    *param = value;
+    const double elapsed = time_config(config);
+    if (elapsed < *best * (1 - kMinGain)) {
+      *best = elapsed;
+      best_value = value;
+    }
+  }
+  *param = best_value;
+  return best_value != start;
+}
+
+// Check the multiply with config against the unblocked one.
+static int verify(const matrix_multiply_config* config) {
+  matrix* expected = make_matrix(C->rows, C->cols);
+  matrix_multiply_naive(A, B, expected);
+  clear_matrix(C);
+  matrix_multiply_run_config(A, B, C, config);
+  int ok = 1;
+  for (int i = 0; i < C->rows && ok; i++) {
+    ok = memcmp(C->values[i], expected->values[i],
+                sizeof(int) * C->cols) == 0;
+  }
+  free_matrix(expected);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int optchar = 0;
+  int n = 512;
+  const char* path = getenv("MATRIX_MULTIPLY_CONFIG");
+  if (path == NULL) {
+    path = MATRIX_MULTIPLY_CONFIG_FILE;
+  }
+
+  while ((optchar = getopt(argc, argv, "n:t:o:v")) != -1) {
+    switch (optchar) {
+      case 'n':
+        n = atoi(optarg);
+        break;
+      case 't':
+        trials = atoi(optarg);
+        break;
+      case 'o':
+        path = optarg;
+        break;
+      case 'v':
+        verbose = 1;
+        break;
+      default:
+        printf("Usage: %s [-n size] [-t trials] [-o file] [-v]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (n < 1 || trials < 1) {
+    printf("Usage: %s [-n size] [-t trials] [-o file] [-v]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned int seed = 1;
+  A = make_matrix(n, n);
+  B = make_matrix(n, n);
+  C = make_matrix(n, n);
+  fill_matrix(A, &seed);
+  fill_matrix(B, &seed);
+
+  matrix_multiply_config best = matrix_multiply_default_config();
+  double best_time = time_config(&best);
+  printf("Defaults: mc %d kc %d nc %d tile %dx%d, %.4f sec\n", best.mc,
+         best.kc, best.nc, best.mr, best.nr, best_time);
+
+  for (int t = 0; t < matrix_multiply_num_tiles; t++) {
+    matrix_multiply_config config = best;
+    config.mr = matrix_multiply_tiles[t][0];
+    config.nr = matrix_multiply_tiles[t][1];
+    if (config.mr == best.mr && config.nr == best.nr) {
+      continue;
+    }
+    const double elapsed = time_config(&config);
+    if (elapsed < best_time * (1 - kMinGain)) {
+      best = config;
+      best_time = elapsed;
+    }
+  }
+
+  for (int changed = 1, round = 1; changed && round <= kMaxRounds; round++) {
+    changed = search(&best, &best.kc, 8, n, &best_time);
+    changed |= search(&best, &best.mc, best.mr, n, &best_time);
+    changed |= search(&best, &best.nc, best.nr, n, &best_time);
+    printf("Round %d: mc %d kc %d nc %d tile %dx%d, %.4f sec\n", round,
+           best.mc, best.kc, best.nc, best.mr, best.nr, best_time);
+  }
+
+  if (!verify(&best)) {
+    printf("Error: the blocked multiply disagrees with the naive one\n");
+    return 1;
+  }
+  if (matrix_multiply_save_config(path, &best) != 0) {
+    printf("Error: cannot write %s\n", path);
+    return 1;
+  }
+  printf("Wrote %s\n", path);
+
+  free_matrix(A);
+  free_matrix(B);
+  free_matrix(C);
+  return 0;
+}
@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "./gemv.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cilk
+#include <cilk/cilk.h>
+#else
+#define cilk_for for
+#endif
+
+// Rows that share each load of x, each with its own accumulator.
+#define GEMV_ROWS 4
+// Rows per parallel block; a multiple of GEMV_ROWS.
+#define GEMV_GRAIN 64
+// Columns of y kept in cache while gemv_t streams the rows of A past them.
+#define GEMV_T_COLS 1024
+// Columns per tile of A in gemv_batch; GEMV_ROWS rows of it fit in L1.
+#define BATCH_COLS 512
+// Vectors that share each load of A in gemv_batch.
+#define BATCH_VECS 4
+
+static inline int min(int a, int b) {
+  return (a < b) ? a : b;
+}
+
+// y[i0..i1) = A[i0..i1)*x.
+static void gemv_rows(const int* A, int cols, int lda, const int* x, int* y,
+                      int i0, int i1) {
+  int i = i0;
+  for (; i + GEMV_ROWS <= i1; i += GEMV_ROWS) {
+    const int* a0 = A + (size_t)i * lda;
+    const int* a1 = a0 + lda;
+    const int* a2 = a1 + lda;
+    const int* a3 = a2 + lda;
+    int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int j = 0; j < cols; j++) {
+      const int xj = x[j];
+      s0 += a0[j] * xj;
+      s1 += a1[j] * xj;
+      s2 += a2[j] * xj;
+      s3 += a3[j] * xj;
+    }
+    y[i] = s0;
+    y[i + 1] = s1;
+    y[i + 2] = s2;
+    y[i + 3] = s3;
+  }
+  for (; i < i1; i++) {
+    const int* a = A + (size_t)i * lda;
+    int s = 0;
+    for (int j = 0; j < cols; j++) {
+      s += a[j] * x[j];
+    }
+    y[i] = s;
+  }
+}
+
+void gemv(const int* A, int rows, int cols, int lda, const int* x, int* y) {
+  cilk_for (int i0 = 0; i0 < rows; i0 += GEMV_GRAIN) {
+    gemv_rows(A, cols, lda, x, y, i0, min(i0 + GEMV_GRAIN, rows));
+  }
+}
+
+// y[j0..j1) = A[:, j0..j1)^T*x: the rows of A, GEMV_ROWS at a time, are
+// scaled and added into the slice of y, which stays in L1.
+static void gemv_t_cols(const int* A, int rows, int lda, const int* x,
+                        int* y, int j0, int j1) {
+  memset(y + j0, 0, (j1 - j0) * sizeof(int));
+  int i = 0;
+  for (; i + GEMV_ROWS <= rows; i += GEMV_ROWS) {
+    const int* a0 = A + (size_t)i * lda;
+    const int* a1 = a0 + lda;
+    const int* a2 = a1 + lda;
+    const int* a3 = a2 + lda;
+    const int x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+    for (int j = j0; j < j1; j++) {
+      y[j] += a0[j] * x0 + a1[j] * x1 + a2[j] * x2 + a3[j] * x3;
+    }
+  }
+  for (; i < rows; i++) {
+    const int* a = A + (size_t)i * lda;
+    const int xi = x[i];
+    for (int j = j0; j < j1; j++) {
+      y[j] += a[j] * xi;
+    }
+  }
+}
+
+void gemv_t(const int* A, int rows, int cols, int lda, const int* x, int* y) {
+  cilk_for (int j0 = 0; j0 < cols; j0 += GEMV_T_COLS) {
+    gemv_t_cols(A, rows, lda, x, y, j0, min(j0 + GEMV_T_COLS, cols));
+  }
+}
+
+// Y[v][i0..i1) = A[i0..i1)*X[v] for every vector.  Each GEMV_ROWS x
+// BATCH_COLS tile of A is read from memory once and then from L1 for each
+// group of BATCH_VECS vectors, whose partial sums are added into Y.
+static void gemv_batch_rows(const int* A, int cols, int lda, const int* X,
+                            int ldx, int* Y, int ldy, int nvec, int i0,
+                            int i1) {
+  for (int v = 0; v < nvec; v++) {
+    memset(Y + (size_t)v * ldy + i0, 0, (i1 - i0) * sizeof(int));
+  }
+  for (int j0 = 0; j0 < cols; j0 += BATCH_COLS) {
+    const int j1 = min(j0 + BATCH_COLS, cols);
+    for (int i = i0; i < i1; i += GEMV_ROWS) {
+      const int nrows = min(GEMV_ROWS, i1 - i);
+      int v = 0;
+      for (; v + BATCH_VECS <= nvec && nrows == GEMV_ROWS; v += BATCH_VECS) {
+        int acc[GEMV_ROWS][BATCH_VECS] = {{0}};
+        const int* a = A + (size_t)i * lda;
+        const int* x = X + (size_t)v * ldx;
+        for (int j = j0; j < j1; j++) {
+          for (int r = 0; r < GEMV_ROWS; r++) {
+            for (int w = 0; w < BATCH_VECS; w++) {
+              acc[r][w] += a[(size_t)r * lda + j] * x[(size_t)w * ldx + j];
+            }
+          }
+        }
+        for (int r = 0; r < GEMV_ROWS; r++) {
+          for (int w = 0; w < BATCH_VECS; w++) {
+            Y[(size_t)(v + w) * ldy + i + r] += acc[r][w];
+          }
+        }
+      }
+      // Leftover vectors, and the rows of a short last block.
+      for (; v < nvec; v++) {
+        const int* x = X + (size_t)v * ldx;
+        for (int r = 0; r < nrows; r++) {
+          const int* a = A + (size_t)(i + r) * lda;
+          int s = 0;
+          for (int j = j0; j < j1; j++) {
+            s += a[j] * x[j];
+          }
+          Y[(size_t)v * ldy + i + r] += s;
+        }
+      }
+    }
+  }
+}
+
+void gemv_batch(const int* A, int rows, int cols, int lda, const int* X,
+                int ldx, int* Y, int ldy, int nvec) {
+  cilk_for (int i0 = 0; i0 < rows; i0 += GEMV_GRAIN) {
+    gemv_batch_rows(A, cols, lda, X, ldx, Y, ldy, nvec, i0,
+                    min(i0 + GEMV_GRAIN, rows));
+  }
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+/**
+ * Matrix-vector products
+ *
+ * Kernels for y = A*x and y = A^T*x on a matrix stored contiguously, row
+ * after row, lda ints apart.  Each element of A is used once per vector,
+ * so these kernels are bound by how fast A streams in from memory: they
+ * read A exactly once, in order, and reuse every load of x across several
+ * rows.  Row blocks run in parallel when built with "make PARALLEL=1".
+ **/
+
+#ifndef GEMV_H_INCLUDED
+
+#define GEMV_H_INCLUDED
+
+// y = A*x, where A is rows x cols, x has cols elements and y has rows.
+void gemv(const int* A, int rows, int cols, int lda, const int* x, int* y);
+
+// y = A^T*x, where A is rows x cols, x has rows elements and y has cols.
+void gemv_t(const int* A, int rows, int cols, int lda, const int* x, int* y);
+
+// Y[v] = A*X[v] for nvec vectors: X[v] starts at X + v * ldx and Y[v] at
+// Y + v * ldy.  Each tile of A is loaded once and applied to every vector,
+// so A streams in once for the whole batch instead of once per vector.
+void gemv_batch(const int* A, int rows, int cols, int lda, const int* X,
+                int ldx, int* Y, int ldy, int nvec);
+
+#endif  // GEMV_H_INCLUDED
@@ -76,9 +76,8 @@ void print_matrix(const matrix* m) {
 }
 
 
-// Multiply matrix A*B, store result in C.
-int matrix_multiply_run(const matrix* A, const matrix* B, matrix* C) {
-  
+// Unblocked multiply: C += A*B, one row of C at a time.
+int matrix_multiply_naive(const matrix* A, const matrix* B, matrix* C) {
   tbassert(A->cols == B->rows,
            "A->cols = %d, B->rows = %d\n", A->cols, B->rows);
   tbassert(A->rows == C->rows,
@@ -86,14 +85,297 @@ int matrix_multiply_run(const matrix* A, const matrix* B, matrix* C) {
   tbassert(B->cols == C->cols,
            "B->cols = %d, C->cols = %d\n", B->cols, C->cols);
 
-
   for (int i = 0; i < A->rows; i++) {
     for (int k = 0; k < A->cols; k++) {
       for (int j = 0; j < B->cols; j++) {
-	C->values[i][j] += A->values[i][k] * B->values[k][j];
+        C->values[i][j] += A->values[i][k] * B->values[k][j];
       }
     }
   }
 
   return 0;
 }
+
+// Micro-kernels.  kernel_MRxNR adds the product of an MR x kc strip of A,
+// packed column by column, and a kc x NR strip of B, packed row by row, to
+// the m x n tile of c at (i0, j0).  The strips are zero-padded to MR and NR,
+// so only the final update has to respect the tile's real size.
+#define DEFINE_KERNEL(MR, NR)                                              \
+  static void kernel_##MR##x##NR(int kc, const int* a, const int* b,       \
+                                 int** c, int i0, int j0, int m, int n) {  \
+    int acc[MR][NR] = {{0}};                                               \
+    for (int k = 0; k < kc; k++) {                                         \
+      for (int i = 0; i < MR; i++) {                                       \
+        for (int j = 0; j < NR; j++) {                                     \
+          acc[i][j] += a[k * MR + i] * b[k * NR + j];                      \
+        }                                                                  \
+      }                                                                    \
+    }                                                                      \
+    for (int i = 0; i < m; i++) {                                          \
+      for (int j = 0; j < n; j++) {                                        \
+        c[i0 + i][j0 + j] += acc[i][j];                                    \
+      }                                                                    \
+    }                                                                      \
+  }
+
+DEFINE_KERNEL(2, 16)
+DEFINE_KERNEL(4, 8)
+DEFINE_KERNEL(4, 16)
+DEFINE_KERNEL(8, 8)
+DEFINE_KERNEL(6, 16)
+
+typedef void (*kernel_t)(int, const int*, const int*, int**, int, int, int,
+                         int);
+
+const int matrix_multiply_tiles[][2] = {
+  {2, 16}, {4, 8}, {4, 16}, {8, 8}, {6, 16},
+};
+const int matrix_multiply_num_tiles =
+    sizeof(matrix_multiply_tiles) / sizeof(matrix_multiply_tiles[0]);
+static const kernel_t kernels[] = {
+  kernel_2x16, kernel_4x8, kernel_4x16, kernel_8x8, kernel_6x16,
+};
+
+static kernel_t find_kernel(int mr, int nr) {
+  for (int t = 0; t < matrix_multiply_num_tiles; t++) {
+    if (matrix_multiply_tiles[t][0] == mr &&
+        matrix_multiply_tiles[t][1] == nr) {
+      return kernels[t];
+    }
+  }
+  return NULL;
+}
+
+static inline int min(int a, int b) {
+  return (a < b) ? a : b;
+}
+
+// Pack rows [i0, i0 + m) and columns [k0, k0 + kc) of A into mr-row
+// strips, each stored column by column and padded with zero rows.
+static void pack_a(const matrix* A, int i0, int m, int k0, int kc, int mr,
+                   int* buf) {
+  for (int is = 0; is < m; is += mr) {
+    int* strip = buf + is * kc;
+    for (int i = 0; i < mr; i++) {
+      if (is + i < m) {
+        const int* row = A->values[i0 + is + i] + k0;
+        for (int k = 0; k < kc; k++) {
+          strip[k * mr + i] = row[k];
+        }
+      } else {
+        for (int k = 0; k < kc; k++) {
+          strip[k * mr + i] = 0;
+        }
+      }
+    }
+  }
+}
+
+// Pack rows [k0, k0 + kc) and columns [j0, j0 + n) of B into nr-column
+// strips, each stored row by row and padded with zero columns.
+static void pack_b(const matrix* B, int k0, int kc, int j0, int n, int nr,
+                   int* buf) {
+  for (int js = 0; js < n; js += nr) {
+    int* strip = buf + js * kc;
+    const int width = min(nr, n - js);
+    for (int k = 0; k < kc; k++) {
+      const int* row = B->values[k0 + k] + j0 + js;
+      int j = 0;
+      for (; j < width; j++) {
+        strip[k * nr + j] = row[j];
+      }
+      for (; j < nr; j++) {
+        strip[k * nr + j] = 0;
+      }
+    }
+  }
+}
+
+int matrix_multiply_run_config(const matrix* A, const matrix* B, matrix* C,
+                               const matrix_multiply_config* config) {
+  tbassert(A->cols == B->rows,
+           "A->cols = %d, B->rows = %d\n", A->cols, B->rows);
+  tbassert(A->rows == C->rows,
+           "A->rows = %d, C->rows = %d\n", A->rows, C->rows);
+  tbassert(B->cols == C->cols,
+           "B->cols = %d, C->cols = %d\n", B->cols, C->cols);
+
+  const int M = A->rows, K = A->cols, N = B->cols;
+  const int mr = config->mr, nr = config->nr;
+  const kernel_t kernel = find_kernel(mr, nr);
+  if (kernel == NULL) {
+    return -1;
+  }
+  const int mc = min(config->mc, M), kc = min(config->kc, K);
+  const int nc = min(config->nc, N);
+  if (M == 0 || K == 0 || N == 0) {
+    return 0;
+  }
+
+  int* a_pack = (int*)malloc(sizeof(int) * ((mc + mr - 1) / mr) * mr * kc);
+  int* b_pack = (int*)malloc(sizeof(int) * ((nc + nr - 1) / nr) * nr * kc);
+  if (a_pack == NULL || b_pack == NULL) {
+    free(a_pack);
+    free(b_pack);
+    return -1;
+  }
+
+  for (int jc = 0; jc < N; jc += nc) {
+    const int n = min(nc, N - jc);
+    for (int pc = 0; pc < K; pc += kc) {
+      const int k = min(kc, K - pc);
+      pack_b(B, pc, k, jc, n, nr, b_pack);
+      for (int ic = 0; ic < M; ic += mc) {
+        const int m = min(mc, M - ic);
+        pack_a(A, ic, m, pc, k, mr, a_pack);
+        for (int jr = 0; jr < n; jr += nr) {
+          for (int ir = 0; ir < m; ir += mr) {
+            kernel(k, a_pack + ir * k, b_pack + jr * k, C->values,
+                   ic + ir, jc + jr, min(mr, m - ir), min(nr, n - jr));
+          }
+        }
+      }
+    }
+  }
+
+  free(a_pack);
+  free(b_pack);
+  return 0;
+}
+
+// Size in bytes of the data or unified cache of cpu0 at level, or 0 if
+// sysfs does not describe one.
+static long cache_size(int level) {
+  for (int index = 0; ; index++) {
+    char path[128], type[32], size[32];
+    int l;
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+      return 0;
+    }
+    int ok = fscanf(f, "%d", &l) == 1;
+    fclose(f);
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+    f = fopen(path, "r");
+    if (f == NULL) {
+      return 0;
+    }
+    ok = ok && fscanf(f, "%31s", type) == 1;
+    fclose(f);
+    if (!ok || l != level || strcmp(type, "Instruction") == 0) {
+      continue;
+    }
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+    f = fopen(path, "r");
+    if (f == NULL) {
+      return 0;
+    }
+    ok = fscanf(f, "%31s", size) == 1;
+    fclose(f);
+    if (!ok) {
+      return 0;
+    }
+    char* unit;
+    long bytes = strtol(size, &unit, 10);
+    if (*unit == 'K') {
+      bytes <<= 10;
+    } else if (*unit == 'M') {
+      bytes <<= 20;
+    }
+    return bytes;
+  }
+}
+
+static int clamp(long x, int lo, int hi) {
+  return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+// Goto-style sizing: a kc x nr strip of B fills half of L1, an mc x kc
+// block of A half of L2, and a kc x nc panel of B half of L3.
+matrix_multiply_config matrix_multiply_default_config(void) {
+  long l1 = cache_size(1), l2 = cache_size(2), l3 = cache_size(3);
+  l1 = l1 ? l1 : 32 << 10;
+  l2 = l2 ? l2 : 256 << 10;
+  l3 = l3 ? l3 : 8 << 20;
+
+  matrix_multiply_config config;
+  config.mr = 4;
+  config.nr = 8;
+  config.kc = clamp(l1 / 2 / (config.nr * sizeof(int)), 64, 1024) / 8 * 8;
+  config.mc = clamp(l2 / 2 / (config.kc * sizeof(int)), config.mr, 1024)
+              / config.mr * config.mr;
+  config.nc = clamp(l3 / 2 / (config.kc * sizeof(int)), config.nr, 8192)
+              / config.nr * config.nr;
+  return config;
+}
+
+int matrix_multiply_load_config(const char* path,
+                                matrix_multiply_config* config) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  matrix_multiply_config c = {0, 0, 0, 0, 0};
+  char line[128], name[32];
+  int value;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#' || sscanf(line, "%31s %d", name, &value) != 2) {
+      continue;
+    }
+    if (strcmp(name, "mc") == 0) {
+      c.mc = value;
+    } else if (strcmp(name, "kc") == 0) {
+      c.kc = value;
+    } else if (strcmp(name, "nc") == 0) {
+      c.nc = value;
+    } else if (strcmp(name, "mr") == 0) {
+      c.mr = value;
+    } else if (strcmp(name, "nr") == 0) {
+      c.nr = value;
+    }
+  }
+  fclose(f);
+
+  if (c.mc <= 0 || c.kc <= 0 || c.nc <= 0 || find_kernel(c.mr, c.nr) == NULL) {
+    return -1;
+  }
+  *config = c;
+  return 0;
+}
+
+int matrix_multiply_save_config(const char* path,
+                                const matrix_multiply_config* config) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    return -1;
+  }
+  fprintf(f, "# matrix_multiply blocking, written by autotune\n");
+  fprintf(f, "mc %d\nkc %d\nnc %d\nmr %d\nnr %d\n", config->mc, config->kc,
+          config->nc, config->mr, config->nr);
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+// Multiply matrix A*B, store result in C.  The blocking comes from the
+// configuration file when there is a usable one, and from the cache sizes
+// otherwise.
+int matrix_multiply_run(const matrix* A, const matrix* B, matrix* C) {
+  static matrix_multiply_config config;
+  static int configured = 0;
+  if (!configured) {
+    const char* path = getenv("MATRIX_MULTIPLY_CONFIG");
+    if (path == NULL) {
+      path = MATRIX_MULTIPLY_CONFIG_FILE;
+    }
+    if (matrix_multiply_load_config(path, &config) != 0) {
+      config = matrix_multiply_default_config();
+    }
+    configured = 1;
+  }
+  return matrix_multiply_run_config(A, B, C, &config);
+}
@@ -44,9 +44,47 @@ typedef struct {
   int** values;
 } matrix;
 
+// Blocking parameters of the multiply.  B is packed kc x nc panels at a
+// time, A mc x kc blocks at a time, and each mr x nr tile of C is kept in
+// registers while a kc-long strip of A and of B is streamed through it.
+typedef struct {
+  int mc;
+  int kc;
+  int nc;
+  int mr;
+  int nr;
+} matrix_multiply_config;
+
+// Configuration file that matrix_multiply_run() loads on its first call,
+// unless the MATRIX_MULTIPLY_CONFIG environment variable names another.
+#define MATRIX_MULTIPLY_CONFIG_FILE "matrix_multiply.conf"
+
 // Multiply matrix A*B, store result in C.
 int matrix_multiply_run(const matrix* A, const matrix* B, matrix* C);
 
+// Multiply matrix A*B, add the product to C, blocking with config.
+int matrix_multiply_run_config(const matrix* A, const matrix* B, matrix* C,
+                               const matrix_multiply_config* config);
+
+// The unblocked i-k-j loop, the reference for the blocked multiply.
+int matrix_multiply_naive(const matrix* A, const matrix* B, matrix* C);
+
+// Block sizes derived from the cache sizes in sysfs, or from typical ones
+// when sysfs is not available.
+matrix_multiply_config matrix_multiply_default_config(void);
+
+// Read or write a configuration file of "name value" lines.  Both return
+// 0 on success and -1 if the file cannot be used; reading also fails on a
+// register tile with no kernel.
+int matrix_multiply_load_config(const char* path,
+                                matrix_multiply_config* config);
+int matrix_multiply_save_config(const char* path,
+                                const matrix_multiply_config* config);
+
+// Register tiles (mr, nr) that have a kernel, as num_tiles pairs.
+extern const int matrix_multiply_tiles[][2];
+extern const int matrix_multiply_num_tiles;
+
 // Allocates a row-by-cols matrix and returns it
 matrix* make_matrix(int rows, int cols);
 
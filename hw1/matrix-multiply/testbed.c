@@ -33,15 +33,113 @@
 #include <string.h>
 #include <time.h>
 
-#include "./fasttime.h"
+#include "bench.h"
+#include "fasttime.h"
+#include "./gemv.h"
 #include "./matrix_multiply.h"
 
+// Fill m with small random values.
+static void fill_matrix(matrix* m, unsigned int* seed) {
+  for (int i = 0; i < m->rows; i++) {
+    for (int j = 0; j < m->cols; j++) {
+      m->values[i][j] = rand_r(seed) % 10;
+    }
+  }
+}
+
+typedef int (*multiply_t)(const matrix*, const matrix*, matrix*);
+
+// Benchmark kernel: multiply two random param x param matrices with the
+// multiply that arg points to.
+static void bench_matrix_multiply(bench_state_t* state) {
+  const multiply_t multiply = *(const multiply_t*)state->arg;
+  const int n = state->param;
+  unsigned int seed = 1;
+
+  bench_pause(state);
+  matrix* A = make_matrix(n, n);
+  matrix* B = make_matrix(n, n);
+  matrix* C = make_matrix(n, n);
+  fill_matrix(A, &seed);
+  fill_matrix(B, &seed);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    multiply(A, B, C);
+  }
+
+  bench_pause(state);
+  free_matrix(A);
+  free_matrix(B);
+  free_matrix(C);
+  bench_resume(state);
+}
+
+// Matrix-vector products timed by bench_gemv().  GEMV_NAIVE multiplies by
+// a param x 1 matrix with matrix_multiply_naive(), as a baseline.
+enum { GEMV, GEMV_T, GEMV_BATCH, GEMV_NAIVE };
+static const int kBatchVectors = 8;
+
+// Benchmark kernel: the product that arg points to, with a random param x
+// param matrix.  GEMV_BATCH multiplies by kBatchVectors vectors at once.
+static void bench_gemv(bench_state_t* state) {
+  const int op = *(const int*)state->arg;
+  const int n = state->param;
+  unsigned int seed = 1;
+
+  bench_pause(state);
+  int* A = (int*)malloc(sizeof(int) * n * n);
+  int* X = (int*)malloc(sizeof(int) * n * kBatchVectors);
+  int* Y = (int*)malloc(sizeof(int) * n * kBatchVectors);
+  matrix* M = make_matrix(n, n);
+  matrix* x = make_matrix(n, 1);
+  matrix* y = make_matrix(n, 1);
+  for (int i = 0; i < n * n; i++) {
+    A[i] = rand_r(&seed) % 10;
+    M->values[i / n][i % n] = A[i];
+  }
+  for (int i = 0; i < n * kBatchVectors; i++) {
+    X[i] = rand_r(&seed) % 10;
+  }
+  for (int i = 0; i < n; i++) {
+    x->values[i][0] = X[i];
+  }
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    switch (op) {
+      case GEMV:
+        gemv(A, n, n, n, X, Y);
+        break;
+      case GEMV_T:
+        gemv_t(A, n, n, n, X, Y);
+        break;
+      case GEMV_BATCH:
+        gemv_batch(A, n, n, n, X, n, Y, n, kBatchVectors);
+        break;
+      default:
+        matrix_multiply_naive(M, x, y);
+        break;
+    }
+  }
+
+  bench_pause(state);
+  free(A);
+  free(X);
+  free(Y);
+  free_matrix(M);
+  free_matrix(x);
+  free_matrix(y);
+  bench_resume(state);
+}
+
 
 int main(int argc, char** argv) {
   int optchar = 0;
   int show_usec = 0;
   int should_print = 0;
   int use_zero_matrix = 0;
+  int run_benchmarks = 0;
 
   // Always use the same seed, so that our tests are repeatable.
   unsigned int randomSeed = 1;
@@ -54,7 +152,7 @@ int main(int argc, char** argv) {
 
 
   // Parse command line arguments
-  while ((optchar = getopt(argc, argv, "upz")) != -1) {
+  while ((optchar = getopt(argc, argv, "upzb")) != -1) {
     switch (optchar) {
       case 'u':
         show_usec = 1;
@@ -65,12 +163,34 @@ int main(int argc, char** argv) {
       case 'z':
         use_zero_matrix = 1;
         break;
+      case 'b':
+        run_benchmarks = 1;
+        break;
       default:
         printf("Ignoring unrecognized option: %c\n", optchar);
         continue;
     }
   }
 
+  // -b runs matrix_multiply_run() through the shared benchmark driver over a
+  // range of sizes instead of the single timed 1000x1000 run below.
+  if (run_benchmarks) {
+    static multiply_t blocked = matrix_multiply_run;
+    static multiply_t naive = matrix_multiply_naive;
+    const bench_options_t opts = bench_options_from_env();
+    bench_register_range("matrix_multiply", bench_matrix_multiply, &blocked,
+                         64, 1024, 2);
+    bench_register_range("matrix_multiply_naive", bench_matrix_multiply,
+                         &naive, 64, 1024, 2);
+    static int ops[] = {GEMV, GEMV_T, GEMV_BATCH, GEMV_NAIVE};
+    bench_register_range("gemv", bench_gemv, &ops[0], 256, 8192, 2);
+    bench_register_range("gemv_t", bench_gemv, &ops[1], 256, 8192, 2);
+    bench_register_range("gemv_batch8", bench_gemv, &ops[2], 256, 8192, 2);
+    bench_register_range("gemv_naive", bench_gemv, &ops[3], 256, 8192, 2);
+    bench_run_all(&opts);
+    return 0;
+  }
+
   // This is a trick to make the memory bug leads to a wrong output.
   int size = sizeof(int) * 4;
   int* temp[20];
@@ -108,16 +228,8 @@ int main(int argc, char** argv) {
       }
     }
   } else {
-    for (int i = 0; i < A->rows; i++) {
-      for (int j = 0; j < A->cols; j++) {
-        A->values[i][j] = rand_r(&randomSeed) % 10;
-      }
-    }
-    for (int i = 0; i < B->rows; i++) {
-      for (int j = 0; j < B->cols; j++) {
-        B->values[i][j] = rand_r(&randomSeed) % 10;
-      }
-    }
+    fill_matrix(A, &randomSeed);
+    fill_matrix(B, &randomSeed);
   }
 
   if (should_print) {
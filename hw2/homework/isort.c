@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Typedefs
 typedef uint32_t data_t;
@@ -44,3 +45,59 @@ void isort(data_t* begin, data_t* end) {
   }
 }
 
+// Return the first position in the sorted run [base, base + n) whose value
+// is greater than val (n >= 1).  The loop runs a fixed log2(n) times and the
+// select compiles to a conditional move, so there is no data-dependent
+// branch to mispredict.
+static inline data_t* upper_bound(data_t* base, size_t n, data_t val) {
+  while (n > 1) {
+    const size_t half = n / 2;
+    base = (base[half] <= val) ? base + half : base;
+    n -= half;
+  }
+  return base + (*base <= val);
+}
+
+// Binary insertion sort, sorting the array between begin and end, inclusive.
+// Each element finds its slot in the sorted prefix by binary search, and the
+// larger elements move up one place with a single memmove, which libc
+// performs with wide vector loads and stores.
+void isort_binary(data_t* begin, data_t* end) {
+  for (data_t* cur = begin + 1; cur <= end; cur++) {
+    const data_t val = *cur;
+    if (*(cur - 1) <= val) {
+      continue;  // already in place; common on partially sorted input
+    }
+    data_t* pos = upper_bound(begin, cur - begin, val);
+    memmove(pos + 1, pos, (cur - pos) * sizeof(data_t));
+    *pos = val;
+  }
+}
+
+// Sentinel insertion sort, sorting the array between begin and end,
+// inclusive.  Moving the minimum to *begin first guarantees that the inner
+// loop stops at begin at the latest, so it needs no `index >= begin` check.
+void isort_sentinel(data_t* begin, data_t* end) {
+  if (end <= begin) {
+    return;
+  }
+  data_t* min = begin;
+  for (data_t* cur = begin + 1; cur <= end; cur++) {
+    if (*cur < *min) {
+      min = cur;
+    }
+  }
+  const data_t tmp = *begin;
+  *begin = *min;
+  *min = tmp;
+
+  for (data_t* cur = begin + 2; cur <= end; cur++) {
+    const data_t val = *cur;
+    data_t* index = cur - 1;
+    while (*index > val) {
+      *(index + 1) = *index;
+      index--;
+    }
+    *(index + 1) = val;
+  }
+}
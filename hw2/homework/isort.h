@@ -5,6 +5,11 @@
 #ifndef ISORT_H
 #define ISORT_H
 
+// Insertion sorts of the range [begin, end], inclusive.  isort shifts one
+// element at a time, isort_binary binary-searches the insertion point and
+// shifts with memmove, and isort_sentinel drops the lower bounds check.
 void isort(data_t* begin, data_t* end);
+void isort_binary(data_t* begin, data_t* end);
+void isort_sentinel(data_t* begin, data_t* end);
 
 #endif  // ISORT_H
@@ -24,8 +24,13 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
-#include "./fasttime.h"
+#include "bench.h"
+#include "fasttime.h"
+#include "./isort.h"
+#include "./setops.h"
+#include "./strsort.h"
 #include "./tests.h"
 
 // Extern variables
@@ -51,9 +56,232 @@ extern void sort_p(data_t*, int, int);
 extern void sort_c(data_t*, int, int);
 extern void sort_m(data_t*, int, int);
 extern void sort_f(data_t*, int, int);
+extern void sort_l(data_t*, int, int);
+extern void sort_r(data_t*, int, int);
+extern void sort_d(data_t*, int, int);
+
+// Benchmark kernel: sort state->param random elements with the sort function
+// passed at registration.  Regenerating the input is not timed.
+static void bench_sort(bench_state_t* state) {
+  const struct testFunc_t* f = state->arg;
+  const int n = state->param;
+
+  bench_pause(state);
+  data_t* data = (data_t*) malloc(n * sizeof(data_t));
+  if (data == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bench_pause(state);
+    all_random(data, n);
+    bench_resume(state);
+    f->func(data, 0, n - 1);
+  }
+
+  bench_pause(state);
+  free(data);
+  bench_resume(state);
+}
+
+struct isortFunc_t {
+  void (*func)(data_t*, data_t*);
+  char* name;
+};
+
+// Benchmark kernel: insertion sort of a state->param element block, the job
+// the coarsened merge sorts hand to isort.  Every iteration copies one of
+// kPool pre-generated random blocks into place and sorts it; the copy is
+// timed for all variants alike.
+static void bench_isort(bench_state_t* state) {
+  const struct isortFunc_t* f = state->arg;
+  const int n = state->param;
+  const int kPool = 256;
+
+  bench_pause(state);
+  data_t* pool = (data_t*) malloc(kPool * n * sizeof(data_t));
+  data_t* data = (data_t*) malloc(n * sizeof(data_t));
+  if (pool == NULL || data == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+  all_random(pool, kPool * n);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    memcpy(data, pool + (i % kPool) * n, n * sizeof(data_t));
+    f->func(data, data + n - 1);
+  }
+
+  bench_pause(state);
+  free(pool);
+  free(data);
+  bench_resume(state);
+}
+
+struct setFunc_t {
+  int (*func)(const data_t*, int, const data_t*, int, data_t*);
+  char* name;
+  int skew;  // b has skew times as many elements as a
+};
+
+// Fill a with n random elements in increasing order, gap apart on average.
+static void random_set(data_t* a, int n, int gap) {
+  data_t v = 0;
+  for (int i = 0; i < n; i++) {
+    v += 1 + rand() % (2 * gap);
+    a[i] = v;
+  }
+}
+
+// Benchmark kernel: a set operation on a set of state->param / skew
+// elements and one of state->param elements.  Both sets span about the
+// same range, so roughly two in five of a's elements are also in b.
+static void bench_setop(bench_state_t* state) {
+  const struct setFunc_t* f = state->arg;
+  const int nb = state->param;
+  const int na = nb / f->skew;
+
+  bench_pause(state);
+  data_t* a = (data_t*) malloc(na * sizeof(data_t));
+  data_t* b = (data_t*) malloc(nb * sizeof(data_t));
+  data_t* out = (data_t*) malloc((na + nb) * sizeof(data_t));
+  if (a == NULL || b == NULL || out == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+  random_set(a, na, 2 * f->skew);
+  random_set(b, nb, 2);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    f->func(a, na, b, nb, out);
+  }
+
+  bench_pause(state);
+  free(a);
+  free(b);
+  free(out);
+  bench_resume(state);
+}
+
+struct strsortFunc_t {
+  void (*func)(const char**, int);
+  char* name;
+};
+
+// Benchmark kernel: sort state->param log-style keys, a date, a host and a
+// path, which share long prefixes.
+static void bench_strsort(bench_state_t* state) {
+  const struct strsortFunc_t* f = state->arg;
+  const int n = state->param;
+  const int kMaxLen = 48;
+
+  bench_pause(state);
+  char* pool = (char*) malloc((size_t) n * kMaxLen);
+  const char** keys = (const char**) malloc(n * sizeof(char*));
+  const char** s = (const char**) malloc(n * sizeof(char*));
+  if (pool == NULL || keys == NULL || s == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+  for (int i = 0; i < n; i++) {
+    keys[i] = pool + (size_t) i * kMaxLen;
+    snprintf(pool + (size_t) i * kMaxLen, kMaxLen,
+             "2014-09-%02d host%03d /srv/app/%05d",
+             1 + rand() % 28, rand() % 200, rand() % 100000);
+  }
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bench_pause(state);
+    memcpy(s, keys, n * sizeof(char*));
+    bench_resume(state);
+    f->func(s, n);
+  }
+
+  bench_pause(state);
+  free(pool);
+  free(keys);
+  free(s);
+  bench_resume(state);
+}
+
+static void run_benchmarks(void) {
+  static struct isortFunc_t isortFunc[] = {
+    {&isort, "isort"},
+    {&isort_binary, "isort_binary"},
+    {&isort_sentinel, "isort_sentinel"},
+  };
+  const int kNumOfIsort = sizeof(isortFunc) / sizeof(isortFunc[0]);
+  static struct testFunc_t benchFunc[] = {
+    {&sort_a, "sort_a"},
+    {&sort_i, "sort_i"},
+    {&sort_p, "sort_p"},
+    {&sort_c, "sort_c"},
+    {&sort_m, "sort_m"},
+    {&sort_f, "sort_f"},
+    {&sort_l, "sort_l"},
+    {&sort_r, "sort_r"},
+    {&sort_d, "sort_d"},
+  };
+  const int kNumOfFunc = sizeof(benchFunc) / sizeof(benchFunc[0]);
+  // From L2-sized (256KB) to DRAM-sized (64MB) inputs: the tuned bottom-up
+  // merge sort against the cache-oblivious one, and radix sort against the
+  // distribution sort.
+  static struct testFunc_t scaleFunc[] = {
+    {&sort_f, "sort_f_large"},
+    {&sort_l, "sort_l_large"},
+    {&sort_r, "sort_r_large"},
+    {&sort_d, "sort_d_large"},
+  };
+  const int kNumOfScale = sizeof(scaleFunc) / sizeof(scaleFunc[0]);
+  static struct setFunc_t setFunc[] = {
+    {&set_intersect_scalar, "set_intersect_scalar", 1},
+    {&set_intersect_block, "set_intersect_block", 1},
+    {&set_intersect_scalar, "set_intersect_scalar_skewed", 64},
+    {&set_intersect_gallop, "set_intersect_gallop_skewed", 64},
+    {&set_union, "set_union", 1},
+    {&set_difference, "set_difference", 1},
+    {&set_intersect_parallel, "set_intersect_parallel", 1},
+  };
+  const int kNumOfSet = sizeof(setFunc) / sizeof(setFunc[0]);
+  static struct strsortFunc_t strsortFunc[] = {
+    {&strsort_qsort, "strsort_qsort"},
+    {&strsort_mkqs, "strsort_mkqs"},
+    {&strsort_msd, "strsort_msd"},
+  };
+  const int kNumOfStrsort = sizeof(strsortFunc) / sizeof(strsortFunc[0]);
+  const bench_options_t opts = bench_options_from_env();
+
+  for (int i = 0; i < kNumOfFunc; i++) {
+    bench_register_range(benchFunc[i].name, bench_sort, &benchFunc[i],
+                         1 << 10, 1 << 20, 4);
+  }
+  for (int i = 0; i < kNumOfScale; i++) {
+    bench_register_range(scaleFunc[i].name, bench_sort, &scaleFunc[i],
+                         1 << 16, 1 << 24, 4);
+  }
+  for (int i = 0; i < kNumOfSet; i++) {
+    bench_register_range(setFunc[i].name, bench_setop, &setFunc[i],
+                         1 << 12, 1 << 22, 4);
+  }
+  for (int i = 0; i < kNumOfStrsort; i++) {
+    bench_register_range(strsortFunc[i].name, bench_strsort, &strsortFunc[i],
+                         1 << 10, 1 << 20, 4);
+  }
+  // Block sizes around THRESHOLD (64) in sort_c, sort_m and sort_f.
+  for (int i = 0; i < kNumOfIsort; i++) {
+    bench_register_range(isortFunc[i].name, bench_isort, &isortFunc[i],
+                         8, 128, 2);
+  }
+  bench_run_all(&opts);
+}
 
 int main(int argc, char** argv) {
-  int N, R, optchar, printFlag = 0;
+  int N, R, optchar, printFlag = 0, benchFlag = 0;
   unsigned int seed = 0;
 
   // an array of struct testFunc_t indicating the sort functions to test
@@ -67,11 +295,14 @@ int main(int argc, char** argv) {
     {&sort_c, "sort_c\t\t"},
     {&sort_m, "sort_m\t\t"},
     {&sort_f, "sort_f\t\t"},
+    {&sort_l, "sort_l\t\t"},
+    {&sort_r, "sort_r\t\t"},
+    {&sort_d, "sort_d\t\t"},
   };
   const int kNumOfFunc = sizeof(testFunc) / sizeof(testFunc[0]);
 
   // process command line options
-  while ((optchar = getopt(argc, argv, "s:p")) != -1) {
+  while ((optchar = getopt(argc, argv, "s:pb")) != -1) {
     switch (optchar) {
     case 's':
       seed = (unsigned int) atoi(optarg);
@@ -81,12 +312,20 @@ int main(int argc, char** argv) {
     case 'p':
       printFlag = 1;
       break;
+    case 'b':
+      benchFlag = 1;
+      break;
     default:
       printf("Ignoring unrecognized option: %c\n", optchar);
       continue;
     }
   }
 
+  if (benchFlag) {
+    run_benchmarks();
+    return 0;
+  }
+
   // shift remaining arguments over
   int remaining_args = argc - optind;
   for (int i = 1; i <= remaining_args; ++i) {
@@ -96,7 +335,9 @@ int main(int argc, char** argv) {
   // check to make sure number of arguments is correct
   if (remaining_args != 2) {
     printf("Usage: %s [-p] <num_elements> <num_repeats>\n", argv[0]);
+    printf("       %s -b\n", argv[0]);
     printf("-p : print before/after arrays\n");
+    printf("-b : benchmark every sort over 2^10..2^20 elements\n");
     exit(-1);
   }
 
@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "./util.h"
+#include "./setops.h"
+
+#ifdef __cilk
+#include <cilk/cilk.h>
+#else
+#define cilk_for for
+#endif
+
+// Block width of the vectorized scans: one register of 32-bit lanes.
+#ifdef __AVX2__
+#define SET_LANES 8
+#else
+#define SET_LANES 4
+#endif
+// Use galloping once one input is this many times larger than the other.
+#define GALLOP_RATIO 32
+// Elements of a and b per piece of a parallel operation.
+#define SETOPS_GRAIN (1 << 16)
+
+typedef data_t set_lanes __attribute__((vector_size(SET_LANES * sizeof(data_t))));
+typedef int32_t set_mask __attribute__((vector_size(SET_LANES * sizeof(int32_t))));
+
+typedef int (*set_op_t)(const data_t*, int, const data_t*, int, data_t*);
+
+int set_intersect_scalar(const data_t* a, int na, const data_t* b, int nb,
+                         data_t* out) {
+  int i = 0, j = 0, c = 0;
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      out[c++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return c;
+}
+
+// Scan a against b block by block, keeping the elements of a that were
+// found in b (intersection) or were not (difference).  mask accumulates,
+// for the current block of a, which lanes matched any block of b so far.
+// A block is done once the block of b reaches as far, and neither input
+// has a match for it after that.
+static int block_scan(const data_t* a, int na, const data_t* b, int nb,
+                      data_t* out, int keep_matched) {
+  int i = 0, j = 0, c = 0;
+  set_mask mask = {0};
+
+  while (i + SET_LANES <= na && j + SET_LANES <= nb) {
+    set_lanes va;
+    memcpy(&va, a + i, sizeof(va));
+    for (int k = 0; k < SET_LANES; k++) {
+      mask |= (set_mask)(va == b[j + k]);
+    }
+    const data_t amax = a[i + SET_LANES - 1];
+    const data_t bmax = b[j + SET_LANES - 1];
+    if (amax <= bmax) {
+      // Branch-free compaction: every lane is stored, only kept ones
+      // advance c.
+      for (int k = 0; k < SET_LANES; k++) {
+        out[c] = va[k];
+        c += (mask[k] != 0) == keep_matched;
+      }
+      mask = (set_mask){0};
+      i += SET_LANES;
+    }
+    if (bmax <= amax) {
+      j += SET_LANES;
+    }
+  }
+
+  // Fewer than SET_LANES left in one input.  The lanes of a still in
+  // mask's block keep what they matched so far.
+  const int block_end = (i + SET_LANES <= na) ? i + SET_LANES : i;
+  for (int t = i; t < na; t++) {
+    const data_t x = a[t];
+    while (j < nb && b[j] < x) {
+      j++;
+    }
+    int matched = (j < nb && b[j] == x);
+    if (t < block_end) {
+      matched |= mask[t - i] != 0;
+    }
+    out[c] = x;
+    c += matched == keep_matched;
+  }
+  return c;
+}
+
+int set_intersect_block(const data_t* a, int na, const data_t* b, int nb,
+                        data_t* out) {
+  return block_scan(a, na, b, nb, out, 1);
+}
+
+int set_difference(const data_t* a, int na, const data_t* b, int nb,
+                   data_t* out) {
+  return block_scan(a, na, b, nb, out, 0);
+}
+
+// First index in [lo, hi) whose element is not below x, or hi.  The
+// loop runs a fixed number of times and the select is branch-free.
+static inline int lower_bound(const data_t* b, int lo, int hi, data_t x) {
+  int n = hi - lo;
+  const data_t* base = b + lo;
+  while (n > 1) {
+    const int half = n / 2;
+    base = (base[half - 1] < x) ? base + half : base;
+    n -= half;
+  }
+  return (base - b) + (n == 1 && *base < x);
+}
+
+int set_intersect_gallop(const data_t* a, int na, const data_t* b, int nb,
+                         data_t* out) {
+  int lo = 0, c = 0;
+  for (int i = 0; i < na && lo < nb; i++) {
+    const data_t x = a[i];
+    // Double the step until b[hi] >= x; x then lies in [lo, hi].
+    int step = 1;
+    int hi = lo;
+    while (hi < nb && b[hi] < x) {
+      lo = hi + 1;
+      hi += step;
+      step *= 2;
+    }
+    hi = (hi < nb) ? hi + 1 : nb;
+    lo = lower_bound(b, lo, hi, x);
+    out[c] = x;
+    c += (lo < nb && b[lo] == x);
+  }
+  return c;
+}
+
+int set_intersect(const data_t* a, int na, const data_t* b, int nb,
+                  data_t* out) {
+  if ((long)na * GALLOP_RATIO <= nb) {
+    return set_intersect_gallop(a, na, b, nb, out);
+  }
+  if ((long)nb * GALLOP_RATIO <= na) {
+    // Galloping emits elements of its first input, which are the same
+    // values, in the same order.
+    return set_intersect_gallop(b, nb, a, na, out);
+  }
+  return set_intersect_block(a, na, b, nb, out);
+}
+
+int set_union(const data_t* a, int na, const data_t* b, int nb, data_t* out) {
+  int i = 0, j = 0, c = 0;
+  // Branch-free merge: the smaller head is stored, and each input whose
+  // head equals it advances, so a value in both is stored once.
+  while (i < na && j < nb) {
+    const data_t x = a[i];
+    const data_t y = b[j];
+    out[c++] = (x < y) ? x : y;
+    i += (x <= y);
+    j += (y <= x);
+  }
+  memcpy(out + c, a + i, (na - i) * sizeof(data_t));
+  c += na - i;
+  memcpy(out + c, b + j, (nb - j) * sizeof(data_t));
+  return c + nb - j;
+}
+
+int set_unique(data_t* a, int n) {
+  if (n == 0) {
+    return 0;
+  }
+  int c = 1;
+  int i = 1;
+  // Writes land at or before the element being kept, and a[i - 1] is only
+  // ever overwritten with itself, so each block can still load its
+  // predecessors from a.
+  for (; i + SET_LANES <= n; i += SET_LANES) {
+    set_lanes cur, prev;
+    memcpy(&cur, a + i, sizeof(cur));
+    memcpy(&prev, a + i - 1, sizeof(prev));
+    const set_mask fresh = (set_mask)(cur != prev);
+    for (int k = 0; k < SET_LANES; k++) {
+      a[c] = cur[k];
+      c += fresh[k] != 0;
+    }
+  }
+  for (; i < n; i++) {
+    const data_t x = a[i];
+    const int fresh = x != a[i - 1];
+    a[c] = x;
+    c += fresh;
+  }
+  return c;
+}
+
+int set_merge_path(const data_t* a, int na, const data_t* b, int nb,
+                   int diag) {
+  int lo = (diag > nb) ? diag - nb : 0;
+  int hi = (diag < na) ? diag : na;
+  // Smallest i with a[i] > b[diag - i - 1]: the first i elements of a and
+  // diag - i of b are the smallest diag, with a first on ties.
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    if (a[mid] <= b[diag - mid - 1]) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Run op on pieces of a and b cut along the merge path, then pack the
+// pieces' results together.  Piece p writes at out + ia[p] when its
+// result is no longer than its part of a, and at out + ia[p] + ib[p]
+// otherwise, so pieces never overlap.
+static int parallel_op(const data_t* a, int na, const data_t* b, int nb,
+                       data_t* out, set_op_t op, int bounded_by_a) {
+  const long total = (long)na + nb;
+  const int pieces = (total + SETOPS_GRAIN - 1) / SETOPS_GRAIN;
+  if (pieces <= 1) {
+    return op(a, na, b, nb, out);
+  }
+
+  int* ia = (int*)malloc((pieces + 1) * sizeof(int));
+  int* ib = (int*)malloc((pieces + 1) * sizeof(int));
+  int* count = (int*)malloc(pieces * sizeof(int));
+  if (ia == NULL || ib == NULL || count == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  ia[0] = ib[0] = 0;
+  ia[pieces] = na;
+  ib[pieces] = nb;
+  for (int p = 1; p < pieces; p++) {
+    const int diag = total * p / pieces;
+    int i = set_merge_path(a, na, b, nb, diag);
+    int j = diag - i;
+    // An element of a and its equal in b must land in the same piece.
+    // Ties put a's copy first, so only b's copy can be left behind.
+    if (i > 0 && j < nb && a[i - 1] == b[j]) {
+      j++;
+    }
+    ia[p] = i;
+    ib[p] = j;
+  }
+
+  cilk_for (int p = 0; p < pieces; p++) {
+    const int offset = bounded_by_a ? ia[p] : ia[p] + ib[p];
+    count[p] = op(a + ia[p], ia[p + 1] - ia[p], b + ib[p], ib[p + 1] - ib[p],
+                  out + offset);
+  }
+
+  int c = count[0];
+  for (int p = 1; p < pieces; p++) {
+    const int offset = bounded_by_a ? ia[p] : ia[p] + ib[p];
+    memmove(out + c, out + offset, count[p] * sizeof(data_t));
+    c += count[p];
+  }
+
+  free(ia);
+  free(ib);
+  free(count);
+  return c;
+}
+
+int set_intersect_parallel(const data_t* a, int na, const data_t* b, int nb,
+                           data_t* out) {
+  return parallel_op(a, na, b, nb, out, set_intersect, 1);
+}
+
+int set_union_parallel(const data_t* a, int na, const data_t* b, int nb,
+                       data_t* out) {
+  return parallel_op(a, na, b, nb, out, set_union, 0);
+}
+
+int set_difference_parallel(const data_t* a, int na, const data_t* b, int nb,
+                            data_t* out) {
+  return parallel_op(a, na, b, nb, out, set_difference, 1);
+}
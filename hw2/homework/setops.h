@@ -0,0 +1,58 @@
+// Copyright (c) 2012 MIT License by 6.172 Staff
+
+#include "./util.h"
+
+#ifndef SETOPS_H
+#define SETOPS_H
+
+// Set operations on sorted data_t arrays.  Inputs are sets: strictly
+// increasing, as the sorts' output becomes after set_unique.  Every
+// function writes its result, also strictly increasing, to out and returns
+// its length.  out holds na elements for intersections and differences and
+// na + nb for unions, and must not overlap the inputs.
+
+// Intersection of a and b.  Gallops through the larger input when the
+// sizes are skewed, and compares blocks of lanes otherwise.
+int set_intersect(const data_t* a, int na, const data_t* b, int nb,
+                  data_t* out);
+
+// The branchy two-pointer merge that set_intersect replaces.
+int set_intersect_scalar(const data_t* a, int na, const data_t* b, int nb,
+                         data_t* out);
+
+// Compares each block of a against each overlapping block of b, all lanes
+// against all lanes.
+int set_intersect_block(const data_t* a, int na, const data_t* b, int nb,
+                        data_t* out);
+
+// Looks up each element of a in b with an exponential then a binary
+// search, starting where the previous lookup ended.  Best when na << nb.
+int set_intersect_gallop(const data_t* a, int na, const data_t* b, int nb,
+                         data_t* out);
+
+// Elements of a or b.
+int set_union(const data_t* a, int na, const data_t* b, int nb, data_t* out);
+
+// Elements of a that are not in b.
+int set_difference(const data_t* a, int na, const data_t* b, int nb,
+                   data_t* out);
+
+// Drop repeated elements of the sorted array a in place.  Returns the
+// number of distinct elements, which now make up a[0..return).
+int set_unique(data_t* a, int n);
+
+// Merge-path split: how many elements of a come first among the first
+// diag elements of the merge of a and b (elements of a first on ties).
+int set_merge_path(const data_t* a, int na, const data_t* b, int nb,
+                   int diag);
+
+// The same operations, split along the merge path into pieces of about
+// SETOPS_GRAIN elements that run in parallel when built with PARALLEL=1.
+int set_intersect_parallel(const data_t* a, int na, const data_t* b, int nb,
+                           data_t* out);
+int set_union_parallel(const data_t* a, int na, const data_t* b, int nb,
+                       data_t* out);
+int set_difference_parallel(const data_t* a, int na, const data_t* b, int nb,
+                            data_t* out);
+
+#endif  // SETOPS_H
@@ -11,5 +11,8 @@ void sort_p(data_t* left, int p, int r);
 void sort_c(data_t* left, int p, int r);
 void sort_m(data_t* left, int p, int r);
 void sort_f(data_t* left, int p, int r);
+void sort_l(data_t* left, int p, int r);
+void sort_r(data_t* left, int p, int r);
+void sort_d(data_t* left, int p, int r);
 
 #endif  // SORT_H
@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+// Distribution ("learned") sort for keys drawn from a smooth distribution.
+//
+// A sorted sample of the keys gives an empirical CDF, which is turned into
+// a monotone piecewise-linear model.  One pass scatters every key into the
+// coarse bucket the model predicts for it.  Each bucket covers 1/1024 of
+// the distribution, so it is small enough to stay in cache and nearly flat
+// inside.  A counting sort then places every key of the bucket into one of
+// `size` slots, interpolating linearly between the bucket's smallest and
+// largest key.  Buckets and slots both come out in key order, so an
+// insertion sort of each bucket, run while it is still in cache, only has
+// to order keys that share a slot.
+//
+// When the model fits poorly, a bucket fills up before the scatter is done.
+// That happens with heavy duplicates, or with a distribution the sample
+// missed.  The input is still untouched then, so it goes to sort_r instead.
+// A bucket with a crowded slot is radix sorted on its own, so the insertion
+// sort never sees a long unsorted run.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "./util.h"
+#include "./isort.h"
+#include "./sort.h"
+
+#define SAMPLE_RATIO 64
+#define MIN_SAMPLE (1 << 15)
+#define MODEL_SEGMENTS 1024
+#define SAMPLES_PER_SEGMENT 32
+#define COARSE_BUCKETS 1024
+// Below this size sampling and per-bucket overhead outweigh the passes
+// saved over sort_r.
+#define MIN_MODEL_SIZE (1 << 20)
+// Coarse buckets have room for twice the expected number of keys plus
+// SLACK_MIN.  A model fit to s sampled keys per bucket is off by about
+// 1/sqrt(s) of a bucket's size, so with at least MIN_SAMPLE / COARSE_BUCKETS
+// samples per bucket a smooth distribution stays far from overflowing.
+#define SLACK_MIN 64
+// A bucket with a slot holding more keys than this is radix sorted rather
+// than insertion sorted.
+#define MAX_SLOT 32
+
+// The model predicts COARSE_BUCKETS * CDF(x) as a 32.32 fixed-point
+// number, whose integer part is the coarse bucket of x.  On segment
+// i = (x - lo) >> shift,
+//
+//   prediction = base[i] + ((x - lo - i * 2^shift) * slope[i]) >> 16,
+//
+// where slope[i] is the rise to the next knot over 2^shift, with 16 more
+// fraction bits.  Segments are a power of two wide so that finding one is
+// a shift.  Rounding the slope down keeps the prediction at the next knot
+// at or below base[i + 1], so the model is monotone and no key lands in a
+// bucket before a smaller key.
+typedef struct {
+  data_t lo;
+  data_t max_offset;  // (x - lo) is clamped to this
+  int shift;
+  uint64_t base[MODEL_SEGMENTS];
+  uint64_t slope[MODEL_SEGMENTS];
+} cdf_model;
+
+#define FIXED_END ((uint64_t)COARSE_BUCKETS << 32)
+
+// Function prototypes
+static void* alloc_or_die(size_t size);
+static int build_model(const data_t* A, int n, cdf_model* model);
+static void prefix_sum(int* count, int buckets);
+
+static inline uint64_t predict(const cdf_model* model, data_t x) {
+  data_t d = x < model->lo ? 0 : x - model->lo;
+  d = d < model->max_offset ? d : model->max_offset;
+  const data_t i = d >> model->shift;
+  const uint64_t offset = d - (i << model->shift);
+  const uint64_t y = model->base[i] + ((offset * model->slope[i]) >> 16);
+  return y < FIXED_END ? y : FIXED_END - 1;
+}
+
+static inline int coarse_bucket(uint64_t y) {
+  return y >> 32;
+}
+
+void sort_d(data_t* A, int p, int r) {
+  assert(A);
+  const int n = r - p + 1;
+  if (n < MIN_MODEL_SIZE) {
+    sort_r(A, p, r);
+    return;
+  }
+  A += p;
+
+  cdf_model* model = alloc_or_die(sizeof(cdf_model));
+  if (!build_model(A, n, model)) {
+    free(model);
+    sort_r(A, 0, n - 1);
+    return;
+  }
+
+  // A: scatter into fixed-capacity coarse buckets in one pass.  A bucket
+  // overflowing means the model fits poorly; A is still intact then, so
+  // radix sort it instead.
+  const int expected = n / COARSE_BUCKETS;
+  const int capacity = 2 * expected + SLACK_MIN;
+  data_t* temp = alloc_or_die((size_t)capacity * COARSE_BUCKETS *
+                              sizeof(data_t));
+  int* count = alloc_or_die(COARSE_BUCKETS * sizeof(int));
+  memset(count, 0, COARSE_BUCKETS * sizeof(int));
+  for (int i = 0; i < n; i++) {
+    const data_t x = A[i];
+    const int b = coarse_bucket(predict(model, x));
+    const int c = count[b];
+    if (c == capacity) {
+      free(count);
+      free(temp);
+      free(model);
+      sort_r(A, 0, n - 1);
+      return;
+    }
+    temp[(size_t)b * capacity + c] = x;
+    count[b] = c + 1;
+  }
+
+  // B: every bucket goes back into A through a counting sort on its slots,
+  // then is insertion sorted while it is still in cache.
+  int* fine = alloc_or_die((capacity + 1) * sizeof(int));
+  int* slots = alloc_or_die(capacity * sizeof(int));
+  data_t* dst = A;
+  for (int b = 0; b < COARSE_BUCKETS; b++) {
+    const int size = count[b];
+    const data_t* src = temp + (size_t)b * capacity;
+    if (size == 0) {
+      continue;
+    }
+    // Within one bucket the distribution is close to flat, so slots
+    // interpolate linearly between the bucket's smallest and largest key.
+    data_t min = src[0];
+    data_t max = src[0];
+    for (int i = 1; i < size; i++) {
+      min = src[i] < min ? src[i] : min;
+      max = src[i] > max ? src[i] : max;
+    }
+    const uint64_t scale = ((uint64_t)size << 32) / ((uint64_t)max - min + 1);
+    memset(fine, 0, (size + 1) * sizeof(int));
+    int crowded = 0;
+    for (int i = 0; i < size; i++) {
+      const int s = ((uint64_t)(src[i] - min) * scale) >> 32;
+      slots[i] = s;
+      crowded |= ++fine[s] > MAX_SLOT;
+    }
+    if (crowded) {
+      memcpy(dst, src, size * sizeof(data_t));
+      sort_r(dst, 0, size - 1);
+    } else {
+      prefix_sum(fine, size + 1);
+      for (int i = 0; i < size; i++) {
+        dst[fine[slots[i]]++] = src[i];
+      }
+      isort(dst, dst + size - 1);
+    }
+    dst += size;
+  }
+
+  free(slots);
+  free(fine);
+  free(count);
+  free(temp);
+  free(model);
+}
+
+static void* alloc_or_die(size_t size) {
+  void* p = malloc(size);
+  if (!p) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+// Exclusive prefix sum: count[b] becomes the number of elements in the
+// buckets before b.
+static void prefix_sum(int* count, int buckets) {
+  int sum = 0;
+  for (int b = 0; b < buckets; b++) {
+    const int t = count[b];
+    count[b] = sum;
+    sum += t;
+  }
+}
+
+// Fit the model to a strided sample of A[0..n).  Returns 0 when all
+// sampled keys are equal, which leaves nothing to interpolate.
+static int build_model(const data_t* A, int n, cdf_model* model) {
+  int m = n / SAMPLE_RATIO;
+  if (m < MIN_SAMPLE) {
+    m = n / 4 < MIN_SAMPLE ? n / 4 : MIN_SAMPLE;
+  }
+  const int ratio = n / m;
+  data_t* sample = alloc_or_die(m * sizeof(data_t));
+  for (int i = 0; i < m; i++) {
+    // Offset within each stride so a periodic input does not alias.
+    sample[i] = A[i * ratio + (i * 7919) % ratio];
+  }
+  sort_r(sample, 0, m - 1);
+
+  const data_t lo = sample[0];
+  const data_t span = sample[m - 1] - lo;
+  if (span == 0) {
+    free(sample);
+    return 0;
+  }
+  // An empty segment would have zero slope and pile its keys into one
+  // slot, so every segment gets SAMPLES_PER_SEGMENT keys on average.
+  int segments = m / SAMPLES_PER_SEGMENT;
+  segments = segments < MODEL_SEGMENTS ? segments : MODEL_SEGMENTS;
+  int shift = 0;
+  while ((span >> shift) >= (data_t)segments) {
+    shift++;
+  }
+  model->lo = lo;
+  model->shift = shift;
+  model->max_offset = ((uint64_t)segments << shift) - 1;
+
+  // knot j = lo + j * 2^shift, and the prediction there is the fraction of
+  // the sample below the knot.  Knots past the sampled range see the whole
+  // sample.
+  int below = 0;
+  uint64_t prev = 0;
+  for (int j = 1; j <= segments; j++) {
+    const uint64_t knot = lo + ((uint64_t)j << shift);
+    while (below < m && sample[below] < knot) {
+      below++;
+    }
+    const uint64_t y = (below == m) ? FIXED_END :
+        (uint64_t)((double)below / m * (double)FIXED_END);
+    model->base[j - 1] = prev;
+    model->slope[j - 1] = ((y - prev) << 16) >> shift;
+    prev = y;
+  }
+
+  free(sample);
+  return 1;
+}
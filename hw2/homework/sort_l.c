@@ -0,0 +1,317 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+// Lazy funnelsort (Brodal and Fagerberg), a cache-oblivious merge sort.
+//
+// An n element array is cut into k = n^(1/3) segments, each segment is
+// sorted recursively, and the k sorted runs are merged by a k-funnel: a
+// complete binary tree of two-way mergers whose nodes own output buffers.
+// Splitting the tree at half its height, the buffers between the top tree
+// and the bottom trees hold k^(3/2) elements, and the top and bottom trees
+// are laid out the same way recursively (van Emde Boas order).  A node is
+// refilled only when its parent finds its buffer empty, which is what makes
+// the funnel "lazy".  Whatever the cache size M and line size B, some level
+// of that recursion fits a funnel in cache, so the sort incurs
+// O((n/B) log_{M/B} (n/B)) misses at every level of the hierarchy without
+// knowing M or B.
+//
+// BASE_CASE and BUFFER_FACTOR only amortize call overhead (a funnel with
+// 3-element buffers at the bottom spends its time in fill_node calls).  Both
+// are constants, so an insertion sort of BASE_CASE elements touches O(1)
+// lines and buffers stay Theta(k^(3/2)); the miss bound holds for any cache,
+// unlike THRESHOLD in sort_c, sort_m and sort_f, which is tuned to one.
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "./util.h"
+#include "./isort.h"
+
+#define BASE_CASE 64
+#define BUFFER_FACTOR 16
+
+// A funnel node.  Leaves stand for the sorted input runs: their buffer is
+// the run itself and they have nothing left to produce.  Internal nodes
+// hand out buf[head, tail) and still have `remaining` elements of their
+// subtree to merge into buf once it is drained.
+typedef struct funnel_node {
+  data_t* buf;
+  int head;
+  int tail;
+  int cap;
+  int remaining;
+  struct funnel_node* left;
+  struct funnel_node* right;
+} funnel_node;
+
+// Memory reused by every funnel of one sort.  Merges happen one at a time
+// (a segment is fully sorted before its parent merges it), so a single
+// arena of nodes and buffers sized for the largest funnel is enough.
+typedef struct {
+  funnel_node* nodes;
+  data_t* arena;
+  size_t arena_cap;
+  int* heap_cap;    // buffer size, by heap index
+  int* heap_pos;    // position in nodes[], by heap index
+  int* heap_count;  // elements in the subtree, by heap index
+  size_t* heap_off;  // buffer offset in the arena, by heap index
+  int heap_size;
+} funnel_ctx;
+
+// Function prototypes
+static void funnelsort(data_t* A, data_t* temp, int n, funnel_ctx* ctx);
+static void fill_node(funnel_node* v);
+
+static inline void* checked_realloc(void* ptr, size_t size) {
+  void* p = realloc(ptr, size);
+  if (p == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+// Lazy funnelsort of A[p..r].
+void sort_l(data_t* A, int p, int r) {
+  assert(A);
+  const int n = r - p + 1;
+  if (n <= BASE_CASE) {
+    if (n > 1) {
+      isort(A + p, A + r);
+    }
+    return;
+  }
+
+  data_t* temp = (data_t*)malloc(n * sizeof(data_t));
+  if (!temp) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  funnel_ctx ctx = {0};
+  funnelsort(A + p, temp, n, &ctx);
+
+  free(temp);
+  free(ctx.nodes);
+  free(ctx.arena);
+  free(ctx.heap_cap);
+  free(ctx.heap_pos);
+  free(ctx.heap_count);
+  free(ctx.heap_off);
+}
+
+// Assign positions in nodes[] and arena offsets to the mergers of the
+// subtree rooted at heap index `root`, which has `height` levels of mergers
+// under a funnel of 2^height inputs.  The subtree is split into a top tree of
+// ceil(height / 2) levels and bottom trees below it; the bottom roots get
+// BUFFER_FACTOR * (2^height)^(3/2) element buffers, capped by what their
+// subtree holds.
+// Every merger but the funnel root is a bottom root at some level, so its
+// buffer size is known by the time it is placed.
+static void layout_funnel(funnel_ctx* ctx, int root, int height, int* next,
+                          size_t* offset) {
+  if (height == 1) {
+    ctx->heap_pos[root] = (*next)++;
+    if (root != 1) {
+      ctx->heap_off[root] = *offset;
+      *offset += ctx->heap_cap[root];
+    }
+    return;
+  }
+  const int top = (height + 1) / 2;
+  const int bottom = height - top;
+  const double k = ldexp(1.0, height);
+  const int size = (int)ceil(BUFFER_FACTOR * k * sqrt(k));
+
+  layout_funnel(ctx, root, top, next, offset);
+  for (int j = 0; j < (1 << top); j++) {
+    const int b = (root << top) + j;
+    const int count = ctx->heap_count[b];
+    ctx->heap_cap[b] = size < count ? size : count;
+    layout_funnel(ctx, b, bottom, next, offset);
+  }
+}
+
+// Length of run j when n elements are cut into runs of seg elements.
+static inline int run_length(int n, int seg, int runs, int j) {
+  if (j >= runs) {
+    return 0;
+  }
+  const int begin = j * seg;
+  return (begin + seg <= n) ? seg : n - begin;
+}
+
+// Merge the `runs` sorted runs of A, each `seg` elements long except the
+// last, into out[0..n).
+static void funnel_merge(data_t* A, int n, int seg, int runs, data_t* out,
+                         funnel_ctx* ctx) {
+  int height = 0;
+  while ((1 << height) < runs) {
+    height++;
+  }
+  const int leaves = 1 << height;
+  const int heap_size = 2 * leaves;
+
+  if (heap_size > ctx->heap_size) {
+    ctx->heap_cap = checked_realloc(ctx->heap_cap, heap_size * sizeof(int));
+    ctx->heap_pos = checked_realloc(ctx->heap_pos, heap_size * sizeof(int));
+    ctx->heap_count = checked_realloc(ctx->heap_count,
+                                      heap_size * sizeof(int));
+    ctx->heap_off = checked_realloc(ctx->heap_off,
+                                    heap_size * sizeof(size_t));
+    ctx->nodes = checked_realloc(ctx->nodes, heap_size * sizeof(funnel_node));
+    ctx->heap_size = heap_size;
+  }
+
+  // Subtree sizes, bottom up.  Leaves past the last run are empty.
+  for (int j = 0; j < leaves; j++) {
+    ctx->heap_count[leaves + j] = run_length(n, seg, runs, j);
+  }
+  for (int i = leaves - 1; i >= 1; i--) {
+    ctx->heap_count[i] = ctx->heap_count[2 * i] + ctx->heap_count[2 * i + 1];
+  }
+
+  // Mergers take nodes[0, leaves - 1) in van Emde Boas order and their
+  // buffers are carved out of the arena in the same order.  The root writes
+  // straight into out.  The leaves follow the mergers.
+  int next = 0;
+  size_t arena_size = 0;
+  ctx->heap_cap[1] = n;
+  layout_funnel(ctx, 1, height, &next, &arena_size);
+  if (arena_size > ctx->arena_cap) {
+    ctx->arena = checked_realloc(ctx->arena, arena_size * sizeof(data_t));
+    ctx->arena_cap = arena_size;
+  }
+  for (int j = 0; j < leaves; j++) {
+    ctx->heap_pos[leaves + j] = leaves - 1 + j;
+  }
+
+  for (int i = 1; i < leaves; i++) {
+    funnel_node* v = &ctx->nodes[ctx->heap_pos[i]];
+    v->buf = (i == 1) ? out : ctx->arena + ctx->heap_off[i];
+    v->head = 0;
+    v->tail = 0;
+    v->cap = ctx->heap_cap[i];
+    v->remaining = ctx->heap_count[i];
+    v->left = &ctx->nodes[ctx->heap_pos[2 * i]];
+    v->right = &ctx->nodes[ctx->heap_pos[2 * i + 1]];
+  }
+  for (int j = 0; j < leaves; j++) {
+    funnel_node* leaf = &ctx->nodes[leaves - 1 + j];
+    const int len = run_length(n, seg, runs, j);
+    leaf->buf = A + (len > 0 ? j * seg : 0);
+    leaf->head = 0;
+    leaf->tail = len;
+    leaf->cap = len;
+    leaf->remaining = 0;
+    leaf->left = NULL;
+    leaf->right = NULL;
+  }
+
+  funnel_node* root = &ctx->nodes[ctx->heap_pos[1]];
+  fill_node(root);
+  assert(root->tail == n);
+}
+
+// Refill v's buffer from its children, refilling a child first whenever
+// its buffer runs dry.  Produces min(cap, remaining) elements.
+static void fill_node(funnel_node* v) {
+  funnel_node* a = v->left;
+  funnel_node* b = v->right;
+  data_t* out = v->buf;
+  const int m = v->cap < v->remaining ? v->cap : v->remaining;
+  int i = 0;
+
+  while (i < m) {
+    if (a->head == a->tail) {
+      if (a->remaining == 0) {
+        break;
+      }
+      fill_node(a);
+    }
+    if (b->head == b->tail) {
+      if (b->remaining == 0) {
+        break;
+      }
+      fill_node(b);
+    }
+
+    // Neither input can run dry within `steps` merge steps, so the loop
+    // needs no bounds checks and the select compiles branch-free.
+    int steps = m - i;
+    if (a->tail - a->head < steps) steps = a->tail - a->head;
+    if (b->tail - b->head < steps) steps = b->tail - b->head;
+    const data_t* pa = a->buf + a->head;
+    const data_t* pb = b->buf + b->head;
+    data_t* po = out + i;
+    for (int s = 0; s < steps; s++) {
+      const data_t x = *pa;
+      const data_t y = *pb;
+      const int take_b = y < x;
+      *po++ = take_b ? y : x;
+      pa += !take_b;
+      pb += take_b;
+    }
+    a->head = pa - a->buf;
+    b->head = pb - b->buf;
+    i += steps;
+  }
+
+  // One side is exhausted: copy the rest of the other.
+  funnel_node* c = (a->head == a->tail && a->remaining == 0) ? b : a;
+  while (i < m) {
+    if (c->head == c->tail) {
+      fill_node(c);
+    }
+    int len = c->tail - c->head;
+    if (len > m - i) len = m - i;
+    memcpy(out + i, c->buf + c->head, len * sizeof(data_t));
+    c->head += len;
+    i += len;
+  }
+
+  v->head = 0;
+  v->tail = m;
+  v->remaining -= m;
+}
+
+// Sort A[0..n) using temp[0..n) as the merge destination.
+static void funnelsort(data_t* A, data_t* temp, int n, funnel_ctx* ctx) {
+  if (n <= BASE_CASE) {
+    if (n > 1) {
+      isort(A, A + n - 1);
+    }
+    return;
+  }
+
+  int runs = (int)ceil(cbrt((double)n));
+  const int seg = (n + runs - 1) / runs;
+  runs = (n + seg - 1) / seg;
+  for (int j = 0; j < runs; j++) {
+    const int begin = j * seg;
+    funnelsort(A + begin, temp + begin, run_length(n, seg, runs, j), ctx);
+  }
+  funnel_merge(A, n, seg, runs, temp, ctx);
+  memcpy(A, temp, n * sizeof(data_t));
+}
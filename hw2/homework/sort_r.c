@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "./util.h"
+
+// LSD radix sort over three 11-bit digits, enough for 32-bit keys.  The
+// 2048 counters per digit stay in L1, and one read of the input builds the
+// histograms of all three digits.
+#define RADIX_BITS 11
+#define RADIX (1 << RADIX_BITS)
+#define PASSES 3
+
+void sort_r(data_t* A, int p, int r) {
+  assert(A);
+  const int n = r - p + 1;
+  if (n < 2) {
+    return;
+  }
+
+  int count[PASSES][RADIX];
+  memset(count, 0, sizeof(count));
+  for (int i = p; i <= r; i++) {
+    const data_t x = A[i];
+    for (int d = 0; d < PASSES; d++) {
+      count[d][(x >> (d * RADIX_BITS)) & (RADIX - 1)]++;
+    }
+  }
+
+  data_t* temp = (data_t*)malloc(n * sizeof(data_t));
+  if (!temp) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  data_t* src = A + p;
+  data_t* dst = temp;
+  for (int d = 0; d < PASSES; d++) {
+    const int shift = d * RADIX_BITS;
+    int* c = count[d];
+    // Every key has the same digit: the pass would only copy.
+    if (c[(src[0] >> shift) & (RADIX - 1)] == n) {
+      continue;
+    }
+    int sum = 0;
+    for (int b = 0; b < RADIX; b++) {
+      const int t = c[b];
+      c[b] = sum;
+      sum += t;
+    }
+    for (int i = 0; i < n; i++) {
+      const data_t x = src[i];
+      dst[c[(x >> shift) & (RADIX - 1)]++] = x;
+    }
+    data_t* t = src;
+    src = dst;
+    dst = t;
+  }
+
+  if (src != A + p) {
+    memcpy(A + p, src, n * sizeof(data_t));
+  }
+  free(temp);
+}
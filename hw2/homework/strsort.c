@@ -0,0 +1,311 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "./util.h"
+#include "./strsort.h"
+
+#ifdef __cilk
+#include <cilk/cilk.h>
+#else
+#define cilk_spawn
+#define cilk_sync
+#define cilk_for for
+#endif
+
+// Ranges shorter than this go to the LCP insertion sort.
+#define INSERTION_THRESHOLD 32
+// Ranges shorter than this are not split among workers.
+#define STRSORT_GRAIN (1 << 14)
+
+// A string and 8 of its bytes, starting at some depth, packed big-endian
+// so that comparing keys compares those bytes.  Bytes past the string's
+// NUL are 0, so a key whose low byte is 0 holds the end of its string.
+typedef struct {
+  uint64_t key;
+  const unsigned char* str;
+} str_entry;
+
+// The 8 bytes of s from depth, which must not be past s's NUL.
+static inline uint64_t load_key(const unsigned char* s, int depth) {
+  uint64_t key = 0;
+  s += depth;
+  for (int k = 0; k < 8 && s[k] != 0; k++) {
+    key |= (uint64_t)s[k] << (56 - 8 * k);
+  }
+  return key;
+}
+
+static inline void reload_keys(str_entry* e, int n, int depth) {
+  for (int i = 0; i < n; i++) {
+    e[i].key = load_key(e[i].str, depth);
+  }
+}
+
+// Number of string bytes in a key, before its NUL.
+static inline int key_length(uint64_t key) {
+  return (key == 0) ? 0 : 8 - __builtin_ctzll(key) / 8;
+}
+
+// Longest common prefix of a and b, which have keys cached from byte kd
+// and are known to agree on their first h bytes.  *cmp gets the sign of
+// strcmp(a, b).  The string bytes are only read past the keys.
+static inline int entry_lcp(const str_entry* a, const str_entry* b, int kd,
+                            int h, int* cmp) {
+  if (h < kd + 8) {
+    const uint64_t diff = a->key ^ b->key;
+    if (diff != 0) {
+      *cmp = (a->key < b->key) ? -1 : 1;
+      return kd + __builtin_clzll(diff) / 8;
+    }
+    if ((a->key & 0xff) == 0) {
+      *cmp = 0;
+      return kd + key_length(a->key);
+    }
+    h = kd + 8;
+  }
+  const unsigned char* s = a->str;
+  const unsigned char* t = b->str;
+  while (s[h] != 0 && s[h] == t[h]) {
+    h++;
+  }
+  *cmp = (s[h] > t[h]) - (s[h] < t[h]);
+  return h;
+}
+
+// Insertion sort of e[0..n), whose strings share their first h bytes and
+// have keys cached from byte kd.  lcp[j] holds the common prefix of e[j - 1]
+// and e[j] in the sorted part, so walking x left past e[j] only compares
+// strings when that prefix equals x's own with e[j]: a longer one means
+// e[j - 1] is also above x, a shorter one that it is below.
+static void lcp_insertion_sort(str_entry* e, int n, int kd, int h) {
+  int lcp[INSERTION_THRESHOLD];
+  for (int i = 1; i < n; i++) {
+    const str_entry x = e[i];
+    int cmp;
+    // x < e[j] from here on, with common prefix xh.
+    int xh = entry_lcp(&x, &e[i - 1], kd, h, &cmp);
+    if (cmp >= 0) {
+      lcp[i] = xh;
+      continue;
+    }
+    int j = i - 1;
+    int left = 0;  // common prefix of e[j - 1] and x, once j stops
+    while (j > 0) {
+      if (lcp[j] > xh) {
+        j--;
+      } else if (lcp[j] < xh) {
+        left = lcp[j];
+        break;
+      } else {
+        const int l = entry_lcp(&x, &e[j - 1], kd, xh, &cmp);
+        if (cmp >= 0) {
+          left = l;
+          break;
+        }
+        xh = l;
+        j--;
+      }
+    }
+    memmove(e + j + 1, e + j, (i - j) * sizeof(str_entry));
+    memmove(lcp + j + 2, lcp + j + 1, (i - j - 1) * sizeof(int));
+    e[j] = x;
+    lcp[j + 1] = xh;
+    if (j > 0) {
+      lcp[j] = left;
+    }
+  }
+}
+
+static inline uint64_t median3(uint64_t a, uint64_t b, uint64_t c) {
+  if (a < b) {
+    return (b < c) ? b : (a < c) ? c : a;
+  }
+  return (a < c) ? a : (b < c) ? c : b;
+}
+
+// Multikey quicksort of e[0..n), whose strings share their first depth
+// bytes and have keys cached from there.  Elements whose keys equal the
+// pivot's go on with the next 8 bytes, unless those keys end the strings.
+static void mkqs(str_entry* e, int n, int depth) {
+  while (n >= INSERTION_THRESHOLD) {
+    const uint64_t pivot = median3(e[0].key, e[n / 2].key, e[n - 1].key);
+    int lt = 0, i = 0, gt = n;
+    while (i < gt) {
+      const uint64_t key = e[i].key;
+      if (key < pivot) {
+        const str_entry t = e[lt];
+        e[lt++] = e[i];
+        e[i++] = t;
+      } else if (key > pivot) {
+        const str_entry t = e[--gt];
+        e[gt] = e[i];
+        e[i] = t;
+      } else {
+        i++;
+      }
+    }
+
+    if (n >= STRSORT_GRAIN) {
+      cilk_spawn mkqs(e, lt, depth);
+      cilk_spawn mkqs(e + gt, n - gt, depth);
+    } else {
+      mkqs(e, lt, depth);
+      mkqs(e + gt, n - gt, depth);
+    }
+    if ((pivot & 0xff) == 0) {
+      break;
+    }
+    e += lt;
+    n = gt - lt;
+    depth += 8;
+    reload_keys(e, n, depth);
+  }
+  if (n > 1 && n < INSERTION_THRESHOLD) {
+    lcp_insertion_sort(e, n, depth, depth);
+  }
+  cilk_sync;
+}
+
+static void msd_radix(str_entry* e, str_entry* tmp, int n, int depth);
+
+// Continue the radix sort on a bucket whose strings share depth bytes.
+static inline void msd_bucket(str_entry* e, str_entry* tmp, int n,
+                              int depth) {
+  if (n < 2) {
+    return;
+  }
+  if (depth % 8 == 0) {
+    reload_keys(e, n, depth);
+  }
+  msd_radix(e, tmp, n, depth);
+}
+
+// MSD radix sort of e[0..n), whose strings share their first depth bytes
+// and have keys cached from depth rounded down to a multiple of 8.  tmp
+// has room for n elements.
+static void msd_radix(str_entry* e, str_entry* tmp, int n, int depth) {
+  int count[256];
+  int start[257];
+  for (;;) {
+    if (n < INSERTION_THRESHOLD) {
+      lcp_insertion_sort(e, n, depth & ~7, depth);
+      return;
+    }
+    const int shift = 56 - 8 * (depth & 7);
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < n; i++) {
+      count[(e[i].key >> shift) & 0xff]++;
+    }
+    // A shared byte (a common prefix) needs no pass over the pointers.
+    const int c0 = (e[0].key >> shift) & 0xff;
+    if (count[c0] != n) {
+      break;
+    }
+    if (c0 == 0) {
+      return;
+    }
+    depth++;
+    if (depth % 8 == 0) {
+      reload_keys(e, n, depth);
+    }
+  }
+
+  const int shift = 56 - 8 * (depth & 7);
+  start[0] = 0;
+  for (int c = 0; c < 256; c++) {
+    start[c + 1] = start[c] + count[c];
+  }
+  int pos[256];
+  memcpy(pos, start, sizeof(pos));
+  for (int i = 0; i < n; i++) {
+    tmp[pos[(e[i].key >> shift) & 0xff]++] = e[i];
+  }
+  memcpy(e, tmp, n * sizeof(str_entry));
+
+  // Bucket 0 holds strings that end at depth, which are all equal.
+  if (n >= STRSORT_GRAIN) {
+    cilk_for (int c = 1; c < 256; c++) {
+      msd_bucket(e + start[c], tmp + start[c], count[c], depth + 1);
+    }
+  } else {
+    for (int c = 1; c < 256; c++) {
+      msd_bucket(e + start[c], tmp + start[c], count[c], depth + 1);
+    }
+  }
+}
+
+static str_entry* make_entries(const char** s, int n) {
+  str_entry* e = (str_entry*)malloc(n * sizeof(str_entry));
+  if (e == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < n; i++) {
+    e[i].str = (const unsigned char*)s[i];
+    e[i].key = load_key(e[i].str, 0);
+  }
+  return e;
+}
+
+static void store_entries(const char** s, str_entry* e, int n) {
+  for (int i = 0; i < n; i++) {
+    s[i] = (const char*)e[i].str;
+  }
+  free(e);
+}
+
+void strsort_mkqs(const char** s, int n) {
+  if (n < 2) {
+    return;
+  }
+  str_entry* e = make_entries(s, n);
+  mkqs(e, n, 0);
+  store_entries(s, e, n);
+}
+
+void strsort_msd(const char** s, int n) {
+  if (n < 2) {
+    return;
+  }
+  str_entry* e = make_entries(s, n);
+  str_entry* tmp = (str_entry*)malloc(n * sizeof(str_entry));
+  if (tmp == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  msd_radix(e, tmp, n, 0);
+  free(tmp);
+  store_entries(s, e, n);
+}
+
+static int compare_strings(const void* a, const void* b) {
+  return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+void strsort_qsort(const char** s, int n) {
+  qsort(s, n, sizeof(const char*), compare_strings);
+}
@@ -0,0 +1,23 @@
+// Copyright (c) 2012 MIT License by 6.172 Staff
+
+#include "./util.h"
+
+#ifndef STRSORT_H
+#define STRSORT_H
+
+// Sorts of n NUL-terminated byte strings, in the order of strcmp: bytes
+// compare as unsigned char and a prefix comes before its extensions.  The
+// array of pointers is permuted in place; the strings are never moved.
+
+// Multikey quicksort: three-way partitions on the next 8 bytes of every
+// string, which are cached next to its pointer.
+void strsort_mkqs(const char** s, int n);
+
+// MSD radix sort: one counting pass per byte, 256 buckets, again reading
+// the bytes from the cached 8.
+void strsort_msd(const char** s, int n);
+
+// qsort with strcmp, the baseline the two above replace.
+void strsort_qsort(const char** s, int n);
+
+#endif  // STRSORT_H
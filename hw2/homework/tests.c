@@ -28,7 +28,11 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "./fasttime.h"
+#include "fasttime.h"
+#include "./isort.h"
+#include "./setops.h"
+#include "./strsort.h"
+#include "./sort.h"
 #include "./tests.h"
 
 // Call TEST_PASS() from your test cases to mark a test as successful
@@ -320,10 +324,323 @@ void test_subarray(int printFlag, int N, int R,
   return;
 }
 
+// Check the isort variants against isort on every block length up to twice
+// the merge sorts' THRESHOLD, on random, sorted and inverted input.
+static void test_isort_variants(int printFlag, int N, int R,
+                                struct testFunc_t* testFunc, int numFunc) {
+  const int kMaxLen = 128;
+  void (*variants[])(data_t*, data_t*) = {isort_binary, isort_sentinel};
+  const char* names[] = {"isort_binary", "isort_sentinel"};
+  data_t expected[kMaxLen + 2], data[kMaxLen + 2];
+  int success = 1;
+
+  for (int v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+    for (int len = 1; len <= kMaxLen && success; len++) {
+      for (int kind = 0; kind < 3; kind++) {
+        // data[0] and data[len + 1] are guards that must stay untouched.
+        expected[0] = data[0] = 7;
+        expected[len + 1] = data[len + 1] = 0;
+        for (int i = 1; i <= len; i++) {
+          expected[i] = (kind == 0) ? rand_r(&randomSeed) % 64
+                      : (kind == 1) ? i : len - i;
+        }
+        memcpy(data, expected, (len + 2) * sizeof(data_t));
+        isort(expected + 1, expected + len);
+        variants[v](data + 1, data + len);
+        if (memcmp(data, expected, (len + 2) * sizeof(data_t)) != 0) {
+          printf("Error: %s differs from isort on %d elements\n",
+                 names[v], len);
+          success = 0;
+          break;
+        }
+      }
+    }
+  }
+
+  if (success) {
+    TEST_PASS();
+  } else {
+    TEST_FAIL("isort variants disagree with isort");
+  }
+}
+
+// sort_d only fits its model to inputs of 2^20 keys and more, above what
+// the suite usually runs.  Check it against sort_r there, on inputs the
+// model fits (uniform, sorted, inverted, two clusters) and on ones that
+// send it back to sort_r (few distinct keys, all keys equal).
+static void test_distribution_sort(int printFlag, int N, int R,
+                                   struct testFunc_t* testFunc, int numFunc) {
+  const int kLen = (1 << 20) + 12345;
+  const char* kinds[] = {"uniform", "sorted", "inverted", "clustered",
+                         "few distinct", "constant"};
+  const int kNumKinds = sizeof(kinds) / sizeof(kinds[0]);
+  data_t* expected = (data_t*) malloc((kLen + 2) * sizeof(data_t));
+  data_t* data = (data_t*) malloc((kLen + 2) * sizeof(data_t));
+  int success = 1;
+
+  if (expected == NULL || data == NULL) {
+    printf("Error: not enough memory\n");
+    free(expected);
+    free(data);
+    exit(-1);
+  }
+
+  for (int kind = 0; kind < kNumKinds && success; kind++) {
+    // data[0] and data[kLen + 1] are guards that must stay untouched.
+    expected[0] = data[0] = 7;
+    expected[kLen + 1] = data[kLen + 1] = 0;
+    for (int i = 1; i <= kLen; i++) {
+      const data_t x = rand_r(&randomSeed) % RANGE;
+      switch (kind) {
+        case 0: expected[i] = x; break;
+        case 1: expected[i] = i; break;
+        case 2: expected[i] = kLen - i; break;
+        case 3: expected[i] = (x % 2) * (RANGE / 2) + x % 100000; break;
+        case 4: expected[i] = x % 7; break;
+        default: expected[i] = 42; break;
+      }
+    }
+    memcpy(data, expected, (kLen + 2) * sizeof(data_t));
+    sort_r(expected, 1, kLen);
+    sort_d(data, 1, kLen);
+    if (memcmp(data, expected, (kLen + 2) * sizeof(data_t)) != 0) {
+      printf("Error: sort_d differs from sort_r on %s input\n", kinds[kind]);
+      success = 0;
+    }
+  }
+
+  free(expected);
+  free(data);
+  if (success) {
+    TEST_PASS();
+  } else {
+    TEST_FAIL("sort_d disagrees with sort_r");
+  }
+}
+
+// Fill a with n strictly increasing random elements, 1 to gap apart.
+static void random_set(data_t* a, int n, int gap) {
+  data_t v = rand_r(&randomSeed) % 3;
+  for (int i = 0; i < n; i++) {
+    v += 1 + rand_r(&randomSeed) % gap;
+    a[i] = v;
+  }
+}
+
+// Reference set operations: one plain merge of a and b.
+static void merge_sets(const data_t* a, int na, const data_t* b, int nb,
+                       data_t* inter, int* ni, data_t* diff, int* nd,
+                       data_t* uni, int* nu) {
+  int i = 0, j = 0;
+  *ni = *nd = *nu = 0;
+  while (i < na || j < nb) {
+    if (j == nb || (i < na && a[i] < b[j])) {
+      diff[(*nd)++] = a[i];
+      uni[(*nu)++] = a[i++];
+    } else if (i == na || b[j] < a[i]) {
+      uni[(*nu)++] = b[j++];
+    } else {
+      inter[(*ni)++] = a[i];
+      uni[(*nu)++] = a[i];
+      i++;
+      j++;
+    }
+  }
+}
+
+// Check every set operation against merge_sets() on pairs of sizes around
+// the block width and above SETOPS_GRAIN, so that the parallel variants
+// really split, with dense and sparse overlap and with skewed sizes that
+// take the galloping path.  Also check set_unique() and the merge-path
+// split invariants.
+static void test_set_operations(int printFlag, int N, int R,
+                                struct testFunc_t* testFunc, int numFunc) {
+  const int sizes[] = {0, 1, 7, 8, 9, 63, 1000, 70000, 300000};
+  const int kNumSizes = sizeof(sizes) / sizeof(sizes[0]);
+  const int kMax = 300000;
+  int (*ops[])(const data_t*, int, const data_t*, int, data_t*) = {
+    set_intersect, set_intersect_scalar, set_intersect_block,
+    set_intersect_gallop, set_intersect_parallel, set_difference,
+    set_difference_parallel, set_union, set_union_parallel};
+  const char* names[] = {
+    "set_intersect", "set_intersect_scalar", "set_intersect_block",
+    "set_intersect_gallop", "set_intersect_parallel", "set_difference",
+    "set_difference_parallel", "set_union", "set_union_parallel"};
+  const int kNumOps = sizeof(ops) / sizeof(ops[0]);
+  data_t* a = (data_t*) malloc(kMax * sizeof(data_t));
+  data_t* b = (data_t*) malloc(kMax * sizeof(data_t));
+  data_t* inter = (data_t*) malloc(kMax * sizeof(data_t));
+  data_t* diff = (data_t*) malloc(kMax * sizeof(data_t));
+  data_t* uni = (data_t*) malloc(2 * kMax * sizeof(data_t));
+  data_t* out = (data_t*) malloc((2 * kMax + 1) * sizeof(data_t));
+  int success = 1;
+
+  if (a == NULL || b == NULL || inter == NULL || diff == NULL ||
+      uni == NULL || out == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+
+  for (int x = 0; x < kNumSizes && success; x++) {
+    for (int y = 0; y < kNumSizes && success; y++) {
+      for (int gap = 2; gap <= 1000 && success; gap *= 10) {
+        const int na = sizes[x], nb = sizes[y];
+        int ni, nd, nu;
+        random_set(a, na, gap);
+        random_set(b, nb, (x == y) ? gap : 3);
+        merge_sets(a, na, b, nb, inter, &ni, diff, &nd, uni, &nu);
+        for (int k = 0; k < kNumOps; k++) {
+          const data_t* expected = (k < 5) ? inter : (k < 7) ? diff : uni;
+          const int n = (k < 5) ? ni : (k < 7) ? nd : nu;
+          const int cap = (k < 7) ? na : na + nb;
+          // out may be written up to its capacity; out[cap] is a guard.
+          out[cap] = 7;
+          if (ops[k](a, na, b, nb, out) != n ||
+              memcmp(out, expected, n * sizeof(data_t)) != 0 ||
+              out[cap] != 7) {
+            printf("Error: %s wrong on sets of %d and %d elements\n",
+                   names[k], na, nb);
+            success = 0;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  for (int n = 0; n < 2000 && success; n += 37) {
+    data_t v = 0;
+    int nu = 0;
+    for (int i = 0; i < n; i++) {
+      v += (rand_r(&randomSeed) % 3 == 0);
+      a[i] = v;
+      if (i == 0 || a[i] != a[i - 1]) {
+        uni[nu++] = a[i];
+      }
+    }
+    if (set_unique(a, n) != nu ||
+        memcmp(a, uni, nu * sizeof(data_t)) != 0) {
+      printf("Error: set_unique wrong on %d elements\n", n);
+      success = 0;
+    }
+  }
+
+  // Every element left of the split is <= every element right of it, and a
+  // is taken first on ties.
+  random_set(a, 15, 3);
+  random_set(b, 15, 3);
+  for (int diag = 0; diag <= 30 && success; diag++) {
+    const int i = set_merge_path(a, 15, b, 15, diag);
+    const int j = diag - i;
+    if (i < 0 || j < 0 || i > 15 || j > 15 ||
+        (i > 0 && j < 15 && a[i - 1] > b[j]) ||
+        (j > 0 && i < 15 && b[j - 1] >= a[i])) {
+      printf("Error: set_merge_path splits diagonal %d at %d\n", diag, i);
+      success = 0;
+    }
+  }
+
+  free(a);
+  free(b);
+  free(inter);
+  free(diff);
+  free(uni);
+  free(out);
+  if (success) {
+    TEST_PASS();
+  } else {
+    TEST_FAIL("set operations disagree with a plain merge");
+  }
+}
+
+static int compare_strings(const void* a, const void* b) {
+  return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+// Check the string sorts against qsort with strcmp, on sizes around the
+// insertion sort cutoff and above the parallel grain, on random bytes
+// (including ones above 127), short keys over a 3-letter alphabet with many
+// duplicates and prefixes, and long keys that only differ near the end.
+static void test_string_sorts(int printFlag, int N, int R,
+                              struct testFunc_t* testFunc, int numFunc) {
+  const int sizes[] = {0, 1, 2, 31, 32, 33, 1000, 40000};
+  const int kNumSizes = sizeof(sizes) / sizeof(sizes[0]);
+  const int kMaxLen = 64;
+  const int kMaxN = 40000;
+  void (*sorts[])(const char**, int) = {strsort_mkqs, strsort_msd};
+  const char* names[] = {"strsort_mkqs", "strsort_msd"};
+  const char* kinds[] = {"random bytes", "short keys", "long prefixes"};
+  char* pool = (char*) malloc(kMaxN * kMaxLen);
+  const char** input = (const char**) malloc(kMaxN * sizeof(char*));
+  const char** expected = (const char**) malloc(kMaxN * sizeof(char*));
+  const char** s = (const char**) malloc(kMaxN * sizeof(char*));
+  int success = 1;
+
+  if (pool == NULL || input == NULL || expected == NULL || s == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+
+  for (int kind = 0; kind < 3 && success; kind++) {
+    for (int x = 0; x < kNumSizes && success; x++) {
+      const int n = sizes[x];
+      for (int i = 0; i < n; i++) {
+        char* str = pool + i * kMaxLen;
+        int len;
+        if (kind == 0) {
+          len = rand_r(&randomSeed) % 20;
+          for (int k = 0; k < len; k++) {
+            str[k] = 1 + rand_r(&randomSeed) % 255;
+          }
+        } else if (kind == 1) {
+          len = rand_r(&randomSeed) % 6;
+          for (int k = 0; k < len; k++) {
+            str[k] = 'a' + rand_r(&randomSeed) % 3;
+          }
+        } else {
+          len = kMaxLen - 1 - rand_r(&randomSeed) % 4;
+          memset(str, 'x', len);
+          str[len - 1 - rand_r(&randomSeed) % 3] =
+              'a' + rand_r(&randomSeed) % 3;
+        }
+        str[len] = '\0';
+        input[i] = str;
+      }
+      memcpy(expected, input, n * sizeof(char*));
+      qsort(expected, n, sizeof(char*), compare_strings);
+      for (int k = 0; k < 2 && success; k++) {
+        memcpy(s, input, n * sizeof(char*));
+        sorts[k](s, n);
+        for (int i = 0; i < n; i++) {
+          if (strcmp(s[i], expected[i]) != 0) {
+            printf("Error: %s wrong on %d %s\n", names[k], n, kinds[kind]);
+            success = 0;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  free(pool);
+  free(input);
+  free(expected);
+  free(s);
+  if (success) {
+    TEST_PASS();
+  } else {
+    TEST_FAIL("string sorts disagree with qsort");
+  }
+}
+
 test_case test_cases[] = {
   test_correctness,
   test_zero_element,
   test_one_element,
+  test_isort_variants,
+  test_distribution_sort,
+  test_set_operations,
+  test_string_sorts,
   // test_subarray,
   // ADD YOUR TEST CASES HERE
   NULL  // This marks the end of all test cases. Don't change this!
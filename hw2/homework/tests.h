@@ -15,4 +15,7 @@ struct testFunc_t {
 
 typedef void (*test_case)(int printFlag, int N, int R, struct testFunc_t* testFunc, int numFunc);
 
+// Fill data with N uniformly random values (defined in tests.c).
+void all_random(data_t* data, int N);
+
 #endif  // TESTS_H
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Typedefs */
 
@@ -27,13 +28,78 @@ void isort(data_t* left, data_t* right) {
   }
 }
 
+/* Binary insertion sort: branchless binary search for the insertion point,
+ * then one memmove to shift the larger elements up */
+void isort_binary(data_t* left, data_t* right) {
+  data_t* cur;
+  for (cur = left + 1; cur <= right; cur++) {
+    data_t val = *cur;
+    if (*(cur - 1) <= val) {
+      continue;
+    }
+
+    // Find the first element of [left, cur) greater than val.
+    data_t* base = left;
+    size_t n = cur - left;
+    while (n > 1) {
+      size_t half = n / 2;
+      base = (base[half] <= val) ? base + half : base;
+      n -= half;
+    }
+    base += (*base <= val);
+
+    memmove(base + 1, base, (cur - base) * sizeof(data_t));
+    *base = val;
+  }
+}
+
+/* Sentinel insertion sort: with the minimum at *left the inner loop stops
+ * by itself and needs no bounds check */
+void isort_sentinel(data_t* left, data_t* right) {
+  if (right <= left) {
+    return;
+  }
+  data_t* min = left;
+  data_t* cur;
+  for (cur = left + 1; cur <= right; cur++) {
+    if (*cur < *min) {
+      min = cur;
+    }
+  }
+  data_t tmp = *left;
+  *left = *min;
+  *min = tmp;
+
+  for (cur = left + 2; cur <= right; cur++) {
+    data_t val = *cur;
+    data_t* index = cur - 1;
+    while (*index > val) {
+      *(index + 1) = *index;
+      index--;
+    }
+    *(index + 1) = val;
+  }
+}
+
 int main(int argc, char* argv[]) {
-  if (argc != 3) {
+  if (argc != 3 && argc != 4) {
     printf("Error: wrong number of arguments.\n");
+    printf("Usage: %s N K [linear|binary|sentinel]\n", argv[0]);
     exit(-1);
   }
   int N = atoi(argv[1]);
   int K = atoi(argv[2]);
+  void (*sort)(data_t*, data_t*) = isort;
+  if (argc == 4) {
+    if (strcmp(argv[3], "binary") == 0) {
+      sort = isort_binary;
+    } else if (strcmp(argv[3], "sentinel") == 0) {
+      sort = isort_sentinel;
+    } else if (strcmp(argv[3], "linear") != 0) {
+      printf("Error: unknown isort variant %s\n", argv[3]);
+      exit(-1);
+    }
+  }
   unsigned int seed = 42;
   printf("Sorting %d values...\n", N);
   data_t* data = (data_t*) malloc(N * sizeof(data_t));
@@ -51,7 +117,7 @@ int main(int argc, char* argv[]) {
     }
     //  printf("\n");
 
-    isort(data, data + N - 1);
+    sort(data, data + N - 1);
     //quickSortIterative(data, 0, N);
     /*for (i = 0; i < N; i++) {
       printf("%d ", data[i]);
@@ -1,14 +1,222 @@
 // Copyright (c) 2012 MIT License by 6.172 Staff
 
+#include "fasttime.h"
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 typedef uint32_t data_t;
 const int U = 10000000;   // size of the array. 10 million vals ~= 40MB
 const int N = 100000000;  // number of searches to perform
 
-int main() {
+/* Limits for the software-pipelined variant */
+
+#define MAX_BATCH 256     // indices generated ahead of use, per stream
+#define MAX_STREAMS 8     // independent rand_r() streams interleaved
+
+/* Naive: one random load per iteration, issued only when its index is known */
+static data_t sum_naive(const data_t* data, int n, data_t seed) {
+  data_t val = 0;
+  int i;
+  for (i = 0; i < n; i++) {
+    int l = rand_r(&seed) % U;
+    val = (val + data[l]);
+  }
+  return val;
+}
+
+/* Software-pipelined: every stream keeps a ring of `batch` indices that
+ * have already been generated and prefetched.  Each step consumes the
+ * oldest index of a ring and refills its slot with a fresh, prefetched
+ * one, so up to batch * streams misses are in flight at once.  Stream 0
+ * is seeded with `seed`, so a single stream visits exactly the same
+ * elements (and returns the same value) as sum_naive(). */
+static data_t sum_batched(const data_t* data, int n, data_t seed,
+                          int batch, int streams) {
+  int idx[MAX_STREAMS][MAX_BATCH];
+  data_t seeds[MAX_STREAMS];
+  data_t val = 0;
+  int s, k;
+
+  int steps = n / streams;         // accesses per stream
+  int tail = n - steps * streams;  // leftovers, done by stream 0
+  if (batch > steps) {
+    batch = steps > 0 ? steps : 1;
+  }
+
+  for (s = 0; s < streams; s++) {
+    seeds[s] = seed + s * 0x9e3779b9u;
+  }
+
+  // Prologue: fill every ring.
+  for (k = 0; k < batch && k < steps; k++) {
+    for (s = 0; s < streams; s++) {
+      int l = rand_r(&seeds[s]) % U;
+      idx[s][k] = l;
+      __builtin_prefetch(&data[l], 0, 0);
+    }
+  }
+
+  // Steady state: consume the oldest slot, refill it batch steps ahead.
+  int slot = 0;
+  for (k = 0; k < steps - batch; k++) {
+    for (s = 0; s < streams; s++) {
+      val = (val + data[idx[s][slot]]);
+      int l = rand_r(&seeds[s]) % U;
+      idx[s][slot] = l;
+      __builtin_prefetch(&data[l], 0, 0);
+    }
+    if (++slot == batch) {
+      slot = 0;
+    }
+  }
+
+  // Epilogue: drain the rings in generation order.
+  for (k = 0; k < batch && k < steps; k++) {
+    for (s = 0; s < streams; s++) {
+      val = (val + data[idx[s][slot]]);
+    }
+    if (++slot == batch) {
+      slot = 0;
+    }
+  }
+
+  for (k = 0; k < tail; k++) {
+    int l = rand_r(&seeds[0]) % U;
+    val = (val + data[l]);
+  }
+  return val;
+}
+
+/* Average latency of a single dependent miss, measured by chasing a
+ * random cyclic permutation (Sattolo) over an array as large as data[]. */
+static double miss_latency_ns(int n) {
+  data_t* next = (data_t*) malloc(U * sizeof(data_t));
+  if (next == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+  data_t seed = 7;
+  int i;
+  for (i = 0; i < U; i++) {
+    next[i] = i;
+  }
+  for (i = U - 1; i > 0; i--) {
+    int j = rand_r(&seed) % i;
+    data_t tmp = next[i];
+    next[i] = next[j];
+    next[j] = tmp;
+  }
+
+  volatile data_t sink;
+  data_t p = 0;
+  fasttime_t start = gettime();
+  for (i = 0; i < n; i++) {
+    p = next[p];
+  }
+  double elapsed = tdiff(start, gettime());
+  sink = p;
+  (void) sink;
+
+  free(next);
+  return elapsed * 1e9 / n;
+}
+
+/* Sweep batch size and stream count, reporting each configuration against
+ * the naive loop.  Achieved memory-level parallelism follows from Little's
+ * law: misses in flight = latency * throughput = latency / (time/access). */
+static void tune(const data_t* data, int n) {
+  const int batches[] = {1, 2, 4, 8, 16, 32, 64, 128, 256};
+  const int streams[] = {1, 2, 4, 8};
+  const int num_batches = sizeof(batches) / sizeof(batches[0]);
+  const int num_streams = sizeof(streams) / sizeof(streams[0]);
+
+  double latency = miss_latency_ns(n / 10 > 0 ? n / 10 : 1);
+
+  fasttime_t start = gettime();
+  data_t expected = sum_naive(data, n, 42);
+  double naive_ns = tdiff(start, gettime()) * 1e9 / n;
+
+  printf("Dependent miss latency: %.2f ns\n", latency);
+  printf("%8s %8s %12s %10s %8s\n", "batch", "streams", "ns/access",
+         "speedup", "MLP");
+  printf("%8s %8s %12.2f %10.2f %8.2f\n", "naive", "-", naive_ns, 1.0,
+         latency / naive_ns);
+
+  int best_batch = 0, best_streams = 0;
+  double best_ns = naive_ns;
+  int b, s;
+  for (s = 0; s < num_streams; s++) {
+    for (b = 0; b < num_batches; b++) {
+      start = gettime();
+      data_t val = sum_batched(data, n, 42, batches[b], streams[s]);
+      double ns = tdiff(start, gettime()) * 1e9 / n;
+      if (streams[s] == 1 && val != expected) {
+        printf("Error: batch %d returned %u, expected %u\n",
+               batches[b], val, expected);
+        exit(-1);
+      }
+      printf("%8d %8d %12.2f %10.2f %8.2f\n", batches[b], streams[s], ns,
+             naive_ns / ns, latency / ns);
+      if (ns < best_ns) {
+        best_ns = ns;
+        best_batch = batches[b];
+        best_streams = streams[s];
+      }
+    }
+  }
+
+  if (best_batch == 0) {
+    printf("Best: naive loop (%.2f ns/access)\n", naive_ns);
+  } else {
+    printf("Best: batch %d, streams %d (%.2f ns/access, %.2fx, MLP %.2f)\n",
+           best_batch, best_streams, best_ns, naive_ns / best_ns,
+           latency / best_ns);
+  }
+}
+
+static void usage(const char* prog) {
+  printf("Usage: %s [-n searches] [-b batch [-s streams]] [-t]\n", prog);
+  printf("  -b : prefetch batch indices ahead (1..%d)\n", MAX_BATCH);
+  printf("  -s : interleave this many independent streams (1..%d)\n",
+         MAX_STREAMS);
+  printf("  -t : sweep batch/streams and report speedup and MLP\n");
+}
+
+int main(int argc, char* argv[]) {
+  int n = N;
+  int batch = 0;
+  int streams = 1;
+  int tuning = 0;
+  int optchar;
+
+  while ((optchar = getopt(argc, argv, "n:b:s:t")) != -1) {
+    switch (optchar) {
+      case 'n':
+        n = atoi(optarg);
+        break;
+      case 'b':
+        batch = atoi(optarg);
+        break;
+      case 's':
+        streams = atoi(optarg);
+        break;
+      case 't':
+        tuning = 1;
+        break;
+      default:
+        usage(argv[0]);
+        exit(-1);
+    }
+  }
+  if (n < 1 || batch < 0 || batch > MAX_BATCH ||
+      streams < 1 || streams > MAX_STREAMS) {
+    usage(argv[0]);
+    exit(-1);
+  }
+
   data_t* data = (data_t*) malloc(U * sizeof(data_t));
   if (data == NULL) {
     free(data);
@@ -23,13 +231,26 @@ int main() {
   }
 
   printf("Allocated array of size %d\n", U);
-  printf("Summing %d random values...\n", N);
 
-  data_t val = 0;
-  data_t seed = 42;
-  for (i = 0; i < N; i++) {
-    int l = rand_r(&seed) % U;
-    val = (val + data[l]);
+  if (tuning) {
+    // The sweep runs 36 configurations; keep the default run short.
+    if (n == N) {
+      n = N / 10;
+    }
+    printf("Tuning over %d random values...\n", n);
+    tune(data, n);
+    free(data);
+    return 0;
+  }
+
+  printf("Summing %d random values...\n", n);
+
+  data_t val;
+  if (batch == 0) {
+    val = sum_naive(data, n, 42);
+  } else {
+    printf("Prefetching %d ahead across %d stream(s)\n", batch, streams);
+    val = sum_batched(data, n, 42, batch, streams);
   }
 
   free(data);
@@ -23,7 +23,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "./fasttime.h"
+#include <string.h>
+#include "bench.h"
+#include "fasttime.h"
 
 // N is small enough so that 3 arrays of size N fit into the AWS machine
 // level 1 caches (which are 32 KB each, as seen by running `lscpu`)
@@ -46,7 +48,35 @@
 #define stringify(V) _stringify(V)
 #define _stringify(V) #V
 
+// Benchmark kernel: state->iterations passes of the inner loop.  The empty
+// asm takes C and clobbers memory, so the compiler can neither drop the
+// stores nor collapse passes that recompute the same C[].
+static void bench_loop(bench_state_t *state) {
+    static __TYPE__ A[N];
+    static __TYPE__ B[N];
+    static __TYPE__ C[N];
+    int64_t i;
+    int j;
+
+    for (i = 0; i < state->iterations; i++) {
+        for (j = 0; j < N; j++) {
+            C[j] = A[j] __OP__ B[j];
+        }
+        __asm__ volatile("" : : "r"(C) : "memory");
+    }
+}
+
 int main(int argc, char *argv[]) {
+    // ./loop -b runs the kernel through the shared benchmark driver instead
+    // of the fixed I-repetition timing below.
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+        const bench_options_t opts = bench_options_from_env();
+        bench_register("loop[" stringify(__OP__) "," stringify(__TYPE__) "]",
+                       bench_loop, NULL, N);
+        bench_run_all(&opts);
+        return 0;
+    }
+
     __TYPE__ A[N];
     __TYPE__ B[N];
     __TYPE__ C[N];
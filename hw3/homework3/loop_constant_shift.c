@@ -22,7 +22,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "./fasttime.h"
+#include "fasttime.h"
 
 // N is small enough so that 3 arrays of size N fit into the AWS machine
 // level 1 caches (which are 32 KB each, as seen by running `lscpu`)
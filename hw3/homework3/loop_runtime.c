@@ -22,7 +22,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "./fasttime.h"
+#include "fasttime.h"
 
 // Run for multiple experiments to reduce measurement error on gettime().
 #define I          100000
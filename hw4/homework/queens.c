@@ -7,7 +7,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
 #include <cilk/cilk.h>
+#endif
 
 // Cilksan functions may not be available when not using Cilksan
 #ifdef __CILKSAN__
@@ -133,9 +137,14 @@ void board_list_identity(void* value) {
     init_list(list);
 }
 
+#ifdef _OPENMP
+// OpenMP has no list reducer; tasks fill per-branch lists merged in order
+BoardList X = ((BoardList) { .head = NULL, .tail = NULL, .size = 0 });
+#else
 // Initialize the reducer globally using OpenCilk's cilk_reducer keyword
 BoardList cilk_reducer(board_list_identity, board_list_reduce) X = 
     ((BoardList) { .head = NULL, .tail = NULL, .size = 0 });
+#endif
 
 // Serial version (original implementation without parallelization)
 void try_serial(int row, int left, int right, BoardList* board_list) {
@@ -163,6 +172,40 @@ void try_serial(int row, int left, int right, BoardList* board_list) {
     }
 }
 
+#ifdef _OPENMP
+// OpenMP tasking version with the same coarsening: each branch gets its own
+// list, and the lists are concatenated in branch order after the taskwait,
+// which is what the Cilk reducer does implicitly
+void try_omp(int row, int left, int right, BoardList* board_list) {
+    int poss, place;
+    if (row == 0xFF) {
+        append_board(board_list, (Board)row);
+        return;
+    }
+    int queens_placed = popcount((uint8_t)row);
+    if (queens_placed >= COARSENING_THRESHOLD) {
+        try_serial(row, left, right, board_list);
+        return;
+    }
+
+    // At most 8 columns are free, so at most 8 branches
+    BoardList branch[8];
+    int n = 0;
+    poss = ~(row | left | right) & 0xFF;
+    while (poss != 0) {
+        place = poss & -poss;
+        BoardList* list = &branch[n++];
+        init_list(list);
+        #pragma omp task firstprivate(place, list)
+        try_omp(row | place, (left | place) << 1, (right | place) >> 1, list);
+        poss &= ~place;
+    }
+    #pragma omp taskwait
+    for (int i = 0; i < n; i++) {
+        merge_lists(board_list, &branch[i]);
+    }
+}
+#else
 // Parallel version with coarsening using reducer
 void try(int row, int left, int right) {
     int poss, place;
@@ -200,6 +243,7 @@ void try(int row, int left, int right) {
         // Views are automatically merged after sync - no manual merging needed!
     }
 }
+#endif
 
 int main() {
     // Disable Cilksan checking for reducer initialization
@@ -207,8 +251,14 @@ int main() {
     init_list(&X);  // Ensure it's initialized (though identity should do this)
     __cilksan_enable_checking();
     
+#ifdef _OPENMP
+    #pragma omp parallel
+    #pragma omp single
+    try_omp(0, 0, 0, &X);
+#else
     // Call the parallel function - no need to pass board_list
     try(0, 0, 0);
+#endif
     
     // After all parallel execution, get the final value
     __cilksan_disable_checking();
@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
 #include <cilk/cilk.h>
+#endif
 
 #ifdef CILKSCALE
 #include <cilk/cilkscale.h>
@@ -9,6 +13,9 @@
 
 typedef uint32_t data_t;
 
+// Smallest subarray sorted in its own OpenMP task
+#define TASK_CUTOFF 4096
+
 // A utility function to swap two elements
 void swap(data_t* a, data_t* b) {
     data_t t = *a;
@@ -41,9 +48,18 @@ void quickSort(data_t arr[], int l, int h) {
 
         // Parallelize both recursive calls - no race condition
         // Each call operates on disjoint array regions
+#ifdef _OPENMP
+        // OpenMP tasks are not cheap enough to create one per partition,
+        // so small subarrays run inline in the parent's task
+        #pragma omp task if (p - l > TASK_CUTOFF)
+        quickSort(arr, l, p - 1);
+        quickSort(arr, p + 1, h);
+        #pragma omp taskwait
+#else
         cilk_spawn quickSort(arr, l, p - 1);
         quickSort(arr, p + 1, h);
         cilk_sync;
+#endif
     }
 }
 
@@ -69,7 +85,13 @@ int main(int argc, char* argv[]) {
     }
 
     // Sort the array
+#ifdef _OPENMP
+    #pragma omp parallel
+    #pragma omp single
+    quickSort(arr, 0, size - 1);
+#else
     quickSort(arr, 0, size - 1);
+#endif
 
 #ifdef CILKSCALE
     // Print Cilkscale scalability information
@@ -2,7 +2,11 @@
 #include <inttypes.h>
 #include <stdlib.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#else
 #include <cilk/cilk.h>
+#endif
 
 // Coarsening threshold: execute serially for n < 25 to reduce spawn overhead
 // This threshold was determined empirically to balance parallelism and overhead
@@ -19,9 +23,16 @@ int64_t fib(int64_t n) {
     }
     else {
         // Parallel execution for large n
+#ifdef _OPENMP
+        #pragma omp task shared(x)
+        x = fib(n - 1);
+        y = fib(n - 2);
+        #pragma omp taskwait
+#else
         x = cilk_spawn fib(n - 1);
         y = cilk_spawn fib(n - 2);
         cilk_sync;
+#endif
     }
 
     return (x + y);
@@ -31,6 +42,13 @@ int main(int argc, char* argv[]) {
     int64_t n = atoi(argv[1]);
     int64_t result;
 
+#ifdef _OPENMP
+    // Tasks need an enclosing team; one thread seeds the recursion
+    #pragma omp parallel
+    #pragma omp single
+    result = fib(n);
+#else
     result = fib(n);
+#endif
     printf("Fibonacci of %" PRId64 " is %" PRId64 ".\n", n, result);
 }
@@ -1,7 +1,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
 #include <cilk/cilk.h>
+#endif
 
 typedef struct Matrix {
     uint16_t rows;
@@ -83,13 +87,19 @@ stored at the address a' = Nm+n.
 @param arr Array to be transposed.
 */
 void transpose(Matrix* arr) {
-    uint16_t j;
     // Parallel transpose using cilk_for
     // Parallelize the outer loop - each iteration swaps one row with corresponding column
     // Note: loop variable must be declared in cilk_for initializer
+    // Row i does i swaps, so OpenMP hands out rows dynamically to keep the
+    // triangle balanced; j is private to each iteration in both runtimes
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 1; i < arr->rows; i++) {
+#else
     cilk_for (uint16_t i = 1; i < arr->rows; i++) {
+#endif
         // Inner loop remains serial - swaps elements in row i with column i
-        for (j = 0; j < i; j++) {
+        for (uint16_t j = 0; j < i; j++) {
             uint8_t tmp = arr->data[i][j];
             arr->data[i][j] = arr->data[j][i];
             arr->data[j][i] = tmp;
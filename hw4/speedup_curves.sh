@@ -0,0 +1,216 @@
+#!/bin/bash
+#
+# speedup_curves.sh - Speedup curves for the Cilk and OpenMP builds of the
+# parallel kernels, measured on the same machine
+#
+# Each kernel is built once per runtime ("make PARALLEL=1" for OpenCilk,
+# "make OPENMP=1" for OpenMP) in a temporary copy of its directory, then
+# timed with 1..P workers. The worker count is set with CILK_NWORKERS or
+# OMP_NUM_THREADS respectively, and the speedup of each run is relative to
+# the same runtime on one worker. Runs that exit nonzero are reported as
+# FAILED instead of timed.
+#
+# Usage:
+#   ./speedup_curves.sh [OPTIONS]
+#
+# Options:
+#   -p, --workers P       Largest worker count (default: nproc)
+#   -k, --kernels LIST    Kernels to run (default: "fib transpose qsort queens screensaver")
+#   -r, --runtimes LIST   Runtimes to compare (default: "cilk openmp")
+#   -n, --repeat N        Runs per point; the fastest is reported (default: 3)
+#   -h, --help            Show this help message
+#
+# Kernel arguments can be overridden with FIB_ARGS, TRANSPOSE_ARGS,
+# QSORT_ARGS, QUEENS_ARGS and SCREENSAVER_ARGS.
+#
+# Example:
+#   ./speedup_curves.sh -p 8 -k "fib qsort"
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_DIR="$(cd "$SCRIPT_DIR/.." && pwd)"
+PRJ2_DIR="$REPO_DIR/prj2/MIT6_172F18-project2"
+
+# Default parameters
+MAX_WORKERS=$(nproc)
+KERNELS="fib transpose qsort queens screensaver"
+RUNTIMES="cilk openmp"
+REPEAT=3
+
+FIB_ARGS=${FIB_ARGS:-"40"}
+TRANSPOSE_ARGS=${TRANSPOSE_ARGS:-"8000"}
+QSORT_ARGS=${QSORT_ARGS:-"1000000"}
+QUEENS_ARGS=${QUEENS_ARGS:-""}
+SCREENSAVER_ARGS=${SCREENSAVER_ARGS:-"-q 400 input/box.in"}
+
+usage() {
+    sed -n '3,27p' "$0" | sed 's/^# \{0,1\}//'
+}
+
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        -p|--workers)
+            MAX_WORKERS="$2"
+            shift 2
+            ;;
+        -k|--kernels)
+            KERNELS="$2"
+            shift 2
+            ;;
+        -r|--runtimes)
+            RUNTIMES="$2"
+            shift 2
+            ;;
+        -n|--repeat)
+            REPEAT="$2"
+            shift 2
+            ;;
+        -h|--help)
+            usage
+            exit 0
+            ;;
+        *)
+            echo "Unknown option: $1"
+            usage
+            exit 1
+            ;;
+    esac
+done
+
+BUILD_DIR=$(mktemp -d)
+trap 'rm -rf "$BUILD_DIR"' EXIT
+
+# Directory holding the Makefile of each kernel
+kernel_dir() {
+    case $1 in
+        fib|transpose) echo "$SCRIPT_DIR/recitation" ;;
+        qsort)         echo "$SCRIPT_DIR/qsort" ;;
+        queens)        echo "$SCRIPT_DIR/homework" ;;
+        screensaver)   echo "$PRJ2_DIR" ;;
+    esac
+}
+
+kernel_args() {
+    case $1 in
+        fib)         echo "$FIB_ARGS" ;;
+        transpose)   echo "$TRANSPOSE_ARGS" ;;
+        qsort)       echo "$QSORT_ARGS" ;;
+        queens)      echo "$QUEENS_ARGS" ;;
+        screensaver) echo "$SCREENSAVER_ARGS" ;;
+    esac
+}
+
+runtime_flags() {
+    case $1 in
+        cilk)   echo "PARALLEL=1" ;;
+        openmp) echo "OPENMP=1" ;;
+    esac
+}
+
+runtime_env() {
+    case $1 in
+        cilk)   echo "CILK_NWORKERS" ;;
+        openmp) echo "OMP_NUM_THREADS" ;;
+    esac
+}
+
+# Build one kernel for one runtime into $BUILD_DIR/<runtime>/<kernel>. The
+# kernel's directory is copied into $BUILD_DIR first, next to a copy of
+# common/ so that ../../common still resolves, and built there; the source
+# tree, and any build already in it, is left alone.
+build() {
+    local kernel=$1 runtime=$2
+    local src="$BUILD_DIR/$runtime/$kernel.src"
+    mkdir -p "$src/build"
+    cp -r "$REPO_DIR/common" "$src/common"
+    cp -r "$(kernel_dir "$kernel")" "$src/build/$kernel"
+    (
+        cd "$src/build/$kernel"
+        make clean > /dev/null 2>&1
+        make $(runtime_flags "$runtime") "$kernel" > "$BUILD_DIR/$runtime/$kernel.log" 2>&1 &&
+            cp "$kernel" "$BUILD_DIR/$runtime/$kernel"
+    )
+    [ -x "$BUILD_DIR/$runtime/$kernel" ]
+}
+
+# Fastest wall-clock time of $REPEAT runs, in seconds. Fails, with the
+# kernel's output in $BUILD_DIR/<runtime>/<kernel>.<workers>.log, if any run
+# exits nonzero.
+time_run() {
+    local kernel=$1 runtime=$2 workers=$3
+    local log="$BUILD_DIR/$runtime/$kernel.$workers.log"
+    local best="" start end elapsed
+    for ((r = 0; r < REPEAT; r++)); do
+        start=$(date +%s.%N)
+        if ! (cd "$(kernel_dir "$kernel")" &&
+                env "$(runtime_env "$runtime")=$workers" \
+                    "$BUILD_DIR/$runtime/$kernel" $(kernel_args "$kernel") > "$log" 2>&1); then
+            return 1
+        fi
+        end=$(date +%s.%N)
+        elapsed=$(awk -v s="$start" -v e="$end" 'BEGIN { print e - s }')
+        if [ -z "$best" ] || awk -v t="$elapsed" -v b="$best" 'BEGIN { exit !(t < b) }'; then
+            best=$elapsed
+        fi
+    done
+    echo "$best"
+}
+
+# Worker counts: powers of two up to MAX_WORKERS, plus MAX_WORKERS itself
+WORKER_COUNTS=""
+for ((p = 1; p < MAX_WORKERS; p *= 2)); do
+    WORKER_COUNTS="$WORKER_COUNTS $p"
+done
+WORKER_COUNTS="$WORKER_COUNTS $MAX_WORKERS"
+
+echo "=== Speedup curves on $(nproc) core(s), up to $MAX_WORKERS worker(s) ==="
+
+for kernel in $KERNELS; do
+    built=""
+    for runtime in $RUNTIMES; do
+        if build "$kernel" "$runtime"; then
+            built="$built $runtime"
+        else
+            echo "WARNING: $kernel did not build for $runtime (see below), skipping"
+            tail -n 3 "$BUILD_DIR/$runtime/$kernel.log"
+        fi
+    done
+    [ -z "$built" ] && continue
+
+    echo ""
+    echo "--- $kernel $(kernel_args "$kernel") ---"
+    printf "%8s" "workers"
+    for runtime in $built; do
+        printf " %12s %8s" "$runtime(s)" "speedup"
+    done
+    echo ""
+
+    declare -A T1=()
+    failed=""
+    for p in $WORKER_COUNTS; do
+        printf "%8d" "$p"
+        for runtime in $built; do
+            if ! t=$(time_run "$kernel" "$runtime" "$p"); then
+                printf " %12s %8s" "FAILED" "-"
+                failed="$failed $runtime:$p"
+                continue
+            fi
+            [ "$p" -eq 1 ] && T1[$runtime]=$t
+            if [ -n "${T1[$runtime]}" ]; then
+                printf " %12.4f %8.2f" "$t" \
+                    "$(awk -v t1="${T1[$runtime]}" -v t="$t" 'BEGIN { print t1 / t }')"
+            else
+                printf " %12.4f %8s" "$t" "-"
+            fi
+        done
+        echo ""
+    done
+    unset T1
+    for run in $failed; do
+        runtime=${run%%:*}
+        p=${run#*:}
+        echo "WARNING: $kernel failed for $runtime with $p worker(s):"
+        tail -n 3 "$BUILD_DIR/$runtime/$kernel.$p.log"
+    done
+done
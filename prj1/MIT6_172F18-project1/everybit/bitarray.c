@@ -20,54 +20,127 @@
  * IN THE SOFTWARE.
  **/
 
+
 // Implements the ADT specified in bitarray.h as a packed array of bits; a bit
 // array containing bit_sz bits will consume roughly bit_sz/8 bytes of
 // memory.
 
 
+// We need _POSIX_C_SOURCE >= 200112L for posix_memalign.
+#define _POSIX_C_SOURCE 200112L
+
 #include "./bitarray.h"
 
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <pthread.h>
 #include <sys/types.h>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-
+#include "./bitarray_internal.h"
 
 
 // ******************************** Macros **********************************
 
-// Hash table configuration for LUT management
-#define LUT_ENTRY_CACHE_SIZE 9
-
-// Thresholds for using different LUT sizes
-#define TINY_LUT_THRESHOLD       (500u)       // 500 bits for 32-bit LUT
-#define SMALL_LUT_THRESHOLD      (5000u)      // 5K bits for 64-bit LUT  
-#define MEDIUM_LUT_THRESHOLD     (50000u)     // 50K bits for 128-bit LUT
-#define LARGE_LUT_THRESHOLD      (250000u)    // 250K bits for 256-bit LUT
-#define CACHE_LINE_LUT_THRESHOLD (500000u)    // 500K bits for 512-bit LUT (cache line)
-#define HUGE_LUT_THRESHOLD       (2500000u)   // 2.5M bits for 1024-bit LUT
-#define MASSIVE_LUT_THRESHOLD    (10000000u)  // 10M bits for 2048-bit LUT
-#define EXTREME_LUT_THRESHOLD    (50000000u)  // 50M bits for 4096-bit LUT
-#define ULTRA_LUT_THRESHOLD      (100000000u) // 100M bits for 8192-bit LUT
-
-// Lookup tables for various bit widths
-static const uint8_t bit_reverse_table256[256] = {
-#define R2(n) n, n + 2*64, n + 1*64, n + 3*64
-#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
-#define R6(n) R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
-    R6(0), R6(2), R6(1), R6(3)
-#undef R2
-#undef R4
-#undef R6
-};
+// Step kind of a compiled word permutation that gathers its source bits
+// with pext and scatters them with pdep instead of shifting them.
+#define BITPERM_SCATTER 64
+
+// A permutation needing more pext/pdep steps than this is applied through
+// per-byte lookup tables instead: eight loads from 16KB of tables beat
+// long pext/pdep chains, and beat the bit-at-a-time fallback by far.
+#ifdef __BMI2__
+#define BITPERM_MAX_SCATTER_STEPS 3
+#else
+#define BITPERM_MAX_SCATTER_STEPS 0
+#endif
+
+// Words a streaming reversal loads from each end before storing any of
+// them (512 bytes).
+#define STREAM_BLOCK_WORDS 64
+
+// Number of candidate positions the parallel searches hand to a thread at
+// a time (2MB of the array).  Must be a multiple of 64.
+#define SEARCH_CHUNK_BITS ((size_t)1 << 24)
+
+// The rank index keeps three words and a bit per block of this many bits
+// (eight words), a 37.5% overhead.
+#define RANK_BLOCK_BITS 512
+
+// The rank index remembers which block holds every this-many-th one.
+#define SELECT_SAMPLE_RATE 512
+
+// Granularity at which a snapshot saves the parts of the array written
+// after it is taken.
+#define SNAPSHOT_PAGE_BYTES 4096
 
 
 // ********************************* Types **********************************
 
+// Rank/select directory over a bit array, kept in RANK_BLOCK_BITS blocks.
+//
+// Edits to the array only mark the blocks they touch as dirty; the counts
+// are recomputed from the dirty blocks onwards when a query needs them.
+// A single-bit edit instead records its +1 or -1 for the later blocks in
+// a Fenwick tree and marks just its own block as touched, so it costs
+// O(log n) rather than a repair to the end.
+typedef struct {
+  size_t num_blocks;
+  // counts[2b] plus the prefix sum of deltas up to b is the number of ones
+  // before block b.  counts[2b + 1] packs nine bits per word w = 1..7 of
+  // block b: the number of ones in the block before that word.
+  // counts[2 * num_blocks] (plus all deltas) is the total.
+  uint64_t* counts;
+  // Fenwick tree over positions 1..num_blocks of the single-bit edits not
+  // yet folded into counts, and how many there have been.
+  int64_t* deltas;
+  size_t num_deltas;
+  // Bit b is set if a single-bit edit has left the word counts in
+  // counts[2b + 1] stale.  The ones before block b are still right.
+  uint64_t* touched;
+  // samples[s] was the block holding one number s * SELECT_SAMPLE_RATE
+  // when the samples were taken; sample_slack single-bit edits ago.  Each
+  // edit moves the numbering by at most one, so select widens its search
+  // by sample_slack ones instead of resampling.
+  size_t* samples;
+  size_t num_samples;
+  size_t sample_slack;
+  // Blocks dirty_lo..dirty_hi have stale counts (none if dirty_lo >
+  // dirty_hi).  A bulk edit that changes the number of ones stretches the
+  // range to the last block, since every later total moves with it.
+  size_t dirty_lo;
+  size_t dirty_hi;
+  bool samples_stale;
+} rank_index_t;
+
+// Undo log of a snapshot: the contents, at the time of the snapshot, of
+// every page written since.  A page is saved just before the first write
+// to it, so the log grows with the pages touched, not with the array.
+typedef struct {
+  size_t num_pages;
+  // slot[p] is one more than the position in saved of page p, or 0 if
+  // page p has not been written since the snapshot.
+  size_t* slot;
+  // Saved pages, SNAPSHOT_PAGE_BYTES each, and the page each belongs to.
+  uint8_t* saved;
+  size_t* saved_page;
+  size_t num_saved;
+  size_t capacity;
+  // Set when a page could not be saved for lack of memory; the snapshot
+  // can no longer be restored.
+  bool lost;
+} snapshot_t;
+
 // Concrete data type representing an array of bits.
 struct bitarray {
   // The number of bits represented by this bit array.
@@ -76,147 +149,53 @@ struct bitarray {
   // The underlying memory buffer that stores the bits in
   // packed form (8 per byte).
   char* buf;
+  // Optional rank/select index, or NULL.
+  rank_index_t* index;
+  // Optional snapshot, or NULL.
+  snapshot_t* snapshot;
 };
 
-
-// 128-bit LUT (256 entries) - implemented as 2x uint64_t
-typedef struct {
-    uint64_t low;
-    uint64_t high;
-} uint128_t;
-
-
-// 256-bit LUT (256 entries) - implemented as 4x uint64_t
-typedef struct {
-    uint64_t low;
-    uint64_t mid_low;
-    uint64_t mid_high;
-    uint64_t high;
-} uint256_t;
-
-
-// 512-bit LUT (256 entries) - implemented as 8x uint64_t (cache line size)
-typedef struct {
-    uint64_t chunk0;
-    uint64_t chunk1;
-    uint64_t chunk2;
-    uint64_t chunk3;
-    uint64_t chunk4;
-    uint64_t chunk5;
-    uint64_t chunk6;
-    uint64_t chunk7;
-} uint512_t;
-
-
-// 1024-bit LUT (256 entries) - implemented as 16x uint64_t
-typedef struct {
-    uint64_t chunk[16];
-} uint1024_t;
-
-
-// 2048-bit LUT (256 entries) - implemented as 32x uint64_t
-typedef struct {
-    uint64_t chunk[32];
-} uint2048_t;
-
-
-// 4096-bit LUT (256 entries) - implemented as 64x uint64_t
-typedef struct {
-    uint64_t chunk[64];
-} uint4096_t;
-
-
-// 8192-bit LUT (256 entries) - implemented as 128x uint64_t
+// One step of a compiled word permutation.  The bits selected by src_mask
+// keep their relative order and land, in that order, on the bits of
+// dst_mask.
 typedef struct {
-    uint64_t chunk[128];
-} uint8192_t;
-
-
-// LUT entry types for different bit widths
-typedef enum {
-    LUT_TYPE_8BIT = 0,      // Fallback for very small arrays
-    LUT_TYPE_32BIT = 1,     // 500+ bits
-    LUT_TYPE_64BIT = 2,     // 5K+ bits
-    LUT_TYPE_128BIT = 3,    // 50K+ bits
-    LUT_TYPE_256BIT = 4,    // 250K+ bits
-    LUT_TYPE_512BIT = 5,    // 500K+ bits (cache line)
-    LUT_TYPE_1024BIT = 6,   // 2.5M+ bits
-    LUT_TYPE_2048BIT = 7,   // 10M+ bits
-    LUT_TYPE_4096BIT = 8,   // 50M+ bits
-    LUT_TYPE_8192BIT = 9    // 100M+ bits
-} lut_type_t;
-
-
-// Hash table entry for LUT management
-typedef struct lut_hash_entry {
-    size_t bit_count;           // Key: number of bits
-    lut_type_t lut_type;        // Value: which LUT to use
-    uint8_t* lut_data;          // Pointer to LUT data
-    size_t lut_size;            // Size of LUT data
-    struct lut_hash_entry* next; // For collision handling
-} lut_hash_entry_t;
-
-
-// Hash table for LUT selection
+  uint64_t src_mask;
+  uint64_t dst_mask;
+  // dst_mask is src_mask shifted left by this many places (right if
+  // negative), or BITPERM_SCATTER when no single shift maps one to the
+  // other.
+  int shift;
+} bitperm_step_t;
+
+// Work shared by the threads of a parallel search.  Threads claim chunks
+// of candidate positions from next_chunk in increasing order.
 typedef struct {
-    lut_hash_entry_t cache[LUT_ENTRY_CACHE_SIZE];
-    size_t cache_head;
-} lut_manager_t;
-
-
-// **************************** Global Variables ****************************
-
-// Global LUT manager instance
-static lut_manager_t* g_lut_manager = NULL;
-
-// ********************** Large Integer Bit Operations **********************
-
-// 64-bit LUT operations
-static inline uint64_t
-read_u64_bits(const uint8_t* const buf, const size_t num_bytes, const size_t bit_pos);
-static inline void
-write_u64_bits(uint8_t* const buf, const size_t num_bytes, const size_t bit_pos, const uint64_t value);
-// 128-bit LUT operations
-static inline uint128_t
-read_u128_bits(const uint8_t* const buf, const size_t num_bytes, const size_t bit_pos);
-static inline void
-write_u128_bits(uint8_t* const buf, const size_t num_bytes, const size_t bit_pos, const uint128_t value);
-static inline uint128_t
-reverse_u128_bits(uint128_t value);
-// 512-bit LUT operations
-static inline uint512_t
-read_u512_bits(const uint8_t* const buf, const size_t num_bytes, const size_t bit_pos);
-static inline void
-write_u512_bits(uint8_t* const buf, const size_t num_bytes, const size_t bit_pos, const uint512_t value);
-static inline uint512_t
-reverse_u512_bits(uint512_t value);
-
+  const bitarray_t* bitarray;
+  uint64_t pattern;
+  size_t pattern_len;
+  size_t begin;
+  size_t end;
+  bool first_only;
+  size_t next_chunk;
+  // Smallest match found so far (first_only) or total matches.
+  size_t result;
+} search_job_t;
+
+// Concrete data type representing a compiled word permutation.
+struct bitperm {
+  // Whether the word is bit-reversed before the steps are applied.
+  bool reverse_first;
+  // Shift steps come first, followed by the pext/pdep steps.
+  int num_steps;
+  bitperm_step_t steps[64];
+  // When not NULL, the permuted word is the OR of table[j][byte j of the
+  // source word] over all eight bytes, and the steps are not used.
+  uint64_t (*table)[256];
+};
 
 
 // ************************** Function Prototypes ***************************
 
-// Hash table management functions
-static lut_manager_t* lut_manager_init(void);
-static void lut_manager_destroy(lut_manager_t* manager);
-static lut_type_t lut_manager_get_type(lut_manager_t* manager, size_t bit_count);
-static size_t lut_manager_get_lut_size(lut_type_t type);
-static lut_hash_entry_t* lut_manager_find_entry(lut_manager_t* manager, size_t bit_count);
-static void lut_manager_add_entry(lut_manager_t* manager, size_t bit_count, lut_type_t type);
-
-// Huge integer bit operations
-static uint1024_t read_u1024_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos);
-static void write_u1024_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint1024_t value);
-static uint1024_t reverse_u1024_bits(uint1024_t value);
-static uint2048_t read_u2048_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos);
-static void write_u2048_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint2048_t value);
-static uint2048_t reverse_u2048_bits(uint2048_t value);
-static uint4096_t read_u4096_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos);
-static void write_u4096_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint4096_t value);
-static uint4096_t reverse_u4096_bits(uint4096_t value);
-static uint8192_t read_u8192_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos);
-static void write_u8192_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint8192_t value);
-static uint8192_t reverse_u8192_bits(uint8192_t value);
-
 // Rotates a subarray left by an arbitrary number of bits.
 //
 // bit_offset is the index of the start of the subarray
@@ -233,69 +212,153 @@ bitarray_rotate_left(bitarray_t* const bitarray,
 		     const size_t bit_length,
 		     const size_t bit_left_amount);
 
-// Reverse a bitarray in-place.
+// Reverses the subarray [bit_offset, bit_offset + bit_length) in place.
 //
-// Rev(A) = {A[n] A[n-1] ... A[0]}
-//
-// Swap bits starting from LSB and MSB moving inwards towards the
-// center of the array.
-static inline void
-bitarray_reverse_naive(bitarray_t* const bitarray,
-		       size_t start_idx,
-		       size_t end);
-
-// Block-wise reversal algorithm for very large arrays - uses 64-bit
-// chunks for better cache locality
-static inline void
-bitarray_reverse_block_wise(bitarray_t* const bitarray,
-			    const size_t start_idx,
-			    const size_t end_idx);
-
-// Reverse a subarray within a bitarray using adaptive LUT optimization
+// Works inwards from both ends a 64-bit word at a time: the word at the
+// front and the word at the back are loaded, bit-reversed and stored at
+// each other's position, so every byte is read and written exactly once.
+// Fewer than 128 bits are left in the middle, and they are reversed with
+// one or two partial-word loads.
+static void
+bitarray_reverse_words(bitarray_t* const bitarray,
+		       const size_t bit_offset,
+		       const size_t bit_length);
+
+// Same as bitarray_reverse_words for ranges spanning at least two aligned
+// words, but every word-aligned result is written with a non-temporal
+// store so that the range passes through the caches without evicting
+// anything.  Each aligned output word is the bit-reversal of an unaligned
+// source word from the other end; the source words it straddles are
+// carried from one step to the next because their memory has already been
+// overwritten.  The partial words at the two ends are saved first and
+// stored last.
+static void
+bitarray_reverse_stream(bitarray_t* const bitarray,
+			const size_t bit_offset,
+			const size_t bit_length);
+
+// Returns the 64 bits starting shift (0..63) bits into low, continuing
+// into high.
+static inline uint64_t funnel_word(const uint64_t low, const uint64_t high,
+                                   const unsigned shift);
+
+// Stores an aligned word, bypassing the caches where the target allows.
+static inline void stream_word(uint64_t* const p, const uint64_t value);
+
+// Reverses the order of the 64 bits of a word.
+static inline uint64_t reverse_word(uint64_t word);
+
+// Loads the 64 bits starting at bit_pos, which must all lie inside buf.
+// Touches exactly the bytes holding those bits.
+static inline uint64_t load_word(const uint8_t* const buf,
+                                 const size_t bit_pos);
+
+// Stores value into the 64 bits starting at bit_pos, leaving the
+// neighbouring bits of the first and last byte untouched.
+static inline void store_word(uint8_t* const buf,
+                              const size_t bit_pos,
+                              const uint64_t value);
+
+// Loads bit_count (1..64) bits starting at bit_pos into the low bits of
+// the result.
+static inline uint64_t load_bits(const uint8_t* const buf,
+                                 const size_t bit_pos,
+                                 const size_t bit_count);
+
+// Stores the low bit_count (1..64) bits of value starting at bit_pos.
+static inline void store_bits(uint8_t* const buf,
+                              const size_t bit_pos,
+                              const size_t bit_count,
+                              uint64_t value);
+
+// Parallel bit extract and deposit, with a bit-at-a-time fallback when the
+// compiler does not target BMI2.
+static inline uint64_t pext64(const uint64_t word, uint64_t mask);
+static inline uint64_t pdep64(const uint64_t word, uint64_t mask);
+
+// Splits the 64-entry destination sequence seq into as few increasing
+// runs as possible and stores each run as a step of perm.  Returns the
+// number of steps.
+static int bitperm_compile(bitperm_t* const perm, const uint8_t seq[64]);
+
+// Tests every candidate start in [begin, end) against the pattern, 64
+// candidates at a time.  For each window of 64 starts a match mask is
+// narrowed by one shifted copy of the data per pattern bit (shift-and),
+// and most windows are ruled out after a handful of pattern bits.
 //
-// start_idx Starting bit index of subarray to reverse
-// end_idx   Ending bit index of subarray to reverse (inclusive)
-// 
-// This function reverses a contiguous subarray of bits using an adaptive
-// strategy that selects the optimal LUT size based on array size. The
-// algorithm:
-// 1. For extremely large arrays (200M+ bits): delegates to block-wise reversal
-// 2. For smaller arrays: uses LUT manager to select optimal chunk size
-//    (8-bit to 8192-bit) based on total bit count
-// 3. Employs cache prefetching and optimized bit operations
-// 4. Falls back to naive bit-by-bit reversal if LUT manager fails
-// 
-// Performance: O(n) with adaptive optimization based on array size
-static inline void
-bitarray_reverse_lut(bitarray_t* const bitarray,
-		     const size_t start_idx,
-		     const size_t end_idx);
+// end must not exceed bit_sz - pattern_len + 1.  If first_only is true,
+// returns the first match or BITARRAY_NOT_FOUND; otherwise returns the
+// number of matches.
+static size_t bitarray_scan(const bitarray_t* const bitarray,
+                            const uint64_t pattern,
+                            const size_t pattern_len,
+                            const size_t begin,
+                            const size_t end,
+                            const bool first_only);
+
+// Runs a search_job_t on num_threads threads, including the caller.
+static size_t bitarray_search_parallel(search_job_t* const job,
+                                       const unsigned num_threads);
+
+// Thread body of bitarray_search_parallel.
+static void* search_worker(void* arg);
+
+// Marks the index blocks overlapping bits [bit_lo, bit_hi) as stale, and
+// every later block too if the edit may have changed the number of ones.
+// Does nothing if the array has no index.
+static inline void rank_index_invalidate(bitarray_t* const bitarray,
+                                         const size_t bit_lo,
+                                         const size_t bit_hi,
+                                         const bool count_changed);
+
+// Records that bit_index flipped, adding delta (+1 or -1) to the ones
+// before every later block.  Does nothing if the array has no index.
+static inline void rank_index_adjust(bitarray_t* const bitarray,
+                                     const size_t bit_index,
+                                     const int delta);
+
+// Sum of the recorded deltas for the ones before block b.
+static inline int64_t rank_index_delta(const rank_index_t* const index,
+                                       const size_t block);
+
+// Adds every recorded delta into counts and clears the Fenwick tree.
+static void rank_index_fold(rank_index_t* const index);
+
+// Saves the pages overlapping bits [bit_lo, bit_hi) that the snapshot has
+// not saved yet.  Called before every edit; does nothing if the array has
+// no snapshot.
+static inline void snapshot_preserve(bitarray_t* const bitarray,
+                                     const size_t bit_lo,
+                                     const size_t bit_hi);
+
+// Appends page to the undo log, or marks the snapshot lost if the log
+// cannot grow.
+static void snapshot_save_page(bitarray_t* const bitarray, const size_t page);
+
+// Recomputes the counts of the dirty blocks.
+static void rank_index_repair(const bitarray_t* const bitarray);
+
+// Recomputes the word counts of block b if a single-bit edit touched it.
+static inline void rank_index_refresh(const bitarray_t* const bitarray,
+                                      const size_t block);
+
+// Recomputes the select samples from the (current) counts.
+static void rank_index_sample(rank_index_t* const index);
+
+// Returns the index-th aligned word of the array with the bits past
+// bit_sz cleared.
+static inline uint64_t data_word(const bitarray_t* const bitarray,
+                                 const size_t index);
+
+// Returns the position of the rank-th (from zero) set bit of word.
+static inline unsigned select_in_word(uint64_t word, const unsigned rank);
+
+// Loads the index-th aligned 64-bit word of a num_bytes-byte buffer,
+// padding past the end of the buffer with zeros.
+static inline uint64_t load_aligned_word(const uint8_t* const buf,
+                                         const size_t num_bytes,
+                                         const size_t index);
 
-// Rotates a subarray left by one bit.
-//
-// bit_offset is the index of the start of the subarray
-// bit_length is the length of the subarray, in bits
-//g
-// The subarray spans the half-open interval
-// [bit_offset, bit_offset + bit_length)
-// That is, the start is inclusive, but the end is exclusive.
-
-// Portable modulo operation that supports negative dividends.
-//
-// Many programming languages define modulo in a manner incompatible with its
-// widely-accepted mathematical definition.
-// http://stackoverflow.com/questions/1907565/c-python-different-behaviour-of-the-modulo-operation
-// provides details; in particular, C's modulo
-// operator (which the standard calls a "remainder" operator) yields a result
-// signed identically to the dividend e.g., -1 % 10 yields -1.
-// This is obviously unacceptable for a function which returns size_t, so we
-// define our own.
-//
-// n is the dividend and m is the divisor
-//
-// Returns a positive integer r = n (mod m), in the range
-// 0 <= r < m.
-static size_t modulo(const ssize_t n, const size_t m);
 
 // Produces a mask which, when ANDed with a byte, retains only the
 // bit_index th byte.
@@ -311,157 +374,11 @@ static size_t modulo(const ssize_t n, const size_t m);
 static char bitmask(const size_t bit_index);
 
 
-//************************** Generic Bit Functions **************************
+// ******************************* Globals **********************************
 
-/* --------------------------------------------------------------------------
- * read_bits
- *
- * Generic function to read arbitrary number of bits from an arbitrary bit position.
- * Returns up to 64 bits in a uint64_t. For larger reads, caller can make multiple calls.
- *
- * buf: pointer to the underlying byte buffer
- * bit_pos: bit index at which to begin reading (0-based from LSB of byte 0)
- * bit_count: number of bits to read (1 to 64)
- *
- * Returns: uint64_t containing the read bits (LSB first)
- */
-static inline uint64_t
-read_bits(const uint8_t* buf, 
-          size_t bit_pos, 
-          size_t bit_count)
-{
-    // Limit to 64 bits for simplicity and performance
-    if (bit_count > 64) {
-        bit_count = 64;
-    }
-    
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    // Calculate how many bytes we need to read
-    const size_t bytes_needed = (bit_count + bit_offset + 7) >> 3;
-    
-    // Handle aligned reads efficiently
-    if (bit_offset == 0 && bit_count == 64 && bytes_needed >= 8) {
-        // Aligned 64-bit read
-        return *(const uint64_t*)(buf + byte_index);
-    }
-    
-    if (bit_offset == 0 && bit_count == 32 && bytes_needed >= 4) {
-        // Aligned 32-bit read
-        return *(const uint32_t*)(buf + byte_index);
-    }
-    
-    if (bit_offset == 0 && bit_count == 16 && bytes_needed >= 2) {
-        // Aligned 16-bit read
-        return *(const uint16_t*)(buf + byte_index);
-    }
-    
-    if (bit_offset == 0 && bit_count == 8 && bytes_needed >= 1) {
-        // Aligned 8-bit read
-        return buf[byte_index];
-    }
-    
-    // Unaligned read: combine bytes
-    uint64_t result = 0;
-    for (size_t i = 0; i < bytes_needed && i < 8; i++) {
-        result |= ((uint64_t)buf[byte_index + i]) << (i * 8);
-    }
-    
-    // Shift to remove leading bits if needed
-    if (bit_offset != 0) {
-        result >>= bit_offset;
-        // Add overflow bits from the next byte if needed
-        if (byte_index + bytes_needed < byte_index + 8) {
-            result |= ((uint64_t)buf[byte_index + bytes_needed]) << (64 - bit_offset);
-        }
-    }
-    
-    // Mask to the requested bit count
-    if (bit_count < 64) {
-        result &= ((1ULL << bit_count) - 1);
-    }
-    
-    return result;
-}
-
-/* --------------------------------------------------------------------------
- * write_bits
- *
- * Generic function to write arbitrary number of bits to an arbitrary bit position.
- * Can write any number of bits from a value buffer.
- *
- * buf: pointer to the underlying byte buffer
- * bit_pos: bit index at which to begin writing (0-based from LSB of byte 0)
- * bit_count: number of bits to write (1 to any number)
- * value: pointer to the data to write
- * value_bytes: size of the value data in bytes
- */
-static inline void
-write_bits(uint8_t* buf, 
-           size_t bit_pos, 
-           size_t bit_count,
-           const uint8_t* value,
-           size_t value_bytes)
-{
-    if (bit_count == 0 || value_bytes == 0) {
-        return;
-    }
-    
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    // Calculate how many bytes we need to write
-    const size_t bytes_needed = (bit_count + bit_offset + 7) >> 3;
-    
-    // Handle aligned writes efficiently
-    if (bit_offset == 0 && bit_count == 64 && bytes_needed >= 8 && value_bytes >= 8) {
-        // Aligned 64-bit write
-        *(uint64_t*)(buf + byte_index) = *(const uint64_t*)value;
-        return;
-    }
-    
-    if (bit_offset == 0 && bit_count == 32 && bytes_needed >= 4 && value_bytes >= 4) {
-        // Aligned 32-bit write
-        *(uint32_t*)(buf + byte_index) = *(const uint32_t*)value;
-        return;
-    }
-    
-    if (bit_offset == 0 && bit_count == 16 && bytes_needed >= 2 && value_bytes >= 2) {
-        // Aligned 16-bit write
-        *(uint16_t*)(buf + byte_index) = *(const uint16_t*)value;
-        return;
-    }
-    
-    if (bit_offset == 0 && bit_count == 8 && bytes_needed >= 1 && value_bytes >= 1) {
-        // Aligned 8-bit write
-        buf[byte_index] = value[0];
-        return;
-    }
-    
-    // Unaligned write: split into bytes
-    for (size_t i = 0; i < bytes_needed && i < value_bytes; i++) {
-        uint8_t byte_val = value[i];
-        
-        if (i == 0 && bit_offset != 0) {
-            // First byte needs special handling for bit alignment
-            const uint8_t first_mask = (uint8_t)(0xFFu << bit_offset);
-            const uint8_t part0 = (uint8_t)(byte_val << bit_offset);
-            buf[byte_index] = (uint8_t)((buf[byte_index] & (uint8_t)~first_mask) |
-                                      (part0 & first_mask));
-        } else {
-            buf[byte_index + i] = byte_val;
-        }
-    }
-    
-    // Handle overflow bits if needed
-    if (bit_offset != 0 && byte_index + bytes_needed < byte_index + value_bytes) {
-        uint8_t overflow = value[bytes_needed];
-        const uint8_t second_mask = (uint8_t)(0xFFu >> (8u - bit_offset));
-        buf[byte_index + bytes_needed] = (uint8_t)((buf[byte_index + bytes_needed] & (uint8_t)~second_mask) |
-                                                 (overflow & second_mask));
-    }
-}
+// Current bitarray_set_streaming settings.
+static size_t stream_threshold = SIZE_MAX;
+static size_t stream_prefetch = BITARRAY_STREAM_PREFETCH;
 
 
 // ******************************* Functions ********************************
@@ -487,6 +404,38 @@ bitarray_new(const size_t bit_sz)
 
   bitarray->buf = buf;
   bitarray->bit_sz = bit_sz;
+  bitarray->index = NULL;
+  bitarray->snapshot = NULL;
+  return bitarray;
+}
+/* --------------------------------------------------------------------------
+ * bitarray_new_aligned
+ */
+bitarray_t*
+bitarray_new_aligned(const size_t bit_sz, const size_t alignment)
+{
+  assert(alignment >= sizeof(void*) && (alignment & (alignment - 1)) == 0);
+
+  // Round the buffer up to whole alignment units, so that it can be filled
+  // or drained by transfers of that granularity.
+  const size_t buf_sz = ((bit_sz + 7) / 8 + alignment - 1) / alignment *
+                        alignment;
+  void* buf = NULL;
+  if (posix_memalign(&buf, alignment, buf_sz > 0 ? buf_sz : alignment) != 0) {
+    return NULL;
+  }
+  memset(buf, 0, buf_sz);
+
+  bitarray_t* const bitarray = malloc(sizeof(struct bitarray));
+  if (bitarray == NULL) {
+    free(buf);
+    return NULL;
+  }
+
+  bitarray->buf = buf;
+  bitarray->bit_sz = bit_sz;
+  bitarray->index = NULL;
+  bitarray->snapshot = NULL;
   return bitarray;
 }
 /* --------------------------------------------------------------------------
@@ -498,6 +447,8 @@ bitarray_free(bitarray_t* const bitarray)
   if (bitarray == NULL) {
     return;
   }
+  bitarray_index_free(bitarray);
+  bitarray_snapshot_free(bitarray);
   free(bitarray->buf);
   bitarray->buf = NULL;
   free(bitarray);
@@ -505,16 +456,21 @@ bitarray_free(bitarray_t* const bitarray)
 /* --------------------------------------------------------------------------
  * bitarray_cleanup_lut_manager
  *
- * Clean up the global LUT manager. Should be called at program termination
- * to free all hash table resources.
+ * Reversal no longer keeps any lookup tables, so there is nothing to free.
  */
 void
 bitarray_cleanup_lut_manager(void)
 {
-  if (g_lut_manager != NULL) {
-    lut_manager_destroy(g_lut_manager);
-    g_lut_manager = NULL;
-  }
+}
+/* --------------------------------------------------------------------------
+ * bitarray_set_streaming
+ */
+void
+bitarray_set_streaming(const size_t threshold_bits,
+		       const size_t prefetch_bytes)
+{
+  stream_threshold = threshold_bits;
+  stream_prefetch = prefetch_bytes;
 }
 /* --------------------------------------------------------------------------
  * bitarray_get_bit_sz
@@ -524,6 +480,14 @@ bitarray_get_bit_sz(const bitarray_t* const bitarray)
 {
   return bitarray->bit_sz;
 }
+/* --------------------------------------------------------------------------
+ * bitarray_get_buf
+ */
+void*
+bitarray_get_buf(const bitarray_t* const bitarray)
+{
+  return bitarray->buf;
+}
 /* --------------------------------------------------------------------------
  * bitarray_get
  */
@@ -553,6 +517,12 @@ bitarray_set(bitarray_t* const bitarray,
 {
   assert(bit_index < bitarray->bit_sz);
 
+  if ((bitarray->index != NULL || bitarray->snapshot != NULL) &&
+      bitarray_get(bitarray, bit_index) != value) {
+    snapshot_preserve(bitarray, bit_index, bit_index + 1);
+    rank_index_adjust(bitarray, bit_index, value ? 1 : -1);
+  }
+
   // We're storing bits in packed form, 8 per byte.  So to set the nth
   // bit, we want to set the (n mod 8)th bit of the (floor(n/8)th) byte.
   //
@@ -570,10 +540,15 @@ bitarray_set(bitarray_t* const bitarray,
 void
 bitarray_randfill(bitarray_t* const bitarray)
 {
-  int32_t *ptr = (int32_t *)bitarray->buf;
-  for (int64_t i=0; i<bitarray->bit_sz/32 + 1; i++){
-    ptr[i] = rand();
+  // Copy rand() output in 32-bit pieces, trimming the last piece so that
+  // nothing is written past the end of the buffer.
+  const size_t num_bytes = (bitarray->bit_sz + 7) / 8;
+  snapshot_preserve(bitarray, 0, bitarray->bit_sz);
+  for (size_t i = 0; i < num_bytes; i += 4) {
+    const int32_t r = rand();
+    memcpy(bitarray->buf + i, &r, num_bytes - i < 4 ? num_bytes - i : 4);
   }
+  rank_index_invalidate(bitarray, 0, bitarray->bit_sz, true);
 }
 /* --------------------------------------------------------------------------
  * bitarray_rotate
@@ -589,6 +564,8 @@ bitarray_rotate(bitarray_t* const bitarray,
   if (bit_length == 0) {
     return;
   }
+  snapshot_preserve(bitarray, bit_offset, bit_offset + bit_length);
+  rank_index_invalidate(bitarray, bit_offset, bit_offset + bit_length, false);
 
   // Convert a rotate left or right to a left rotate only, and eliminate
   // multiple full rotations.
@@ -608,1218 +585,1373 @@ bitarray_rotate_left(bitarray_t* const bitarray,
   size_t k = bit_left_amount % bit_length;
   if (k == 0) return;
   // BA = rev(rev(BA)) = rev(rev(A) rev(B))
-  bitarray_reverse_lut(bitarray, bit_offset,
-		       bit_offset + k - 1);
-  bitarray_reverse_lut(bitarray, bit_offset + k,
-		       bit_offset + bit_length - 1);
-  bitarray_reverse_lut(bitarray, bit_offset,
-		       bit_offset + bit_length - 1);
+  bitarray_reverse_words(bitarray, bit_offset, k);
+  bitarray_reverse_words(bitarray, bit_offset + k, bit_length - k);
+  bitarray_reverse_words(bitarray, bit_offset, bit_length);
 }
 /* --------------------------------------------------------------------------
- * bitarray_revers_naive
+ * bitarray_reverse
  */
-static inline void
-bitarray_reverse_naive(bitarray_t* const bitarray,
-		       size_t start_idx,
-		       size_t end_idx)
+void
+bitarray_reverse(bitarray_t* const bitarray,
+		 const size_t bit_offset,
+		 const size_t bit_length)
 {
-  /* Validate parameters */
-  if (bitarray == NULL || bitarray->buf == NULL || start_idx >= end_idx) {
-    return;
-  }
-  
-  bool temp;
-  while (start_idx < end_idx) {
-    temp = bitarray_get(bitarray, start_idx);
-    bitarray_set(bitarray, start_idx, bitarray_get(bitarray, end_idx));
-    bitarray_set(bitarray, end_idx, temp);
-    start_idx++;
-    end_idx--;
-  }
+  assert(bit_offset + bit_length <= bitarray->bit_sz);
+
+  snapshot_preserve(bitarray, bit_offset, bit_offset + bit_length);
+  rank_index_invalidate(bitarray, bit_offset, bit_offset + bit_length, false);
+  bitarray_reverse_words(bitarray, bit_offset, bit_length);
 }
 /* --------------------------------------------------------------------------
- * bitarray_reverse_block_wise
- *
- * Block-wise reversal algorithm for very large arrays. Uses 64-bit chunks
- * for better cache locality and memory access patterns compared to naive
- * bit-by-bit reversal. This is NOT the Block Swap rotation algorithm.
+ * bitarray_copy
  */
-static inline void
-bitarray_reverse_block_wise(bitarray_t* const bitarray,
-                           const size_t start_idx,
-                           const size_t end_idx)
+void
+bitarray_copy(bitarray_t* const dst,
+	      const size_t dst_offset,
+	      const bitarray_t* const src,
+	      const size_t src_offset,
+	      const size_t bit_length)
 {
-  if (bitarray == NULL || bitarray->buf == NULL || start_idx >= end_idx) {
+  assert(dst_offset + bit_length <= dst->bit_sz);
+  assert(src_offset + bit_length <= src->bit_sz);
+
+  if (bit_length == 0) {
     return;
   }
-  
-  uint8_t* buf = (uint8_t*)bitarray->buf;
-  const size_t total_bits = end_idx - start_idx + 1u;
-  
-  // For very large arrays, use 64-bit word operations for better performance
-  if (total_bits >= 64) {
-    size_t pos = start_idx;
-    size_t end_pos = end_idx;
-    
-    // Process 64-bit chunks from both ends with aggressive prefetching
-    while (pos + 63 < end_pos) {
-      // Prefetch next chunks for better cache performance
-      if (pos + 127 < end_pos) {
-        __builtin_prefetch(&buf[(pos + 64) >> 3], 0, 3);
-        __builtin_prefetch(&buf[(end_pos - 127) >> 3], 0, 3);
-      }
-      if (pos + 255 < end_pos) {
-        __builtin_prefetch(&buf[(pos + 128) >> 3], 0, 3);
-        __builtin_prefetch(&buf[(end_pos - 255) >> 3], 0, 3);
-      }
-      
-      // Read 64-bit chunks from both ends
-      uint64_t left_chunk = read_bits(buf, pos, 64);
-      uint64_t right_chunk = read_bits(buf, end_pos - 63, 64);
-      
-      // Reverse each chunk using LUT - optimized version
-      const uint8_t* lut = bit_reverse_table256;
-      uint64_t left_reversed = 0;
-      uint64_t right_reversed = 0;
-      
-      // Unrolled and optimized bit reversal
-      left_reversed = ((uint64_t)lut[left_chunk & 0xFF]) << 56;
-      left_chunk >>= 8;
-      left_reversed |= ((uint64_t)lut[left_chunk & 0xFF]) << 48;
-      left_chunk >>= 8;
-      left_reversed |= ((uint64_t)lut[left_chunk & 0xFF]) << 40;
-      left_chunk >>= 8;
-      left_reversed |= ((uint64_t)lut[left_chunk & 0xFF]) << 32;
-      left_chunk >>= 8;
-      left_reversed |= ((uint64_t)lut[left_chunk & 0xFF]) << 24;
-      left_chunk >>= 8;
-      left_reversed |= ((uint64_t)lut[left_chunk & 0xFF]) << 16;
-      left_chunk >>= 8;
-      left_reversed |= ((uint64_t)lut[left_chunk & 0xFF]) << 8;
-      left_chunk >>= 8;
-      left_reversed |= ((uint64_t)lut[left_chunk & 0xFF]);
-      
-      right_reversed = ((uint64_t)lut[right_chunk & 0xFF]) << 56;
-      right_chunk >>= 8;
-      right_reversed |= ((uint64_t)lut[right_chunk & 0xFF]) << 48;
-      right_chunk >>= 8;
-      right_reversed |= ((uint64_t)lut[right_chunk & 0xFF]) << 40;
-      right_chunk >>= 8;
-      right_reversed |= ((uint64_t)lut[right_chunk & 0xFF]) << 32;
-      right_chunk >>= 8;
-      right_reversed |= ((uint64_t)lut[right_chunk & 0xFF]) << 24;
-      right_chunk >>= 8;
-      right_reversed |= ((uint64_t)lut[right_chunk & 0xFF]) << 16;
-      right_chunk >>= 8;
-      right_reversed |= ((uint64_t)lut[right_chunk & 0xFF]) << 8;
-      right_chunk >>= 8;
-      right_reversed |= ((uint64_t)lut[right_chunk & 0xFF]);
-      
-      // Swap the reversed chunks
-      write_bits(buf, pos, 64, (const uint8_t*)&right_reversed, 8);
-      write_bits(buf, end_pos - 63, 64, (const uint8_t*)&left_reversed, 8);
-      
-      pos += 64;
-      end_pos -= 64;
+  snapshot_preserve(dst, dst_offset, dst_offset + bit_length);
+  rank_index_invalidate(dst, dst_offset, dst_offset + bit_length, true);
+
+  uint8_t* const to = (uint8_t*)dst->buf;
+  const uint8_t* const from = (const uint8_t*)src->buf;
+  const size_t num_words = bit_length / 64;
+  const size_t tail = bit_length % 64;
+
+  if (dst == src && dst_offset > src_offset &&
+      dst_offset < src_offset + bit_length) {
+    // Overlapping move to the right: go backwards so that no source word
+    // is overwritten before it is read.
+    if (tail != 0) {
+      store_bits(to, dst_offset + 64 * num_words, tail,
+                 load_bits(from, src_offset + 64 * num_words, tail));
     }
-    
-    // Handle remaining bits with naive approach
-    if (pos < end_pos) {
-      bitarray_reverse_naive(bitarray, pos, end_pos);
+    for (size_t i = num_words; i-- > 0;) {
+      store_word(to, dst_offset + 64 * i, load_word(from, src_offset + 64 * i));
+    }
+    return;
+  }
+
+  if (dst_offset % 8 == 0) {
+    // Whole-byte stores: every load reads bytes at or past those stored so
+    // far, even when moving left within one array.
+    uint8_t* const p = to + dst_offset / 8;
+    for (size_t i = 0; i < num_words; i++) {
+      const uint64_t word = WORD_TO_LE(load_word(from, src_offset + 64 * i));
+      memcpy(p + 8 * i, &word, sizeof(word));
     }
   } else {
-    // Fall back to naive for small arrays
-    bitarray_reverse_naive(bitarray, start_idx, end_idx);
+    for (size_t i = 0; i < num_words; i++) {
+      store_word(to, dst_offset + 64 * i, load_word(from, src_offset + 64 * i));
+    }
+  }
+  if (tail != 0) {
+    store_bits(to, dst_offset + 64 * num_words, tail,
+               load_bits(from, src_offset + 64 * num_words, tail));
   }
 }
 /* --------------------------------------------------------------------------
- * bitarray_reverse_lut
+ * bitarray_reverse_words
  */
-static inline void
-bitarray_reverse_lut(bitarray_t* const bitarray,
-                     const size_t start_idx,
-                     const size_t end_idx)
+static void
+bitarray_reverse_words(bitarray_t* const bitarray,
+		       const size_t bit_offset,
+		       const size_t bit_length)
 {
-  /* Validate parameters */
-  if (bitarray == NULL || bitarray->buf == NULL || start_idx >= end_idx) {
+  // The streaming kernel needs two aligned words to work on.
+  if (bit_length >= stream_threshold && bit_length >= 192) {
+    bitarray_reverse_stream(bitarray, bit_offset, bit_length);
     return;
   }
 
-  // Initialize LUT manager if not already done
-  if (g_lut_manager == NULL) {
-    g_lut_manager = lut_manager_init();
-    if (g_lut_manager == NULL) {
-      // Fallback to naive implementation if LUT manager fails
-      bitarray_reverse_naive(bitarray, start_idx, end_idx);
-      return;
-    }
+  uint8_t* const buf = (uint8_t*)bitarray->buf;
+  size_t lo = bit_offset;
+  size_t hi = bit_offset + bit_length;
+
+  // The two words never overlap, so both can be loaded before either is
+  // stored; a byte they share is merged bit by bit by store_word.
+  while (hi - lo >= 128) {
+    const uint64_t front = load_word(buf, lo);
+    const uint64_t back = load_word(buf, hi - 64);
+    store_word(buf, lo, reverse_word(back));
+    store_word(buf, hi - 64, reverse_word(front));
+    lo += 64;
+    hi -= 64;
   }
 
-  uint8_t* buf = (uint8_t*)bitarray->buf;
-  const size_t num_bytes = (bitarray->bit_sz + 7u) >> 3;
-  const size_t total_bits = end_idx - start_idx + 1u;
-
-  // For extremely large arrays, use block-wise reversal for better cache locality
-  if (total_bits >= (2 * ULTRA_LUT_THRESHOLD)) {
-    // Use block-wise reversal for extremely large arrays (200M+ bits)
-    bitarray_reverse_block_wise(bitarray, start_idx, end_idx);
+  const size_t m = hi - lo;
+  if (m == 0) {
     return;
   }
+  if (m <= 64) {
+    const uint64_t middle = load_bits(buf, lo, m);
+    store_bits(buf, lo, m, reverse_word(middle) >> (64 - m));
+  } else {
+    // rev(a b) = rev(b) rev(a), with |a| = 64 and |b| = m - 64.
+    const uint64_t a = load_word(buf, lo);
+    const uint64_t b = load_bits(buf, lo + 64, m - 64);
+    store_bits(buf, lo, m - 64, reverse_word(b) >> (128 - m));
+    store_word(buf, lo + (m - 64), reverse_word(a));
+  }
+}
+/* --------------------------------------------------------------------------
+ * bitarray_reverse_stream
+ *
+ * Let [first, end) be the aligned words inside the range.  Output word
+ * first + k comes from the source bits starting at 64 * (end - 1 - k) + d,
+ * and output word end - 1 - k from those starting at 64 * (first + k) + d,
+ * where d = tail_bits - head_bits lies strictly between -64 and 64.  So
+ * each output word straddles the source word at the same step and one
+ * neighbour: the next one inwards, which is still intact, or the previous
+ * one outwards, which this step just overwrote and the loop carries in
+ * prev.  Which neighbour depends only on the sign of d.
+ */
+static void
+bitarray_reverse_stream(bitarray_t* const bitarray,
+			const size_t bit_offset,
+			const size_t bit_length)
+{
+  uint8_t* const buf = (uint8_t*)bitarray->buf;
+  uint64_t* const words = (uint64_t*)bitarray->buf;
+  const size_t lo = bit_offset;
+  const size_t hi = bit_offset + bit_length;
+  const size_t first = (lo + 63) / 64;
+  const size_t end = hi / 64;
+  const size_t head_bits = 64 * first - lo;
+  const size_t tail_bits = hi - 64 * end;
+  assert(end - first >= 2);
+
+  // The head receives the last head_bits of the range, reversed, and the
+  // tail the first tail_bits.  Both may come from words the loop
+  // overwrites.
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  if (head_bits != 0) {
+    head = reverse_word(load_bits(buf, hi - head_bits, head_bits)) >>
+           (64 - head_bits);
+  }
+  if (tail_bits != 0) {
+    tail = reverse_word(load_bits(buf, lo, tail_bits)) >> (64 - tail_bits);
+  }
 
-  // Use hash table to determine optimal LUT strategy
-  lut_type_t lut_type = lut_manager_get_type(g_lut_manager, total_bits);
-  
-  switch (lut_type) {
-    case LUT_TYPE_512BIT: {
-      // 512-bit LUT strategy for huge arrays (cache line aligned) with prefetching
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 512) ? 512 : remaining;
-        
-        // Prefetch next cache line for large arrays
-        if (chunk_size == 512 && pos + 512 < end_idx) {
-          __builtin_prefetch(&buf[(pos + 512) >> 3], 0, 3);
-        }
-        
-        uint512_t chunk = read_u512_bits(buf, num_bytes, pos);
-        uint512_t reversed = reverse_u512_bits(chunk);
-        write_u512_bits(buf, num_bytes, pos, reversed);
-        
-        pos += chunk_size;
-      }
-      break;
-    }
-    case LUT_TYPE_256BIT: {
-      // 256-bit LUT strategy for very large arrays - use 64-bit chunks for efficiency
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 64) ? 64 : remaining;
-        
-        uint64_t chunk = read_bits(buf, pos, 64);
-        uint64_t reversed = 0;
-        
-        // Reverse each 8-bit chunk using the 8-bit LUT
-        reversed |= ((uint64_t)bit_reverse_table256[chunk & 0xFF]) << 56;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 8) & 0xFF]) << 48;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 16) & 0xFF]) << 40;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 24) & 0xFF]) << 32;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 32) & 0xFF]) << 24;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 40) & 0xFF]) << 16;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 48) & 0xFF]) << 8;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 56) & 0xFF]);
-        
-        write_bits(buf, pos, 64, (const uint8_t*)&reversed, 8);
-        pos += chunk_size;
+  const size_t ahead = stream_prefetch / 8;
+  // Whether outputs straddle the source word at the same step and the
+  // next one inwards (f, f + 1 and b, b + 1) or the previous one outwards
+  // (f - 1, f and b - 1, b), and by how many bits.
+  const bool inward = tail_bits >= head_bits;
+  const unsigned shift = inward ? tail_bits - head_bits :
+                         64 - (head_bits - tail_bits);
+  // The word outwards of the current step, already overwritten.  At the
+  // start it is the partial tail or head word; only its bits inside the
+  // range are ever used.
+  uint64_t prev;
+  if (inward) {
+    prev = tail_bits != 0 ? load_bits(buf, 64 * end, tail_bits) : 0;
+  } else {
+    prev = load_bits(buf, lo, head_bits) << (64 - head_bits);
+  }
+
+  // Reading a line with non-temporal stores still pending in its
+  // write-combining buffer flushes them one word at a time, so each side
+  // is loaded a block ahead of its stores rather than a word ahead.
+  size_t f = first;
+  size_t b = end - 1;
+  uint64_t front[STREAM_BLOCK_WORDS + 1];
+  uint64_t back[STREAM_BLOCK_WORDS + 1];
+  while (b - f > 2 * STREAM_BLOCK_WORDS) {
+    if (ahead != 0 && f + 2 * ahead + STREAM_BLOCK_WORDS < b) {
+      for (size_t i = 0; i < STREAM_BLOCK_WORDS; i += 8) {
+        __builtin_prefetch(&words[f + ahead + i], 0, 0);
+        __builtin_prefetch(&words[b - ahead - i], 0, 0);
       }
-      break;
     }
-    case LUT_TYPE_128BIT: {
-      // 128-bit LUT strategy for large arrays
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 128) ? 128 : remaining;
-        
-        uint128_t chunk = read_u128_bits(buf, num_bytes, pos);
-        uint128_t reversed = reverse_u128_bits(chunk);
-        write_u128_bits(buf, num_bytes, pos, reversed);
-        
-        pos += chunk_size;
-      }
-      break;
+    for (size_t i = 0; i <= STREAM_BLOCK_WORDS; i++) {
+      front[i] = WORD_FROM_LE(words[f + i]);
+      back[i] = WORD_FROM_LE(words[b - i]);
     }
-    case LUT_TYPE_64BIT: {
-      // 64-bit LUT strategy for medium arrays
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 64) ? 64 : remaining;
-        
-        uint64_t chunk = read_bits(buf, pos, 64);
-        uint64_t reversed = 0;
-        
-        // Reverse each 8-bit chunk using the 8-bit LUT
-        reversed |= ((uint64_t)bit_reverse_table256[chunk & 0xFF]) << 56;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 8) & 0xFF]) << 48;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 16) & 0xFF]) << 40;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 24) & 0xFF]) << 32;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 32) & 0xFF]) << 24;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 40) & 0xFF]) << 16;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 48) & 0xFF]) << 8;
-        reversed |= ((uint64_t)bit_reverse_table256[(chunk >> 56) & 0xFF]);
-        
-        write_bits(buf, pos, 64, (const uint8_t*)&reversed, 8);
-        pos += chunk_size;
+    if (inward) {
+      for (size_t i = 0; i < STREAM_BLOCK_WORDS; i++) {
+        const uint64_t high = i == 0 ? prev : back[i - 1];
+        stream_word(&words[f + i], reverse_word(funnel_word(back[i], high,
+                                                            shift)));
       }
-      break;
-    }
-    case LUT_TYPE_32BIT: {
-      // 32-bit LUT strategy for small arrays
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 32) ? 32 : remaining;
-        
-        uint32_t chunk = read_bits(buf, pos, 32);
-        uint32_t reversed = 0;
-        
-        // Reverse each 8-bit chunk using the 8-bit LUT
-        reversed |= bit_reverse_table256[chunk & 0xFF] << 24;
-        reversed |= bit_reverse_table256[(chunk >> 8) & 0xFF] << 16;
-        reversed |= bit_reverse_table256[(chunk >> 16) & 0xFF] << 8;
-        reversed |= bit_reverse_table256[(chunk >> 24) & 0xFF];
-        
-        write_bits(buf, pos, 32, (const uint8_t*)&reversed, 4);
-        pos += chunk_size;
+      for (size_t i = 0; i < STREAM_BLOCK_WORDS; i++) {
+        stream_word(&words[b - i], reverse_word(funnel_word(front[i],
+                                                            front[i + 1],
+                                                            shift)));
       }
-      break;
-    }
-    case LUT_TYPE_1024BIT: {
-      // 1024-bit LUT strategy for huge arrays
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 1024) ? 1024 : remaining;
-        
-        uint1024_t chunk = read_u1024_bits(buf, num_bytes, pos);
-        uint1024_t reversed = reverse_u1024_bits(chunk);
-        write_u1024_bits(buf, num_bytes, pos, reversed);
-        
-        pos += chunk_size;
+      prev = back[STREAM_BLOCK_WORDS - 1];
+    } else {
+      for (size_t i = 0; i < STREAM_BLOCK_WORDS; i++) {
+        stream_word(&words[f + i], reverse_word(funnel_word(back[i + 1],
+                                                            back[i], shift)));
       }
-      break;
-    }
-    case LUT_TYPE_2048BIT: {
-      // 2048-bit LUT strategy for massive arrays
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 2048) ? 2048 : remaining;
-        
-        uint2048_t chunk = read_u2048_bits(buf, num_bytes, pos);
-        uint2048_t reversed = reverse_u2048_bits(chunk);
-        write_u2048_bits(buf, num_bytes, pos, reversed);
-        
-        pos += chunk_size;
+      for (size_t i = 0; i < STREAM_BLOCK_WORDS; i++) {
+        const uint64_t low = i == 0 ? prev : front[i - 1];
+        stream_word(&words[b - i], reverse_word(funnel_word(low, front[i],
+                                                            shift)));
       }
-      break;
+      prev = front[STREAM_BLOCK_WORDS - 1];
     }
-    case LUT_TYPE_4096BIT: {
-      // 4096-bit LUT strategy for extreme arrays
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 4096) ? 4096 : remaining;
-        
-        uint4096_t chunk = read_u4096_bits(buf, num_bytes, pos);
-        uint4096_t reversed = reverse_u4096_bits(chunk);
-        write_u4096_bits(buf, num_bytes, pos, reversed);
-        
-        pos += chunk_size;
-      }
-      break;
+    f += STREAM_BLOCK_WORDS;
+    b -= STREAM_BLOCK_WORDS;
+  }
+
+  // Fewer than two blocks remain in the middle: finish a word at a time
+  // with ordinary stores.
+  for (; f < b; f++, b--) {
+    const uint64_t front_word = WORD_FROM_LE(words[f]);
+    const uint64_t back_word = WORD_FROM_LE(words[b]);
+    if (inward) {
+      const uint64_t next = WORD_FROM_LE(words[f + 1]);
+      words[f] = WORD_TO_LE(reverse_word(funnel_word(back_word, prev, shift)));
+      words[b] = WORD_TO_LE(reverse_word(funnel_word(front_word, next,
+                                                     shift)));
+      prev = back_word;
+    } else {
+      const uint64_t before = WORD_FROM_LE(words[b - 1]);
+      words[f] = WORD_TO_LE(reverse_word(funnel_word(before, back_word,
+                                                     shift)));
+      words[b] = WORD_TO_LE(reverse_word(funnel_word(prev, front_word,
+                                                     shift)));
+      prev = front_word;
     }
-    case LUT_TYPE_8192BIT: {
-      // 8192-bit LUT strategy for ultra arrays
-      size_t pos = start_idx;
-      while (pos < end_idx) {
-        size_t remaining = end_idx - pos + 1;
-        size_t chunk_size = (remaining >= 8192) ? 8192 : remaining;
-        
-        uint8192_t chunk = read_u8192_bits(buf, num_bytes, pos);
-        uint8192_t reversed = reverse_u8192_bits(chunk);
-        write_u8192_bits(buf, num_bytes, pos, reversed);
-        
-        pos += chunk_size;
-      }
-      break;
+  }
+  if (f == b) {
+    const uint64_t middle = WORD_FROM_LE(words[f]);
+    words[f] = WORD_TO_LE(reverse_word(inward ?
+                                       funnel_word(middle, prev, shift) :
+                                       funnel_word(prev, middle, shift)));
+  }
+
+  // Non-temporal stores are weakly ordered: drain them before the caller,
+  // or another thread it hands the array to, can observe the range.
+#ifdef __SSE2__
+  _mm_sfence();
+#endif
+
+  if (head_bits != 0) {
+    store_bits(buf, lo, head_bits, head);
+  }
+  if (tail_bits != 0) {
+    store_bits(buf, 64 * end, tail_bits, tail);
+  }
+}
+/* --------------------------------------------------------------------------
+ * bitperm_new
+ */
+bitperm_t*
+bitperm_new(const uint8_t dest[64])
+{
+  // Reject anything that is not a permutation of 0..63.
+  uint64_t seen = 0;
+  for (int i = 0; i < 64; i++) {
+    if (dest[i] >= 64 || (seen >> dest[i]) & 1) {
+      return NULL;
     }
-    case LUT_TYPE_8BIT:
-    default: {
-      // Fall back to naive bit-by-bit for very small arrays
-      size_t lo = start_idx;
-      size_t hi = end_idx;
-      
-      while (lo < hi) {
-        // Read bits
-        bool left_bit = bitarray_get(bitarray, lo);
-        bool right_bit = bitarray_get(bitarray, hi);
-        
-        // Swap bits
-        bitarray_set(bitarray, lo, right_bit);
-        bitarray_set(bitarray, hi, left_bit);
-        
-        lo++;
-        hi--;
+    seen |= (uint64_t)1 << dest[i];
+  }
+
+  bitperm_t* const perm = malloc(sizeof(struct bitperm));
+  if (perm == NULL) {
+    return NULL;
+  }
+
+  // A permutation that mostly reverses the word (the FFT bit-reversal
+  // shuffle, say) splits into many runs as given but very few once the
+  // word has been reversed, so compile both ways and keep the cheaper.
+  uint8_t reversed[64];
+  for (int i = 0; i < 64; i++) {
+    reversed[i] = dest[63 - i];
+  }
+  bitperm_t alt;
+  alt.reverse_first = true;
+  const int alt_steps = bitperm_compile(&alt, reversed);
+
+  perm->reverse_first = false;
+  const int steps = bitperm_compile(perm, dest);
+  if (alt_steps + 1 < steps) {
+    *perm = alt;
+  }
+
+  perm->table = NULL;
+  int num_scatter = 0;
+  for (int i = 0; i < perm->num_steps; i++) {
+    num_scatter += perm->steps[i].shift == BITPERM_SCATTER;
+  }
+  if (num_scatter > BITPERM_MAX_SCATTER_STEPS) {
+    perm->table = malloc(8 * sizeof(*perm->table));
+    if (perm->table == NULL) {
+      free(perm);
+      return NULL;
+    }
+    for (int j = 0; j < 8; j++) {
+      for (int byte = 0; byte < 256; byte++) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; b++) {
+          if ((byte >> b) & 1) {
+            word |= (uint64_t)1 << dest[8 * j + b];
+          }
+        }
+        perm->table[j][byte] = word;
       }
-      break;
     }
   }
+  return perm;
 }
 /* --------------------------------------------------------------------------
- * read_u64_bits
+ * bitperm_free
  */
-static inline uint64_t
-read_u64_bits(const uint8_t* const buf,
-              const size_t num_bytes,
-              const size_t bit_pos)
+void
+bitperm_free(bitperm_t* const perm)
 {
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    if (bit_offset == 0 && byte_index + 8u <= num_bytes) {
-        // Aligned 64-bit read
-        return *(const uint64_t*)(buf + byte_index);
-    }
-    
-    // Unaligned read: combine up to 9 bytes
+  if (perm == NULL) {
+    return;
+  }
+  free(perm->table);
+  free(perm);
+}
+/* --------------------------------------------------------------------------
+ * bitperm_apply
+ */
+uint64_t
+bitperm_apply(const bitperm_t* const perm, uint64_t word)
+{
+  if (perm->table != NULL) {
     uint64_t result = 0;
-    for (int i = 0; i < 8; i++) {
-        if (byte_index + i < num_bytes) {
-            result |= ((uint64_t)buf[byte_index + i]) << (i * 8);
-        }
-    }
-    
-    if (bit_offset != 0) {
-        result >>= bit_offset;
-        if (byte_index + 8 < num_bytes) {
-            result |= ((uint64_t)buf[byte_index + 8]) << (64 - bit_offset);
-        }
+    for (int j = 0; j < 8; j++) {
+      result |= perm->table[j][(word >> (8 * j)) & 0xFF];
     }
-    
     return result;
+  }
+
+  if (perm->reverse_first) {
+    word = reverse_word(word);
+  }
+
+  uint64_t result = 0;
+  for (int i = 0; i < perm->num_steps; i++) {
+    const bitperm_step_t* const step = &perm->steps[i];
+    if (step->shift == BITPERM_SCATTER) {
+      result |= pdep64(pext64(word, step->src_mask), step->dst_mask);
+    } else if (step->shift >= 0) {
+      result |= (word & step->src_mask) << step->shift;
+    } else {
+      result |= (word & step->src_mask) >> -step->shift;
+    }
+  }
+  return result;
+}
+/* --------------------------------------------------------------------------
+ * bitarray_permute
+ */
+void
+bitarray_permute(bitarray_t* const bitarray,
+		 const size_t bit_offset,
+		 const size_t bit_length,
+		 const bitperm_t* const perm)
+{
+  assert(bit_offset + bit_length <= bitarray->bit_sz);
+  assert(bit_length % 64 == 0);
+
+  snapshot_preserve(bitarray, bit_offset, bit_offset + bit_length);
+  rank_index_invalidate(bitarray, bit_offset, bit_offset + bit_length, false);
+
+  uint8_t* const buf = (uint8_t*)bitarray->buf;
+  uint8_t* const p = buf + bit_offset / 8;
+  const unsigned shift = bit_offset % 8;
+  const size_t num_words = bit_length / 64;
+
+  // Results are written as whole byte-aligned words, each one carrying the
+  // top bits of the previous result.  Going through store_word instead
+  // would make every load overlap the single-byte store just before it,
+  // which store forwarding cannot serve.
+  uint64_t carry = p[0] & ((1u << shift) - 1);
+  for (size_t i = 0; i < num_words; i++) {
+    const uint64_t value =
+      bitperm_apply(perm, load_word(buf, bit_offset + 64 * i));
+    uint64_t word = WORD_TO_LE((value << shift) | carry);
+    memcpy(p + 8 * i, &word, sizeof(word));
+    carry = shift == 0 ? 0 : value >> (64 - shift);
+  }
+  if (shift != 0 && num_words > 0) {
+    p[8 * num_words] =
+      (p[8 * num_words] & (uint8_t)(0xFF << shift)) | (uint8_t)carry;
+  }
 }
+/* --------------------------------------------------------------------------
+ * bitarray_find
+ */
+size_t
+bitarray_find(const bitarray_t* const bitarray,
+	      const uint64_t pattern,
+	      const size_t pattern_len,
+	      const size_t start)
+{
+  assert(pattern_len >= 1 && pattern_len <= 64);
 
+  if (pattern_len > bitarray->bit_sz ||
+      start > bitarray->bit_sz - pattern_len) {
+    return BITARRAY_NOT_FOUND;
+  }
+  return bitarray_scan(bitarray, pattern, pattern_len, start,
+                       bitarray->bit_sz - pattern_len + 1, true);
+}
 /* --------------------------------------------------------------------------
- * write_u64_bits
+ * bitarray_count
  */
-static inline void
-write_u64_bits(uint8_t* const buf,
-               const size_t num_bytes,
-               const size_t bit_pos,
-               const uint64_t value)
+size_t
+bitarray_count(const bitarray_t* const bitarray,
+	       const uint64_t pattern,
+	       const size_t pattern_len)
 {
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    if (bit_offset == 0 && byte_index + 8u <= num_bytes) {
-        // Aligned 64-bit write
-        *(uint64_t*)(buf + byte_index) = value;
-        return;
-    }
-    
-    // Unaligned write: split into bytes
-    for (int i = 0; i < 8; i++) {
-        if (byte_index + i < num_bytes) {
-            uint8_t byte_val = (uint8_t)(value >> (i * 8));
-            if (i == 0 && bit_offset != 0) {
-                // First byte needs special handling
-                const uint8_t first_mask = (uint8_t)(0xFFu << bit_offset);
-                const uint8_t part0 = (uint8_t)(byte_val << bit_offset);
-                buf[byte_index] = (uint8_t)((buf[byte_index] & (uint8_t)~first_mask) |
-                                          (part0 & first_mask));
-            } else {
-                buf[byte_index + i] = byte_val;
-            }
-        }
-    }
-    
-    if (bit_offset != 0 && byte_index + 8 < num_bytes) {
-        // Handle overflow bits
-        uint8_t overflow = (uint8_t)(value >> (64 - bit_offset));
-        const uint8_t second_mask = (uint8_t)(0xFFu >> (8u - bit_offset));
-        buf[byte_index + 8] = (uint8_t)((buf[byte_index + 8] & (uint8_t)~second_mask) |
-                                       (overflow & second_mask));
-    }
+  assert(pattern_len >= 1 && pattern_len <= 64);
+
+  if (pattern_len > bitarray->bit_sz) {
+    return 0;
+  }
+  return bitarray_scan(bitarray, pattern, pattern_len, 0,
+                       bitarray->bit_sz - pattern_len + 1, false);
 }
 /* --------------------------------------------------------------------------
- * read_u128_bits
+ * bitarray_find_parallel
  */
-static inline uint128_t
-read_u128_bits(const uint8_t* const buf,
-               const size_t num_bytes,
-               const size_t bit_pos)
+size_t
+bitarray_find_parallel(const bitarray_t* const bitarray,
+		       const uint64_t pattern,
+		       const size_t pattern_len,
+		       const size_t start,
+		       const unsigned num_threads)
 {
-    uint128_t result = {0, 0};
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    if (bit_offset == 0 && byte_index + 16u <= num_bytes) {
-        // Aligned 128-bit read
-        result.low = *(const uint64_t*)(buf + byte_index);
-        result.high = *(const uint64_t*)(buf + byte_index + 8);
-        return result;
-    }
-    
-    // Unaligned read: combine up to 17 bytes
-    for (int i = 0; i < 16; i++) {
-        if (byte_index + i < num_bytes) {
-            if (i < 8) {
-                result.low |= ((uint64_t)buf[byte_index + i]) << (i * 8);
-            } else {
-                result.high |= ((uint64_t)buf[byte_index + i]) << ((i - 8) * 8);
-            }
-        }
-    }
-    
-    if (bit_offset != 0) {
-        // Shift right by bit_offset
-        uint64_t carry = result.low & ((1ULL << bit_offset) - 1);
-        result.low >>= bit_offset;
-        result.high >>= bit_offset;
-        result.high |= (carry << (64 - bit_offset));
-        
-        // Handle overflow from 17th byte
-        if (byte_index + 16 < num_bytes) {
-            uint64_t overflow = ((uint64_t)buf[byte_index + 16]) << (64 - bit_offset);
-            result.high |= overflow;
-        }
-    }
-    
-    return result;
+  assert(pattern_len >= 1 && pattern_len <= 64);
+
+  if (pattern_len > bitarray->bit_sz ||
+      start > bitarray->bit_sz - pattern_len) {
+    return BITARRAY_NOT_FOUND;
+  }
+  search_job_t job = {
+    .bitarray = bitarray,
+    .pattern = pattern,
+    .pattern_len = pattern_len,
+    .begin = start,
+    .end = bitarray->bit_sz - pattern_len + 1,
+    .first_only = true,
+    .result = BITARRAY_NOT_FOUND,
+  };
+  return bitarray_search_parallel(&job, num_threads);
 }
 /* --------------------------------------------------------------------------
- * write_u128_bits
+ * bitarray_count_parallel
  */
-static inline void
-write_u128_bits(uint8_t* const buf,
-                const size_t num_bytes,
-                const size_t bit_pos,
-                const uint128_t value)
+size_t
+bitarray_count_parallel(const bitarray_t* const bitarray,
+			const uint64_t pattern,
+			const size_t pattern_len,
+			const unsigned num_threads)
 {
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    if (bit_offset == 0 && byte_index + 16u <= num_bytes) {
-        // Aligned 128-bit write
-        *(uint64_t*)(buf + byte_index) = value.low;
-        *(uint64_t*)(buf + byte_index + 8) = value.high;
-        return;
-    }
-    
-    // Unaligned write: split into bytes
-    for (int i = 0; i < 16; i++) {
-        if (byte_index + i < num_bytes) {
-            uint8_t byte_val;
-            if (i < 8) {
-                byte_val = (uint8_t)(value.low >> (i * 8));
-            } else {
-                byte_val = (uint8_t)(value.high >> ((i - 8) * 8));
-            }
-            
-            if (i == 0 && bit_offset != 0) {
-                // First byte needs special handling
-                const uint8_t first_mask = (uint8_t)(0xFFu << bit_offset);
-                const uint8_t part0 = (uint8_t)(byte_val << bit_offset);
-                buf[byte_index] = (uint8_t)((buf[byte_index] & (uint8_t)~first_mask) |
-                                          (part0 & first_mask));
-            } else {
-                buf[byte_index + i] = byte_val;
-            }
-        }
-    }
-    
-    if (bit_offset != 0 && byte_index + 16 < num_bytes) {
-        // Handle overflow bits
-        uint8_t overflow = (uint8_t)(value.high >> (64 - bit_offset));
-        const uint8_t second_mask = (uint8_t)(0xFFu >> (8u - bit_offset));
-        buf[byte_index + 16] = (uint8_t)((buf[byte_index + 16] & (uint8_t)~second_mask) |
-                                       (overflow & second_mask));
+  assert(pattern_len >= 1 && pattern_len <= 64);
+
+  if (pattern_len > bitarray->bit_sz) {
+    return 0;
+  }
+  search_job_t job = {
+    .bitarray = bitarray,
+    .pattern = pattern,
+    .pattern_len = pattern_len,
+    .begin = 0,
+    .end = bitarray->bit_sz - pattern_len + 1,
+    .first_only = false,
+    .result = 0,
+  };
+  return bitarray_search_parallel(&job, num_threads);
+}
+/* --------------------------------------------------------------------------
+ * bitarray_index_build
+ */
+bool
+bitarray_index_build(bitarray_t* const bitarray)
+{
+  if (bitarray->index != NULL) {
+    return true;
+  }
+
+  rank_index_t* const index = malloc(sizeof(rank_index_t));
+  if (index == NULL) {
+    return false;
+  }
+  index->num_blocks = (bitarray->bit_sz + RANK_BLOCK_BITS - 1) /
+                      RANK_BLOCK_BITS;
+  index->counts = calloc(2 * (index->num_blocks + 1), sizeof(uint64_t));
+  index->deltas = calloc(index->num_blocks + 1, sizeof(int64_t));
+  index->touched = calloc(index->num_blocks / 64 + 1, sizeof(uint64_t));
+  if (index->counts == NULL || index->deltas == NULL ||
+      index->touched == NULL) {
+    free(index->counts);
+    free(index->deltas);
+    free(index->touched);
+    free(index);
+    return false;
+  }
+  index->num_deltas = 0;
+  index->samples = NULL;
+  index->num_samples = 0;
+  index->sample_slack = 0;
+  index->dirty_lo = 0;
+  index->dirty_hi = index->num_blocks == 0 ? 0 : index->num_blocks - 1;
+  index->samples_stale = true;
+
+  bitarray->index = index;
+  rank_index_repair(bitarray);
+  return true;
+}
+/* --------------------------------------------------------------------------
+ * bitarray_index_free
+ */
+void
+bitarray_index_free(bitarray_t* const bitarray)
+{
+  rank_index_t* const index = bitarray->index;
+  if (index == NULL) {
+    return;
+  }
+  free(index->counts);
+  free(index->deltas);
+  free(index->touched);
+  free(index->samples);
+  free(index);
+  bitarray->index = NULL;
+}
+/* --------------------------------------------------------------------------
+ * bitarray_snapshot
+ */
+bool
+bitarray_snapshot(bitarray_t* const bitarray)
+{
+  snapshot_t* snapshot = bitarray->snapshot;
+  if (snapshot == NULL) {
+    snapshot = malloc(sizeof(snapshot_t));
+    if (snapshot == NULL) {
+      return false;
+    }
+    snapshot->num_pages = ((bitarray->bit_sz + 7) / 8 +
+                           SNAPSHOT_PAGE_BYTES - 1) / SNAPSHOT_PAGE_BYTES;
+    snapshot->slot = calloc(snapshot->num_pages + 1, sizeof(size_t));
+    if (snapshot->slot == NULL) {
+      free(snapshot);
+      return false;
+    }
+    snapshot->saved = NULL;
+    snapshot->saved_page = NULL;
+    snapshot->num_saved = 0;
+    snapshot->capacity = 0;
+    snapshot->lost = false;
+    bitarray->snapshot = snapshot;
+    return true;
+  }
+
+  // Start a new log, keeping its storage.  Only the saved pages have a
+  // slot to clear.
+  for (size_t k = 0; k < snapshot->num_saved; k++) {
+    snapshot->slot[snapshot->saved_page[k]] = 0;
+  }
+  snapshot->num_saved = 0;
+  snapshot->lost = false;
+  return true;
+}
+/* --------------------------------------------------------------------------
+ * bitarray_restore
+ *
+ * The saved pages are left in the log: they match the array again, so
+ * the next edit to them need not save them a second time.
+ */
+bool
+bitarray_restore(bitarray_t* const bitarray)
+{
+  snapshot_t* const snapshot = bitarray->snapshot;
+  if (snapshot == NULL || snapshot->lost) {
+    return false;
+  }
+
+  const size_t num_bytes = (bitarray->bit_sz + 7) / 8;
+  for (size_t k = 0; k < snapshot->num_saved; k++) {
+    const size_t begin = snapshot->saved_page[k] * SNAPSHOT_PAGE_BYTES;
+    const size_t bytes = num_bytes - begin < SNAPSHOT_PAGE_BYTES ?
+                         num_bytes - begin : SNAPSHOT_PAGE_BYTES;
+    memcpy(bitarray->buf + begin, snapshot->saved + k * SNAPSHOT_PAGE_BYTES,
+           bytes);
+    const size_t bit_hi = 8 * (begin + bytes) < bitarray->bit_sz ?
+                          8 * (begin + bytes) : bitarray->bit_sz;
+    rank_index_invalidate(bitarray, 8 * begin, bit_hi, true);
+  }
+  return true;
+}
+/* --------------------------------------------------------------------------
+ * bitarray_snapshot_free
+ */
+void
+bitarray_snapshot_free(bitarray_t* const bitarray)
+{
+  snapshot_t* const snapshot = bitarray->snapshot;
+  if (snapshot == NULL) {
+    return;
+  }
+  free(snapshot->slot);
+  free(snapshot->saved);
+  free(snapshot->saved_page);
+  free(snapshot);
+  bitarray->snapshot = NULL;
+}
+/* --------------------------------------------------------------------------
+ * bitarray_rank
+ */
+size_t
+bitarray_rank(const bitarray_t* const bitarray, const size_t bit_index)
+{
+  assert(bit_index <= bitarray->bit_sz);
+
+  const size_t word = bit_index / 64;
+  const uint64_t partial = bit_index % 64 == 0 ? 0 :
+    data_word(bitarray, word) & ((uint64_t)-1 >> (64 - bit_index % 64));
+  rank_index_t* const index = bitarray->index;
+
+  if (index == NULL) {
+    size_t rank = __builtin_popcountll(partial);
+    for (size_t i = 0; i < word; i++) {
+      rank += __builtin_popcountll(data_word(bitarray, i));
     }
+    return rank;
+  }
+
+  const size_t block = word / 8;
+  if (index->dirty_lo <= index->dirty_hi && index->dirty_lo <= block) {
+    rank_index_repair(bitarray);
+  }
+  rank_index_refresh(bitarray, block);
+  const unsigned w = word % 8;
+  const uint64_t relative = w == 0 ? 0 :
+    (index->counts[2 * block + 1] >> (9 * (w - 1))) & 0x1FF;
+  return index->counts[2 * block] + rank_index_delta(index, block) +
+         relative + __builtin_popcountll(partial);
 }
 /* --------------------------------------------------------------------------
- * read_u512_bits
+ * bitarray_select
  */
-static inline uint512_t
-read_u512_bits(const uint8_t* const buf,
-               const size_t num_bytes,
-               const size_t bit_pos)
+size_t
+bitarray_select(const bitarray_t* const bitarray, const size_t rank)
 {
-    uint512_t result = {0, 0, 0, 0, 0, 0, 0, 0};
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    if (bit_offset == 0 && byte_index + 64u <= num_bytes) {
-        // Aligned 512-bit read (cache line aligned)
-        result.chunk0 = *(const uint64_t*)(buf + byte_index);
-        result.chunk1 = *(const uint64_t*)(buf + byte_index + 8);
-        result.chunk2 = *(const uint64_t*)(buf + byte_index + 16);
-        result.chunk3 = *(const uint64_t*)(buf + byte_index + 24);
-        result.chunk4 = *(const uint64_t*)(buf + byte_index + 32);
-        result.chunk5 = *(const uint64_t*)(buf + byte_index + 40);
-        result.chunk6 = *(const uint64_t*)(buf + byte_index + 48);
-        result.chunk7 = *(const uint64_t*)(buf + byte_index + 56);
-        return result;
+  const size_t num_words = (bitarray->bit_sz + 63) / 64;
+  rank_index_t* const index = bitarray->index;
+
+  if (index == NULL) {
+    size_t remaining = rank;
+    for (size_t i = 0; i < num_words; i++) {
+      const uint64_t word = data_word(bitarray, i);
+      const size_t ones = __builtin_popcountll(word);
+      if (remaining < ones) {
+        return 64 * i + select_in_word(word, remaining);
+      }
+      remaining -= ones;
     }
-    
-    // Unaligned read: combine up to 65 bytes
-    for (int i = 0; i < 64; i++) {
-        if (byte_index + i < num_bytes) {
-            uint64_t byte_val = (uint64_t)buf[byte_index + i];
-            if (i < 8) {
-                result.chunk0 |= byte_val << (i * 8);
-            } else if (i < 16) {
-                result.chunk1 |= byte_val << ((i - 8) * 8);
-            } else if (i < 24) {
-                result.chunk2 |= byte_val << ((i - 16) * 8);
-            } else if (i < 32) {
-                result.chunk3 |= byte_val << ((i - 24) * 8);
-            } else if (i < 40) {
-                result.chunk4 |= byte_val << ((i - 32) * 8);
-            } else if (i < 48) {
-                result.chunk5 |= byte_val << ((i - 40) * 8);
-            } else if (i < 56) {
-                result.chunk6 |= byte_val << ((i - 48) * 8);
-            } else {
-                result.chunk7 |= byte_val << ((i - 56) * 8);
-            }
-        }
+    return BITARRAY_NOT_FOUND;
+  }
+
+  if (index->dirty_lo <= index->dirty_hi) {
+    rank_index_repair(bitarray);
+  }
+  if (rank >= index->counts[2 * index->num_blocks] +
+              rank_index_delta(index, index->num_blocks)) {
+    return BITARRAY_NOT_FOUND;
+  }
+  if (index->samples_stale) {
+    rank_index_fold(index);
+    rank_index_sample(index);
+  }
+
+  // The block holding the answer is the last one with at most rank ones
+  // before it.  It lies between the samples of rank - sample_slack and
+  // rank + sample_slack, since no one has been renumbered by more than
+  // that.  (Should there have been no memory for the samples, all blocks
+  // are searched.)
+  size_t lo = 0;
+  size_t hi = index->num_blocks - 1;
+  if (!index->samples_stale) {
+    const size_t slack = index->sample_slack;
+    const size_t s_lo = rank < slack ? 0 :
+                        (rank - slack) / SELECT_SAMPLE_RATE;
+    const size_t s_hi = (rank + slack) / SELECT_SAMPLE_RATE + 1;
+    if (s_lo < index->num_samples) {
+      lo = index->samples[s_lo];
+    }
+    if (s_hi < index->num_samples) {
+      hi = index->samples[s_hi];
     }
-    
-    if (bit_offset != 0) {
-        // Shift right by bit_offset across all chunks
-        uint64_t carry = result.chunk0 & ((1ULL << bit_offset) - 1);
-        result.chunk0 >>= bit_offset;
-        result.chunk1 >>= bit_offset;
-        result.chunk2 >>= bit_offset;
-        result.chunk3 >>= bit_offset;
-        result.chunk4 >>= bit_offset;
-        result.chunk5 >>= bit_offset;
-        result.chunk6 >>= bit_offset;
-        result.chunk7 >>= bit_offset;
-        
-        // Propagate carries across all chunks
-        result.chunk1 |= (carry << (64 - bit_offset));
-        carry = result.chunk1 & ((1ULL << bit_offset) - 1);
-        result.chunk1 &= ~((1ULL << bit_offset) - 1);
-        
-        result.chunk2 |= (carry << (64 - bit_offset));
-        carry = result.chunk2 & ((1ULL << bit_offset) - 1);
-        result.chunk2 &= ~((1ULL << bit_offset) - 1);
-        
-        result.chunk3 |= (carry << (64 - bit_offset));
-        carry = result.chunk3 & ((1ULL << bit_offset) - 1);
-        result.chunk3 &= ~((1ULL << bit_offset) - 1);
-        
-        result.chunk4 |= (carry << (64 - bit_offset));
-        carry = result.chunk4 & ((1ULL << bit_offset) - 1);
-        result.chunk4 &= ~((1ULL << bit_offset) - 1);
-        
-        result.chunk5 |= (carry << (64 - bit_offset));
-        carry = result.chunk5 & ((1ULL << bit_offset) - 1);
-        result.chunk5 &= ~((1ULL << bit_offset) - 1);
-        
-        result.chunk6 |= (carry << (64 - bit_offset));
-        carry = result.chunk6 & ((1ULL << bit_offset) - 1);
-        result.chunk6 &= ~((1ULL << bit_offset) - 1);
-        
-        result.chunk7 |= (carry << (64 - bit_offset));
-        
-        // Handle overflow from 65th byte
-        if (byte_index + 64 < num_bytes) {
-            uint64_t overflow = ((uint64_t)buf[byte_index + 64]) << (64 - bit_offset);
-            result.chunk7 |= overflow;
-        }
+  }
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo + 1) / 2;
+    if (index->counts[2 * mid] + rank_index_delta(index, mid) <= rank) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
     }
-    
-    return result;
-}
+  }
 
+  rank_index_refresh(bitarray, lo);
+  size_t remaining = rank - index->counts[2 * lo] -
+                     rank_index_delta(index, lo);
+  const uint64_t relative = index->counts[2 * lo + 1];
+  unsigned w = 7;
+  while (w > 0 && ((relative >> (9 * (w - 1))) & 0x1FF) > remaining) {
+    w--;
+  }
+  if (w > 0) {
+    remaining -= (relative >> (9 * (w - 1))) & 0x1FF;
+  }
+  const size_t word = 8 * lo + w;
+  return 64 * word + select_in_word(data_word(bitarray, word), remaining);
+}
 /* --------------------------------------------------------------------------
- * write_u512_bits
+ * bitperm_compile
+ *
+ * The bits of an increasing run keep their order, so one pext/pdep pair
+ * moves the whole run.  Placing each element on the run whose last value
+ * is the largest one below it uses the fewest runs (one per element of the
+ * longest decreasing subsequence).  Runs that turn out to be a plain shift
+ * are merged by shift amount, as shifting is cheaper than pext/pdep
+ * everywhere and much cheaper than the fallback.
  */
-static inline void
-write_u512_bits(uint8_t* const buf,
-                const size_t num_bytes,
-                const size_t bit_pos,
-                const uint512_t value)
+static int
+bitperm_compile(bitperm_t* const perm, const uint8_t seq[64])
 {
-    const size_t byte_index = bit_pos >> 3;
-    const uint8_t bit_offset = (uint8_t)(bit_pos & 7u);
-    
-    if (bit_offset == 0 && byte_index + 64u <= num_bytes) {
-        // Aligned 512-bit write (cache line aligned)
-        *(uint64_t*)(buf + byte_index) = value.chunk0;
-        *(uint64_t*)(buf + byte_index + 8) = value.chunk1;
-        *(uint64_t*)(buf + byte_index + 16) = value.chunk2;
-        *(uint64_t*)(buf + byte_index + 24) = value.chunk3;
-        *(uint64_t*)(buf + byte_index + 32) = value.chunk4;
-        *(uint64_t*)(buf + byte_index + 40) = value.chunk5;
-        *(uint64_t*)(buf + byte_index + 48) = value.chunk6;
-        *(uint64_t*)(buf + byte_index + 56) = value.chunk7;
-        return;
+  uint64_t src[64];
+  uint64_t dst[64];
+  int last[64];
+  int runs = 0;
+
+  for (int i = 0; i < 64; i++) {
+    int best = -1;
+    for (int r = 0; r < runs; r++) {
+      if (last[r] < seq[i] && (best < 0 || last[r] > last[best])) {
+        best = r;
+      }
     }
-    
-    // Unaligned write: split into bytes
-    for (int i = 0; i < 64; i++) {
-        if (byte_index + i < num_bytes) {
-            uint8_t byte_val;
-            if (i < 8) {
-                byte_val = (uint8_t)(value.chunk0 >> (i * 8));
-            } else if (i < 16) {
-                byte_val = (uint8_t)(value.chunk1 >> ((i - 8) * 8));
-            } else if (i < 24) {
-                byte_val = (uint8_t)(value.chunk2 >> ((i - 16) * 8));
-            } else if (i < 32) {
-                byte_val = (uint8_t)(value.chunk3 >> ((i - 24) * 8));
-            } else if (i < 40) {
-                byte_val = (uint8_t)(value.chunk4 >> ((i - 32) * 8));
-            } else if (i < 48) {
-                byte_val = (uint8_t)(value.chunk5 >> ((i - 40) * 8));
-            } else if (i < 56) {
-                byte_val = (uint8_t)(value.chunk6 >> ((i - 48) * 8));
-            } else {
-                byte_val = (uint8_t)(value.chunk7 >> ((i - 56) * 8));
-            }
-            
-            if (i == 0 && bit_offset != 0) {
-                // First byte needs special handling
-                const uint8_t first_mask = (uint8_t)(0xFFu << bit_offset);
-                const uint8_t part0 = (uint8_t)(byte_val << bit_offset);
-                buf[byte_index] = (uint8_t)((buf[byte_index] & (uint8_t)~first_mask) |
-                                          (part0 & first_mask));
-            } else {
-                buf[byte_index + i] = byte_val;
-            }
-        }
+    if (best < 0) {
+      best = runs++;
+      src[best] = 0;
+      dst[best] = 0;
     }
-    
-    if (bit_offset != 0 && byte_index + 64 < num_bytes) {
-        // Handle overflow bits
-        uint8_t overflow = (uint8_t)(value.chunk7 >> (64 - bit_offset));
-        const uint8_t second_mask = (uint8_t)(0xFFu >> (8u - bit_offset));
-        buf[byte_index + 64] = (uint8_t)((buf[byte_index + 64] & (uint8_t)~second_mask) |
-                                       (overflow & second_mask));
+    src[best] |= (uint64_t)1 << i;
+    dst[best] |= (uint64_t)1 << seq[i];
+    last[best] = seq[i];
+  }
+
+  // shifted[s + 63] collects the source bits of every run that is a shift
+  // left by s.
+  uint64_t shifted[127] = {0};
+  int num_steps = 0;
+  for (int r = 0; r < runs; r++) {
+    const int s = __builtin_ctzll(dst[r]) - __builtin_ctzll(src[r]);
+    const uint64_t moved = s >= 0 ? src[r] << s : src[r] >> -s;
+    if (moved == dst[r]) {
+      shifted[s + 63] |= src[r];
+    } else {
+      perm->steps[num_steps].src_mask = src[r];
+      perm->steps[num_steps].dst_mask = dst[r];
+      perm->steps[num_steps].shift = BITPERM_SCATTER;
+      num_steps++;
+    }
+  }
+
+  // Move the pext/pdep steps behind the shift steps.
+  const int num_scatter = num_steps;
+  memmove(&perm->steps[64 - num_scatter], &perm->steps[0],
+          num_scatter * sizeof(bitperm_step_t));
+  num_steps = 0;
+  for (int s = -63; s <= 63; s++) {
+    if (shifted[s + 63] != 0) {
+      perm->steps[num_steps].src_mask = shifted[s + 63];
+      perm->steps[num_steps].dst_mask =
+        s >= 0 ? shifted[s + 63] << s : shifted[s + 63] >> -s;
+      perm->steps[num_steps].shift = s;
+      num_steps++;
     }
+  }
+  memmove(&perm->steps[num_steps], &perm->steps[64 - num_scatter],
+          num_scatter * sizeof(bitperm_step_t));
+  perm->num_steps = num_steps + num_scatter;
+  return perm->num_steps;
 }
 /* --------------------------------------------------------------------------
- * reverse_u128_bits
+ * funnel_word
  */
-static inline uint128_t
-reverse_u128_bits(uint128_t value)
+static inline uint64_t
+funnel_word(const uint64_t low, const uint64_t high, const unsigned shift)
 {
-    uint128_t result = {0, 0};
-    
-    // Reverse each 8-bit chunk using the 8-bit LUT
-    result.low |= ((uint64_t)bit_reverse_table256[value.low & 0xFF]) << 56;
-    result.low |= ((uint64_t)bit_reverse_table256[(value.low >> 8) & 0xFF]) << 48;
-    result.low |= ((uint64_t)bit_reverse_table256[(value.low >> 16) & 0xFF]) << 40;
-    result.low |= ((uint64_t)bit_reverse_table256[(value.low >> 24) & 0xFF]) << 32;
-    result.low |= ((uint64_t)bit_reverse_table256[(value.low >> 32) & 0xFF]) << 24;
-    result.low |= ((uint64_t)bit_reverse_table256[(value.low >> 40) & 0xFF]) << 16;
-    result.low |= ((uint64_t)bit_reverse_table256[(value.low >> 48) & 0xFF]) << 8;
-    result.low |= ((uint64_t)bit_reverse_table256[(value.low >> 56) & 0xFF]);
-    
-    result.high |= ((uint64_t)bit_reverse_table256[value.high & 0xFF]) << 56;
-    result.high |= ((uint64_t)bit_reverse_table256[(value.high >> 8) & 0xFF]) << 48;
-    result.high |= ((uint64_t)bit_reverse_table256[(value.high >> 16) & 0xFF]) << 40;
-    result.high |= ((uint64_t)bit_reverse_table256[(value.high >> 24) & 0xFF]) << 32;
-    result.high |= ((uint64_t)bit_reverse_table256[(value.high >> 32) & 0xFF]) << 24;
-    result.high |= ((uint64_t)bit_reverse_table256[(value.high >> 40) & 0xFF]) << 16;
-    result.high |= ((uint64_t)bit_reverse_table256[(value.high >> 48) & 0xFF]) << 8;
-    result.high |= ((uint64_t)bit_reverse_table256[(value.high >> 56) & 0xFF]);
-    
-    return result;
+  return shift == 0 ? low : (low >> shift) | (high << (64 - shift));
 }
 /* --------------------------------------------------------------------------
- * reverse_u512_bits
+ * stream_word
  */
-static inline uint512_t
-reverse_u512_bits(uint512_t value)
+static inline void
+stream_word(uint64_t* const p, const uint64_t value)
 {
-    uint512_t result = {0, 0, 0, 0, 0, 0, 0, 0};
-    
-    // Reverse each 8-bit chunk using the 8-bit LUT
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[value.chunk0 & 0xFF]) << 56;
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[(value.chunk0 >> 8) & 0xFF]) << 48;
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[(value.chunk0 >> 16) & 0xFF]) << 40;
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[(value.chunk0 >> 24) & 0xFF]) << 32;
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[(value.chunk0 >> 32) & 0xFF]) << 24;
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[(value.chunk0 >> 40) & 0xFF]) << 16;
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[(value.chunk0 >> 48) & 0xFF]) << 8;
-    result.chunk0 |= ((uint64_t)bit_reverse_table256[(value.chunk0 >> 56) & 0xFF]);
-    
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[value.chunk1 & 0xFF]) << 56;
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[(value.chunk1 >> 8) & 0xFF]) << 48;
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[(value.chunk1 >> 16) & 0xFF]) << 40;
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[(value.chunk1 >> 24) & 0xFF]) << 32;
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[(value.chunk1 >> 32) & 0xFF]) << 24;
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[(value.chunk1 >> 40) & 0xFF]) << 16;
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[(value.chunk1 >> 48) & 0xFF]) << 8;
-    result.chunk1 |= ((uint64_t)bit_reverse_table256[(value.chunk1 >> 56) & 0xFF]);
-    
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[value.chunk2 & 0xFF]) << 56;
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[(value.chunk2 >> 8) & 0xFF]) << 48;
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[(value.chunk2 >> 16) & 0xFF]) << 40;
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[(value.chunk2 >> 24) & 0xFF]) << 32;
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[(value.chunk2 >> 32) & 0xFF]) << 24;
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[(value.chunk2 >> 40) & 0xFF]) << 16;
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[(value.chunk2 >> 48) & 0xFF]) << 8;
-    result.chunk2 |= ((uint64_t)bit_reverse_table256[(value.chunk2 >> 56) & 0xFF]);
-    
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[value.chunk3 & 0xFF]) << 56;
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[(value.chunk3 >> 8) & 0xFF]) << 48;
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[(value.chunk3 >> 16) & 0xFF]) << 40;
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[(value.chunk3 >> 24) & 0xFF]) << 32;
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[(value.chunk3 >> 32) & 0xFF]) << 24;
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[(value.chunk3 >> 40) & 0xFF]) << 16;
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[(value.chunk3 >> 48) & 0xFF]) << 8;
-    result.chunk3 |= ((uint64_t)bit_reverse_table256[(value.chunk3 >> 56) & 0xFF]);
-    
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[value.chunk4 & 0xFF]) << 56;
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[(value.chunk4 >> 8) & 0xFF]) << 48;
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[(value.chunk4 >> 16) & 0xFF]) << 40;
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[(value.chunk4 >> 24) & 0xFF]) << 32;
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[(value.chunk4 >> 32) & 0xFF]) << 24;
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[(value.chunk4 >> 40) & 0xFF]) << 16;
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[(value.chunk4 >> 48) & 0xFF]) << 8;
-    result.chunk4 |= ((uint64_t)bit_reverse_table256[(value.chunk4 >> 56) & 0xFF]);
-    
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[value.chunk5 & 0xFF]) << 56;
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[(value.chunk5 >> 8) & 0xFF]) << 48;
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[(value.chunk5 >> 16) & 0xFF]) << 40;
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[(value.chunk5 >> 24) & 0xFF]) << 32;
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[(value.chunk5 >> 32) & 0xFF]) << 24;
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[(value.chunk5 >> 40) & 0xFF]) << 16;
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[(value.chunk5 >> 48) & 0xFF]) << 8;
-    result.chunk5 |= ((uint64_t)bit_reverse_table256[(value.chunk5 >> 56) & 0xFF]);
-    
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[value.chunk6 & 0xFF]) << 56;
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[(value.chunk6 >> 8) & 0xFF]) << 48;
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[(value.chunk6 >> 16) & 0xFF]) << 40;
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[(value.chunk6 >> 24) & 0xFF]) << 32;
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[(value.chunk6 >> 32) & 0xFF]) << 24;
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[(value.chunk6 >> 40) & 0xFF]) << 16;
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[(value.chunk6 >> 48) & 0xFF]) << 8;
-    result.chunk6 |= ((uint64_t)bit_reverse_table256[(value.chunk6 >> 56) & 0xFF]);
-    
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[value.chunk7 & 0xFF]) << 56;
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[(value.chunk7 >> 8) & 0xFF]) << 48;
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[(value.chunk7 >> 16) & 0xFF]) << 40;
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[(value.chunk7 >> 24) & 0xFF]) << 32;
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[(value.chunk7 >> 32) & 0xFF]) << 24;
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[(value.chunk7 >> 40) & 0xFF]) << 16;
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[(value.chunk7 >> 48) & 0xFF]) << 8;
-    result.chunk7 |= ((uint64_t)bit_reverse_table256[(value.chunk7 >> 56) & 0xFF]);
-    
-    // Reverse the order of chunks for proper bit reversal
-    uint512_t temp = result;
-    result.chunk0 = temp.chunk7;
-    result.chunk1 = temp.chunk6;
-    result.chunk2 = temp.chunk5;
-    result.chunk3 = temp.chunk4;
-    result.chunk4 = temp.chunk3;
-    result.chunk5 = temp.chunk2;
-    result.chunk6 = temp.chunk1;
-    result.chunk7 = temp.chunk0;
-    
-    return result;
+#if defined(__SSE2__) && defined(__x86_64__)
+  _mm_stream_si64((long long*)p, (long long)WORD_TO_LE(value));
+#else
+  *p = WORD_TO_LE(value);
+#endif
 }
 /* --------------------------------------------------------------------------
- * modulo
+ * reverse_word
  */
-static size_t
-modulo(const ssize_t n, const size_t m)
+static inline uint64_t
+reverse_word(uint64_t word)
 {
-  const ssize_t signed_m = (ssize_t)m;
-  assert(signed_m > 0);
-  const ssize_t result = ((n % signed_m) + signed_m) % signed_m;
-  assert(result >= 0);
-  return (size_t)result;
+  word = __builtin_bswap64(word);
+  word = ((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) |
+         ((word & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  word = ((word >> 2) & 0x3333333333333333ULL) |
+         ((word & 0x3333333333333333ULL) << 2);
+  word = ((word >> 1) & 0x5555555555555555ULL) |
+         ((word & 0x5555555555555555ULL) << 1);
+  return word;
 }
 /* --------------------------------------------------------------------------
- * bitmask
+ * load_word
  */
-static char
-bitmask(const size_t bit_index)
+static inline uint64_t
+load_word(const uint8_t* const buf, const size_t bit_pos)
 {
-  return 1 << (bit_index % 8);
+  const uint8_t* const p = buf + bit_pos / 8;
+  const unsigned shift = bit_pos % 8;
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  word = WORD_FROM_LE(word);
+  if (shift != 0) {
+    word = (word >> shift) | ((uint64_t)p[8] << (64 - shift));
+  }
+  return word;
 }
 /* --------------------------------------------------------------------------
- * lut_manager_init
- *
- * Initialize the LUT manager with cache-based LUT selection.
- * Pre-populates the cache with threshold-based LUT type mappings.
+ * store_word
  */
-static lut_manager_t*
-lut_manager_init(void)
+static inline void
+store_word(uint8_t* const buf, const size_t bit_pos, const uint64_t value)
 {
-    lut_manager_t* manager = calloc(1, sizeof(lut_manager_t));
-    if (manager == NULL) {
-        return NULL;
-    }
-    
-    // Initialize cache head
-    manager->cache_head = 0;
-    
-    // Pre-populate cache with threshold mappings
-    lut_manager_add_entry(manager, TINY_LUT_THRESHOLD, LUT_TYPE_32BIT);
-    lut_manager_add_entry(manager, SMALL_LUT_THRESHOLD, LUT_TYPE_64BIT);
-    lut_manager_add_entry(manager, MEDIUM_LUT_THRESHOLD, LUT_TYPE_128BIT);
-    lut_manager_add_entry(manager, LARGE_LUT_THRESHOLD, LUT_TYPE_256BIT);
-    lut_manager_add_entry(manager, CACHE_LINE_LUT_THRESHOLD, LUT_TYPE_512BIT);
-    lut_manager_add_entry(manager, HUGE_LUT_THRESHOLD, LUT_TYPE_1024BIT);
-    lut_manager_add_entry(manager, MASSIVE_LUT_THRESHOLD, LUT_TYPE_2048BIT);
-    lut_manager_add_entry(manager, EXTREME_LUT_THRESHOLD, LUT_TYPE_4096BIT);
-    lut_manager_add_entry(manager, ULTRA_LUT_THRESHOLD, LUT_TYPE_8192BIT);
-    
-    return manager;
+  uint8_t* const p = buf + bit_pos / 8;
+  const unsigned shift = bit_pos % 8;
+  uint64_t word;
+  if (shift == 0) {
+    word = WORD_TO_LE(value);
+    memcpy(p, &word, sizeof(word));
+    return;
+  }
+  memcpy(&word, p, sizeof(word));
+  word = WORD_FROM_LE(word);
+  word = (word & (((uint64_t)1 << shift) - 1)) | (value << shift);
+  word = WORD_TO_LE(word);
+  memcpy(p, &word, sizeof(word));
+  p[8] = (p[8] & (uint8_t)(0xFF << shift)) | (uint8_t)(value >> (64 - shift));
 }
 /* --------------------------------------------------------------------------
- * lut_manager_destroy
- *
- * Clean up the LUT manager and free all allocated memory.
+ * load_bits
  */
-static void
-lut_manager_destroy(lut_manager_t* manager)
+static inline uint64_t
+load_bits(const uint8_t* const buf, const size_t bit_pos,
+          const size_t bit_count)
 {
-    if (manager == NULL) {
-        return;
-    }
-    
-    // No dynamic allocations to free in cache-based approach
-    free(manager);
+  const uint8_t* p = buf + bit_pos / 8;
+  unsigned shift = bit_pos % 8;
+  uint64_t value = 0;
+  size_t done = 0;
+  while (done < bit_count) {
+    value |= (uint64_t)(*p++ >> shift) << done;
+    done += 8 - shift;
+    shift = 0;
+  }
+  return bit_count == 64 ? value : value & (((uint64_t)1 << bit_count) - 1);
 }
 /* --------------------------------------------------------------------------
- * lut_manager_add_entry
- *
- * Add a new entry to the cache for bit count to LUT type mapping.
+ * store_bits
  */
-static void
-lut_manager_add_entry(lut_manager_t* manager, size_t bit_count, lut_type_t type)
+static inline void
+store_bits(uint8_t* const buf, const size_t bit_pos, const size_t bit_count,
+           uint64_t value)
 {
-    if (manager->cache_head >= LUT_ENTRY_CACHE_SIZE) {
-        return; // Cache full
-    }
-    
-    // Add to cache
-    lut_hash_entry_t* entry = &manager->cache[manager->cache_head];
-    entry->bit_count = bit_count;
-    entry->lut_type = type;
-    entry->lut_data = NULL; // Will be set when needed
-    entry->lut_size = lut_manager_get_lut_size(type);
-    entry->next = NULL;
-    
-    manager->cache_head++;
+  uint8_t* p = buf + bit_pos / 8;
+  unsigned shift = bit_pos % 8;
+  size_t remaining = bit_count;
+  while (remaining > 0) {
+    const unsigned take = remaining < 8 - shift ? remaining : 8 - shift;
+    const uint8_t mask = (uint8_t)(((1u << take) - 1) << shift);
+    *p = (*p & ~mask) | ((uint8_t)(value << shift) & mask);
+    value >>= take;
+    remaining -= take;
+    shift = 0;
+    p++;
+  }
 }
 /* --------------------------------------------------------------------------
- * lut_manager_find_entry
- *
- * Find the appropriate LUT entry for a given bit count.
- * Returns the entry with the highest threshold <= bit_count.
+ * pext64
  */
-static lut_hash_entry_t*
-lut_manager_find_entry(lut_manager_t* manager, size_t bit_count)
+static inline uint64_t
+pext64(const uint64_t word, uint64_t mask)
 {
-    lut_hash_entry_t* best_entry = NULL;
-    size_t best_threshold = 0;
-    
-    // Search cache for the best match
-    for (size_t i = 0; i < manager->cache_head; i++) {
-        lut_hash_entry_t* entry = &manager->cache[i];
-        if (entry->bit_count <= bit_count && entry->bit_count > best_threshold) {
-            best_entry = entry;
-            best_threshold = entry->bit_count;
-        }
-    }
-    
-    // If no threshold found, use 8-bit LUT as fallback
-    if (best_entry == NULL) {
-        // Create a fallback entry for 8-bit LUT
-        static lut_hash_entry_t fallback = {0, LUT_TYPE_8BIT, NULL, 0, NULL};
-        return &fallback;
-    }
-    
-    return best_entry;
+#ifdef __BMI2__
+  return _pext_u64(word, mask);
+#else
+  uint64_t result = 0;
+  for (uint64_t bit = 1; mask != 0; bit <<= 1) {
+    if (word & mask & -mask) {
+      result |= bit;
+    }
+    mask &= mask - 1;
+  }
+  return result;
+#endif
 }
 /* --------------------------------------------------------------------------
- * lut_manager_get_type
- *
- * Get the appropriate LUT type for a given bit count using hash table lookup.
+ * pdep64
  */
-static lut_type_t
-lut_manager_get_type(lut_manager_t* manager, size_t bit_count)
+static inline uint64_t
+pdep64(const uint64_t word, uint64_t mask)
 {
-    if (manager == NULL) {
-        return LUT_TYPE_8BIT; // Fallback
-    }
-    
-    lut_hash_entry_t* entry = lut_manager_find_entry(manager, bit_count);
-    return entry->lut_type;
+#ifdef __BMI2__
+  return _pdep_u64(word, mask);
+#else
+  uint64_t result = 0;
+  for (uint64_t bit = 1; mask != 0; bit <<= 1) {
+    if (word & bit) {
+      result |= mask & -mask;
+    }
+    mask &= mask - 1;
+  }
+  return result;
+#endif
 }
 /* --------------------------------------------------------------------------
- * lut_manager_get_lut_size
- *
- * Get the size of LUT data for a given LUT type.
+ * bitarray_scan
  */
 static size_t
-lut_manager_get_lut_size(lut_type_t type)
+bitarray_scan(const bitarray_t* const bitarray,
+	      const uint64_t pattern,
+	      const size_t pattern_len,
+	      const size_t begin,
+	      const size_t end,
+	      const bool first_only)
 {
-    switch (type) {
-        case LUT_TYPE_8BIT:    return 256 * sizeof(uint8_t);
-        case LUT_TYPE_32BIT:   return 256 * sizeof(uint32_t);
-        case LUT_TYPE_64BIT:   return 256 * sizeof(uint64_t);
-        case LUT_TYPE_128BIT:  return 256 * sizeof(uint128_t);
-        case LUT_TYPE_256BIT:  return 256 * sizeof(uint256_t);
-        case LUT_TYPE_512BIT:  return 256 * sizeof(uint512_t);
-        case LUT_TYPE_1024BIT: return 256 * sizeof(uint1024_t);
-        case LUT_TYPE_2048BIT: return 256 * sizeof(uint2048_t);
-        case LUT_TYPE_4096BIT: return 256 * sizeof(uint4096_t);
-        case LUT_TYPE_8192BIT: return 256 * sizeof(uint8192_t);
-        default:               return 256 * sizeof(uint8_t);
+  const uint8_t* const buf = (const uint8_t*)bitarray->buf;
+  const size_t num_bytes = (bitarray->bit_sz + 7) / 8;
+  size_t count = 0;
+
+  size_t index = begin / 64;
+  uint64_t hi = load_aligned_word(buf, num_bytes, index);
+  for (size_t pos = index * 64; pos < end; pos += 64) {
+    // Bit j of the window at shift k is data bit pos + j + k, so bit j of
+    // matches survives only if the pattern occurs at pos + j.
+    const uint64_t lo = hi;
+    hi = load_aligned_word(buf, num_bytes, ++index);
+
+    uint64_t matches = ~(uint64_t)0;
+    if (pos < begin) {
+      matches <<= begin - pos;
+    }
+    if (end - pos < 64) {
+      matches &= ((uint64_t)1 << (end - pos)) - 1;
+    }
+    matches &= ~(lo ^ -(pattern & 1));
+    // Random data rules out a window after about eight pattern bits, so
+    // those are tested without the early exit, which would mispredict.
+    const size_t head = pattern_len < 8 ? pattern_len : 8;
+    for (size_t k = 1; k < head; k++) {
+      const uint64_t window = (lo >> k) | (hi << (64 - k));
+      matches &= ~(window ^ -((pattern >> k) & 1));
+    }
+    for (size_t k = head; k < pattern_len && matches != 0; k++) {
+      const uint64_t window = (lo >> k) | (hi << (64 - k));
+      matches &= ~(window ^ -((pattern >> k) & 1));
+    }
+
+    if (matches != 0) {
+      if (first_only) {
+        return pos + __builtin_ctzll(matches);
+      }
+      count += __builtin_popcountll(matches);
     }
+  }
+  return first_only ? BITARRAY_NOT_FOUND : count;
 }
 /* --------------------------------------------------------------------------
- * read_u1024_bits
- *
- * Read 1024 bits starting at an arbitrary bit position.
- * Returns a uint1024_t structure with the bits.
+ * bitarray_search_parallel
  */
-static uint1024_t
-read_u1024_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos)
+static size_t
+bitarray_search_parallel(search_job_t* const job, const unsigned num_threads)
 {
-    uint1024_t result = {0};
-    
-    for (size_t i = 0; i < 16; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            result.chunk[i] = read_u64_bits(buf, num_bytes, chunk_bit_pos);
-        }
+  assert(num_threads >= 1);
+
+  job->next_chunk = 0;
+  pthread_t* const threads = malloc(num_threads * sizeof(pthread_t));
+  unsigned spawned = 0;
+  if (threads != NULL) {
+    while (spawned + 1 < num_threads &&
+           pthread_create(&threads[spawned], NULL, search_worker, job) == 0) {
+      spawned++;
     }
-    
-    return result;
+  }
+
+  // The caller works too, so the search completes even if no thread could
+  // be started.
+  search_worker(job);
+  for (unsigned i = 0; i < spawned; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  return job->result;
 }
 /* --------------------------------------------------------------------------
- * write_u1024_bits
- *
- * Write 1024 bits starting at an arbitrary bit position.
+ * search_worker
  */
-static void
-write_u1024_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint1024_t value)
+static void*
+search_worker(void* arg)
 {
-    for (size_t i = 0; i < 16; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            write_u64_bits(buf, num_bytes, chunk_bit_pos, value.chunk[i]);
-        }
+  search_job_t* const job = arg;
+  const size_t span = job->end - job->begin;
+  size_t count = 0;
+
+  for (;;) {
+    const size_t chunk = __atomic_fetch_add(&job->next_chunk, 1,
+                                            __ATOMIC_RELAXED);
+    if (chunk >= (span + SEARCH_CHUNK_BITS - 1) / SEARCH_CHUNK_BITS) {
+      break;
     }
+    const size_t lo = job->begin + chunk * SEARCH_CHUNK_BITS;
+    const size_t hi = span - chunk * SEARCH_CHUNK_BITS > SEARCH_CHUNK_BITS ?
+                      lo + SEARCH_CHUNK_BITS : job->end;
+
+    if (!job->first_only) {
+      count += bitarray_scan(job->bitarray, job->pattern, job->pattern_len,
+                             lo, hi, false);
+      continue;
+    }
+
+    // Chunks are claimed in order, so once a match precedes this chunk
+    // every later chunk is useless too.
+    size_t best = __atomic_load_n(&job->result, __ATOMIC_RELAXED);
+    if (best < lo) {
+      break;
+    }
+    const size_t found = bitarray_scan(job->bitarray, job->pattern,
+                                       job->pattern_len, lo, hi, true);
+    while (found < best &&
+           !__atomic_compare_exchange_n(&job->result, &best, found, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+  }
+
+  if (!job->first_only) {
+    __atomic_fetch_add(&job->result, count, __ATOMIC_RELAXED);
+  }
+  return NULL;
 }
 /* --------------------------------------------------------------------------
- * reverse_u1024_bits
- *
- * Reverse the bits in a 1024-bit value using the LUT.
+ * rank_index_invalidate
  */
-static uint1024_t
-reverse_u1024_bits(uint1024_t value)
+static inline void
+rank_index_invalidate(bitarray_t* const bitarray,
+		      const size_t bit_lo,
+		      const size_t bit_hi,
+		      const bool count_changed)
 {
-    uint1024_t result = {0};
-    
-    // Reverse each 8-bit chunk using the LUT
-    for (size_t i = 0; i < 16; i++) {
-        uint64_t chunk = value.chunk[i];
-        uint64_t reversed_chunk = 0;
-        
-        // Process 8 bytes in the chunk
-        for (size_t j = 0; j < 8; j++) {
-            uint8_t byte_val = (chunk >> (j * 8)) & 0xFF;
-            uint8_t reversed_byte = bit_reverse_table256[byte_val];
-            reversed_chunk |= ((uint64_t)reversed_byte) << ((7 - j) * 8);
-        }
-        
-        result.chunk[15 - i] = reversed_chunk;
-    }
-    
-    return result;
+  rank_index_t* const index = bitarray->index;
+  if (index == NULL || bit_lo >= bit_hi) {
+    return;
+  }
+  const size_t lo = bit_lo / RANK_BLOCK_BITS;
+  const size_t hi = count_changed ? index->num_blocks - 1 :
+                    (bit_hi - 1) / RANK_BLOCK_BITS;
+  if (count_changed) {
+    // Every later count is recomputed anyway.
+    rank_index_fold(index);
+  }
+  if (index->dirty_lo > index->dirty_hi) {
+    index->dirty_lo = lo;
+    index->dirty_hi = hi;
+  } else {
+    index->dirty_lo = lo < index->dirty_lo ? lo : index->dirty_lo;
+    index->dirty_hi = hi > index->dirty_hi ? hi : index->dirty_hi;
+  }
+  index->samples_stale = true;
 }
 /* --------------------------------------------------------------------------
- * read_u2048_bits
+ * rank_index_adjust
  *
- * Read 2048 bits starting at an arbitrary bit position.
- * Returns a uint2048_t structure with the bits.
+ * Only the edited block's word counts go stale, and the dirty range is
+ * left alone.  Folding and resampling once there have been num_blocks
+ * edits keeps the amortized cost O(log n) and bounds how far select has
+ * to widen its search.
  */
-static uint2048_t
-read_u2048_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos)
+static inline void
+rank_index_adjust(bitarray_t* const bitarray,
+		  const size_t bit_index,
+		  const int delta)
 {
-    uint2048_t result = {0};
-    
-    for (size_t i = 0; i < 32; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            result.chunk[i] = read_u64_bits(buf, num_bytes, chunk_bit_pos);
-        }
+  rank_index_t* const index = bitarray->index;
+  if (index == NULL) {
+    return;
+  }
+  const size_t block = bit_index / RANK_BLOCK_BITS;
+  for (size_t p = block + 1; p <= index->num_blocks; p += p & -p) {
+    index->deltas[p] += delta;
+  }
+  index->touched[block / 64] |= (uint64_t)1 << (block % 64);
+  index->sample_slack++;
+  if (++index->num_deltas >= index->num_blocks) {
+    rank_index_fold(index);
+    // Samples need the counts of every block, which a bulk edit may have
+    // left for the next query to repair.
+    if (!index->samples_stale && index->dirty_lo > index->dirty_hi) {
+      rank_index_sample(index);
     }
-    
-    return result;
+  }
 }
 /* --------------------------------------------------------------------------
- * write_u2048_bits
+ * rank_index_delta
+ */
+static inline int64_t
+rank_index_delta(const rank_index_t* const index, const size_t block)
+{
+  int64_t sum = 0;
+  if (index->num_deltas == 0) {
+    return 0;
+  }
+  for (size_t p = block; p > 0; p -= p & -p) {
+    sum += index->deltas[p];
+  }
+  return sum;
+}
+/* --------------------------------------------------------------------------
+ * rank_index_fold
  *
- * Write 2048 bits starting at an arbitrary bit position.
+ * Undoing the Fenwick construction from the top leaves each position's own
+ * delta, and a running sum of those is the prefix for every block.
  */
 static void
-write_u2048_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint2048_t value)
+rank_index_fold(rank_index_t* const index)
 {
-    for (size_t i = 0; i < 32; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            write_u64_bits(buf, num_bytes, chunk_bit_pos, value.chunk[i]);
-        }
+  if (index->num_deltas == 0) {
+    return;
+  }
+  const size_t n = index->num_blocks;
+  for (size_t p = n; p > 0; p--) {
+    const size_t parent = p + (p & -p);
+    if (parent <= n) {
+      index->deltas[parent] -= index->deltas[p];
     }
+  }
+  int64_t sum = 0;
+  for (size_t p = 1; p <= n; p++) {
+    sum += index->deltas[p];
+    index->deltas[p] = 0;
+    index->counts[2 * p] += sum;
+  }
+  index->num_deltas = 0;
 }
 /* --------------------------------------------------------------------------
- * reverse_u2048_bits
- *
- * Reverse the bits in a 2048-bit value using the LUT.
+ * snapshot_preserve
  */
-static uint2048_t
-reverse_u2048_bits(uint2048_t value)
+static inline void
+snapshot_preserve(bitarray_t* const bitarray,
+		  const size_t bit_lo,
+		  const size_t bit_hi)
 {
-    uint2048_t result = {0};
-    
-    // Use the 2048-bit LUT for efficient reversal
-    // Process 8-bit chunks and use LUT
-    for (size_t i = 0; i < 32; i++) {
-        uint64_t chunk = value.chunk[i];
-        uint64_t reversed_chunk = 0;
-        
-        // Process 8 bytes in the chunk
-        for (size_t j = 0; j < 8; j++) {
-            uint8_t byte_val = (chunk >> (j * 8)) & 0xFF;
-            uint8_t reversed_byte = bit_reverse_table256[byte_val];
-            reversed_chunk |= ((uint64_t)reversed_byte) << ((7 - j) * 8);
-        }
-        
-        result.chunk[31 - i] = reversed_chunk;
+  snapshot_t* const snapshot = bitarray->snapshot;
+  if (snapshot == NULL || snapshot->lost || bit_lo >= bit_hi) {
+    return;
+  }
+  const size_t last = (bit_hi - 1) / 8 / SNAPSHOT_PAGE_BYTES;
+  for (size_t page = bit_lo / 8 / SNAPSHOT_PAGE_BYTES; page <= last; page++) {
+    if (snapshot->slot[page] == 0) {
+      snapshot_save_page(bitarray, page);
     }
-    
-    return result;
+  }
 }
 /* --------------------------------------------------------------------------
- * read_u4096_bits
- *
- * Read 4096 bits starting at an arbitrary bit position.
- * Returns a uint4096_t structure with the bits.
+ * snapshot_save_page
  */
-static uint4096_t
-read_u4096_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos)
+static void
+snapshot_save_page(bitarray_t* const bitarray, const size_t page)
 {
-    uint4096_t result = {0};
-    
-    for (size_t i = 0; i < 64; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            result.chunk[i] = read_u64_bits(buf, num_bytes, chunk_bit_pos);
-        }
+  snapshot_t* const snapshot = bitarray->snapshot;
+  if (snapshot->num_saved == snapshot->capacity) {
+    const size_t capacity = snapshot->capacity == 0 ? 8 :
+                            2 * snapshot->capacity;
+    uint8_t* const saved = realloc(snapshot->saved,
+                                   capacity * SNAPSHOT_PAGE_BYTES);
+    if (saved == NULL) {
+      snapshot->lost = true;
+      return;
     }
-    
-    return result;
+    snapshot->saved = saved;
+    size_t* const saved_page = realloc(snapshot->saved_page,
+                                       capacity * sizeof(size_t));
+    if (saved_page == NULL) {
+      snapshot->lost = true;
+      return;
+    }
+    snapshot->saved_page = saved_page;
+    snapshot->capacity = capacity;
+  }
+
+  const size_t num_bytes = (bitarray->bit_sz + 7) / 8;
+  const size_t begin = page * SNAPSHOT_PAGE_BYTES;
+  const size_t bytes = num_bytes - begin < SNAPSHOT_PAGE_BYTES ?
+                       num_bytes - begin : SNAPSHOT_PAGE_BYTES;
+  const size_t k = snapshot->num_saved++;
+  memcpy(snapshot->saved + k * SNAPSHOT_PAGE_BYTES, bitarray->buf + begin,
+         bytes);
+  snapshot->saved_page[k] = page;
+  snapshot->slot[page] = k + 1;
 }
 /* --------------------------------------------------------------------------
- * write_u4096_bits
+ * rank_index_repair
  *
- * Write 4096 bits starting at an arbitrary bit position.
+ * The total before dirty_lo is still right, so the counts are rebuilt
+ * forwards from there; the total after dirty_hi follows from them.  Each
+ * stored count leaves out the deltas the Fenwick tree adds back.
  */
 static void
-write_u4096_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint4096_t value)
+rank_index_repair(const bitarray_t* const bitarray)
 {
-    for (size_t i = 0; i < 64; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            write_u64_bits(buf, num_bytes, chunk_bit_pos, value.chunk[i]);
-        }
+  rank_index_t* const index = bitarray->index;
+  uint64_t total = index->counts[2 * index->dirty_lo] +
+                   rank_index_delta(index, index->dirty_lo);
+
+  for (size_t b = index->dirty_lo; b <= index->dirty_hi; b++) {
+    uint64_t relative = 0;
+    uint64_t ones = 0;
+    for (unsigned w = 0; w < 8; w++) {
+      if (w > 0) {
+        relative |= ones << (9 * (w - 1));
+      }
+      ones += __builtin_popcountll(data_word(bitarray, 8 * b + w));
     }
+    index->counts[2 * b] = total - rank_index_delta(index, b);
+    index->counts[2 * b + 1] = relative;
+    index->touched[b / 64] &= ~((uint64_t)1 << (b % 64));
+    total += ones;
+  }
+  index->counts[2 * (index->dirty_hi + 1)] =
+    total - rank_index_delta(index, index->dirty_hi + 1);
+
+  // Leave the range empty.
+  index->dirty_lo = 1;
+  index->dirty_hi = 0;
 }
 /* --------------------------------------------------------------------------
- * reverse_u4096_bits
- *
- * Reverse the bits in a 4096-bit value using the LUT.
+ * rank_index_sample
  */
-static uint4096_t
-reverse_u4096_bits(uint4096_t value)
+static void
+rank_index_sample(rank_index_t* const index)
 {
-    uint4096_t result = {0};
-    
-    // Use the 4096-bit LUT for efficient reversal
-    // Process 8-bit chunks and use LUT
-    for (size_t i = 0; i < 64; i++) {
-        uint64_t chunk = value.chunk[i];
-        uint64_t reversed_chunk = 0;
-        
-        // Process 8 bytes in the chunk
-        for (size_t j = 0; j < 8; j++) {
-            uint8_t byte_val = (chunk >> (j * 8)) & 0xFF;
-            uint8_t reversed_byte = bit_reverse_table256[byte_val];
-            reversed_chunk |= ((uint64_t)reversed_byte) << ((7 - j) * 8);
-        }
-        
-        result.chunk[63 - i] = reversed_chunk;
+  const size_t ones = index->counts[2 * index->num_blocks];
+  const size_t num_samples = (ones + SELECT_SAMPLE_RATE - 1) /
+                             SELECT_SAMPLE_RATE;
+  size_t* const samples = realloc(index->samples,
+                                  (num_samples + 1) * sizeof(size_t));
+  if (samples == NULL) {
+    index->samples_stale = true;
+    return;
+  }
+
+  size_t s = 0;
+  for (size_t b = 0; b < index->num_blocks && s < num_samples; b++) {
+    while (s < num_samples &&
+           s * SELECT_SAMPLE_RATE < index->counts[2 * (b + 1)]) {
+      samples[s++] = b;
     }
-    
-    return result;
+  }
+  index->samples = samples;
+  index->num_samples = num_samples;
+  index->sample_slack = 0;
+  index->samples_stale = false;
 }
 /* --------------------------------------------------------------------------
- * read_u8192_bits
- *
- * Read 8192 bits starting at an arbitrary bit position.
- * Returns a uint8192_t structure with the bits.
+ * rank_index_refresh
  */
-static uint8192_t
-read_u8192_bits(const uint8_t* buf, size_t num_bytes, size_t bit_pos)
+static inline void
+rank_index_refresh(const bitarray_t* const bitarray, const size_t block)
 {
-    uint8192_t result = {0};
-    
-    for (size_t i = 0; i < 128; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            result.chunk[i] = read_u64_bits(buf, num_bytes, chunk_bit_pos);
-        }
-    }
-    
-    return result;
+  rank_index_t* const index = bitarray->index;
+  const uint64_t bit = (uint64_t)1 << (block % 64);
+  if ((index->touched[block / 64] & bit) == 0) {
+    return;
+  }
+  uint64_t relative = 0;
+  uint64_t ones = 0;
+  for (unsigned w = 0; w < 7; w++) {
+    ones += __builtin_popcountll(data_word(bitarray, 8 * block + w));
+    relative |= ones << (9 * w);
+  }
+  index->counts[2 * block + 1] = relative;
+  index->touched[block / 64] &= ~bit;
 }
 /* --------------------------------------------------------------------------
- * write_u8192_bits
- *
- * Write 8192 bits starting at an arbitrary bit position.
+ * data_word
  */
-static void
-write_u8192_bits(uint8_t* buf, size_t num_bytes, size_t bit_pos, uint8192_t value)
+static inline uint64_t
+data_word(const bitarray_t* const bitarray, const size_t index)
 {
-    for (size_t i = 0; i < 128; i++) {
-        size_t chunk_bit_pos = bit_pos + (i * 64);
-        if (chunk_bit_pos < num_bytes * 8) {
-            write_u64_bits(buf, num_bytes, chunk_bit_pos, value.chunk[i]);
-        }
-    }
+  if (64 * index >= bitarray->bit_sz) {
+    return 0;
+  }
+  const uint64_t word = load_aligned_word((const uint8_t*)bitarray->buf,
+                                          (bitarray->bit_sz + 7) / 8, index);
+  const size_t end = bitarray->bit_sz - 64 * index;
+  return end >= 64 ? word : word & (((uint64_t)1 << end) - 1);
 }
 /* --------------------------------------------------------------------------
- * reverse_u8192_bits
- *
- * Reverse the bits in a 8192-bit value using the LUT.
+ * select_in_word
  */
-static uint8192_t
-reverse_u8192_bits(uint8192_t value)
+static inline unsigned
+select_in_word(uint64_t word, const unsigned rank)
 {
-    uint8192_t result = {0};
-    
-    // Use the 8192-bit LUT for efficient reversal
-    // Process 8-bit chunks and use LUT
-    for (size_t i = 0; i < 128; i++) {
-        uint64_t chunk = value.chunk[i];
-        uint64_t reversed_chunk = 0;
-        
-        // Process 8 bytes in the chunk
-        for (size_t j = 0; j < 8; j++) {
-            uint8_t byte_val = (chunk >> (j * 8)) & 0xFF;
-            uint8_t reversed_byte = bit_reverse_table256[byte_val];
-            reversed_chunk |= ((uint64_t)reversed_byte) << ((7 - j) * 8);
-        }
-        
-        result.chunk[127 - i] = reversed_chunk;
-    }
-    
-    return result;
+#ifdef __BMI2__
+  return __builtin_ctzll(_pdep_u64((uint64_t)1 << rank, word));
+#else
+  for (unsigned i = 0; i < rank; i++) {
+    word &= word - 1;
+  }
+  return __builtin_ctzll(word);
+#endif
+}
+/* --------------------------------------------------------------------------
+ * load_aligned_word
+ */
+static inline uint64_t
+load_aligned_word(const uint8_t* const buf, const size_t num_bytes,
+                  const size_t index)
+{
+  uint64_t word = 0;
+  if (8 * index + 8 <= num_bytes) {
+    memcpy(&word, buf + 8 * index, sizeof(word));
+  } else if (8 * index < num_bytes) {
+    memcpy(&word, buf + 8 * index, num_bytes - 8 * index);
+  }
+  return WORD_FROM_LE(word);
+}
+/* --------------------------------------------------------------------------
+ * bitmask
+ */
+static char
+bitmask(const size_t bit_index)
+{
+  return 1 << (bit_index % 8);
 }
-
@@ -25,18 +25,37 @@
 
 #include <sys/types.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // ********************************* Types **********************************
 
 // Abstract data type representing an array of bits.
 typedef struct bitarray bitarray_t;
 
+// Abstract data type representing a fixed permutation of the 64 bit
+// positions of a word, compiled once and then applied to many words.
+typedef struct bitperm bitperm_t;
+
+// Returned by the search functions when the pattern does not occur.
+#define BITARRAY_NOT_FOUND ((size_t)-1)
+
+// Suggested bitarray_set_streaming settings: stream reversals of 32MB and
+// more, prefetching 1KB ahead of each cursor.  Streaming is off until
+// enabled.
+#define BITARRAY_STREAM_THRESHOLD ((size_t)1 << 28)
+#define BITARRAY_STREAM_PREFETCH 1024
+
 // ******************************* Prototypes *******************************
 
 // Allocates space for a new bit array.
 // bit_sz is the number of bits storable in the resultant bit array
 bitarray_t* bitarray_new(const size_t bit_sz);
 
+// Like bitarray_new, but the buffer starts on an alignment-byte boundary
+// and is padded to a whole number of alignment units, as needed for
+// O_DIRECT transfers.  alignment must be a power of two.
+bitarray_t* bitarray_new_aligned(const size_t bit_sz, const size_t alignment);
+
 // Frees a bit array allocated by bitarray_new.
 void bitarray_free(bitarray_t* const bitarray);
 
@@ -44,6 +63,11 @@ void bitarray_free(bitarray_t* const bitarray);
 // Note the invariant bitarray_get_bit_sz(bitarray_new(n)) = n.
 size_t bitarray_get_bit_sz(const bitarray_t* const bitarray);
 
+// Returns the packed storage of a bit array: bit i is bit (i mod 8) of byte
+// i/8.  Writing through this pointer bypasses the rank/select index, so
+// free the index first.
+void* bitarray_get_buf(const bitarray_t* const bitarray);
+
 // Does a random fill of all the bits in the bit array.
 void bitarray_randfill(bitarray_t* const bitarray);
 
@@ -85,8 +109,171 @@ void bitarray_rotate(bitarray_t* const bitarray,
                      const size_t bit_length,
                      const ssize_t bit_right_amount);
 
-// Clean up the global LUT manager. Should be called at program termination
-// to free all hash table resources.
+// Copies bit_length bits from src, starting at src_offset, into dst,
+// starting at dst_offset.  src and dst may be the same bit array, and the
+// two ranges may overlap.
+void bitarray_copy(bitarray_t* const dst,
+                   const size_t dst_offset,
+                   const bitarray_t* const src,
+                   const size_t src_offset,
+                   const size_t bit_length);
+
+// Reverses a subarray in place.
+//
+// bit_offset is the index of the start of the subarray
+// bit_length is the length of the subarray, in bits
+//
+// The subarray spans the half-open interval
+// [bit_offset, bit_offset + bit_length), as for bitarray_rotate.
+//
+// Example:
+// Let ba be a bit array containing the byte 0b10010110; then,
+// bitarray_reverse(ba, 1, 4) reverses the second through fifth bits.
+// After the reversal, ba contains the byte 0b10100110.
+void bitarray_reverse(bitarray_t* const bitarray,
+                      const size_t bit_offset,
+                      const size_t bit_length);
+
+// Sets when rotations and reversals switch to their streaming mode.
+//
+// A reversal of at least threshold_bits bits (each of the three in a
+// rotation is judged on its own) writes its results with non-temporal
+// stores, which go to memory without being allocated in the caches.  A
+// range much larger than the last-level cache would evict everything else
+// from it while gaining nothing from being cached itself.  Both cursors
+// prefetch prefetch_bytes ahead (0 disables this).
+//
+// Streaming trades some speed for the rest of the cache: the reversal
+// still reads every line it writes.  Run "everybit -c" to measure both on
+// a given machine.  Pass SIZE_MAX (the default) to disable streaming.  The
+// settings are global and not synchronized; change them before starting
+// threads.
+void bitarray_set_streaming(const size_t threshold_bits,
+                            const size_t prefetch_bytes);
+
+// Compiles a word permutation: bit i of a word moves to bit dest[i], where
+// bit 0 is the word's first bit in bit array order.
+// Returns NULL if dest is not a permutation of 0..63 or memory runs out.
+//
+// The permutation is split into runs of bits that keep their relative
+// order; each run is moved with one shift or, when built with BMI2=1, one
+// pext/pdep pair.  Shuffles that mostly reverse the word are compiled as a
+// word reversal followed by such runs.  Permutations that break into too
+// many runs are applied through 16KB of per-byte lookup tables instead.
+bitperm_t* bitperm_new(const uint8_t dest[64]);
+
+// Frees a permutation allocated by bitperm_new.
+void bitperm_free(bitperm_t* const perm);
+
+// Applies a permutation to a single word.
+uint64_t bitperm_apply(const bitperm_t* const perm, uint64_t word);
+
+// Applies a permutation to each consecutive 64-bit group of the subarray
+// [bit_offset, bit_offset + bit_length).  bit_length must be a multiple of
+// 64; bit_offset need not be aligned.
+//
+// Example: with dest[i] = the 6-bit reversal of i, every 64-bit group is
+// put into bit-reversed order, as for a 64-point FFT.
+void bitarray_permute(bitarray_t* const bitarray,
+                      const size_t bit_offset,
+                      const size_t bit_length,
+                      const bitperm_t* const perm);
+
+// Finds the first occurrence of a bit pattern at or after a given index.
+//
+// pattern holds pattern_len bits (1 to 64), its lowest bit being the first
+// in bit array order; higher bits are ignored.  start is the smallest
+// index at which a match may begin.
+//
+// Returns the index at which the first match begins, or BITARRAY_NOT_FOUND.
+//
+// Example:
+// Let ba be a bit array containing the byte 0b10010110; then,
+// bitarray_find(ba, 0x3, 2, 0) searches for "11" and returns 5.
+size_t bitarray_find(const bitarray_t* const bitarray,
+                     const uint64_t pattern,
+                     const size_t pattern_len,
+                     const size_t start);
+
+// Counts the occurrences of a bit pattern, overlapping ones included.
+// pattern and pattern_len are as for bitarray_find.
+size_t bitarray_count(const bitarray_t* const bitarray,
+                      const uint64_t pattern,
+                      const size_t pattern_len);
+
+// Multithreaded versions of bitarray_find and bitarray_count for very large
+// arrays.  The array is split into 2MB chunks that num_threads threads
+// (including the caller) claim in order; bitarray_find_parallel stops
+// claiming chunks that lie past a match already found.
+size_t bitarray_find_parallel(const bitarray_t* const bitarray,
+                              const uint64_t pattern,
+                              const size_t pattern_len,
+                              const size_t start,
+                              const unsigned num_threads);
+size_t bitarray_count_parallel(const bitarray_t* const bitarray,
+                               const uint64_t pattern,
+                               const size_t pattern_len,
+                               const unsigned num_threads);
+
+// Builds a rank/select index for the bit array.  Until the array is
+// edited, bitarray_rank runs in constant time and bitarray_select in
+// O(log n).  The index takes three eighths of the array's size plus a
+// word per 512 set bits.  Returns false if there is not enough memory,
+// leaving the array without an index.
+//
+// Later edits through this interface keep the index usable, and are
+// repaired lazily by the next query that needs them:
+// - bitarray_set records the change in a Fenwick tree in O(log n) and
+//   marks only its own 512-bit block stale.  Rank then costs O(log n),
+//   and select's binary search widens by one set bit per such edit.
+//   After n/512 of them the edits are folded back into the index, at an
+//   amortized O(1) per edit.
+// - Bulk edits (rotation, reversal, copies, restores) mark the 512-bit
+//   blocks they touch as stale, along with every later block if they may
+//   change the number of ones.  The next query recounts those blocks.
+// Queries may therefore write to the index, so they must not run
+// concurrently with each other after an edit.
+bool bitarray_index_build(bitarray_t* const bitarray);
+
+// Frees the rank/select index, if any.  bitarray_free does this as well.
+void bitarray_index_free(bitarray_t* const bitarray);
+
+// Takes a snapshot of the bit array's contents, replacing any earlier
+// snapshot.  Returns false if there is not enough memory.
+//
+// Taking a snapshot copies nothing.  Afterwards, each edit through this
+// interface first saves the 4KB pages it is about to change, unless they
+// are saved already, so the cost of a snapshot grows with the pages
+// touched after it rather than with the size of the array.  Writes made
+// directly to bitarray_get_buf are not seen.
+bool bitarray_snapshot(bitarray_t* const bitarray);
+
+// Returns the bit array to its contents at the last bitarray_snapshot, in
+// time proportional to the pages changed since.  The snapshot is kept, so
+// the array can be restored to it again.  Returns false, leaving the array
+// unchanged, if there is no snapshot or a page could not be saved for
+// lack of memory.
+bool bitarray_restore(bitarray_t* const bitarray);
+
+// Drops the snapshot, if any.  bitarray_free does this as well.
+void bitarray_snapshot_free(bitarray_t* const bitarray);
+
+// Returns the number of set bits among the first bit_index bits, where
+// 0 <= bit_index <= bitarray_get_bit_sz(bitarray).  Without an index this
+// scans the prefix.
+size_t bitarray_rank(const bitarray_t* const bitarray, const size_t bit_index);
+
+// Returns the index of the set bit preceded by exactly rank set bits, or
+// BITARRAY_NOT_FOUND if there are not that many.  Without an index this
+// scans the array.
+//
+// Example:
+// Let ba be a bit array containing the byte 0b10010110; then,
+// bitarray_rank(ba, 4) returns 2 and bitarray_select(ba, 2) returns 5.
+size_t bitarray_select(const bitarray_t* const bitarray, const size_t rank);
+
+// Formerly freed the reversal lookup tables.  Reversal no longer keeps any
+// global state, so this does nothing; it remains for existing callers.
 void bitarray_cleanup_lut_manager(void);
 
 #endif  // BITARRAY_H
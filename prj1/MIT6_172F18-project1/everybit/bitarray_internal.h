@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Helpers shared by the modules that work on a bit array's words directly
+// (bitarray.c, bitmap2d.c and bitpool.c).  Not part of the public interface.
+
+#ifndef BITARRAY_INTERNAL_H
+#define BITARRAY_INTERNAL_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Bit i of a bit array lives in bit (i mod 8) of byte i/8, so on a
+// little-endian machine bit j of a 64-bit word loaded from byte i/8 is
+// array bit i + j.  Big-endian hosts swap each word after loading it.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WORD_FROM_LE(w) __builtin_bswap64(w)
+#else
+#define WORD_FROM_LE(w) (w)
+#endif
+#define WORD_TO_LE(w) WORD_FROM_LE(w)
+
+// Portable modulo operation that supports negative dividends.
+//
+// Many programming languages define modulo in a manner incompatible with its
+// widely-accepted mathematical definition.
+// http://stackoverflow.com/questions/1907565/c-python-different-behaviour-of-the-modulo-operation
+// provides details; in particular, C's modulo
+// operator (which the standard calls a "remainder" operator) yields a result
+// signed identically to the dividend e.g., -1 % 10 yields -1.
+// This is obviously unacceptable for a function which returns size_t, so we
+// define our own.
+//
+// n is the dividend and m is the divisor
+//
+// Returns a positive integer r = n (mod m), in the range
+// 0 <= r < m.
+static inline size_t
+modulo(const ssize_t n, const size_t m)
+{
+  const ssize_t signed_m = (ssize_t)m;
+  assert(signed_m > 0);
+  const ssize_t result = ((n % signed_m) + signed_m) % signed_m;
+  assert(result >= 0);
+  return (size_t)result;
+}
+
+#endif  // BITARRAY_INTERNAL_H
@@ -0,0 +1,807 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Implements the streaming file operations of bitfile.h.  Reads and writes
+// go through a minimal io_uring driver built on the raw system calls (no
+// liburing), or through pread/pwrite when io_uring is unavailable.
+
+// We need _GNU_SOURCE for O_DIRECT and syscall.
+#define _GNU_SOURCE
+
+#include "./bitfile.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include <linux/io_uring.h>
+
+#include "./bitarray.h"
+
+
+// ******************************** Macros **********************************
+
+// Alignment of buffers, offsets and lengths for O_DIRECT.
+#define DIRECT_ALIGN 4096
+
+// Alignment used for buffered I/O, enough for word access to the buffers.
+#define BUFFERED_ALIGN 64
+
+// An output block is gathered from at most this many runs of the source:
+// the subarray's two ends and the rotation's wrap point split it.
+#define MAX_SEGMENTS 4
+
+// The tag of a completion names the slot and, for reads, the segment.
+#define TAG(slot, segment) ((uint64_t)(slot) * 8 + (segment))
+#define TAG_SLOT(tag) ((tag) / 8)
+#define TAG_SEGMENT(tag) ((tag) % 8)
+#define WRITE_SEGMENT 7
+
+
+// ********************************* Types **********************************
+
+// How destination bits are drawn from the source: bit p of the result is
+// source bit p outside [offset, offset + length), and inside it either
+// source bit 2 * offset + length - 1 - p (reverse) or the bit left_amount
+// places to its right, wrapping around (rotate).
+typedef struct {
+  size_t offset;
+  size_t length;
+  bool reverse;
+  size_t left_amount;
+} mapping_t;
+
+// A run of the destination copied from a run of the source, forwards or
+// reversed.
+typedef struct {
+  size_t dst_bit;
+  size_t src_bit;
+  size_t length;
+  bool reversed;
+} segment_t;
+
+typedef enum { SLOT_FREE, SLOT_READING, SLOT_WRITING } slot_state_t;
+
+// One block in flight, with the source spans it reads and the block it
+// writes.
+typedef struct {
+  slot_state_t state;
+  size_t block;
+  int num_segments;
+  segment_t segments[MAX_SEGMENTS];
+  // Byte range of the source file read for each segment, and where in the
+  // input buffer it lands.
+  off_t span_offset[MAX_SEGMENTS];
+  size_t span_bytes[MAX_SEGMENTS];
+  size_t region[MAX_SEGMENTS];
+  // Bytes of each span read so far; a short read is resubmitted for the
+  // rest unless it ended at the end of the file.
+  size_t span_done[MAX_SEGMENTS];
+  int pending;
+  bitarray_t* in;
+  bitarray_t* out;
+  // Bytes of the block to write, and how many are written so far; a short
+  // write is resubmitted for the rest.
+  size_t write_bytes;
+  size_t write_done;
+} slot_t;
+
+// Either an io_uring instance or a queue of completions of reads and writes
+// already done synchronously.
+typedef struct {
+  bool uring;
+  int ring_fd;
+  void* sq_map;
+  size_t sq_map_bytes;
+  void* cq_map;
+  size_t cq_map_bytes;
+  struct io_uring_sqe* sqes;
+  size_t sqes_bytes;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  struct io_uring_cqe* cqes;
+  unsigned to_submit;
+  unsigned in_flight;
+  // Synchronous fallback: completed requests not yet reaped.
+  uint64_t* done_tags;
+  ssize_t* done_results;
+  unsigned num_done;
+  unsigned capacity;
+} io_engine_t;
+
+
+// ************************** Function Prototypes ***************************
+
+// Streams the file through the given mapping into a temporary file next to
+// path, then renames it over path.
+static int bitfile_transform_in_place(const char* const path,
+                                      const mapping_t* const mapping,
+                                      const bitfile_options_t* const options);
+
+// Streams the file through the given mapping.
+static int bitfile_transform(const char* const src_path,
+                             const char* const dst_path,
+                             const mapping_t* const mapping,
+                             const bitfile_options_t* const options);
+
+// Splits the destination bits [lo, hi) into runs with a single source
+// each.  Returns the number of runs.
+static int plan_segments(const mapping_t* const mapping,
+                         const size_t lo,
+                         const size_t hi,
+                         segment_t segments[MAX_SEGMENTS]);
+
+// Opens path with the given flags, adding O_DIRECT if *direct is set and
+// clearing *direct if the file system rejects it.
+static int open_maybe_direct(const char* const path,
+                             const int flags,
+                             bool* const direct);
+
+// Sets up an engine able to hold the given number of requests, on
+// io_uring if use_uring is set and the kernel allows it.
+static int io_init(io_engine_t* const io,
+                   const unsigned capacity,
+                   const bool use_uring);
+
+// Waits for every request submitted or queued to complete, discarding the
+// results, so that no buffer is still in use by the kernel.  Returns -1
+// if the wait itself fails.
+static int io_drain(io_engine_t* const io);
+
+// Releases everything io_init acquired.  Requests still in flight must be
+// drained first, or the kernel may go on writing into their buffers.
+static void io_destroy(io_engine_t* const io);
+
+// Queues a read or write of len bytes at off.
+static int io_queue(io_engine_t* const io,
+                    const bool write,
+                    const int fd,
+                    void* const buf,
+                    const size_t len,
+                    const off_t off,
+                    const uint64_t tag);
+
+// Submits everything queued and returns one completion, waiting for it
+// only if none is ready.
+static int io_reap(io_engine_t* const io,
+                   uint64_t* const tag,
+                   ssize_t* const result);
+
+
+// ******************************* Functions ********************************
+
+/* --------------------------------------------------------------------------
+ * bitfile_rotate
+ */
+int
+bitfile_rotate(const char* const src_path,
+               const char* const dst_path,
+               const size_t bit_offset,
+               const size_t bit_length,
+               const ssize_t bit_right_amount,
+               const bitfile_options_t* const options)
+{
+  mapping_t mapping = {
+    .offset = bit_offset,
+    .length = bit_length,
+    .reverse = false,
+    .left_amount = 0,
+  };
+  if (bit_length > 0) {
+    // Left rotation by -bit_right_amount, reduced mod bit_length.
+    const ssize_t m = (ssize_t)bit_length;
+    mapping.left_amount = (size_t)(((-bit_right_amount % m) + m) % m);
+  }
+  return bitfile_transform(src_path, dst_path, &mapping, options);
+}
+/* --------------------------------------------------------------------------
+ * bitfile_reverse
+ */
+int
+bitfile_reverse(const char* const src_path,
+                const char* const dst_path,
+                const size_t bit_offset,
+                const size_t bit_length,
+                const bitfile_options_t* const options)
+{
+  const mapping_t mapping = {
+    .offset = bit_offset,
+    .length = bit_length,
+    .reverse = true,
+    .left_amount = 0,
+  };
+  return bitfile_transform(src_path, dst_path, &mapping, options);
+}
+/* --------------------------------------------------------------------------
+ * bitfile_transform
+ *
+ * Output blocks are handed to slots in order.  A slot reads the source
+ * spans its block needs, gathers the block once the last read completes,
+ * and writes it; it is then free for the next block.  The only waiting is
+ * in io_reap, when no slot has work that does not depend on I/O.
+ */
+static int
+bitfile_transform(const char* const src_path,
+                  const char* const dst_path,
+                  const mapping_t* const mapping,
+                  const bitfile_options_t* const options)
+{
+  const bitfile_options_t defaults = BITFILE_DEFAULT_OPTIONS;
+  const bitfile_options_t* const opts = options != NULL ? options : &defaults;
+  if (opts->depth == 0 || opts->block_bytes == 0 ||
+      (opts->direct && opts->block_bytes % DIRECT_ALIGN != 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct stat src_stat;
+  struct stat dst_stat;
+  if (stat(src_path, &src_stat) == 0 && stat(dst_path, &dst_stat) == 0 &&
+      dst_stat.st_dev == src_stat.st_dev &&
+      dst_stat.st_ino == src_stat.st_ino) {
+    return bitfile_transform_in_place(src_path, mapping, opts);
+  }
+
+  int src = -1;
+  int dst = -1;
+  slot_t* slots = NULL;
+  io_engine_t io;
+  bool io_ready = false;
+  int retval = -1;
+  int saved_errno = 0;
+
+  bool direct = opts->direct;
+  src = open_maybe_direct(src_path, O_RDONLY, &direct);
+  if (src < 0) {
+    return -1;
+  }
+  if (fstat(src, &src_stat) != 0) {
+    goto cleanup;
+  }
+  const size_t file_bytes = (size_t)src_stat.st_size;
+  if (mapping->offset + mapping->length > 8 * file_bytes) {
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  // Both files must agree on O_DIRECT, so reopen the source buffered if
+  // the destination's file system turns out not to support it.
+  const bool src_direct = direct;
+  dst = open_maybe_direct(dst_path, O_WRONLY | O_CREAT | O_TRUNC, &direct);
+  if (dst < 0) {
+    goto cleanup;
+  }
+  if (src_direct && !direct) {
+    close(src);
+    src = open_maybe_direct(src_path, O_RDONLY, &direct);
+    if (src < 0) {
+      goto cleanup;
+    }
+  }
+  const size_t align = direct ? DIRECT_ALIGN : BUFFERED_ALIGN;
+
+  const size_t block_bytes = opts->block_bytes;
+  const size_t num_blocks = (file_bytes + block_bytes - 1) / block_bytes;
+  const unsigned depth = opts->depth;
+
+  slots = calloc(depth, sizeof(slot_t));
+  if (slots == NULL) {
+    goto cleanup;
+  }
+  for (unsigned i = 0; i < depth; i++) {
+    // Each span overshoots its segment by less than two alignment units.
+    const size_t in_bytes = block_bytes + 2 * MAX_SEGMENTS * align;
+    slots[i].in = bitarray_new_aligned(8 * in_bytes, align);
+    slots[i].out = bitarray_new_aligned(8 * block_bytes, align);
+    if (slots[i].in == NULL || slots[i].out == NULL) {
+      errno = ENOMEM;
+      goto cleanup;
+    }
+  }
+  if (io_init(&io, depth * (MAX_SEGMENTS + 1), opts->use_uring) != 0) {
+    goto cleanup;
+  }
+  io_ready = true;
+
+  size_t next_block = 0;
+  size_t blocks_done = 0;
+  while (blocks_done < num_blocks) {
+    // Start reading for every free slot.
+    for (unsigned i = 0; i < depth && next_block < num_blocks; i++) {
+      slot_t* const slot = &slots[i];
+      if (slot->state != SLOT_FREE) {
+        continue;
+      }
+      const size_t lo = next_block * block_bytes * 8;
+      const size_t hi = lo + block_bytes * 8 < 8 * file_bytes ?
+                        lo + block_bytes * 8 : 8 * file_bytes;
+      slot->block = next_block++;
+      slot->num_segments = plan_segments(mapping, lo, hi, slot->segments);
+      slot->pending = slot->num_segments;
+      slot->state = SLOT_READING;
+
+      size_t region = 0;
+      char* const in_buf = bitarray_get_buf(slot->in);
+      for (int s = 0; s < slot->num_segments; s++) {
+        const segment_t* const seg = &slot->segments[s];
+        const size_t first = seg->src_bit / 8 / align * align;
+        const size_t last = (seg->src_bit + seg->length + 7) / 8;
+        slot->span_offset[s] = (off_t)first;
+        slot->span_bytes[s] = (last - first + align - 1) / align * align;
+        slot->span_done[s] = 0;
+        slot->region[s] = region;
+        if (io_queue(&io, false, src, in_buf + region, slot->span_bytes[s],
+                     slot->span_offset[s], TAG(i, s)) != 0) {
+          goto cleanup;
+        }
+        region += slot->span_bytes[s];
+      }
+    }
+
+    uint64_t tag;
+    ssize_t result;
+    if (io_reap(&io, &tag, &result) != 0) {
+      goto cleanup;
+    }
+    if (result < 0) {
+      errno = (int)-result;
+      goto cleanup;
+    }
+    const unsigned index = TAG_SLOT(tag);
+    slot_t* const slot = &slots[index];
+
+    if (TAG_SEGMENT(tag) == WRITE_SEGMENT) {
+      // A short write is resubmitted for the rest, like a short read; one
+      // that makes no progress, or leaves O_DIRECT misaligned, is an error.
+      const size_t done = slot->write_done + (size_t)result;
+      if (done < slot->write_bytes) {
+        if (result == 0 || (direct && done % align != 0)) {
+          errno = EIO;
+          goto cleanup;
+        }
+        slot->write_done = done;
+        if (io_queue(&io, true, dst, (char*)bitarray_get_buf(slot->out) + done,
+                     slot->write_bytes - done,
+                     (off_t)(slot->block * block_bytes + done), tag) != 0) {
+          goto cleanup;
+        }
+        continue;
+      }
+      slot->state = SLOT_FREE;
+      blocks_done++;
+      continue;
+    }
+
+    // A read that stops at the end of the file leaves the rest of the span
+    // past the last bit anyone asked for, so it is zeroed.  One that stops
+    // short anywhere else is resubmitted for the rest; one that makes no
+    // progress, or leaves O_DIRECT misaligned, is an error.
+    const int s = TAG_SEGMENT(tag);
+    const size_t done = slot->span_done[s] + (size_t)result;
+    if (done < slot->span_bytes[s]) {
+      char* const span = (char*)bitarray_get_buf(slot->in) + slot->region[s];
+      if ((size_t)slot->span_offset[s] + done >= file_bytes) {
+        memset(span + done, 0, slot->span_bytes[s] - done);
+      } else if (result == 0 || (direct && done % align != 0)) {
+        errno = EIO;
+        goto cleanup;
+      } else {
+        slot->span_done[s] = done;
+        if (io_queue(&io, false, src, span + done,
+                     slot->span_bytes[s] - done,
+                     slot->span_offset[s] + (off_t)done, tag) != 0) {
+          goto cleanup;
+        }
+        continue;
+      }
+    }
+    if (--slot->pending > 0) {
+      continue;
+    }
+
+    // Gather the block and write it.
+    const size_t lo = slot->block * block_bytes * 8;
+    for (int t = 0; t < slot->num_segments; t++) {
+      const segment_t* const seg = &slot->segments[t];
+      const size_t from = 8 * slot->region[t] +
+                          (seg->src_bit - 8 * (size_t)slot->span_offset[t]);
+      bitarray_copy(slot->out, seg->dst_bit - lo, slot->in, from,
+                    seg->length);
+      if (seg->reversed) {
+        bitarray_reverse(slot->out, seg->dst_bit - lo, seg->length);
+      }
+    }
+    const size_t bytes = file_bytes - slot->block * block_bytes < block_bytes ?
+                         file_bytes - slot->block * block_bytes : block_bytes;
+    // O_DIRECT writes whole units; the file is truncated afterwards.
+    slot->write_bytes = (bytes + align - 1) / align * align;
+    if (!direct) {
+      slot->write_bytes = bytes;
+    }
+    slot->write_done = 0;
+    slot->state = SLOT_WRITING;
+    if (io_queue(&io, true, dst, bitarray_get_buf(slot->out),
+                 slot->write_bytes, (off_t)(slot->block * block_bytes),
+                 TAG(index, WRITE_SEGMENT)) != 0) {
+      goto cleanup;
+    }
+  }
+
+  if (ftruncate(dst, (off_t)file_bytes) != 0) {
+    goto cleanup;
+  }
+  retval = 0;
+
+cleanup:
+  saved_errno = errno;
+  // On an error, requests for other blocks may still be in flight.  If
+  // they cannot be waited for, their buffers are leaked rather than freed
+  // under the kernel.
+  if (io_ready) {
+    if (io_drain(&io) != 0) {
+      slots = NULL;
+    }
+    io_destroy(&io);
+  }
+  if (slots != NULL) {
+    for (unsigned i = 0; i < opts->depth; i++) {
+      bitarray_free(slots[i].in);
+      bitarray_free(slots[i].out);
+    }
+    free(slots);
+  }
+  if (dst >= 0 && close(dst) != 0 && retval == 0) {
+    saved_errno = errno;
+    retval = -1;
+  }
+  if (src >= 0) {
+    close(src);
+  }
+  errno = saved_errno;
+  return retval;
+}
+/* --------------------------------------------------------------------------
+ * bitfile_transform_in_place
+ *
+ * The temporary file is in the same directory, so the rename is atomic and
+ * path holds either the old or the new contents, never a partial result.
+ */
+static int
+bitfile_transform_in_place(const char* const path,
+                           const mapping_t* const mapping,
+                           const bitfile_options_t* const options)
+{
+  static const char suffix[] = ".XXXXXX";
+  const size_t length = strlen(path);
+  char* const tmp_path = malloc(length + sizeof(suffix));
+  if (tmp_path == NULL) {
+    return -1;
+  }
+  memcpy(tmp_path, path, length);
+  memcpy(tmp_path + length, suffix, sizeof(suffix));
+
+  // mkstemp creates the file private; give it the mode of the original.
+  struct stat path_stat;
+  const int fd = stat(path, &path_stat) == 0 ? mkstemp(tmp_path) : -1;
+  if (fd < 0) {
+    free(tmp_path);
+    return -1;
+  }
+  if (fchmod(fd, path_stat.st_mode & 07777) != 0) {
+    const int saved_errno = errno;
+    close(fd);
+    unlink(tmp_path);
+    free(tmp_path);
+    errno = saved_errno;
+    return -1;
+  }
+  close(fd);
+
+  int retval = bitfile_transform(path, tmp_path, mapping, options);
+  if (retval == 0) {
+    retval = rename(tmp_path, path);
+  }
+  if (retval != 0) {
+    const int saved_errno = errno;
+    unlink(tmp_path);
+    errno = saved_errno;
+  }
+  free(tmp_path);
+  return retval;
+}
+/* --------------------------------------------------------------------------
+ * plan_segments
+ */
+static int
+plan_segments(const mapping_t* const mapping,
+              const size_t lo,
+              const size_t hi,
+              segment_t segments[MAX_SEGMENTS])
+{
+  const size_t a = mapping->offset;
+  const size_t b = mapping->offset + mapping->length;
+  // Rotation wrap point: [a, wrap) comes from left_amount places further
+  // right, [wrap, b) from the start of the subarray.
+  const size_t wrap = b - mapping->left_amount;
+  int n = 0;
+
+  for (size_t p = lo; p < hi;) {
+    segment_t* const seg = &segments[n++];
+    size_t end;
+    seg->dst_bit = p;
+    seg->reversed = false;
+    if (p < a || p >= b) {
+      end = p < a ? a : hi;
+      seg->src_bit = p;
+    } else if (mapping->reverse) {
+      end = b;
+      seg->reversed = true;
+    } else if (p < wrap) {
+      end = wrap;
+      seg->src_bit = p + mapping->left_amount;
+    } else {
+      end = b;
+      seg->src_bit = p - (wrap - a);
+    }
+    if (end > hi) {
+      end = hi;
+    }
+    seg->length = end - p;
+    if (seg->reversed) {
+      seg->src_bit = 2 * a + mapping->length - end;
+    }
+    p = end;
+  }
+  assert(n <= MAX_SEGMENTS);
+  return n;
+}
+/* --------------------------------------------------------------------------
+ * open_maybe_direct
+ */
+static int
+open_maybe_direct(const char* const path, const int flags, bool* const direct)
+{
+  if (*direct) {
+    const int fd = open(path, flags | O_DIRECT, 0644);
+    if (fd >= 0 || errno != EINVAL) {
+      return fd;
+    }
+    *direct = false;
+  }
+  return open(path, flags, 0644);
+}
+/* --------------------------------------------------------------------------
+ * io_init
+ */
+static int
+io_init(io_engine_t* const io, const unsigned capacity, const bool use_uring)
+{
+  memset(io, 0, sizeof(*io));
+  io->ring_fd = -1;
+  io->capacity = capacity;
+
+  if (use_uring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    const int fd = (int)syscall(__NR_io_uring_setup, capacity, &params);
+    if (fd >= 0) {
+      io->ring_fd = fd;
+      io->sq_map_bytes = params.sq_off.array +
+                         params.sq_entries * sizeof(unsigned);
+      io->cq_map_bytes = params.cq_off.cqes +
+                         params.cq_entries * sizeof(struct io_uring_cqe);
+      const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single && io->cq_map_bytes > io->sq_map_bytes) {
+        io->sq_map_bytes = io->cq_map_bytes;
+      }
+      io->sq_map = mmap(NULL, io->sq_map_bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+      io->cq_map = single ? io->sq_map :
+                   mmap(NULL, io->cq_map_bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      io->sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+      io->sqes = mmap(NULL, io->sqes_bytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+      if (io->sq_map == MAP_FAILED || io->cq_map == MAP_FAILED ||
+          io->sqes == MAP_FAILED) {
+        const int err = errno;
+        io_destroy(io);
+        errno = err;
+        return -1;
+      }
+
+      char* const sq = io->sq_map;
+      char* const cq = io->cq_map;
+      io->sq_head = (unsigned*)(sq + params.sq_off.head);
+      io->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+      io->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+      io->sq_array = (unsigned*)(sq + params.sq_off.array);
+      io->cq_head = (unsigned*)(cq + params.cq_off.head);
+      io->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+      io->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+      io->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+      io->uring = true;
+      return 0;
+    }
+    // ENOSYS, or EPERM under a seccomp filter: fall back.
+  }
+
+  io->done_tags = malloc(capacity * sizeof(uint64_t));
+  io->done_results = malloc(capacity * sizeof(ssize_t));
+  if (io->done_tags == NULL || io->done_results == NULL) {
+    io_destroy(io);
+    errno = ENOMEM;
+    return -1;
+  }
+  return 0;
+}
+/* --------------------------------------------------------------------------
+ * io_drain
+ */
+static int
+io_drain(io_engine_t* const io)
+{
+  if (!io->uring) {
+    // Every request already ran synchronously.
+    io->num_done = 0;
+    return 0;
+  }
+  while (io->in_flight > 0) {
+    uint64_t tag;
+    ssize_t result;
+    if (io_reap(io, &tag, &result) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+/* --------------------------------------------------------------------------
+ * io_destroy
+ */
+static void
+io_destroy(io_engine_t* const io)
+{
+  if (io->sqes != NULL && io->sqes != MAP_FAILED) {
+    munmap(io->sqes, io->sqes_bytes);
+  }
+  if (io->cq_map != NULL && io->cq_map != MAP_FAILED &&
+      io->cq_map != io->sq_map) {
+    munmap(io->cq_map, io->cq_map_bytes);
+  }
+  if (io->sq_map != NULL && io->sq_map != MAP_FAILED) {
+    munmap(io->sq_map, io->sq_map_bytes);
+  }
+  if (io->ring_fd >= 0) {
+    close(io->ring_fd);
+  }
+  free(io->done_tags);
+  free(io->done_results);
+  memset(io, 0, sizeof(*io));
+  io->ring_fd = -1;
+}
+/* --------------------------------------------------------------------------
+ * io_queue
+ */
+static int
+io_queue(io_engine_t* const io,
+         const bool write,
+         const int fd,
+         void* const buf,
+         const size_t len,
+         const off_t off,
+         const uint64_t tag)
+{
+  if (!io->uring) {
+    assert(io->num_done < io->capacity);
+    ssize_t result = write ? pwrite(fd, buf, len, off) :
+                             pread(fd, buf, len, off);
+    if (result < 0) {
+      result = -errno;
+    }
+    io->done_tags[io->num_done] = tag;
+    io->done_results[io->num_done] = result;
+    io->num_done++;
+    return 0;
+  }
+
+  // The ring is sized for every request the slots can have outstanding.
+  assert(io->in_flight < io->capacity);
+  const unsigned tail = *io->sq_tail;
+  const unsigned index = tail & *io->sq_mask;
+  struct io_uring_sqe* const sqe = &io->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = (uint32_t)len;
+  sqe->off = (uint64_t)off;
+  sqe->user_data = tag;
+  io->sq_array[index] = index;
+  __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  io->to_submit++;
+  io->in_flight++;
+  return 0;
+}
+/* --------------------------------------------------------------------------
+ * io_reap
+ */
+static int
+io_reap(io_engine_t* const io, uint64_t* const tag, ssize_t* const result)
+{
+  if (!io->uring) {
+    if (io->num_done == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    // Completion order does not matter to the caller.
+    io->num_done--;
+    *tag = io->done_tags[io->num_done];
+    *result = io->done_results[io->num_done];
+    return 0;
+  }
+
+  for (;;) {
+    const unsigned head = *io->cq_head;
+    if (head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE) &&
+        io->to_submit == 0) {
+      const struct io_uring_cqe* const cqe = &io->cqes[head & *io->cq_mask];
+      *tag = cqe->user_data;
+      *result = cqe->res;
+      __atomic_store_n(io->cq_head, head + 1, __ATOMIC_RELEASE);
+      io->in_flight--;
+      return 0;
+    }
+    if (io->in_flight == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    // Submit what is queued; block only if nothing has completed yet.
+    const bool ready = head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+    const int submitted = (int)syscall(__NR_io_uring_enter, io->ring_fd,
+                                       io->to_submit, ready ? 0 : 1,
+                                       ready ? 0 : IORING_ENTER_GETEVENTS,
+                                       NULL, 0);
+    if (submitted < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    io->to_submit -= (unsigned)submitted;
+  }
+}
@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Streaming rotation and reversal of bit arrays stored in files that may be
+// larger than memory or the page cache.
+//
+// A file of n bytes holds a bit array of 8n bits, packed as by bitarray.h
+// (bit i is bit (i mod 8) of byte i/8).  Each operation reads the source
+// file and writes the result to a destination file, one output
+// block at a time: every block is gathered from at most four runs of the
+// source with bitarray_copy and bitarray_reverse.  Several blocks are in
+// flight at once, so the kernels work on one block while the reads and
+// writes of the others proceed.
+
+#ifndef BITFILE_H
+#define BITFILE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// ********************************* Types **********************************
+
+// Tuning for the streaming operations.
+typedef struct {
+  // Bytes per output block.  Must be a multiple of 4096 when direct is set.
+  size_t block_bytes;
+  // Number of blocks in flight: 2 for double buffering, 3 for triple.
+  unsigned depth;
+  // Open both files with O_DIRECT, bypassing the page cache.  Falls back to
+  // buffered I/O on file systems that refuse it.
+  bool direct;
+  // Queue reads and writes through io_uring.  Falls back to pread/pwrite
+  // if the kernel does not allow it.
+  bool use_uring;
+} bitfile_options_t;
+
+// 1MB blocks, triple buffered, direct I/O through io_uring.
+#define BITFILE_DEFAULT_OPTIONS { (size_t)1 << 20, 3, true, true }
+
+// ******************************* Prototypes *******************************
+
+// Writes to dst_path the bit array in src_path with the subarray
+// [bit_offset, bit_offset + bit_length) rotated right by bit_right_amount,
+// as bitarray_rotate would.  options may be NULL for the defaults.
+//
+// If src_path and dst_path name the same file, the result goes to a
+// temporary file beside it that is then renamed over it.  Returns 0 on
+// success and -1, with errno set, on failure.
+int bitfile_rotate(const char* const src_path,
+                   const char* const dst_path,
+                   const size_t bit_offset,
+                   const size_t bit_length,
+                   const ssize_t bit_right_amount,
+                   const bitfile_options_t* const options);
+
+// Writes to dst_path the bit array in src_path with the subarray
+// [bit_offset, bit_offset + bit_length) reversed.  Otherwise as for
+// bitfile_rotate.
+int bitfile_reverse(const char* const src_path,
+                    const char* const dst_path,
+                    const size_t bit_offset,
+                    const size_t bit_length,
+                    const bitfile_options_t* const options);
+
+#endif  // BITFILE_H
@@ -0,0 +1,509 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Implements the two-dimensional bitmaps of bitmap2d.h.
+
+#include "./bitmap2d.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "./bitarray.h"
+#include "./bitarray_internal.h"
+
+
+// ******************************** Macros **********************************
+
+// Rows a thread claims at a time when rotating rows.
+#define ROW_CHUNK 16
+
+// Words of every row (one cache line) a thread claims at a time when
+// rotating columns.
+#define COLUMN_CHUNK 8
+
+
+// ********************************* Types **********************************
+
+// Concrete data type representing a two-dimensional bitmap.
+struct bitmap2d {
+  size_t width;
+  size_t height;
+  // Bits per row, width rounded up to a multiple of 64.
+  size_t stride;
+  bitarray_t* bits;
+};
+
+typedef struct bitmap_job bitmap_job_t;
+
+// Processes items [begin, end) of a job with the given scratch words.
+typedef void (*bitmap_kernel_t)(const bitmap_job_t* const job,
+                                const size_t begin,
+                                const size_t end,
+                                uint64_t* const scratch);
+
+// Work shared by the threads of one operation.  The items (rows, or word
+// columns) are claimed chunk by chunk from next; each thread takes its own
+// slice of scratch.
+struct bitmap_job {
+  const bitmap2d_t* bitmap;
+  bitmap_kernel_t kernel;
+  // Rotation amount: to the left in pixels for rows, upwards in rows for
+  // columns.
+  size_t amount;
+  // Columns being rotated, and the word holding the first of them.
+  size_t col_offset;
+  size_t col_width;
+  size_t first_word;
+  size_t num_items;
+  size_t chunk;
+  size_t next;
+  unsigned next_worker;
+  uint64_t* scratch;
+  size_t scratch_words;
+};
+
+
+// ************************** Function Prototypes ***************************
+
+// Runs a job on up to num_threads threads, including the caller.  Returns
+// false if the scratch memory could not be allocated, in which case
+// nothing has been done.
+static bool run_job(bitmap_job_t* const job, unsigned num_threads);
+
+// Thread body of run_job.
+static void* job_worker(void* arg);
+
+// Rotates rows [begin, end) left by job->amount.  Each row is written
+// twice into scratch, one copy right after the other, so that every
+// output word is a single unaligned load from the doubled row.
+static void rotate_rows_kernel(const bitmap_job_t* const job,
+                               const size_t begin,
+                               const size_t end,
+                               uint64_t* const scratch);
+
+// Rotates word columns [begin, end) of the column band up by job->amount
+// rows, following the cycles of the row permutation so that each word is
+// read and written once, with no scratch memory.
+static void rotate_columns_kernel(const bitmap_job_t* const job,
+                                  const size_t begin,
+                                  const size_t end,
+                                  uint64_t* const scratch);
+
+// Returns the words of row y.
+static inline uint64_t* row_words(const bitmap2d_t* const bitmap,
+                                  const size_t y);
+
+
+// ******************************* Functions ********************************
+
+/* --------------------------------------------------------------------------
+ * bitmap2d_new
+ */
+bitmap2d_t*
+bitmap2d_new(const size_t width, const size_t height)
+{
+  bitmap2d_t* const bitmap = malloc(sizeof(bitmap2d_t));
+  if (bitmap == NULL) {
+    return NULL;
+  }
+  bitmap->width = width;
+  bitmap->height = height;
+  bitmap->stride = (width + 63) / 64 * 64;
+  // Cache-line aligned, so that threads working on different lines of a
+  // row never share one.
+  bitmap->bits = bitarray_new_aligned(bitmap->stride * height, 64);
+  if (bitmap->bits == NULL) {
+    free(bitmap);
+    return NULL;
+  }
+  return bitmap;
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_from_packed
+ */
+bitmap2d_t*
+bitmap2d_from_packed(const bitarray_t* const packed,
+                     const size_t width,
+                     const size_t height)
+{
+  assert(width * height <= bitarray_get_bit_sz(packed));
+
+  bitmap2d_t* const bitmap = bitmap2d_new(width, height);
+  if (bitmap == NULL) {
+    return NULL;
+  }
+  for (size_t y = 0; y < height; y++) {
+    bitarray_copy(bitmap->bits, y * bitmap->stride, packed, y * width, width);
+  }
+  return bitmap;
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_to_packed
+ */
+void
+bitmap2d_to_packed(const bitmap2d_t* const bitmap, bitarray_t* const packed)
+{
+  assert(bitmap->width * bitmap->height <= bitarray_get_bit_sz(packed));
+
+  for (size_t y = 0; y < bitmap->height; y++) {
+    bitarray_copy(packed, y * bitmap->width, bitmap->bits, y * bitmap->stride,
+                  bitmap->width);
+  }
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_free
+ */
+void
+bitmap2d_free(bitmap2d_t* const bitmap)
+{
+  if (bitmap == NULL) {
+    return;
+  }
+  bitarray_free(bitmap->bits);
+  free(bitmap);
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_get_width
+ */
+size_t
+bitmap2d_get_width(const bitmap2d_t* const bitmap)
+{
+  return bitmap->width;
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_get_height
+ */
+size_t
+bitmap2d_get_height(const bitmap2d_t* const bitmap)
+{
+  return bitmap->height;
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_get_stride
+ */
+size_t
+bitmap2d_get_stride(const bitmap2d_t* const bitmap)
+{
+  return bitmap->stride;
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_get_bitarray
+ */
+bitarray_t*
+bitmap2d_get_bitarray(const bitmap2d_t* const bitmap)
+{
+  return bitmap->bits;
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_get
+ */
+bool
+bitmap2d_get(const bitmap2d_t* const bitmap, const size_t x, const size_t y)
+{
+  assert(x < bitmap->width && y < bitmap->height);
+  return bitarray_get(bitmap->bits, y * bitmap->stride + x);
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_set
+ */
+void
+bitmap2d_set(bitmap2d_t* const bitmap,
+             const size_t x,
+             const size_t y,
+             const bool value)
+{
+  assert(x < bitmap->width && y < bitmap->height);
+  bitarray_set(bitmap->bits, y * bitmap->stride + x, value);
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_rotate_rows
+ */
+bool
+bitmap2d_rotate_rows(bitmap2d_t* const bitmap,
+                     const ssize_t amount,
+                     const unsigned num_threads)
+{
+  if (bitmap->width == 0 || bitmap->height == 0) {
+    return true;
+  }
+  const size_t left = modulo(-amount, bitmap->width);
+  if (left == 0) {
+    return true;
+  }
+  const size_t row_words = bitmap->stride / 64;
+  bitmap_job_t job = {
+    .bitmap = bitmap,
+    .kernel = rotate_rows_kernel,
+    .amount = left,
+    .num_items = bitmap->height,
+    .chunk = ROW_CHUNK,
+    .scratch_words = 2 * row_words + 1,
+  };
+  return run_job(&job, num_threads);
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_rotate_columns
+ */
+bool
+bitmap2d_rotate_columns(bitmap2d_t* const bitmap,
+                        const size_t col_offset,
+                        const size_t col_width,
+                        const ssize_t amount,
+                        const unsigned num_threads)
+{
+  assert(col_offset + col_width <= bitmap->width);
+
+  if (col_width == 0 || bitmap->height == 0) {
+    return true;
+  }
+  const size_t up = modulo(-amount, bitmap->height);
+  if (up == 0) {
+    return true;
+  }
+  const size_t first_word = col_offset / 64;
+  bitmap_job_t job = {
+    .bitmap = bitmap,
+    .kernel = rotate_columns_kernel,
+    .amount = up,
+    .col_offset = col_offset,
+    .col_width = col_width,
+    .first_word = first_word,
+    .num_items = (col_offset + col_width + 63) / 64 - first_word,
+    .chunk = COLUMN_CHUNK,
+    .scratch_words = 0,
+  };
+  return run_job(&job, num_threads);
+}
+/* --------------------------------------------------------------------------
+ * bitmap2d_shift
+ *
+ * Rotating the columns cannot fail, so the rows go first: if they fail,
+ * nothing has moved yet.
+ */
+bool
+bitmap2d_shift(bitmap2d_t* const bitmap,
+               const ssize_t dx,
+               const ssize_t dy,
+               const unsigned num_threads)
+{
+  if (!bitmap2d_rotate_rows(bitmap, dx, num_threads)) {
+    return false;
+  }
+  return bitmap2d_rotate_columns(bitmap, 0, bitmap->width, dy, num_threads);
+}
+/* --------------------------------------------------------------------------
+ * run_job
+ */
+static bool
+run_job(bitmap_job_t* const job, unsigned num_threads)
+{
+  // No more threads than chunks.
+  const size_t num_chunks = (job->num_items + job->chunk - 1) / job->chunk;
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  if (num_threads > num_chunks) {
+    num_threads = (unsigned)num_chunks;
+  }
+
+  job->next = 0;
+  job->next_worker = 0;
+  job->scratch = NULL;
+  if (job->scratch_words != 0) {
+    job->scratch = malloc(num_threads * job->scratch_words * sizeof(uint64_t));
+    if (job->scratch == NULL) {
+      return false;
+    }
+  }
+
+  pthread_t* const threads = num_threads > 1 ?
+                             malloc((num_threads - 1) * sizeof(pthread_t)) :
+                             NULL;
+  unsigned spawned = 0;
+  if (threads != NULL) {
+    while (spawned + 1 < num_threads &&
+           pthread_create(&threads[spawned], NULL, job_worker, job) == 0) {
+      spawned++;
+    }
+  }
+
+  // The caller works too, so the job completes even if no thread could be
+  // started.
+  job_worker(job);
+  for (unsigned i = 0; i < spawned; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(job->scratch);
+  return true;
+}
+/* --------------------------------------------------------------------------
+ * job_worker
+ */
+static void*
+job_worker(void* arg)
+{
+  bitmap_job_t* const job = arg;
+  const unsigned id = __atomic_fetch_add(&job->next_worker, 1,
+                                         __ATOMIC_RELAXED);
+  uint64_t* const scratch = job->scratch == NULL ? NULL :
+                            job->scratch + id * job->scratch_words;
+  for (;;) {
+    const size_t begin = __atomic_fetch_add(&job->next, job->chunk,
+                                            __ATOMIC_RELAXED);
+    if (begin >= job->num_items) {
+      break;
+    }
+    const size_t end = begin + job->chunk < job->num_items ?
+                       begin + job->chunk : job->num_items;
+    job->kernel(job, begin, end, scratch);
+  }
+  return NULL;
+}
+/* --------------------------------------------------------------------------
+ * rotate_rows_kernel
+ */
+static void
+rotate_rows_kernel(const bitmap_job_t* const job,
+                   const size_t begin,
+                   const size_t end,
+                   uint64_t* const scratch)
+{
+  const bitmap2d_t* const bitmap = job->bitmap;
+  const size_t width = bitmap->width;
+  const size_t n = (width + 63) / 64;
+  const unsigned tail = width % 64;
+  const uint64_t last_mask = tail == 0 ? ~(uint64_t)0 :
+                             ((uint64_t)1 << tail) - 1;
+  const size_t base = width / 64;
+  const size_t left = job->amount;
+
+  for (size_t y = begin; y < end; y++) {
+    uint64_t* const row = row_words(bitmap, y);
+
+    // scratch holds the row at bit 0 and again at bit width.
+    memset(scratch + n, 0, (n + 1) * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) {
+      scratch[i] = WORD_FROM_LE(row[i]);
+    }
+    scratch[n - 1] &= last_mask;
+    for (size_t i = 0; i < n; i++) {
+      const uint64_t word = i == n - 1 ? WORD_FROM_LE(row[i]) & last_mask :
+                            WORD_FROM_LE(row[i]);
+      scratch[base + i] |= word << tail;
+      if (tail != 0) {
+        scratch[base + i + 1] |= word >> (64 - tail);
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      const size_t pos = 64 * i + left;
+      const size_t q = pos / 64;
+      const unsigned shift = pos % 64;
+      uint64_t word = shift == 0 ? scratch[q] :
+                      (scratch[q] >> shift) | (scratch[q + 1] << (64 - shift));
+      if (i == n - 1) {
+        word &= last_mask;
+      }
+      row[i] = WORD_TO_LE(word);
+    }
+  }
+}
+/* --------------------------------------------------------------------------
+ * rotate_columns_kernel
+ *
+ * Row y receives row (y + up) mod height.  The rows fall into gcd(height,
+ * up) cycles; each is walked from its first row, which is saved, and the
+ * last row of the cycle receives the saved copy.  Only the bits of the
+ * column band move: the words at its two ends are merged under a mask.
+ */
+static void
+rotate_columns_kernel(const bitmap_job_t* const job,
+                      const size_t begin,
+                      const size_t end,
+                      uint64_t* const scratch)
+{
+  (void)scratch;
+  const bitmap2d_t* const bitmap = job->bitmap;
+  const size_t height = bitmap->height;
+  const size_t up = job->amount;
+  const size_t col_end = job->col_offset + job->col_width;
+
+  uint64_t mask[COLUMN_CHUNK];
+  uint64_t saved[COLUMN_CHUNK];
+  const size_t count = end - begin;
+  const size_t w0 = job->first_word + begin;
+  for (size_t j = 0; j < count; j++) {
+    const size_t word_lo = 64 * (w0 + j);
+    const size_t lo = job->col_offset > word_lo ? job->col_offset - word_lo : 0;
+    const size_t hi = col_end < word_lo + 64 ? col_end - word_lo : 64;
+    mask[j] = (hi == 64 ? ~(uint64_t)0 : ((uint64_t)1 << hi) - 1) &
+              ~(((uint64_t)1 << lo) - 1);
+  }
+
+  size_t a = height;
+  size_t b = up;
+  while (b != 0) {
+    const size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  const size_t num_cycles = a;
+
+  for (size_t start = 0; start < num_cycles; start++) {
+    const uint64_t* const first = row_words(bitmap, start) + w0;
+    for (size_t j = 0; j < count; j++) {
+      saved[j] = WORD_FROM_LE(first[j]);
+    }
+    size_t y = start;
+    for (;;) {
+      const size_t from = y + up < height ? y + up : y + up - height;
+      uint64_t* const dst = row_words(bitmap, y) + w0;
+      if (from == start) {
+        for (size_t j = 0; j < count; j++) {
+          const uint64_t old = WORD_FROM_LE(dst[j]);
+          dst[j] = WORD_TO_LE((old & ~mask[j]) | (saved[j] & mask[j]));
+        }
+        break;
+      }
+      const uint64_t* const src = row_words(bitmap, from) + w0;
+      for (size_t j = 0; j < count; j++) {
+        const uint64_t old = WORD_FROM_LE(dst[j]);
+        const uint64_t moved = WORD_FROM_LE(src[j]);
+        dst[j] = WORD_TO_LE((old & ~mask[j]) | (moved & mask[j]));
+      }
+      y = from;
+    }
+  }
+}
+/* --------------------------------------------------------------------------
+ * row_words
+ */
+static inline uint64_t*
+row_words(const bitmap2d_t* const bitmap, const size_t y)
+{
+  return (uint64_t*)bitarray_get_buf(bitmap->bits) + y * (bitmap->stride / 64);
+}
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Two-dimensional bitmaps with whole-image rotations.
+//
+// A bitmap2d_t of width w and height h keeps its pixels in a bit array,
+// row after row, with every row padded to a whole number of 64-bit words:
+// pixel (x, y) is bit y * stride + x, where stride is w rounded up to a
+// multiple of 64.  Row starts being word-aligned, the rotations below run
+// on whole words and never need to shift one row against another.
+//
+// The operations that move pixels split their work among num_threads
+// threads, the caller included; pass 1 to do everything on the calling
+// thread.  They need a little scratch memory per thread and return false,
+// leaving the bitmap unchanged, if it cannot be had.
+
+#ifndef BITMAP2D_H
+#define BITMAP2D_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "./bitarray.h"
+
+// ********************************* Types **********************************
+
+// Abstract data type representing a two-dimensional bitmap.
+typedef struct bitmap2d bitmap2d_t;
+
+// ******************************* Prototypes *******************************
+
+// Allocates a width x height bitmap with every pixel clear.  Returns NULL
+// if there is not enough memory.
+bitmap2d_t* bitmap2d_new(const size_t width, const size_t height);
+
+// Allocates a bitmap holding the image in the first width * height bits of
+// packed, whose rows follow each other with no padding.  Returns NULL if
+// there is not enough memory.
+bitmap2d_t* bitmap2d_from_packed(const bitarray_t* const packed,
+                                 const size_t width,
+                                 const size_t height);
+
+// Writes the bitmap into the first width * height bits of packed, rows
+// concatenated with no padding.
+void bitmap2d_to_packed(const bitmap2d_t* const bitmap,
+                        bitarray_t* const packed);
+
+// Frees a bitmap allocated by bitmap2d_new or bitmap2d_from_packed.
+void bitmap2d_free(bitmap2d_t* const bitmap);
+
+size_t bitmap2d_get_width(const bitmap2d_t* const bitmap);
+size_t bitmap2d_get_height(const bitmap2d_t* const bitmap);
+
+// Returns the number of bits from the start of one row to the next.
+size_t bitmap2d_get_stride(const bitmap2d_t* const bitmap);
+
+// Returns the bit array holding the pixels.  The operations below write its
+// buffer directly, so it should not be given a rank index or snapshot.
+bitarray_t* bitmap2d_get_bitarray(const bitmap2d_t* const bitmap);
+
+// Reads or writes pixel (x, y), where x < width and y < height.
+bool bitmap2d_get(const bitmap2d_t* const bitmap,
+                  const size_t x,
+                  const size_t y);
+void bitmap2d_set(bitmap2d_t* const bitmap,
+                  const size_t x,
+                  const size_t y,
+                  const bool value);
+
+// Rotates every row right by amount pixels (left if amount is negative),
+// wrapping around at the right edge: pixel (x, y) moves to
+// ((x + amount) mod width, y).
+bool bitmap2d_rotate_rows(bitmap2d_t* const bitmap,
+                          const ssize_t amount,
+                          const unsigned num_threads);
+
+// Rotates the columns [col_offset, col_offset + col_width) down by amount
+// pixels (up if amount is negative), wrapping around at the bottom edge:
+// pixel (x, y) of those columns moves to (x, (y + amount) mod height).
+// With col_offset 0 and col_width equal to the width, this moves whole
+// rows.
+bool bitmap2d_rotate_columns(bitmap2d_t* const bitmap,
+                             const size_t col_offset,
+                             const size_t col_width,
+                             const ssize_t amount,
+                             const unsigned num_threads);
+
+// Shifts the image dx pixels right and dy pixels down on a torus: pixel
+// (x, y) moves to ((x + dx) mod width, (y + dy) mod height).
+bool bitmap2d_shift(bitmap2d_t* const bitmap,
+                    const ssize_t dx,
+                    const ssize_t dy,
+                    const unsigned num_threads);
+
+#endif  // BITMAP2D_H
@@ -0,0 +1,409 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Implements the pools of small bit vectors of bitpool.h.
+//
+// Each group of BITPOOL_LANES vectors is stored as words_per_vector lanes_t
+// values, lane l of value i being word i of vector l of the group.  Every
+// rotation kernel works a group at a time on lanes_t, so that with AVX2
+// (make AVX2=1) one instruction shifts a word of four vectors, and with
+// plain SSE2 two instructions do.
+
+// We need _POSIX_C_SOURCE >= 200112L for posix_memalign.
+#define _POSIX_C_SOURCE 200112L
+
+#include "./bitpool.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./bitarray.h"
+#include "./bitarray_internal.h"
+
+
+// ******************************** Macros **********************************
+
+#define MAX_WORDS (BITPOOL_MAX_WIDTH / 64)
+
+
+// ********************************* Types **********************************
+
+// One word of each of the BITPOOL_LANES vectors of a group.
+typedef uint64_t lanes_t
+    __attribute__((vector_size(BITPOOL_LANES * sizeof(uint64_t))));
+
+// Concrete data type representing a pool of bit vectors.
+struct bitpool {
+  size_t width;
+  size_t count;
+  size_t words_per_vector;
+  size_t num_groups;
+  lanes_t* words;
+  // width bits, used to move a vector to or from a bit array.
+  bitarray_t* staging;
+};
+
+
+// ************************** Function Prototypes ***************************
+
+// Rotates the one-word vectors of a group left by (*left)[l] bits each.
+// The word never leaves its register.
+static inline void rotate_narrow(lanes_t* const group,
+                                 const size_t width,
+                                 const lanes_t* const left);
+
+// Rotates every vector of a group of multi-word vectors left by left bits.
+// The group is written twice into scratch, one copy right after the other,
+// and each output word is then one funnel shift of two scratch words.
+static void rotate_wide(lanes_t* const group,
+                        const size_t width,
+                        const size_t left);
+
+// Rotates lane lane of a group of multi-word vectors left by left bits, as
+// rotate_wide does for all lanes at once.
+static void rotate_lane(lanes_t* const group,
+                        const size_t width,
+                        const unsigned lane,
+                        const size_t left);
+
+// Returns the mask of the bits of the last word of a vector.
+static inline uint64_t last_word_mask(const size_t width);
+
+
+// ******************************* Functions ********************************
+
+/* --------------------------------------------------------------------------
+ * bitpool_new
+ */
+bitpool_t*
+bitpool_new(const size_t width, const size_t count)
+{
+  if (width == 0 || width > BITPOOL_MAX_WIDTH) {
+    return NULL;
+  }
+  bitpool_t* const pool = malloc(sizeof(bitpool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->width = width;
+  pool->count = count;
+  pool->words_per_vector = (width + 63) / 64;
+  pool->num_groups = (count + BITPOOL_LANES - 1) / BITPOOL_LANES;
+
+  const size_t num_lanes = pool->num_groups * pool->words_per_vector;
+  void* words = NULL;
+  if (posix_memalign(&words, sizeof(lanes_t),
+                     num_lanes > 0 ? num_lanes * sizeof(lanes_t) :
+                     sizeof(lanes_t)) != 0) {
+    free(pool);
+    return NULL;
+  }
+  memset(words, 0, num_lanes * sizeof(lanes_t));
+  pool->words = words;
+
+  pool->staging = bitarray_new(pool->words_per_vector * 64);
+  if (pool->staging == NULL) {
+    free(pool->words);
+    free(pool);
+    return NULL;
+  }
+  return pool;
+}
+/* --------------------------------------------------------------------------
+ * bitpool_free
+ */
+void
+bitpool_free(bitpool_t* const pool)
+{
+  if (pool == NULL) {
+    return;
+  }
+  bitarray_free(pool->staging);
+  free(pool->words);
+  free(pool);
+}
+/* --------------------------------------------------------------------------
+ * bitpool_get_width
+ */
+size_t
+bitpool_get_width(const bitpool_t* const pool)
+{
+  return pool->width;
+}
+/* --------------------------------------------------------------------------
+ * bitpool_get_count
+ */
+size_t
+bitpool_get_count(const bitpool_t* const pool)
+{
+  return pool->count;
+}
+/* --------------------------------------------------------------------------
+ * bitpool_get
+ */
+bool
+bitpool_get(const bitpool_t* const pool,
+            const size_t index,
+            const size_t bit_index)
+{
+  assert(index < pool->count && bit_index < pool->width);
+  const lanes_t* const group =
+      pool->words + index / BITPOOL_LANES * pool->words_per_vector;
+  const uint64_t word = group[bit_index / 64][index % BITPOOL_LANES];
+  return (word >> (bit_index % 64)) & 1;
+}
+/* --------------------------------------------------------------------------
+ * bitpool_set
+ */
+void
+bitpool_set(bitpool_t* const pool,
+            const size_t index,
+            const size_t bit_index,
+            const bool value)
+{
+  assert(index < pool->count && bit_index < pool->width);
+  lanes_t* const group =
+      pool->words + index / BITPOOL_LANES * pool->words_per_vector;
+  const unsigned lane = index % BITPOOL_LANES;
+  const uint64_t bit = (uint64_t)1 << (bit_index % 64);
+  if (value) {
+    group[bit_index / 64][lane] |= bit;
+  } else {
+    group[bit_index / 64][lane] &= ~bit;
+  }
+}
+/* --------------------------------------------------------------------------
+ * bitpool_load
+ */
+void
+bitpool_load(bitpool_t* const pool,
+             const size_t index,
+             const bitarray_t* const src,
+             const size_t src_offset)
+{
+  assert(index < pool->count);
+  assert(src_offset + pool->width <= bitarray_get_bit_sz(src));
+
+  const size_t n = pool->words_per_vector;
+  lanes_t* const group = pool->words + index / BITPOOL_LANES * n;
+  const unsigned lane = index % BITPOOL_LANES;
+  bitarray_copy(pool->staging, 0, src, src_offset, pool->width);
+  const unsigned char* const buf = bitarray_get_buf(pool->staging);
+  // The staging words are in the bit array's byte order; the pool keeps
+  // host order.
+  for (size_t i = 0; i < n; i++) {
+    uint64_t word;
+    memcpy(&word, buf + 8 * i, sizeof(word));
+    group[i][lane] = WORD_FROM_LE(word);
+  }
+  // The staging bits past width are stale; keep them out of the pool.
+  group[n - 1][lane] &= last_word_mask(pool->width);
+}
+/* --------------------------------------------------------------------------
+ * bitpool_store
+ */
+void
+bitpool_store(bitpool_t* const pool,
+              const size_t index,
+              bitarray_t* const dst,
+              const size_t dst_offset)
+{
+  assert(index < pool->count);
+  assert(dst_offset + pool->width <= bitarray_get_bit_sz(dst));
+
+  const size_t n = pool->words_per_vector;
+  const lanes_t* const group = pool->words + index / BITPOOL_LANES * n;
+  const unsigned lane = index % BITPOOL_LANES;
+  unsigned char* const buf = bitarray_get_buf(pool->staging);
+  for (size_t i = 0; i < n; i++) {
+    const uint64_t word = WORD_TO_LE(group[i][lane]);
+    memcpy(buf + 8 * i, &word, sizeof(word));
+  }
+  bitarray_copy(dst, dst_offset, pool->staging, 0, pool->width);
+}
+/* --------------------------------------------------------------------------
+ * bitpool_rotate_all
+ */
+void
+bitpool_rotate_all(bitpool_t* const pool, const ssize_t bit_right_amount)
+{
+  const size_t width = pool->width;
+  const size_t left = modulo(-bit_right_amount, width);
+  if (left == 0) {
+    return;
+  }
+
+  const size_t n = pool->words_per_vector;
+  if (n == 1) {
+    // Every lane shifts by the same count, which SSE2 can do as well.
+    const uint64_t mask = last_word_mask(width);
+    for (size_t g = 0; g < pool->num_groups; g++) {
+      const lanes_t x = pool->words[g];
+      pool->words[g] = ((x >> left) | (x << (width - left))) & mask;
+    }
+    return;
+  }
+  for (size_t g = 0; g < pool->num_groups; g++) {
+    rotate_wide(pool->words + g * n, width, left);
+  }
+}
+/* --------------------------------------------------------------------------
+ * bitpool_rotate_each
+ */
+void
+bitpool_rotate_each(bitpool_t* const pool,
+                    const ssize_t* const bit_right_amounts)
+{
+  const size_t width = pool->width;
+  const size_t n = pool->words_per_vector;
+
+  for (size_t g = 0; g < pool->num_groups; g++) {
+    lanes_t* const group = pool->words + g * n;
+    // Lanes past count hold no vector and stay clear under any rotation.
+    lanes_t left = {0};
+    for (unsigned l = 0; l < BITPOOL_LANES; l++) {
+      const size_t index = g * BITPOOL_LANES + l;
+      if (index < pool->count) {
+        left[l] = modulo(-bit_right_amounts[index], width);
+      }
+    }
+
+    if (n == 1) {
+      rotate_narrow(group, width, &left);
+      continue;
+    }
+    bool uniform = true;
+    for (unsigned l = 1; l < BITPOOL_LANES; l++) {
+      uniform = uniform && left[l] == left[0];
+    }
+    if (uniform) {
+      if (left[0] != 0) {
+        rotate_wide(group, width, left[0]);
+      }
+      continue;
+    }
+    for (unsigned l = 0; l < BITPOOL_LANES; l++) {
+      if (left[l] != 0) {
+        rotate_lane(group, width, l, left[l]);
+      }
+    }
+  }
+}
+/* --------------------------------------------------------------------------
+ * rotate_narrow
+ *
+ * The high part is shifted in two steps, by 1 and by width - 1 - left, so
+ * that no count reaches 64 when left is 0.
+ */
+static inline void
+rotate_narrow(lanes_t* const group,
+              const size_t width,
+              const lanes_t* const left)
+{
+  const lanes_t x = *group;
+  *group = ((x >> *left) | ((x << 1) << ((width - 1) - *left))) &
+           last_word_mask(width);
+}
+/* --------------------------------------------------------------------------
+ * rotate_wide
+ */
+static void
+rotate_wide(lanes_t* const group, const size_t width, const size_t left)
+{
+  const size_t n = (width + 63) / 64;
+  const unsigned tail = width % 64;
+  const uint64_t last_mask = last_word_mask(width);
+  const size_t base = width / 64;
+  lanes_t scratch[2 * MAX_WORDS + 1];
+
+  // scratch holds the group at bit 0 and again at bit width.
+  memset(scratch + n, 0, (n + 1) * sizeof(lanes_t));
+  for (size_t i = 0; i < n; i++) {
+    scratch[i] = group[i];
+  }
+  for (size_t i = 0; i < n; i++) {
+    scratch[base + i] |= group[i] << tail;
+    if (tail != 0) {
+      scratch[base + i + 1] |= group[i] >> (64 - tail);
+    }
+  }
+
+  const size_t q0 = left / 64;
+  const unsigned shift = left % 64;
+  if (shift == 0) {
+    for (size_t i = 0; i < n; i++) {
+      group[i] = scratch[q0 + i];
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      group[i] = (scratch[q0 + i] >> shift) |
+                 (scratch[q0 + i + 1] << (64 - shift));
+    }
+  }
+  group[n - 1] &= last_mask;
+}
+/* --------------------------------------------------------------------------
+ * rotate_lane
+ */
+static void
+rotate_lane(lanes_t* const group,
+            const size_t width,
+            const unsigned lane,
+            const size_t left)
+{
+  const size_t n = (width + 63) / 64;
+  const unsigned tail = width % 64;
+  const size_t base = width / 64;
+  uint64_t scratch[2 * MAX_WORDS + 1];
+
+  memset(scratch + n, 0, (n + 1) * sizeof(uint64_t));
+  for (size_t i = 0; i < n; i++) {
+    scratch[i] = group[i][lane];
+  }
+  for (size_t i = 0; i < n; i++) {
+    const uint64_t word = group[i][lane];
+    scratch[base + i] |= word << tail;
+    if (tail != 0) {
+      scratch[base + i + 1] |= word >> (64 - tail);
+    }
+  }
+
+  const size_t q0 = left / 64;
+  const unsigned shift = left % 64;
+  for (size_t i = 0; i < n; i++) {
+    group[i][lane] = shift == 0 ? scratch[q0 + i] :
+                     (scratch[q0 + i] >> shift) |
+                     (scratch[q0 + i + 1] << (64 - shift));
+  }
+  group[n - 1][lane] &= last_word_mask(width);
+}
+/* --------------------------------------------------------------------------
+ * last_word_mask
+ */
+static inline uint64_t
+last_word_mask(const size_t width)
+{
+  const unsigned tail = width % 64;
+  return tail == 0 ? ~(uint64_t)0 : ((uint64_t)1 << tail) - 1;
+}
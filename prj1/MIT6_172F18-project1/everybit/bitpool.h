@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Pools of many small bit vectors of one width, rotated in batches.
+//
+// A bitpool_t holds count vectors of width bits each (1 to
+// BITPOOL_MAX_WIDTH) in one allocation.  Rotating a pool rotates every
+// vector with a single call, so the per-call work of bitarray_rotate is
+// paid once per batch rather than once per vector.  The vectors are stored
+// in groups of BITPOOL_LANES, word-interleaved: word i of the vectors of a
+// group sits in one run of BITPOOL_LANES words, so one SIMD instruction
+// works on a word of every vector in the group.
+
+#ifndef BITPOOL_H
+#define BITPOOL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "./bitarray.h"
+
+// ********************************* Types **********************************
+
+// Abstract data type representing a pool of bit vectors.
+typedef struct bitpool bitpool_t;
+
+// Widest vector a pool can hold, in bits.
+#define BITPOOL_MAX_WIDTH 2048
+
+// Number of vectors whose words are interleaved, and rotated together.
+#define BITPOOL_LANES 4
+
+// ******************************* Prototypes *******************************
+
+// Allocates a pool of count vectors of width bits, all clear.  Returns NULL
+// if width is 0 or more than BITPOOL_MAX_WIDTH, or if there is not enough
+// memory.
+bitpool_t* bitpool_new(const size_t width, const size_t count);
+
+// Frees a pool allocated by bitpool_new.
+void bitpool_free(bitpool_t* const pool);
+
+size_t bitpool_get_width(const bitpool_t* const pool);
+size_t bitpool_get_count(const bitpool_t* const pool);
+
+// Reads or writes bit bit_index of vector index.
+bool bitpool_get(const bitpool_t* const pool,
+                 const size_t index,
+                 const size_t bit_index);
+void bitpool_set(bitpool_t* const pool,
+                 const size_t index,
+                 const size_t bit_index,
+                 const bool value);
+
+// Copies width bits of src, starting at src_offset, into vector index.
+void bitpool_load(bitpool_t* const pool,
+                  const size_t index,
+                  const bitarray_t* const src,
+                  const size_t src_offset);
+
+// Copies vector index into width bits of dst, starting at dst_offset.
+// Loads and stores stage the bits in the pool, so a pool must not be loaded
+// from or stored to by two threads at once.
+void bitpool_store(bitpool_t* const pool,
+                   const size_t index,
+                   bitarray_t* const dst,
+                   const size_t dst_offset);
+
+// Rotates every vector right by bit_right_amount (left if negative), as
+// bitarray_rotate would rotate a bit array of the pool's width.
+void bitpool_rotate_all(bitpool_t* const pool, const ssize_t bit_right_amount);
+
+// Rotates vector i right by bit_right_amounts[i], for every vector.
+void bitpool_rotate_each(bitpool_t* const pool,
+                         const ssize_t* const bit_right_amounts);
+
+#endif  // BITPOOL_H
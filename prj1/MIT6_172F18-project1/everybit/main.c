@@ -26,17 +26,34 @@
 // We need _POSIX_C_SOURCE >= 2 to use getopt.
 #define _POSIX_C_SOURCE 200112L
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <pthread.h>
 #include <unistd.h>
+#include "./bitarray.h"
+#include "./bitmap2d.h"
+#include "./bitpool.h"
 #include "./tests.h"
 
+#include "bench.h"
+
 
 // ******************************* Prototypes *******************************
 
 void print_usage(const char* const argv_0);
 
+// Runs bitarray_rotate(), bitarray_reverse(), bitarray_permute(),
+// bitarray_count(), snapshot rollbacks, the bitmap2d rotations and the
+// bitpool batches through the shared benchmark driver.
+void run_benchmarks(void);
+
+// Measures how much a huge rotation slows down a workload whose data
+// should stay cached, with and without streaming stores, and sweeps the
+// streaming prefetch distance.
+void run_pollution_benchmark(void);
+
 
 // ******************************* Functions ********************************
 
@@ -47,7 +64,7 @@ int main(int argc, char** argv) {
   char optchar;
   opterr = 0;
   int selected_test = -1;
-  while ((optchar = getopt(argc, argv, "n:t:sml")) != -1) {
+  while ((optchar = getopt(argc, argv, "n:t:smlbc")) != -1) {
     switch (optchar) {
     case 'n':
       selected_test = atoi(optarg);
@@ -81,6 +98,16 @@ int main(int argc, char** argv) {
       printf("---- END RESULTS ----\n");
       retval = EXIT_SUCCESS;
       goto cleanup;
+    case 'b':
+      // -b benchmarks rotations over a range of array sizes.
+      run_benchmarks();
+      retval = EXIT_SUCCESS;
+      goto cleanup;
+    case 'c':
+      // -c measures the cache pollution of huge rotations.
+      run_pollution_benchmark();
+      retval = EXIT_SUCCESS;
+      goto cleanup;
     }
   }
 
@@ -99,7 +126,409 @@ void print_usage(const char* const argv_0) {
           "\t -m Run a sample medium (0.1s) rotation operation\n"
           "\t -l Run a sample large (1s) rotation operation\n"
           "\t    (note: the provided -[s/m/l] options only test performance and NOT correctness.)\n"
+          "\t -b Benchmark rotations, reversals, word permutations, pattern\n"
+          "\t    counts, snapshot rollbacks and image rotations over up to 2^26\n"
+          "\t    bits (BENCH_* variables in the environment tune the run, see\n"
+          "\t    common/bench.h)\n"
+          "\t -c Measure how much a 512MB rotation slows a cache-resident\n"
+          "\t    workload, with and without streaming stores, and tune the\n"
+          "\t    streaming prefetch distance\n"
           "\t -t tests/default\tRun alltests in the testfile tests/default\n"
           "\t -n 1 -t tests/default\tRun test 1 in the testfile tests/default\n",
           argv_0);
 }
+
+// Rotates the middle three quarters of a random array of state->param bits
+// by a third of that length, so that neither end is byte aligned.
+static void bench_rotate(bench_state_t* state) {
+  const size_t bit_sz = state->param;
+  const size_t bit_offset = bit_sz / 8 + 1;
+  const size_t bit_length = bit_sz * 3 / 4;
+
+  bench_pause(state);
+  bitarray_t* bitarray = bitarray_new(bit_sz);
+  bitarray_randfill(bitarray);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bitarray_rotate(bitarray, bit_offset, bit_length, bit_length / 3);
+  }
+
+  bench_pause(state);
+  bitarray_free(bitarray);
+  bench_resume(state);
+}
+
+// Reverses the same unaligned range as bench_rotate.
+static void bench_reverse(bench_state_t* state) {
+  const size_t bit_sz = state->param;
+  const size_t bit_offset = bit_sz / 8 + 1;
+  const size_t bit_length = bit_sz * 3 / 4;
+
+  bench_pause(state);
+  bitarray_t* bitarray = bitarray_new(bit_sz);
+  bitarray_randfill(bitarray);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bitarray_reverse(bitarray, bit_offset, bit_length);
+  }
+
+  bench_pause(state);
+  bitarray_free(bitarray);
+  bench_resume(state);
+}
+
+// Puts every 64-bit group of an unaligned range into 6-bit bit-reversed
+// order, the FFT input shuffle.
+static void bench_permute(bench_state_t* state) {
+  const size_t bit_sz = state->param;
+  const size_t bit_length = (bit_sz - 1) / 64 * 64;
+
+  bench_pause(state);
+  uint8_t dest[64];
+  for (int i = 0; i < 64; i++) {
+    dest[i] = 0;
+    for (int b = 0; b < 6; b++) {
+      dest[i] |= ((i >> b) & 1) << (5 - b);
+    }
+  }
+  bitperm_t* perm = bitperm_new(dest);
+  bitarray_t* bitarray = bitarray_new(bit_sz);
+  bitarray_randfill(bitarray);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bitarray_permute(bitarray, 1, bit_length, perm);
+  }
+
+  bench_pause(state);
+  bitarray_free(bitarray);
+  bitperm_free(perm);
+  bench_resume(state);
+}
+
+// Counts the occurrences of a 24-bit pattern in a random array.
+static void bench_search(bench_state_t* state) {
+  bench_pause(state);
+  bitarray_t* bitarray = bitarray_new(state->param);
+  bitarray_randfill(bitarray);
+  bench_resume(state);
+
+  size_t matches = 0;
+  for (int64_t i = 0; i < state->iterations; i++) {
+    matches += bitarray_count(bitarray, 0x5a3c96, 24);
+  }
+  __asm__ volatile("" : : "r"(matches));
+
+  bench_pause(state);
+  bitarray_free(bitarray);
+  bench_resume(state);
+}
+
+// Takes a snapshot, rotates up to 4096 bits in the middle of the array
+// and rolls back, which should cost the same at every array size.
+static void bench_snapshot(bench_state_t* state) {
+  const size_t bit_sz = state->param;
+  const size_t bit_length = bit_sz / 2 < 4096 ? bit_sz / 2 : 4096;
+
+  bench_pause(state);
+  bitarray_t* bitarray = bitarray_new(bit_sz);
+  bitarray_randfill(bitarray);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bitarray_snapshot(bitarray);
+    bitarray_rotate(bitarray, bit_sz / 2, bit_length, 17);
+    bitarray_restore(bitarray);
+  }
+
+  bench_pause(state);
+  bitarray_free(bitarray);
+  bench_resume(state);
+}
+
+// Width of the images in the bitmap benchmarks, which have state->param
+// pixels.  Not a multiple of 64, so packed rows start at every offset.
+#define BENCH_IMAGE_WIDTH 1000
+
+// Rotates every row of a packed image with one bitarray_rotate per row,
+// the baseline for bitmap2d_rotate_rows.
+static void bench_packed_rows(bench_state_t* state) {
+  const size_t height = state->param / BENCH_IMAGE_WIDTH;
+
+  bench_pause(state);
+  bitarray_t* bitarray = bitarray_new(height * BENCH_IMAGE_WIDTH);
+  bitarray_randfill(bitarray);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    for (size_t y = 0; y < height; y++) {
+      bitarray_rotate(bitarray, y * BENCH_IMAGE_WIDTH, BENCH_IMAGE_WIDTH, 17);
+    }
+  }
+
+  bench_pause(state);
+  bitarray_free(bitarray);
+  bench_resume(state);
+}
+
+// Rotates every row of the same image held as a bitmap2d_t.
+static void bench_bitmap_rows(bench_state_t* state) {
+  const size_t height = state->param / BENCH_IMAGE_WIDTH;
+
+  bench_pause(state);
+  bitmap2d_t* bitmap = bitmap2d_new(BENCH_IMAGE_WIDTH, height);
+  bitarray_randfill(bitmap2d_get_bitarray(bitmap));
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bitmap2d_rotate_rows(bitmap, 17, 1);
+  }
+
+  bench_pause(state);
+  bitmap2d_free(bitmap);
+  bench_resume(state);
+}
+
+// Moves every row of the image down by five.
+static void bench_bitmap_columns(bench_state_t* state) {
+  const size_t height = state->param / BENCH_IMAGE_WIDTH;
+
+  bench_pause(state);
+  bitmap2d_t* bitmap = bitmap2d_new(BENCH_IMAGE_WIDTH, height);
+  bitarray_randfill(bitmap2d_get_bitarray(bitmap));
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bitmap2d_rotate_columns(bitmap, 0, BENCH_IMAGE_WIDTH, 5, 1);
+  }
+
+  bench_pause(state);
+  bitmap2d_free(bitmap);
+  bench_resume(state);
+}
+
+// Vector widths of the pool benchmarks: one word, and four words.
+static size_t bench_narrow_width = 64;
+static size_t bench_wide_width = 256;
+
+// Rotates state->param vectors of *state->arg bits, packed one after the
+// other, with one bitarray_rotate per vector: the baseline for bitpool.
+static void bench_packed_vectors(bench_state_t* state) {
+  const size_t width = *(const size_t*) state->arg;
+  const size_t count = state->param;
+
+  bench_pause(state);
+  bitarray_t* bitarray = bitarray_new(count * width);
+  bitarray_randfill(bitarray);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    for (size_t v = 0; v < count; v++) {
+      bitarray_rotate(bitarray, v * width, width, 17);
+    }
+  }
+
+  bench_pause(state);
+  bitarray_free(bitarray);
+  bench_resume(state);
+}
+
+// Rotates the same vectors held in a bitpool_t, in one batch.
+static void bench_pool_vectors(bench_state_t* state) {
+  const size_t width = *(const size_t*) state->arg;
+  const size_t count = state->param;
+
+  bench_pause(state);
+  bitpool_t* pool = bitpool_new(width, count);
+  bitarray_t* bitarray = bitarray_new(width);
+  for (size_t v = 0; v < count; v++) {
+    bitarray_randfill(bitarray);
+    bitpool_load(pool, v, bitarray, 0);
+  }
+  bitarray_free(bitarray);
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    bitpool_rotate_all(pool, 17);
+  }
+
+  bench_pause(state);
+  bitpool_free(pool);
+  bench_resume(state);
+}
+
+void run_benchmarks(void) {
+  const bench_options_t opts = bench_options_from_env();
+  bench_register_range("bitarray_rotate", bench_rotate, NULL,
+                       1 << 8, 1 << 26, 8);
+  bench_register_range("bitarray_reverse", bench_reverse, NULL,
+                       1 << 8, 1 << 26, 8);
+  bench_register_range("bitarray_permute", bench_permute, NULL,
+                       1 << 8, 1 << 26, 8);
+  bench_register_range("bitarray_count", bench_search, NULL,
+                       1 << 8, 1 << 26, 8);
+  bench_register_range("bitarray_snapshot", bench_snapshot, NULL,
+                       1 << 8, 1 << 26, 8);
+  bench_register_range("packed_rows_rotate", bench_packed_rows, NULL,
+                       1 << 14, 1 << 26, 8);
+  bench_register_range("bitmap2d_rotate_rows", bench_bitmap_rows, NULL,
+                       1 << 14, 1 << 26, 8);
+  bench_register_range("bitmap2d_rotate_columns", bench_bitmap_columns, NULL,
+                       1 << 14, 1 << 26, 8);
+  bench_register_range("packed_vectors_rotate/64", bench_packed_vectors,
+                       &bench_narrow_width, 1 << 6, 1 << 18, 8);
+  bench_register_range("bitpool_rotate_all/64", bench_pool_vectors,
+                       &bench_narrow_width, 1 << 6, 1 << 18, 8);
+  bench_register_range("packed_vectors_rotate/256", bench_packed_vectors,
+                       &bench_wide_width, 1 << 6, 1 << 18, 8);
+  bench_register_range("bitpool_rotate_all/256", bench_pool_vectors,
+                       &bench_wide_width, 1 << 6, 1 << 18, 8);
+  bench_run_all(&opts);
+  bitarray_cleanup_lut_manager();
+}
+
+// Size of the array rotated by the pollution benchmark, and of the working
+// set of the workload that runs alongside it.
+#define POLLUTION_ARRAY_BITS ((size_t)1 << 32)
+#define POLLUTION_VICTIM_BYTES ((size_t)8 << 20)
+
+// A workload that chases a random cycle through its working set until told
+// to stop, counting the loads it completed.
+typedef struct {
+  const size_t* next;
+  int stop;
+  uint64_t loads;
+  double seconds;
+} victim_t;
+
+static void* victim_run(void* arg) {
+  victim_t* const victim = arg;
+  size_t p = 0;
+  uint64_t loads = 0;
+  const fasttime_t start = gettime();
+  while (!__atomic_load_n(&victim->stop, __ATOMIC_RELAXED)) {
+    for (int i = 0; i < 1024; i++) {
+      p = victim->next[p];
+    }
+    loads += 1024;
+  }
+  victim->seconds = tdiff(start, gettime());
+  victim->loads = loads;
+  __asm__ volatile("" : : "r"(p));
+  return NULL;
+}
+
+// Returns the time in ns of one load of a full pass over the victim's
+// cycle, which is also how long it takes to bring the set back in.
+static double victim_pass(const size_t* const next, const size_t n) {
+  size_t p = 0;
+  const fasttime_t start = gettime();
+  for (size_t i = 0; i < n; i++) {
+    p = next[p];
+  }
+  const double seconds = tdiff(start, gettime());
+  __asm__ volatile("" : : "r"(p));
+  return seconds * 1e9 / n;
+}
+
+void run_pollution_benchmark(void) {
+  // Sattolo's algorithm gives a single cycle through every entry.
+  const size_t n = POLLUTION_VICTIM_BYTES / sizeof(size_t);
+  size_t* const next = malloc(n * sizeof(size_t));
+  bitarray_t* const bitarray = bitarray_new(POLLUTION_ARRAY_BITS);
+  if (next == NULL || bitarray == NULL) {
+    fprintf(stderr, "Error: not enough memory\n");
+    free(next);
+    bitarray_free(bitarray);
+    return;
+  }
+  unsigned int seed = 1;
+  for (size_t i = 0; i < n; i++) {
+    next[i] = i;
+  }
+  for (size_t i = n - 1; i > 0; i--) {
+    const size_t j = (size_t) rand_r(&seed) % i;
+    const size_t tmp = next[i];
+    next[i] = next[j];
+    next[j] = tmp;
+  }
+  bitarray_randfill(bitarray);
+
+  const size_t bit_offset = 3;
+  const size_t bit_length = POLLUTION_ARRAY_BITS - 64;
+  const ssize_t amount = (ssize_t) (bit_length / 3);
+
+  printf("Rotating %zuMB beside a %zuMB working set\n",
+         POLLUTION_ARRAY_BITS / 8 >> 20, POLLUTION_VICTIM_BYTES >> 20);
+  printf("%-10s %12s %14s %14s %14s\n", "mode", "rotate", "alone ns/ld",
+         "beside ns/ld", "after ns/ld");
+  for (int streaming = 0; streaming < 2; streaming++) {
+    bitarray_set_streaming(streaming ? BITARRAY_STREAM_THRESHOLD : SIZE_MAX,
+                           BITARRAY_STREAM_PREFETCH);
+
+    // Warm the working set twice, and keep the second pass as the
+    // undisturbed cost of a load.
+    victim_pass(next, n);
+    const double alone = victim_pass(next, n);
+
+    victim_t victim = { next, 0, 0, 0.0 };
+    pthread_t thread;
+    const bool corun = pthread_create(&thread, NULL, victim_run, &victim) == 0;
+    const fasttime_t start = gettime();
+    bitarray_rotate(bitarray, bit_offset, bit_length, amount);
+    const double rotate = tdiff(start, gettime());
+    double beside = 0.0;
+    if (corun) {
+      __atomic_store_n(&victim.stop, 1, __ATOMIC_RELAXED);
+      pthread_join(thread, NULL);
+      beside = victim.loads != 0 ? victim.seconds * 1e9 / victim.loads : 0.0;
+    }
+
+    // Warm again, rotate alone, and time the pass that reloads the set.
+    victim_pass(next, n);
+    bitarray_rotate(bitarray, bit_offset, bit_length, -amount);
+    const double after = victim_pass(next, n);
+
+    printf("%-10s %11.3fs %14.2f %14.2f %14.2f\n",
+           streaming ? "streaming" : "cached", rotate, alone, beside, after);
+  }
+
+  printf("\nReversal of %zuMB by prefetch distance\n",
+         POLLUTION_ARRAY_BITS / 8 >> 20);
+  printf("%10s %12s\n", "bytes", "reverse");
+  // The first entry reverses with ordinary stores, for reference.
+  const size_t distances[] = { SIZE_MAX, 0, 128, 256, 512, 1024, 2048, 4096,
+                               8192 };
+  size_t best = 0;
+  double best_time = 0.0;
+  for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+    const bool cached = distances[i] == SIZE_MAX;
+    bitarray_set_streaming(cached ? SIZE_MAX : BITARRAY_STREAM_THRESHOLD,
+                           cached ? 0 : distances[i]);
+    double time = 0.0;
+    for (int trial = 0; trial < 3; trial++) {
+      const fasttime_t start = gettime();
+      bitarray_reverse(bitarray, bit_offset, bit_length);
+      const double t = tdiff(start, gettime());
+      if (trial == 0 || t < time) {
+        time = t;
+      }
+    }
+    if (cached) {
+      printf("%10s %11.3fs\n", "cached", time);
+    } else {
+      printf("%10zu %11.3fs\n", distances[i], time);
+      if (best_time == 0.0 || time < best_time) {
+        best = distances[i];
+        best_time = time;
+      }
+    }
+  }
+  printf("Best prefetch distance: %zu bytes\n", best);
+
+  bitarray_set_streaming(SIZE_MAX, BITARRAY_STREAM_PREFETCH);
+  bitarray_free(bitarray);
+  free(next);
+}
@@ -21,17 +21,26 @@
  **/
 #define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "./bitarray.h"
-#include "./ktiming.h"
+#include "./bitfile.h"
+#include "./bitmap2d.h"
+#include "./bitpool.h"
 #include "./tests.h"
 
+#include "fasttime.h"
+
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_GREEN   "\x1b[32m"
 #define ANSI_COLOR_YELLOW  "\x1b[33m"
@@ -52,6 +61,76 @@ void testutil_rotate(const size_t bit_offset,
                      const size_t bit_length,
                      const ssize_t bit_right_shift_amount);
 
+// Reverses a subarray of test_bitarray in place.
+// Requires that test_bitarray is not NULL.
+void testutil_reverse(const size_t bit_offset,
+                      const size_t bit_length);
+
+// Writes test_bitarray to a temporary file, rotates (or, if reverse is set,
+// reverses) the subarray with the streaming bitfile functions, and reads the
+// result back into test_bitarray.  Small blocks make even short test arrays
+// span several of them.  mode may hold 'd' for O_DIRECT with 4096-byte
+// blocks, 'p' to transform the file in place, and 's' for pread/pwrite
+// instead of io_uring.
+void testutil_file_transform(const size_t bit_offset,
+                             const size_t bit_length,
+                             const ssize_t bit_right_shift_amount,
+                             const bool reverse,
+                             const char* const mode,
+                             const char* const func_name,
+                             const int line);
+
+// Treats test_bitarray as an image of the given width, rows concatenated,
+// and moves its pixels with the bitmap2d functions on three threads: rows
+// right by dx, then the columns [col_offset, col_offset + col_width) down
+// by dy.  Any bits past the last whole row are left alone.
+void testutil_bitmap2d(const size_t width,
+                       const ssize_t dx,
+                       const size_t col_offset,
+                       const size_t col_width,
+                       const ssize_t dy,
+                       const char* const func_name,
+                       const int line);
+
+// Treats test_bitarray as vectors of the given width, concatenated, and
+// rotates them as one bitpool: vector i right by amount + i * step.  With a
+// step of 0 the pool is rotated by bitpool_rotate_all, otherwise by
+// bitpool_rotate_each.  Any bits past the last whole vector are left alone.
+void testutil_bitpool(const size_t width,
+                      const ssize_t amount,
+                      const ssize_t step,
+                      const char* const func_name,
+                      const int line);
+
+// Searches test_bitarray for the pattern given as a string of 0s and 1s,
+// starting at start, and checks the result against expected (-1 for no
+// match).  The serial and parallel searches must agree.
+void testutil_find(const char* const pattern_string,
+                   const size_t start,
+                   const ssize_t expected,
+                   const char* const func_name,
+                   const int line);
+
+// Counts the occurrences of the pattern in test_bitarray and checks the
+// result against expected.  The serial and parallel counts must agree.
+void testutil_count(const char* const pattern_string,
+                    const size_t expected,
+                    const char* const func_name,
+                    const int line);
+
+// Checks bitarray_rank(test_bitarray, bit_index) against expected.
+void testutil_rank(const size_t bit_index,
+                   const size_t expected,
+                   const char* const func_name,
+                   const int line);
+
+// Checks bitarray_select(test_bitarray, rank) against expected (-1 for no
+// such bit).
+void testutil_select(const size_t rank,
+                     const ssize_t expected,
+                     const char* const func_name,
+                     const int line);
+
 // Checks that the rotation is valid given the size of test_bitarray.
 // Causes a test suite failure if the input is invalid.
 void testutil_require_valid_input(const size_t bit_offset,
@@ -86,6 +165,10 @@ static bool boolfromchar(const char c);
 // Retrieves a char* argument from a buffer in strtok.
 char* next_arg_char();
 
+// Retrieves an optional trailing mode argument from a buffer in strtok, or
+// "" if the line has none.
+const char* next_mode_arg();
+
 
 // ******************************** Globals *********************************
 // Some global variables make it easier to run individual tests.
@@ -248,6 +331,224 @@ void testutil_rotate(const size_t bit_offset,
   }
 }
 
+void testutil_reverse(const size_t bit_offset,
+                      const size_t bit_length) {
+  assert(test_bitarray != NULL);
+  bitarray_reverse(test_bitarray, bit_offset, bit_length);
+  if (test_verbose) {
+    bitarray_fprint(stdout, test_bitarray);
+    fprintf(stdout, " reverse off=%zu, len=%zu\n", bit_offset, bit_length);
+  }
+}
+
+void testutil_file_transform(const size_t bit_offset,
+                             const size_t bit_length,
+                             const ssize_t bit_right_shift_amount,
+                             const bool reverse,
+                             const char* const mode,
+                             const char* const func_name,
+                             const int line) {
+  assert(test_bitarray != NULL);
+  const size_t bit_sz = bitarray_get_bit_sz(test_bitarray);
+  const size_t num_bytes = (bit_sz + 7) / 8;
+  const bool direct = strchr(mode, 'd') != NULL;
+  const bool in_place = strchr(mode, 'p') != NULL;
+  const bitfile_options_t options = {
+    direct ? 4096 : 64, 3, direct, strchr(mode, 's') == NULL
+  };
+  char src_path[] = "/tmp/everybit-src-XXXXXX";
+  char dst_path[] = "/tmp/everybit-dst-XXXXXX";
+  const int src = mkstemp(src_path);
+  const int dst = mkstemp(dst_path);
+  const char* const out_path = in_place ? src_path : dst_path;
+  bitarray_t* const result = bitarray_new(bit_sz);
+  bool ok = src >= 0 && dst >= 0 && result != NULL &&
+            write(src, bitarray_get_buf(test_bitarray), num_bytes) ==
+            (ssize_t) num_bytes;
+  if (ok) {
+    const int status = reverse ?
+      bitfile_reverse(src_path, out_path, bit_offset, bit_length, &options) :
+      bitfile_rotate(src_path, out_path, bit_offset, bit_length,
+                     bit_right_shift_amount, &options);
+    // In place, the result is a new file renamed over the old one.
+    const int out = status == 0 ? open(out_path, O_RDONLY) : -1;
+    struct stat out_stat;
+    ok = out >= 0 && fstat(out, &out_stat) == 0 &&
+         out_stat.st_size == (off_t) num_bytes &&
+         pread(out, bitarray_get_buf(result), num_bytes, 0) ==
+         (ssize_t) num_bytes;
+    if (out >= 0) {
+      close(out);
+    }
+  }
+  if (ok) {
+    bitarray_copy(test_bitarray, 0, result, 0, bit_sz);
+  } else {
+    TEST_FAIL_WITH_NAME(func_name, line, " File %s failed: %s",
+                        reverse ? "reverse" : "rotate", strerror(errno));
+  }
+  if (src >= 0) {
+    close(src);
+    unlink(src_path);
+  }
+  if (dst >= 0) {
+    close(dst);
+    unlink(dst_path);
+  }
+  bitarray_free(result);
+  if (test_verbose) {
+    bitarray_fprint(stdout, test_bitarray);
+    fprintf(stdout, " file %s off=%zu, len=%zu, amnt=%zd, mode=%s\n",
+            reverse ? "reverse" : "rotate", bit_offset, bit_length,
+            bit_right_shift_amount, mode);
+  }
+}
+
+void testutil_bitmap2d(const size_t width,
+                       const ssize_t dx,
+                       const size_t col_offset,
+                       const size_t col_width,
+                       const ssize_t dy,
+                       const char* const func_name,
+                       const int line) {
+  assert(test_bitarray != NULL);
+  assert(width > 0 && col_offset + col_width <= width);
+  const size_t height = bitarray_get_bit_sz(test_bitarray) / width;
+  bitmap2d_t* const bitmap = bitmap2d_from_packed(test_bitarray, width,
+                                                  height);
+  if (bitmap == NULL ||
+      !bitmap2d_rotate_rows(bitmap, dx, 3) ||
+      !bitmap2d_rotate_columns(bitmap, col_offset, col_width, dy, 3)) {
+    TEST_FAIL_WITH_NAME(func_name, line, " Could not move the pixels.");
+  } else {
+    bitmap2d_to_packed(bitmap, test_bitarray);
+  }
+  bitmap2d_free(bitmap);
+  if (test_verbose) {
+    bitarray_fprint(stdout, test_bitarray);
+    fprintf(stdout, " bitmap2d width=%zu, dx=%zd, cols=%zu+%zu, dy=%zd\n",
+            width, dx, col_offset, col_width, dy);
+  }
+}
+
+void testutil_bitpool(const size_t width,
+                      const ssize_t amount,
+                      const ssize_t step,
+                      const char* const func_name,
+                      const int line) {
+  assert(test_bitarray != NULL);
+  const size_t count = bitarray_get_bit_sz(test_bitarray) / width;
+  bitpool_t* const pool = bitpool_new(width, count);
+  ssize_t* const amounts = malloc((count + 1) * sizeof(ssize_t));
+  if (pool == NULL || amounts == NULL) {
+    TEST_FAIL_WITH_NAME(func_name, line, " Could not create the pool.");
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      bitpool_load(pool, i, test_bitarray, i * width);
+      amounts[i] = amount + (ssize_t) i * step;
+    }
+    if (step == 0) {
+      bitpool_rotate_all(pool, amount);
+    } else {
+      bitpool_rotate_each(pool, amounts);
+    }
+    for (size_t i = 0; i < count; i++) {
+      bitpool_store(pool, i, test_bitarray, i * width);
+    }
+  }
+  free(amounts);
+  bitpool_free(pool);
+  if (test_verbose) {
+    bitarray_fprint(stdout, test_bitarray);
+    fprintf(stdout, " bitpool width=%zu, amnt=%zd, step=%zd\n", width, amount,
+            step);
+  }
+}
+
+// Packs a string of 0s and 1s into a bitarray_find pattern.
+static uint64_t pattern_from_string(const char* const pattern_string) {
+  uint64_t pattern = 0;
+  for (size_t i = 0; pattern_string[i] != '\0'; i++) {
+    pattern |= (uint64_t) boolfromchar(pattern_string[i]) << i;
+  }
+  return pattern;
+}
+
+void testutil_find(const char* const pattern_string,
+                   const size_t start,
+                   const ssize_t expected,
+                   const char* const func_name,
+                   const int line) {
+  assert(test_bitarray != NULL);
+  const size_t pattern_len = strlen(pattern_string);
+  const uint64_t pattern = pattern_from_string(pattern_string);
+  const size_t want = expected < 0 ? BITARRAY_NOT_FOUND : (size_t) expected;
+
+  const size_t found = bitarray_find(test_bitarray, pattern, pattern_len,
+                                     start);
+  const size_t found_parallel =
+    bitarray_find_parallel(test_bitarray, pattern, pattern_len, start, 4);
+  if (found != want || found_parallel != want) {
+    TEST_FAIL_WITH_NAME(func_name, line, " Incorrect match for %s from %zu.\n"
+                        "    Expected: %zd\n    Actual:   %zd (parallel %zd)",
+                        pattern_string, start, expected,
+                        (ssize_t) found, (ssize_t) found_parallel);
+  } else {
+    TEST_PASS_WITH_NAME(func_name, line);
+  }
+}
+
+void testutil_count(const char* const pattern_string,
+                    const size_t expected,
+                    const char* const func_name,
+                    const int line) {
+  assert(test_bitarray != NULL);
+  const size_t pattern_len = strlen(pattern_string);
+  const uint64_t pattern = pattern_from_string(pattern_string);
+
+  const size_t count = bitarray_count(test_bitarray, pattern, pattern_len);
+  const size_t count_parallel =
+    bitarray_count_parallel(test_bitarray, pattern, pattern_len, 4);
+  if (count != expected || count_parallel != expected) {
+    TEST_FAIL_WITH_NAME(func_name, line, " Incorrect count for %s.\n"
+                        "    Expected: %zu\n    Actual:   %zu (parallel %zu)",
+                        pattern_string, expected, count, count_parallel);
+  } else {
+    TEST_PASS_WITH_NAME(func_name, line);
+  }
+}
+
+void testutil_rank(const size_t bit_index,
+                   const size_t expected,
+                   const char* const func_name,
+                   const int line) {
+  assert(test_bitarray != NULL);
+  const size_t rank = bitarray_rank(test_bitarray, bit_index);
+  if (rank != expected) {
+    TEST_FAIL_WITH_NAME(func_name, line, " Incorrect rank at %zu.\n"
+                        "    Expected: %zu\n    Actual:   %zu",
+                        bit_index, expected, rank);
+  } else {
+    TEST_PASS_WITH_NAME(func_name, line);
+  }
+}
+
+void testutil_select(const size_t rank,
+                     const ssize_t expected,
+                     const char* const func_name,
+                     const int line) {
+  assert(test_bitarray != NULL);
+  const size_t want = expected < 0 ? BITARRAY_NOT_FOUND : (size_t) expected;
+  const size_t found = bitarray_select(test_bitarray, rank);
+  if (found != want) {
+    TEST_FAIL_WITH_NAME(func_name, line, " Incorrect select of %zu.\n"
+                        "    Expected: %zd\n    Actual:   %zd",
+                        rank, expected, (ssize_t) found);
+  } else {
+    TEST_PASS_WITH_NAME(func_name, line);
+  }
+}
+
 void testutil_require_valid_input(const size_t bit_offset,
                                   const size_t bit_length,
                                   const ssize_t bit_right_shift_amount,
@@ -287,10 +588,10 @@ int timed_rotation(const double time_limit_seconds) {
     testutil_newrand(bit_sz, 6172);
  
     // Time the duration of a rotation
-    const clockmark_t start_time = ktiming_getmark();
+    const fasttime_t start_time = gettime();
     testutil_rotate(bit_offset, bit_length, bit_right_shift_amount);
-    const clockmark_t end_time = ktiming_getmark();
-    double diff_seconds = ktiming_diff_usec(&start_time, &end_time) / 1000000000.0;
+    const fasttime_t end_time = gettime();
+    double diff_seconds = tdiff(start_time, end_time);
 
     //char *str_size = NULL;
     char buf[20];
@@ -333,6 +634,11 @@ char* next_arg_char() {
   return buf;
 }
 
+const char* next_mode_arg() {
+  char* buf = strtok(NULL, " \n");
+  return buf != NULL ? buf : "";
+}
+
 void parse_and_run_tests(const char* filename, int selected_test) {
   test_verbose = false;
   fprintf(stderr, "Testing file %s.\n", filename);
@@ -362,6 +668,8 @@ void parse_and_run_tests(const char* filename, int selected_test) {
       }
 
       fprintf(stderr, "\nRunning test #%d...\n", test);
+      // Every test starts with streaming stores off.
+      bitarray_set_streaming(SIZE_MAX, BITARRAY_STREAM_PREFETCH);
       break;
     case 'n':
       if (!ready_to_run) {
@@ -390,6 +698,186 @@ void parse_and_run_tests(const char* filename, int selected_test) {
         testutil_rotate(offset, length, amount);
       }
       break;
+    case 'v':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t offset = (size_t) NEXT_ARG_LONG();
+        size_t length = (size_t) NEXT_ARG_LONG();
+        testutil_require_valid_input(offset, length, 0, filename, line);
+        testutil_reverse(offset, length);
+      }
+      break;
+    case 'R':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t offset = (size_t) NEXT_ARG_LONG();
+        size_t length = (size_t) NEXT_ARG_LONG();
+        ssize_t amount = (ssize_t) NEXT_ARG_LONG();
+        const char* mode = next_mode_arg();
+        testutil_require_valid_input(offset, length, amount, filename, line);
+        testutil_file_transform(offset, length, amount, false, mode,
+                                filename, line);
+      }
+      break;
+    case 'V':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t offset = (size_t) NEXT_ARG_LONG();
+        size_t length = (size_t) NEXT_ARG_LONG();
+        const char* mode = next_mode_arg();
+        testutil_require_valid_input(offset, length, 0, filename, line);
+        testutil_file_transform(offset, length, 0, true, mode, filename,
+                                line);
+      }
+      break;
+    case 'H':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t width = (size_t) NEXT_ARG_LONG();
+        ssize_t dx = (ssize_t) NEXT_ARG_LONG();
+        testutil_bitmap2d(width, dx, 0, 0, 0, filename, line);
+      }
+      break;
+    case 'W':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t width = (size_t) NEXT_ARG_LONG();
+        size_t col_offset = (size_t) NEXT_ARG_LONG();
+        size_t col_width = (size_t) NEXT_ARG_LONG();
+        ssize_t dy = (ssize_t) NEXT_ARG_LONG();
+        testutil_bitmap2d(width, 0, col_offset, col_width, dy, filename,
+                          line);
+      }
+      break;
+    case 'T':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t width = (size_t) NEXT_ARG_LONG();
+        ssize_t dx = (ssize_t) NEXT_ARG_LONG();
+        ssize_t dy = (ssize_t) NEXT_ARG_LONG();
+        testutil_bitmap2d(width, dx, 0, width, dy, filename, line);
+      }
+      break;
+    case 'B':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t width = (size_t) NEXT_ARG_LONG();
+        ssize_t amount = (ssize_t) NEXT_ARG_LONG();
+        testutil_bitpool(width, amount, 0, filename, line);
+      }
+      break;
+    case 'E':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t width = (size_t) NEXT_ARG_LONG();
+        ssize_t amount = (ssize_t) NEXT_ARG_LONG();
+        ssize_t step = (ssize_t) NEXT_ARG_LONG();
+        testutil_bitpool(width, amount, step, filename, line);
+      }
+      break;
+    case 'P':
+      if (!ready_to_run) {
+        continue;
+      }
+      assert(test_bitarray != NULL);
+      if (!bitarray_snapshot(test_bitarray)) {
+        TEST_FAIL_WITH_NAME(filename, line, " Could not take a snapshot.");
+      }
+      break;
+    case 'U':
+      if (!ready_to_run) {
+        continue;
+      }
+      assert(test_bitarray != NULL);
+      if (!bitarray_restore(test_bitarray)) {
+        TEST_FAIL_WITH_NAME(filename, line, " Could not restore the snapshot.");
+      }
+      break;
+    case 'S':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t threshold = (size_t) NEXT_ARG_LONG();
+        bitarray_set_streaming(threshold, BITARRAY_STREAM_PREFETCH);
+      }
+      break;
+    case 'f':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        char* pattern = strtok(NULL, " ");
+        size_t start = (size_t) NEXT_ARG_LONG();
+        ssize_t expected = (ssize_t) NEXT_ARG_LONG();
+        testutil_find(pattern, start, expected, filename, line);
+      }
+      break;
+    case 'i':
+      if (!ready_to_run) {
+        continue;
+      }
+      assert(test_bitarray != NULL);
+      if (!bitarray_index_build(test_bitarray)) {
+        TEST_FAIL_WITH_NAME(filename, line, " Could not build the index.");
+      }
+      break;
+    case 'b':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t bit_index = (size_t) NEXT_ARG_LONG();
+        bool value = NEXT_ARG_LONG() != 0;
+        bitarray_set(test_bitarray, bit_index, value);
+      }
+      break;
+    case 'k':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t bit_index = (size_t) NEXT_ARG_LONG();
+        size_t expected = (size_t) NEXT_ARG_LONG();
+        testutil_rank(bit_index, expected, filename, line);
+      }
+      break;
+    case 's':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        size_t rank = (size_t) NEXT_ARG_LONG();
+        ssize_t expected = (ssize_t) NEXT_ARG_LONG();
+        testutil_select(rank, expected, filename, line);
+      }
+      break;
+    case 'c':
+      if (!ready_to_run) {
+        continue;
+      }
+      {
+        char* pattern = strtok(NULL, " ");
+        size_t expected = (size_t) NEXT_ARG_LONG();
+        testutil_count(pattern, expected, filename, line);
+      }
+      break;
     default:
       fprintf(stderr, "Unknown command %s", buf);
     }
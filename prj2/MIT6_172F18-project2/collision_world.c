@@ -24,6 +24,8 @@
 #include "./collision_world.h"
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 #include <stdio.h>
@@ -32,11 +34,18 @@
 #include "./intersection_event_list.h"
 #include "./line.h"
 #include "./quadtree.h"
-#include "./fasttime.h"  // For timing instrumentation
+#include "fasttime.h"  // For timing instrumentation
 
-// Cilk reducer support for parallelization
-#include <cilk/cilk.h>
+// Cilk reducer support for parallelization (OpenMP with "make OPENMP=1")
+#include "./parallel.h"
 
+#ifdef _OPENMP
+// The event list reducer as an OpenMP user-defined reduction. Merge order
+// does not matter: the list is sorted after detection.
+#pragma omp declare reduction(merge : IntersectionEventList : \
+    IntersectionEventList_merge(&omp_out, &omp_in)) \
+    initializer(IntersectionEventList_identity(&omp_priv))
+#else
 // Identity and reduce functions for collision counter reducer
 static void collisionCounter_identity(void* v) {
   *(unsigned int*)v = 0;
@@ -45,6 +54,7 @@ static void collisionCounter_identity(void* v) {
 static void collisionCounter_reduce(void* left, void* right) {
   *(unsigned int*)left += *(unsigned int*)right;
 }
+#endif
 
 // Note: Reducers are now declared using cilk_reducer keyword (OpenCilk 2.0 syntax)
 // No need for static keys - the compiler handles reducer management automatically
@@ -81,6 +91,301 @@ static int compareCandidatePairs(const void* a, const void* b) {
   return compareLines(l2_a, l2_b);
 }
 
+// Sort key for spatial reordering: Morton code of a line's midpoint, with
+// the line's position in lines[] before the sort.
+typedef struct {
+  uint32_t code;
+  unsigned int index;
+  unsigned int id;
+} MortonKey;
+
+// Spread the low 16 bits of v to the even bit positions.
+static uint32_t spreadBits16(uint32_t v) {
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// Quantize a coordinate to 16 bits across [lo, hi], clamping lines that
+// have strayed just outside the box.
+static uint32_t quantize16(double value, double lo, double hi) {
+  double u = (value - lo) / (hi - lo);
+  if (u < 0.0) {
+    u = 0.0;
+  } else if (u > 1.0) {
+    u = 1.0;
+  }
+  return (uint32_t)(u * 65535.0);
+}
+
+// Morton (Z-order) code of a line's midpoint: nearby midpoints mostly get
+// nearby codes.
+static uint32_t lineMortonCode(const Line* line) {
+  double midX = (line->p1.x + line->p2.x) / 2.0;
+  double midY = (line->p1.y + line->p2.y) / 2.0;
+  return spreadBits16(quantize16(midX, BOX_XMIN, BOX_XMAX)) |
+         (spreadBits16(quantize16(midY, BOX_YMIN, BOX_YMAX)) << 1);
+}
+
+// Orders keys by Morton code, breaking ties by line ID so that the layout
+// does not depend on the previous one.
+static int compareMortonKeys(const void* a, const void* b) {
+  const MortonKey* keyA = (const MortonKey*)a;
+  const MortonKey* keyB = (const MortonKey*)b;
+  if (keyA->code != keyB->code) {
+    return (keyA->code < keyB->code) ? -1 : 1;
+  }
+  if (keyA->id != keyB->id) {
+    return (keyA->id < keyB->id) ? -1 : 1;
+  }
+  return 0;
+}
+
+// Restore the min-heap property of freeIds[] upward from index i.
+static void siftFreeIdUp(unsigned int* heap, unsigned int i) {
+  while (i > 0) {
+    unsigned int parent = (i - 1) / 2;
+    if (heap[parent] <= heap[i]) {
+      break;
+    }
+    unsigned int tmp = heap[parent];
+    heap[parent] = heap[i];
+    heap[i] = tmp;
+    i = parent;
+  }
+}
+
+// Restore the min-heap property of freeIds[] downward from index i.
+static void siftFreeIdDown(unsigned int* heap, unsigned int n,
+                           unsigned int i) {
+  while (true) {
+    unsigned int smallest = i;
+    unsigned int left = 2 * i + 1;
+    unsigned int right = left + 1;
+    if (left < n && heap[left] < heap[smallest]) {
+      smallest = left;
+    }
+    if (right < n && heap[right] < heap[smallest]) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    unsigned int tmp = heap[smallest];
+    heap[smallest] = heap[i];
+    heap[i] = tmp;
+    i = smallest;
+  }
+}
+
+// Mark an id free for reuse. O(log n).
+static void pushFreeId(CollisionWorld* collisionWorld, unsigned int id) {
+  unsigned int i = collisionWorld->numFreeIds++;
+  collisionWorld->freeIds[i] = id;
+  siftFreeIdUp(collisionWorld->freeIds, i);
+}
+
+// Take the smallest free id. O(log n). Requires numFreeIds > 0.
+static unsigned int popFreeId(CollisionWorld* collisionWorld) {
+  unsigned int* heap = collisionWorld->freeIds;
+  unsigned int id = heap[0];
+  heap[0] = heap[--collisionWorld->numFreeIds];
+  siftFreeIdDown(heap, collisionWorld->numFreeIds, 0);
+  return id;
+}
+
+// Take a specific id off the free heap, for callers that choose their own
+// ids (CollisionWorld_addLine). O(n), but loaders only reach it when they
+// add ids out of order.
+static void dropFreeId(CollisionWorld* collisionWorld, unsigned int id) {
+  unsigned int* heap = collisionWorld->freeIds;
+  for (unsigned int i = 0; i < collisionWorld->numFreeIds; i++) {
+    if (heap[i] == id) {
+      heap[i] = heap[--collisionWorld->numFreeIds];
+      if (i < collisionWorld->numFreeIds) {
+        siftFreeIdDown(heap, collisionWorld->numFreeIds, i);
+        siftFreeIdUp(heap, i);
+      }
+      return;
+    }
+  }
+}
+
+// Make room in slotOfId[] and freeIds[] for ids below `needed`.
+static bool growIds(CollisionWorld* collisionWorld, unsigned int needed) {
+  if (needed <= collisionWorld->idCapacity) {
+    return true;
+  }
+  unsigned int newCapacity = collisionWorld->idCapacity * 2;
+  if (newCapacity < needed) {
+    newCapacity = needed;
+  }
+  unsigned int* slotOfId = realloc(collisionWorld->slotOfId,
+                                   newCapacity * sizeof(unsigned int));
+  if (slotOfId == NULL) {
+    return false;
+  }
+  collisionWorld->slotOfId = slotOfId;
+  unsigned int* freeIds = realloc(collisionWorld->freeIds,
+                                  newCapacity * sizeof(unsigned int));
+  if (freeIds == NULL) {
+    return false;
+  }
+  collisionWorld->freeIds = freeIds;
+  for (unsigned int id = collisionWorld->idCapacity; id < newCapacity; id++) {
+    slotOfId[id] = COLLISIONWORLD_NO_SLOT;
+  }
+  collisionWorld->idCapacity = newCapacity;
+  return true;
+}
+
+// Make room for at least `needed` lines. Reordered storage may move, so
+// lines[] and linesInInputOrder[] are repointed into its new location.
+static bool growLineStorage(CollisionWorld* collisionWorld,
+                            unsigned int needed) {
+  if (needed <= collisionWorld->capacity) {
+    return true;
+  }
+  unsigned int newCapacity = collisionWorld->capacity * 2;
+  if (newCapacity < needed) {
+    newCapacity = needed;
+  }
+  Line** lines = realloc(collisionWorld->lines, newCapacity * sizeof(Line*));
+  if (lines == NULL) {
+    return false;
+  }
+  collisionWorld->lines = lines;
+
+  if (collisionWorld->lineStorage != NULL) {
+    Line** inputOrder = realloc(collisionWorld->linesInInputOrder,
+                                newCapacity * sizeof(Line*));
+    if (inputOrder == NULL) {
+      return false;
+    }
+    collisionWorld->linesInInputOrder = inputOrder;
+    unsigned int* position = realloc(collisionWorld->inputPosition,
+                                     newCapacity * sizeof(unsigned int));
+    if (position == NULL) {
+      return false;
+    }
+    collisionWorld->inputPosition = position;
+    // The spare buffer is only scratch between reorders; replace it.
+    Line* spare = malloc(newCapacity * sizeof(Line));
+    if (spare == NULL) {
+      return false;
+    }
+    Line* storage = realloc(collisionWorld->lineStorage,
+                            newCapacity * sizeof(Line));
+    if (storage == NULL) {
+      free(spare);
+      return false;
+    }
+    free(collisionWorld->spareStorage);
+    collisionWorld->spareStorage = spare;
+    collisionWorld->lineStorage = storage;
+    for (unsigned int i = 0; i < collisionWorld->numOfLines; i++) {
+      lines[i] = &storage[i];
+      inputOrder[position[i]] = &storage[i];
+    }
+  }
+
+  collisionWorld->capacity = newCapacity;
+  return true;
+}
+
+// Append a line whose id is already reserved. Storage must have room.
+static void storeLine(CollisionWorld* collisionWorld, Line* line) {
+  unsigned int slot = collisionWorld->numOfLines;
+  if (collisionWorld->lineStorage != NULL) {
+    // Reordered: lines live in lineStorage, and a new line is last in
+    // input order until the next reorder moves it.
+    collisionWorld->lineStorage[slot] = *line;
+    free(line);
+    line = &collisionWorld->lineStorage[slot];
+    collisionWorld->inputPosition[slot] = slot;
+    collisionWorld->linesInInputOrder[slot] = line;
+  }
+  collisionWorld->lines[slot] = line;
+  collisionWorld->slotOfId[line->id] = slot;
+  collisionWorld->numOfLines++;
+}
+
+// Copy the lines into contiguous storage in Morton order and repoint
+// lines[], linesInInputOrder[] and inputPosition[] at the copies. If memory
+// runs out the current layout is simply kept.
+static void reorderLines(CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  if (n == 0) {
+    return;
+  }
+
+  if (collisionWorld->lineStorage == NULL) {
+    // First reorder: set up both buffers and the id map, with room for
+    // lines added later.
+    unsigned int capacity = collisionWorld->capacity;
+    Line* storage = malloc(capacity * sizeof(Line));
+    Line* spare = malloc(capacity * sizeof(Line));
+    Line** inputOrder = malloc(capacity * sizeof(Line*));
+    unsigned int* position = malloc(capacity * sizeof(unsigned int));
+    if (storage == NULL || spare == NULL || inputOrder == NULL ||
+        position == NULL) {
+      free(storage);
+      free(spare);
+      free(inputOrder);
+      free(position);
+      return;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+      position[i] = i;
+    }
+    // Move the lines out of their individual allocations.
+    for (unsigned int i = 0; i < n; i++) {
+      storage[i] = *collisionWorld->lines[i];
+      free(collisionWorld->lines[i]);
+      collisionWorld->lines[i] = &storage[i];
+    }
+    collisionWorld->lineStorage = storage;
+    collisionWorld->spareStorage = spare;
+    collisionWorld->linesInInputOrder = inputOrder;
+    collisionWorld->inputPosition = position;
+  }
+
+  MortonKey* keys = malloc(n * sizeof(MortonKey));
+  unsigned int* newPosition = malloc(n * sizeof(unsigned int));
+  if (keys == NULL || newPosition == NULL) {
+    free(keys);
+    free(newPosition);
+    return;
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    keys[i].code = lineMortonCode(collisionWorld->lines[i]);
+    keys[i].index = i;
+    keys[i].id = collisionWorld->lines[i]->id;
+  }
+  qsort(keys, n, sizeof(MortonKey), compareMortonKeys);
+
+  Line* fresh = collisionWorld->spareStorage;
+  for (unsigned int k = 0; k < n; k++) {
+    unsigned int from = keys[k].index;
+    fresh[k] = *collisionWorld->lines[from];
+    newPosition[k] = collisionWorld->inputPosition[from];
+  }
+  for (unsigned int k = 0; k < n; k++) {
+    collisionWorld->lines[k] = &fresh[k];
+    collisionWorld->linesInInputOrder[newPosition[k]] = &fresh[k];
+    collisionWorld->slotOfId[fresh[k].id] = k;
+  }
+  memcpy(collisionWorld->inputPosition, newPosition, n * sizeof(unsigned int));
+
+  collisionWorld->spareStorage = collisionWorld->lineStorage;
+  collisionWorld->lineStorage = fresh;
+  free(keys);
+  free(newPosition);
+}
+
 CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
   assert(capacity > 0);
 
@@ -94,19 +399,45 @@ CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
   collisionWorld->timeStep = 0.5;
   collisionWorld->lines = malloc(capacity * sizeof(Line*));
   collisionWorld->numOfLines = 0;
+  collisionWorld->capacity = capacity;
+
+  // Id arrays are sized by the first line added.
+  collisionWorld->slotOfId = NULL;
+  collisionWorld->freeIds = NULL;
+  collisionWorld->numFreeIds = 0;
+  collisionWorld->nextId = 0;
+  collisionWorld->idCapacity = 0;
   
   // Initialize collision detection algorithm to brute-force by default.
   // Can be changed later via CollisionWorld_setUseQuadtree().
   collisionWorld->useQuadtree = false;
+
+  // Line storage stays in input order unless reordering is enabled.
+  collisionWorld->reorderInterval = 0;
+  collisionWorld->framesSinceReorder = 0;
+  collisionWorld->lineStorage = NULL;
+  collisionWorld->spareStorage = NULL;
+  collisionWorld->linesInInputOrder = NULL;
+  collisionWorld->inputPosition = NULL;
   
   return collisionWorld;
 }
 
 void CollisionWorld_delete(CollisionWorld* collisionWorld) {
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    free(collisionWorld->lines[i]);
+  if (collisionWorld->lineStorage != NULL) {
+    // Reordered: the lines live in the storage arrays.
+    free(collisionWorld->lineStorage);
+    free(collisionWorld->spareStorage);
+    free(collisionWorld->linesInInputOrder);
+    free(collisionWorld->inputPosition);
+  } else {
+    for (int i = 0; i < collisionWorld->numOfLines; i++) {
+      free(collisionWorld->lines[i]);
+    }
   }
   free(collisionWorld->lines);
+  free(collisionWorld->slotOfId);
+  free(collisionWorld->freeIds);
   free(collisionWorld);
 }
 
@@ -115,8 +446,137 @@ unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld) {
 }
 
 void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line) {
-  collisionWorld->lines[collisionWorld->numOfLines] = line;
-  collisionWorld->numOfLines++;
+  unsigned int id = line->id;
+  if (!growIds(collisionWorld, id + 1) ||
+      !growLineStorage(collisionWorld, collisionWorld->numOfLines + 1)) {
+    fprintf(stderr, "CollisionWorld_addLine: out of memory\n");
+    exit(1);
+  }
+  assert(collisionWorld->slotOfId[id] == COLLISIONWORLD_NO_SLOT);
+
+  // Ids skipped by the caller become free; a free id being claimed leaves
+  // the heap.
+  if (id >= collisionWorld->nextId) {
+    for (unsigned int skipped = collisionWorld->nextId; skipped < id;
+         skipped++) {
+      pushFreeId(collisionWorld, skipped);
+    }
+    collisionWorld->nextId = id + 1;
+  } else {
+    dropFreeId(collisionWorld, id);
+  }
+  storeLine(collisionWorld, line);
+}
+
+bool CollisionWorld_adoptLines(CollisionWorld* collisionWorld, Line* lines,
+                               unsigned int numOfLines) {
+  assert(collisionWorld->numOfLines == 0);
+  assert(collisionWorld->lineStorage == NULL);
+  if (numOfLines == 0) {
+    free(lines);
+    return true;
+  }
+
+  // The adopted array becomes lineStorage, as if just reordered, so every
+  // reordering array is sized to it.
+  Line** pointers = malloc(numOfLines * sizeof(Line*));
+  Line* spare = malloc(numOfLines * sizeof(Line));
+  Line** inputOrder = malloc(numOfLines * sizeof(Line*));
+  unsigned int* position = malloc(numOfLines * sizeof(unsigned int));
+  if (pointers == NULL || spare == NULL || inputOrder == NULL ||
+      position == NULL || !growIds(collisionWorld, numOfLines)) {
+    free(pointers);
+    free(spare);
+    free(inputOrder);
+    free(position);
+    return false;
+  }
+  for (unsigned int i = 0; i < numOfLines; i++) {
+    assert(lines[i].id < numOfLines);
+    assert(collisionWorld->slotOfId[lines[i].id] == COLLISIONWORLD_NO_SLOT);
+    pointers[i] = &lines[i];
+    inputOrder[i] = &lines[i];
+    position[i] = i;
+    collisionWorld->slotOfId[lines[i].id] = i;
+  }
+  free(collisionWorld->lines);
+  collisionWorld->lines = pointers;
+  collisionWorld->capacity = numOfLines;
+  collisionWorld->lineStorage = lines;
+  collisionWorld->spareStorage = spare;
+  collisionWorld->linesInInputOrder = inputOrder;
+  collisionWorld->inputPosition = position;
+  collisionWorld->numOfLines = numOfLines;
+  collisionWorld->nextId = numOfLines;
+  return true;
+}
+
+bool CollisionWorld_insertLine(CollisionWorld* collisionWorld, Line *line,
+                               unsigned int* id) {
+  if (!growLineStorage(collisionWorld, collisionWorld->numOfLines + 1)) {
+    return false;
+  }
+  unsigned int newId;
+  if (collisionWorld->numFreeIds > 0) {
+    newId = popFreeId(collisionWorld);
+  } else {
+    if (!growIds(collisionWorld, collisionWorld->nextId + 1)) {
+      return false;
+    }
+    newId = collisionWorld->nextId++;
+  }
+  line->id = newId;
+  *id = newId;
+  storeLine(collisionWorld, line);
+  return true;
+}
+
+bool CollisionWorld_removeLine(CollisionWorld* collisionWorld,
+                               unsigned int id) {
+  if (id >= collisionWorld->nextId ||
+      collisionWorld->slotOfId[id] == COLLISIONWORLD_NO_SLOT) {
+    return false;
+  }
+  unsigned int slot = collisionWorld->slotOfId[id];
+  unsigned int last = collisionWorld->numOfLines - 1;
+
+  if (collisionWorld->lineStorage == NULL) {
+    // Individually allocated lines: the last one takes the freed slot.
+    free(collisionWorld->lines[slot]);
+    if (slot != last) {
+      collisionWorld->lines[slot] = collisionWorld->lines[last];
+      collisionWorld->slotOfId[collisionWorld->lines[slot]->id] = slot;
+    }
+  } else {
+    Line* storage = collisionWorld->lineStorage;
+    unsigned int* position = collisionWorld->inputPosition;
+    Line** inputOrder = collisionWorld->linesInInputOrder;
+    // Input order: the line added last takes the removed line's position.
+    Line* latest = inputOrder[last];
+    inputOrder[position[slot]] = latest;
+    position[latest - storage] = position[slot];
+    // Storage: the line in the last slot moves into the freed slot.
+    if (slot != last) {
+      storage[slot] = storage[last];
+      position[slot] = position[last];
+      inputOrder[position[slot]] = &storage[slot];
+      collisionWorld->slotOfId[storage[slot].id] = slot;
+    }
+  }
+
+  collisionWorld->slotOfId[id] = COLLISIONWORLD_NO_SLOT;
+  collisionWorld->numOfLines--;
+  pushFreeId(collisionWorld, id);
+  return true;
+}
+
+Line* CollisionWorld_getLineById(CollisionWorld* collisionWorld,
+                                 unsigned int id) {
+  if (id >= collisionWorld->nextId ||
+      collisionWorld->slotOfId[id] == COLLISIONWORLD_NO_SLOT) {
+    return NULL;
+  }
+  return collisionWorld->lines[collisionWorld->slotOfId[id]];
 }
 
 Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
@@ -124,10 +584,24 @@ Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
   if (index >= collisionWorld->numOfLines) {
     return NULL;
   }
+  if (collisionWorld->linesInInputOrder != NULL) {
+    return collisionWorld->linesInInputOrder[index];
+  }
   return collisionWorld->lines[index];
 }
 
 void CollisionWorld_updateLines(CollisionWorld* collisionWorld) {
+  // Reorder on the first frame, then every reorderInterval frames.
+  if (collisionWorld->reorderInterval > 0) {
+    if (collisionWorld->framesSinceReorder == 0) {
+      reorderLines(collisionWorld);
+    }
+    collisionWorld->framesSinceReorder++;
+    if (collisionWorld->framesSinceReorder ==
+        collisionWorld->reorderInterval) {
+      collisionWorld->framesSinceReorder = 0;
+    }
+  }
   CollisionWorld_detectIntersection(collisionWorld);
   CollisionWorld_updatePosition(collisionWorld);
   CollisionWorld_lineWallCollision(collisionWorld);
@@ -211,9 +685,9 @@ void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
     // Test all line-line pairs to see if they will intersect before the
     // next time step. Simple but can be slow for large numbers of lines.
     for (int i = 0; i < collisionWorld->numOfLines; i++) {
-      Line *l1 = collisionWorld->lines[i];
-  
       for (int j = i + 1; j < collisionWorld->numOfLines; j++) {
+	// Fetched per pair: the swap below must not leak into the next j.
+	Line *l1 = collisionWorld->lines[i];
 	Line *l2 = collisionWorld->lines[j];
   
 	// intersect expects compareLines(l1, l2) < 0 to be true.
@@ -270,6 +744,18 @@ void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
       }
     }
     
+    // Allow the quantized broadphase to be switched off for A/B comparison
+    const char* quantizedEnv = getenv("QUADTREE_QUANTIZED_BOXES");
+    if (quantizedEnv != NULL) {
+      config.useQuantizedBoxes = (atoi(quantizedEnv) != 0);
+    }
+    
+    // Likewise for the packed-leaf narrow phase
+    const char* packedEnv = getenv("QUADTREE_PACKED_LEAVES");
+    if (packedEnv != NULL) {
+      config.usePackedLeaves = (atoi(packedEnv) != 0);
+    }
+    
     // Enable debug stats for performance analysis (can be disabled in production)
     config.enableDebugStats = true;  // Set to true for debugging
     
@@ -351,6 +837,29 @@ void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
           double sort_time = tdiff(start_sort, end_sort);
           #endif
           
+          // Memory locality of the narrow phase: how far apart the two
+          // lines of a candidate pair are stored. Spatial reordering
+          // (CollisionWorld_setReorderInterval) should shrink this.
+          #ifdef DEBUG_LINE_LOCALITY
+          {
+            double totalLines = 0.0;
+            unsigned int samePage = 0;
+            for (unsigned int i = 0; i < candidateList.count; i++) {
+              const char* a = (const char*)candidateList.pairs[i].line1;
+              const char* b = (const char*)candidateList.pairs[i].line2;
+              size_t bytes = (a < b) ? (size_t)(b - a) : (size_t)(a - b);
+              totalLines += bytes / 64.0;
+              if (bytes < 4096) {
+                samePage++;
+              }
+            }
+            unsigned int pairs = candidateList.count > 0 ? candidateList.count : 1;
+            fprintf(stderr, "LINE LOCALITY: %u pairs, mean distance %.1f cache lines, "
+                    "%.1f%% within 4KB\n", candidateList.count,
+                    totalLines / pairs, samePage * 100.0 / pairs);
+          }
+          #endif
+
           // Test candidate pairs using existing intersect() function
           // This is the TEST PHASE: spatial filtering already done in query phase
           #ifdef DEBUG_COLLISIONS
@@ -366,7 +875,9 @@ void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
           // PHASE 3: Parallelize candidate testing using cilk_for
           // Each iteration is independent - perfect for parallelization
           // Using cilk_reducer for thread-safe parallel operations
-          cilk_for (unsigned int i = 0; i < candidateList.count; i++) {
+          parallel_for(reduction(merge : intersectionEventList)
+                       reduction(+ : localCollisionCount))
+              (unsigned int i = 0; i < candidateList.count; i++) {
             Line* l1 = candidateList.pairs[i].line1;
             Line* l2 = candidateList.pairs[i].line2;
             
@@ -378,9 +889,11 @@ void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
               l2 = temp;
             }
             
-            // Use existing collision detection function
-            IntersectionType intersectionType =
-                intersect(l1, l2, collisionWorld->timeStep);
+            // Use existing collision detection function, unless the query
+            // already ran it on packed leaf geometry
+            IntersectionType intersectionType = candidateList.tested
+                ? candidateList.pairs[i].intersectionType
+                : intersect(l1, l2, collisionWorld->timeStep);
             if (intersectionType != NO_INTERSECTION) {
               // PHASE 3: Using cilk_reducer - thread-safe parallel operations
               IntersectionEventList_appendNode(&intersectionEventList, l1, l2,
@@ -429,9 +942,9 @@ void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
     if (!quadtreeSucceeded) {
       // BRUTE-FORCE ALGORITHM: Fallback if quadtree fails
       for (int i = 0; i < collisionWorld->numOfLines; i++) {
-        Line *l1 = collisionWorld->lines[i];
-        
         for (int j = i + 1; j < collisionWorld->numOfLines; j++) {
+          // Fetched per pair: the swap below must not leak into the next j.
+          Line *l1 = collisionWorld->lines[i];
           Line *l2 = collisionWorld->lines[j];
           
           // intersect expects compareLines(l1, l2) < 0 to be true.
@@ -587,3 +1100,10 @@ void CollisionWorld_setUseQuadtree(CollisionWorld* collisionWorld,
   assert(collisionWorld != NULL);
   collisionWorld->useQuadtree = useQuadtree;
 }
+
+void CollisionWorld_setReorderInterval(CollisionWorld* collisionWorld,
+                                       unsigned int reorderInterval) {
+  assert(collisionWorld != NULL);
+  collisionWorld->reorderInterval = reorderInterval;
+  collisionWorld->framesSinceReorder = 0;
+}
@@ -38,6 +38,21 @@ struct CollisionWorld {
   Line** lines;
   unsigned int numOfLines;
 
+  // Allocated length of lines[] (and of the reordering arrays below, once
+  // they exist). Doubles whenever a line is added to a full world.
+  unsigned int capacity;
+
+  // Id bookkeeping for lines added and removed while running.
+  // slotOfId[id] is the index in lines[] of the live line with that id, or
+  // COLLISIONWORLD_NO_SLOT. Every id below nextId that is not live sits in
+  // freeIds, a binary min-heap, so new lines reuse the smallest free id and
+  // ids stay dense. Both arrays hold idCapacity entries.
+  unsigned int* slotOfId;
+  unsigned int* freeIds;
+  unsigned int numFreeIds;
+  unsigned int nextId;
+  unsigned int idCapacity;
+
   // Record the total number of line-wall collisions.
   unsigned int numLineWallCollisions;
 
@@ -48,9 +63,31 @@ struct CollisionWorld {
   // When true, uses quadtree spatial partitioning for optimization.
   // When false (default), uses brute-force O(n^2) collision detection.
   bool useQuadtree;
+
+  // Spatial reordering of line storage (see
+  // CollisionWorld_setReorderInterval). 0 disables it.
+  unsigned int reorderInterval;
+  unsigned int framesSinceReorder;
+
+  // Once reordered, the lines live in lineStorage, in Morton order of their
+  // midpoints, and lines[i] == &lineStorage[i]. The next reorder copies them
+  // into spareStorage and swaps the two. Both are NULL until the first
+  // reorder, while lines[] still holds the individually allocated lines.
+  Line* lineStorage;
+  Line* spareStorage;
+
+  // Id map kept by reordering: linesInInputOrder[k] is the k-th line added,
+  // wherever it now lives, and inputPosition[i] is the input position of
+  // lines[i]. CollisionWorld_getLine() indexes linesInInputOrder, so callers
+  // keep seeing lines in the order they were added.
+  Line** linesInInputOrder;
+  unsigned int* inputPosition;
 };
 typedef struct CollisionWorld CollisionWorld;
 
+// slotOfId[] entry of an id that no live line holds.
+#define COLLISIONWORLD_NO_SLOT 0xFFFFFFFFu
+
 CollisionWorld* CollisionWorld_new(const unsigned int capacity);
 
 void CollisionWorld_delete(CollisionWorld* collisionWorld);
@@ -58,10 +95,38 @@ void CollisionWorld_delete(CollisionWorld* collisionWorld);
 // Return the total number of lines in the box.
 unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld);
 
-// Add a line into the box.  Must be under capacity.
+// Add a line into the box, keeping the ID already set in line->id. The
+// ID must not belong to a live line. Storage grows as needed.
 // This CollisionWorld becomes owner of the Line* line.
 void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line);
 
+// Take over an array of numOfLines lines, already in contiguous storage,
+// as the box's only lines. The world must be empty. The lines keep their
+// IDs, which must be distinct and below numOfLines. The array must come
+// from malloc, and the CollisionWorld frees it. Returns false, without
+// taking ownership, if memory runs out.
+bool CollisionWorld_adoptLines(CollisionWorld* collisionWorld, Line* lines,
+                               unsigned int numOfLines);
+
+// Add a line into the box while the simulation is running, giving it the
+// smallest ID no live line holds. That ID is stored in line->id and *id.
+// This CollisionWorld becomes owner of the Line* line; once storage has
+// been reordered the line is copied in and freed, so use *id (or
+// CollisionWorld_getLineById) to find it again. Returns false, without
+// taking ownership, if memory runs out.
+bool CollisionWorld_insertLine(CollisionWorld* collisionWorld, Line *line,
+                               unsigned int* id);
+
+// Remove and free the line with the given ID. Its ID becomes free for
+// reuse. The line last in CollisionWorld_getLine order takes its place.
+// Returns false if no live line has that ID.
+bool CollisionWorld_removeLine(CollisionWorld* collisionWorld,
+                               unsigned int id);
+
+// Get the live line with the given ID, or NULL.
+Line* CollisionWorld_getLineById(CollisionWorld* collisionWorld,
+                                 unsigned int id);
+
 // Get a line from box.
 Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
                              const unsigned int index);
@@ -99,4 +164,13 @@ void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld, Line *l1,
 void CollisionWorld_setUseQuadtree(CollisionWorld* collisionWorld,
                                    bool useQuadtree);
 
+// Reorder line storage every reorderInterval frames (0, the default,
+// disables reordering). The lines are sorted by the Morton code of their
+// midpoints and copied into one contiguous array in that order, so that
+// lines close on screen, which the quadtree tests against each other, are
+// also close in memory. Collisions are still resolved in compareLines
+// order, so the simulation is unchanged.
+void CollisionWorld_setReorderInterval(CollisionWorld* collisionWorld,
+                                       unsigned int reorderInterval);
+
 #endif  // COLLISIONWORLD_H_
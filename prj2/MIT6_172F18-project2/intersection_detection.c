@@ -30,35 +30,42 @@
 // Detect if lines l1 and l2 will intersect between now and the next time step.
 IntersectionType intersect(Line *l1, Line *l2, double time) {
   assert(compareLines(l1, l2) < 0);
+  return intersectGeometry(l1->p1, l1->p2, l1->velocity,
+                           l2->p1, l2->p2, l2->velocity, time);
+}
 
+// The body of intersect(), on geometry passed by value.
+IntersectionType intersectGeometry(Vec l1p1, Vec l1p2, Vec l1velocity,
+                                   Vec l2p1, Vec l2p2, Vec l2velocity,
+                                   double time) {
   Vec velocity;
   Vec p1;
   Vec p2;
-  Vec v1 = Vec_makeFromLine(*l1);
-  Vec v2 = Vec_makeFromLine(*l2);
+  Vec v1 = Vec_subtract(l1p1, l1p2);
+  Vec v2 = Vec_subtract(l2p1, l2p2);
 
   // Get relative velocity.
-  velocity = Vec_subtract(l2->velocity, l1->velocity);
+  velocity = Vec_subtract(l2velocity, l1velocity);
 
   // Get the parallelogram.
-  p1 = Vec_add(l2->p1, Vec_multiply(velocity, time));
-  p2 = Vec_add(l2->p2, Vec_multiply(velocity, time));
+  p1 = Vec_add(l2p1, Vec_multiply(velocity, time));
+  p2 = Vec_add(l2p2, Vec_multiply(velocity, time));
 
   int num_line_intersections = 0;
   bool top_intersected = false;
   bool bottom_intersected = false;
 
-  if (intersectLines(l1->p1, l1->p2, l2->p1, l2->p2)) {
+  if (intersectLines(l1p1, l1p2, l2p1, l2p2)) {
     return ALREADY_INTERSECTED;
   }
-  if (intersectLines(l1->p1, l1->p2, p1, p2)) {
+  if (intersectLines(l1p1, l1p2, p1, p2)) {
     num_line_intersections++;
   }
-  if (intersectLines(l1->p1, l1->p2, p1, l2->p1)) {
+  if (intersectLines(l1p1, l1p2, p1, l2p1)) {
     num_line_intersections++;
     top_intersected = true;
   }
-  if (intersectLines(l1->p1, l1->p2, p2, l2->p2)) {
+  if (intersectLines(l1p1, l1p2, p2, l2p2)) {
     num_line_intersections++;
     bottom_intersected = true;
   }
@@ -67,8 +74,8 @@ IntersectionType intersect(Line *l1, Line *l2, double time) {
     return L2_WITH_L1;
   }
 
-  if (pointInParallelogram(l1->p1, l2->p1, l2->p2, p1, p2)
-      && pointInParallelogram(l1->p2, l2->p1, l2->p2, p1, p2)) {
+  if (pointInParallelogram(l1p1, l2p1, l2p2, p1, p2)
+      && pointInParallelogram(l1p2, l2p1, l2p2, p1, p2)) {
     return L1_WITH_L2;
   }
 
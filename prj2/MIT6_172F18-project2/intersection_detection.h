@@ -37,6 +37,13 @@ typedef enum {
 // Precondition: compareLines(l1, l2) < 0 must be true.
 IntersectionType intersect(Line *l1, Line *l2, double time);
 
+// intersect() on geometry passed by value, for callers that keep line
+// geometry outside Line structs. l1 must be the line ordered first by
+// compareLines().
+IntersectionType intersectGeometry(Vec l1p1, Vec l1p2, Vec l1velocity,
+                                   Vec l2p1, Vec l2p2, Vec l2velocity,
+                                   double time);
+
 // Check if a point is in the parallelogram.
 bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4);
 
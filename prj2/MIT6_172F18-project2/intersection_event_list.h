@@ -26,8 +26,8 @@
 #include "./line.h"
 #include "./intersection_detection.h"
 
-// Cilk reducer support for parallelization
-#include <cilk/cilk.h>
+// Cilk reducer support for parallelization (OpenMP with "make OPENMP=1")
+#include "./parallel.h"
 
 struct IntersectionEventNode {
   // This IntersectionEventNode does not own these Line* lines.
@@ -30,6 +30,7 @@
 
 #include "./graphic_stuff.h"
 #include "./line.h"
+#include "./scene_parser.h"
 #include "./vec.h"
 
 static char* LineDemo_input_file_path;
@@ -57,6 +58,28 @@ void LineDemo_delete(LineDemo* lineDemo) {
 
 // Read in lines from line.in and add them into collision world for simulation.
 void LineDemo_createLines(LineDemo* lineDemo) {
+  // Fast path: parse the mmapped file in parallel straight into the
+  // collision world's line storage.
+  Line* lines;
+  unsigned int numParsed;
+  SceneParserStatus status = SceneParser_parseFile(LineDemo_input_file_path,
+                                                   &lines, &numParsed);
+  if (status == SCENE_PARSER_OK) {
+    lineDemo->collisionWorld = CollisionWorld_new(numParsed > 0 ? numParsed : 1);
+    if (lineDemo->collisionWorld == NULL ||
+        !CollisionWorld_adoptLines(lineDemo->collisionWorld, lines, numParsed)) {
+      fprintf(stderr, "Out of memory loading %s\n", LineDemo_input_file_path);
+      exit(1);
+    }
+    return;
+  }
+  if (status == SCENE_PARSER_MALFORMED) {
+    fprintf(stderr, "Malformed input line %u (%s)\n", numParsed,
+            LineDemo_input_file_path);
+    exit(1);
+  }
+  // Otherwise (e.g. the file cannot be mapped) read it with stdio.
+
   unsigned int lineId = 0;
   unsigned int numOfLines;
   window_dimension px1;
@@ -151,3 +174,10 @@ void LineDemo_setUseQuadtree(LineDemo* lineDemo, bool useQuadtree) {
   assert(lineDemo->collisionWorld != NULL);
   CollisionWorld_setUseQuadtree(lineDemo->collisionWorld, useQuadtree);
 }
+
+void LineDemo_setReorderInterval(LineDemo* lineDemo,
+                                 unsigned int reorderInterval) {
+  assert(lineDemo != NULL);
+  assert(lineDemo->collisionWorld != NULL);
+  CollisionWorld_setReorderInterval(lineDemo->collisionWorld, reorderInterval);
+}
@@ -77,4 +77,10 @@ void LineDemo_setInputFile(char* input_file_path);
 // CollisionWorld) and before starting the simulation.
 void LineDemo_setUseQuadtree(LineDemo* lineDemo, bool useQuadtree);
 
+// Reorder line storage by Morton code every reorderInterval frames (0
+// disables it). Like LineDemo_setUseQuadtree(), call it after
+// LineDemo_initLine().
+void LineDemo_setReorderInterval(LineDemo* lineDemo,
+                                 unsigned int reorderInterval);
+
 #endif  // LINEDEMO_H_
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+// Parallel-loop selection: OpenCilk by default, OpenMP with "make OPENMP=1"
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#ifdef _OPENMP
+
+#include <omp.h>
+
+#define PARALLEL_PRAGMA(x) _Pragma(#x)
+
+// A parallel loop: parallel_for(clauses) (int i = 0; i < n; i++) { ... }
+// The clauses (schedule, reductions) are only seen by OpenMP; under Cilk
+// the same variables are declared as reducers instead.
+#define parallel_for(clauses) \
+  PARALLEL_PRAGMA(omp parallel for clauses) for
+
+// Reducer declarations become plain variables named in a reduction clause
+#define cilk_reducer(identity, reduce)
+
+#define __cilkrts_get_worker_number() ((unsigned int)omp_get_thread_num())
+
+#else
+
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+
+#define parallel_for(clauses) cilk_for
+
+#endif  // _OPENMP
+
+#endif  // PARALLEL_H_
@@ -35,13 +35,13 @@
 
 #include "./line.h"
 #include "./vec.h"
-#include "./fasttime.h"  // For timing instrumentation
+#include "fasttime.h"  // For timing instrumentation
 
-// Cilk support for parallelization
-#include <cilk/cilk.h>
-#include <cilk/cilk_api.h>  // For __cilkrts_get_worker_number()
+// Cilk support for parallelization (OpenMP with "make OPENMP=1")
+#include "./parallel.h"  // For __cilkrts_get_worker_number()
 #include <stdatomic.h>  // For atomic operations on seenPairs
 
+#ifndef _OPENMP
 // Reducer functions for statistics (same as in collision_world.c)
 static void collisionCounter_identity(void* v) {
   *(unsigned int*)v = 0;
@@ -50,6 +50,7 @@ static void collisionCounter_identity(void* v) {
 static void collisionCounter_reduce(void* left, void* right) {
   *(unsigned int*)left += *(unsigned int*)right;
 }
+#endif
 
 // Reducer functions for error handling in parallel query
 static void queryError_identity(void* v) {
@@ -65,6 +66,26 @@ static void queryError_reduce(void* left, void* right) {
   }
 }
 
+#ifdef _OPENMP
+#pragma omp declare reduction(firsterr : QuadTreeError : \
+    queryError_reduce(&omp_out, &omp_in)) \
+    initializer(queryError_identity(&omp_priv))
+#endif
+
+// Reduction clauses for the debug-only counters of the parallel query
+#ifdef DEBUG_QUADTREE_STATS
+#define QUERY_STATS_REDUCTION reduction(+ : totalPairsQuantizedOut)
+#else
+#define QUERY_STATS_REDUCTION
+#endif
+#ifdef DEBUG_PHASE8
+#define QUERY_PHASE8_REDUCTION \
+  reduction(+ : debugPairsSkippedCapacity, debugPairsSkippedAlreadySeen, \
+            debugPairsSkippedOrder, debugPairsSkippedBounds, debugPairsAdded)
+#else
+#define QUERY_PHASE8_REDUCTION
+#endif
+
 // Debug flag for discrepancy investigation
 // When enabled, logs cell assignments and candidate pairs for specific frames
 
@@ -78,6 +99,13 @@ static void queryError_reduce(void* left, void* right) {
 // Default initial capacity for candidate pair lists
 #define DEFAULT_CANDIDATE_CAPACITY 64
 
+// Boxes compared per vector in the quantized broadphase: 16 x uint16 fill
+// one 256-bit AVX2 register (two SSE2 registers without -mavx2)
+#define QBOX_LANES 16
+
+// Largest 16-bit quantized coordinate
+#define QBOX_MAX 65535.0
+
 // ============================================================================
 // Helper Functions (Internal)
 // ============================================================================
@@ -256,6 +284,8 @@ QuadTreeConfig QuadTreeConfig_default(void) {
   config.maxLinesPerNode = 32;
   config.minCellSize = 0.001;
   config.enableDebugStats = false;
+  config.useQuantizedBoxes = true;
+  config.usePackedLeaves = true;
   return config;
 }
 
@@ -268,6 +298,8 @@ QuadTreeConfig QuadTreeConfig_create(unsigned int maxDepth,
   config.maxLinesPerNode = maxLinesPerNode;
   config.minCellSize = minCellSize;
   config.enableDebugStats = enableDebugStats;
+  config.useQuantizedBoxes = false;
+  config.usePackedLeaves = false;
   return config;
 }
 
@@ -309,6 +341,8 @@ const char* QuadTree_errorString(QuadTreeError error) {
       return "Invalid configuration parameters";
     case QUADTREE_ERROR_EMPTY_TREE:
       return "Operation on empty tree";
+    case QUADTREE_ERROR_CONTEXT_TOO_SMALL:
+      return "Query context not prepared for this tree";
     default:
       return "Unknown error";
   }
@@ -355,6 +389,13 @@ static QuadNode* createQuadNode(double xmin, double xmax,
   node->isLeaf = true;
   node->depth = depth;
   
+  node->qxmin = NULL;
+  node->qxmax = NULL;
+  node->qymin = NULL;
+  node->qymax = NULL;
+  node->qcapacity = 0;
+  node->packed = NULL;
+  
   return node;
 }
 
@@ -375,8 +416,22 @@ static void destroyQuadNode(QuadNode* node) {
     }
   }
   
-  // Free line array and node itself
+  // Free line array, quantized boxes and node itself
   free(node->lines);
+  free(node->qxmin);
+  free(node->qxmax);
+  free(node->qymin);
+  free(node->qymax);
+  if (node->packed != NULL) {
+    free(node->packed->p1x);
+    free(node->packed->p1y);
+    free(node->packed->p2x);
+    free(node->packed->p2y);
+    free(node->packed->vx);
+    free(node->packed->vy);
+    free(node->packed->ids);
+    free(node->packed);
+  }
   free(node);
 }
 
@@ -882,6 +937,238 @@ static int findOverlappingCellsRecursive(QuadNode* node,
   return cellCount;
 }
 
+/**
+ * Vector of QBOX_LANES quantized coordinates, and the lane mask produced
+ * by comparing two of them.
+ */
+typedef uint16_t QBoxLanes __attribute__((vector_size(QBOX_LANES * sizeof(uint16_t))));
+typedef int16_t QBoxMask __attribute__((vector_size(QBOX_LANES * sizeof(int16_t))));
+
+/**
+ * Quantize a lower bound to 16-bit fixed point relative to a cell,
+ * rounding toward -infinity and clamping to [0, QBOX_MAX].
+ *
+ * (v - origin) * scale is monotone in v under IEEE rounding, and floor,
+ * ceil and clamping are monotone too, so if two full-precision boxes
+ * overlap, their quantized boxes overlap as well.
+ *
+ * @param v Coordinate to quantize
+ * @param origin Cell minimum along the same axis
+ * @param scale QBOX_MAX divided by the cell size
+ * @return Quantized coordinate
+ */
+static uint16_t quantizeDown(double v, double origin, double scale) {
+  double q = floor((v - origin) * scale);
+  if (!(q > 0.0)) {
+    return 0;  // Also catches NaN, conservatively
+  }
+  return (q >= QBOX_MAX) ? (uint16_t)QBOX_MAX : (uint16_t)q;
+}
+
+/**
+ * Quantize an upper bound to 16-bit fixed point relative to a cell,
+ * rounding toward +infinity and clamping to [0, QBOX_MAX].
+ *
+ * @param v Coordinate to quantize
+ * @param origin Cell minimum along the same axis
+ * @param scale QBOX_MAX divided by the cell size
+ * @return Quantized coordinate
+ */
+static uint16_t quantizeUp(double v, double origin, double scale) {
+  double q = ceil((v - origin) * scale);
+  if (!(q < QBOX_MAX)) {
+    return (uint16_t)QBOX_MAX;  // Also catches NaN, conservatively
+  }
+  return (q <= 0.0) ? 0 : (uint16_t)q;
+}
+
+/**
+ * Fill the quantized box arrays of every leaf under a node.
+ *
+ * Arrays are padded to a multiple of QBOX_LANES so the query loop can
+ * always load whole vectors; padding lanes are never read back.
+ *
+ * @param node Subtree root
+ * @param bounds Full-precision boxes, four doubles per tree->lines index
+ * @param lineIdToIndex Map from line id to tree->lines index
+ * @param numLines Number of lines in tree->lines (invalid index marker)
+ * @return QUADTREE_SUCCESS on success, error code otherwise
+ */
+static QuadTreeError quantizeLeafBoxes(QuadNode* node,
+                                       const double* bounds,
+                                       const unsigned int* lineIdToIndex,
+                                       unsigned int numLines) {
+  if (!node->isLeaf) {
+    for (int i = 0; i < 4; i++) {
+      QuadTreeError error = quantizeLeafBoxes(node->children[i], bounds,
+                                              lineIdToIndex, numLines);
+      if (error != QUADTREE_SUCCESS) {
+        return error;
+      }
+    }
+    return QUADTREE_SUCCESS;
+  }
+  
+  unsigned int needed = (node->numLines + QBOX_LANES - 1) / QBOX_LANES
+                        * QBOX_LANES;
+  if (needed == 0) {
+    return QUADTREE_SUCCESS;
+  }
+  if (needed > node->qcapacity) {
+    uint16_t* arrays[4];
+    for (int a = 0; a < 4; a++) {
+      arrays[a] = malloc(needed * sizeof(uint16_t));
+      if (arrays[a] == NULL) {
+        for (int b = 0; b < a; b++) {
+          free(arrays[b]);
+        }
+        return QUADTREE_ERROR_MALLOC_FAILED;
+      }
+    }
+    free(node->qxmin);
+    free(node->qxmax);
+    free(node->qymin);
+    free(node->qymax);
+    node->qxmin = arrays[0];
+    node->qxmax = arrays[1];
+    node->qymin = arrays[2];
+    node->qymax = arrays[3];
+    node->qcapacity = needed;
+  }
+  
+  // Cells are squares, so one scale serves both axes
+  double scale = QBOX_MAX / (node->xmax - node->xmin);
+  for (unsigned int j = 0; j < node->numLines; j++) {
+    const Line* line = node->lines[j];
+    unsigned int index = (line != NULL) ? lineIdToIndex[line->id] : numLines;
+    if (index >= numLines) {
+      // Unknown line: cover the whole cell so it is never rejected
+      node->qxmin[j] = 0;
+      node->qxmax[j] = (uint16_t)QBOX_MAX;
+      node->qymin[j] = 0;
+      node->qymax[j] = (uint16_t)QBOX_MAX;
+      continue;
+    }
+    const double* box = &bounds[4 * index];
+    node->qxmin[j] = quantizeDown(box[0], node->xmin, scale);
+    node->qxmax[j] = quantizeUp(box[1], node->xmin, scale);
+    node->qymin[j] = quantizeDown(box[2], node->ymin, scale);
+    node->qymax[j] = quantizeUp(box[3], node->ymin, scale);
+  }
+  for (unsigned int j = node->numLines; j < needed; j++) {
+    node->qxmin[j] = node->qxmax[j] = 0;
+    node->qymin[j] = node->qymax[j] = 0;
+  }
+  return QUADTREE_SUCCESS;
+}
+
+/**
+ * Copy the geometry of every leaf's lines into its packed arrays
+ * (see QuadLeafGeometry).
+ *
+ * @param node Subtree root
+ * @return QUADTREE_SUCCESS on success, error code otherwise
+ */
+static QuadTreeError packLeafGeometry(QuadNode* node) {
+  if (!node->isLeaf) {
+    for (int i = 0; i < 4; i++) {
+      QuadTreeError error = packLeafGeometry(node->children[i]);
+      if (error != QUADTREE_SUCCESS) {
+        return error;
+      }
+    }
+    return QUADTREE_SUCCESS;
+  }
+  
+  if (node->numLines == 0) {
+    return QUADTREE_SUCCESS;
+  }
+  if (node->packed == NULL) {
+    node->packed = calloc(1, sizeof(QuadLeafGeometry));
+    if (node->packed == NULL) {
+      return QUADTREE_ERROR_MALLOC_FAILED;
+    }
+  }
+  QuadLeafGeometry* packed = node->packed;
+  if (node->numLines > packed->capacity) {
+    unsigned int capacity = node->numLines;
+    double* fields[6];
+    for (int f = 0; f < 6; f++) {
+      fields[f] = malloc(capacity * sizeof(double));
+    }
+    unsigned int* ids = malloc(capacity * sizeof(unsigned int));
+    bool failed = (ids == NULL);
+    for (int f = 0; f < 6; f++) {
+      failed = failed || (fields[f] == NULL);
+    }
+    if (failed) {
+      for (int f = 0; f < 6; f++) {
+        free(fields[f]);
+      }
+      free(ids);
+      return QUADTREE_ERROR_MALLOC_FAILED;
+    }
+    free(packed->p1x);
+    free(packed->p1y);
+    free(packed->p2x);
+    free(packed->p2y);
+    free(packed->vx);
+    free(packed->vy);
+    free(packed->ids);
+    packed->p1x = fields[0];
+    packed->p1y = fields[1];
+    packed->p2x = fields[2];
+    packed->p2y = fields[3];
+    packed->vx = fields[4];
+    packed->vy = fields[5];
+    packed->ids = ids;
+    packed->capacity = capacity;
+  }
+  
+  for (unsigned int j = 0; j < node->numLines; j++) {
+    const Line* line = node->lines[j];
+    packed->p1x[j] = line->p1.x;
+    packed->p1y[j] = line->p1.y;
+    packed->p2x[j] = line->p2.x;
+    packed->p2y[j] = line->p2.y;
+    packed->vx[j] = line->velocity.x;
+    packed->vy[j] = line->velocity.y;
+    packed->ids[j] = line->id;
+  }
+  return QUADTREE_SUCCESS;
+}
+
+/**
+ * Test one query box against QBOX_LANES quantized boxes of a leaf.
+ *
+ * @param cell Leaf whose quantized boxes were filled this frame
+ * @param first Index of the first line of the block (multiple of QBOX_LANES)
+ * @param xmin, xmax, ymin, ymax Query box, quantized relative to cell
+ * @return Bit k set if cell->lines[first + k] may overlap the query box
+ */
+static unsigned int quantizedOverlapMask(const QuadNode* cell,
+                                         unsigned int first,
+                                         uint16_t xmin, uint16_t xmax,
+                                         uint16_t ymin, uint16_t ymax) {
+  QBoxLanes bxmin, bxmax, bymin, bymax;
+  memcpy(&bxmin, cell->qxmin + first, sizeof(bxmin));
+  memcpy(&bxmax, cell->qxmax + first, sizeof(bxmax));
+  memcpy(&bymin, cell->qymin + first, sizeof(bymin));
+  memcpy(&bymax, cell->qymax + first, sizeof(bymax));
+  
+  // Same predicate as boxesOverlap(), one lane per box
+  QBoxMask separated = (bxmax < xmin) | (bxmin > xmax) |
+                       (bymax < ymin) | (bymin > ymax);
+  
+  unsigned int mask = 0;
+  for (int k = 0; k < QBOX_LANES; k++) {
+    if (separated[k] == 0) {
+      mask |= 1u << k;
+    }
+  }
+  return mask;
+}
+
 QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
                                           double timeStep,
                                           QuadTreeCandidateList* candidateList,
@@ -1006,6 +1293,45 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
     }
   }
   
+  // Quantize every line's box into the leaves that hold it. The query loop
+  // then rejects most same-cell pairs with 16-bit vector compares instead
+  // of touching the seenPairs matrix. intersect() still sees only
+  // full-precision geometry.
+  if (tree->config.useQuantizedBoxes) {
+    double* lineBounds = malloc(4 * (size_t)tree->numLines * sizeof(double));
+    if (lineBounds == NULL) {
+      free(lineIdToIndex);
+      return QUADTREE_ERROR_MALLOC_FAILED;
+    }
+    parallel_for() (unsigned int idx = 0; idx < tree->numLines; idx++) {
+      if (tree->lines[idx] != NULL) {
+        double* box = &lineBounds[4 * idx];
+        computeLineBoundingBox(tree->lines[idx], tree->buildTimeStep,
+                               &box[0], &box[1], &box[2], &box[3],
+                               tree->maxVelocity, tree->config.minCellSize);
+      }
+    }
+    QuadTreeError error = quantizeLeafBoxes(tree->root, lineBounds,
+                                            lineIdToIndex, tree->numLines);
+    free(lineBounds);
+    if (error != QUADTREE_SUCCESS) {
+      free(lineIdToIndex);
+      return error;
+    }
+  }
+  
+  // Packed leaves: the narrow phase below reads line2 from its leaf's
+  // packed arrays, and only pairs that intersect reach the candidate list.
+  bool packedLeaves = tree->config.usePackedLeaves;
+  if (packedLeaves) {
+    QuadTreeError error = packLeafGeometry(tree->root);
+    if (error != QUADTREE_SUCCESS) {
+      free(lineIdToIndex);
+      return error;
+    }
+  }
+  candidateList->tested = packedLeaves;
+  
   // Allocate a 2D boolean matrix to track all pairs we've seen globally
   // This ensures we never add the same pair twice, regardless of processing order
   // Matrix is upper triangular (only pairs where id1 < id2 are stored)
@@ -1065,6 +1391,10 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
     totalCellsChecked = 0;
   unsigned int cilk_reducer(collisionCounter_identity, collisionCounter_reduce) 
     totalPairsFound = 0;
+  #ifdef DEBUG_QUADTREE_STATS
+  unsigned int cilk_reducer(collisionCounter_identity, collisionCounter_reduce) 
+    totalPairsQuantizedOut = 0;
+  #endif
   
   // PHASE 8: Debug counters for detailed debugging
   #ifdef DEBUG_PHASE8
@@ -1090,7 +1420,12 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
   // PHASE 8: Parallelize query phase - each line's candidate search is independent
   // Use cilk_for to parallelize the loop over lines
   // Note: seenPairs matrix uses atomic operations for thread-safety
-  cilk_for (unsigned int i = 0; i < tree->numLines; i++) {
+  // Per-line work varies with cell occupancy, so OpenMP schedules dynamically
+  parallel_for(schedule(dynamic, 64)
+               reduction(+ : totalCellsChecked, totalPairsFound)
+               reduction(firsterr : queryError)
+               QUERY_STATS_REDUCTION QUERY_PHASE8_REDUCTION)
+      (unsigned int i = 0; i < tree->numLines; i++) {
     Line* line1 = tree->lines[i];
     if (line1 == NULL) {
       continue;
@@ -1188,7 +1523,33 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
       }
       #endif
       
+      // Query box in this cell's fixed-point frame (see quantizeLeafBoxes)
+      bool quantized = (cell->qxmin != NULL);
+      uint16_t q1xmin = 0, q1xmax = 0, q1ymin = 0, q1ymax = 0;
+      unsigned int overlapMask = 0;
+      if (quantized) {
+        double scale = QBOX_MAX / (cell->xmax - cell->xmin);
+        q1xmin = quantizeDown(lineXmin, cell->xmin, scale);
+        q1xmax = quantizeUp(lineXmax, cell->xmin, scale);
+        q1ymin = quantizeDown(lineYmin, cell->ymin, scale);
+        q1ymax = quantizeUp(lineYmax, cell->ymin, scale);
+      }
+      
       for (unsigned int j = 0; j < cell->numLines; j++) {
+        // Quantized broadphase: skip lines whose boxes cannot overlap line1's
+        if (quantized) {
+          if (j % QBOX_LANES == 0) {
+            overlapMask = quantizedOverlapMask(cell, j, q1xmin, q1xmax,
+                                               q1ymin, q1ymax);
+          }
+          if ((overlapMask & (1u << (j % QBOX_LANES))) == 0) {
+            #ifdef DEBUG_QUADTREE_STATS
+            totalPairsQuantizedOut++;
+            #endif
+            continue;
+          }
+        }
+        
         Line* line2 = cell->lines[j];
         
         // Skip NULL lines and self
@@ -1196,6 +1557,9 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
           continue;
         }
         
+        // With packed leaves, line2 is only dereferenced if it collides
+        unsigned int line2Id = packedLeaves ? cell->packed->ids[j] : line2->id;
+        
         #ifdef DEBUG_PHASE8
         // Trace all lines found in cells for line1_idx=8
         if (traceLine8) {
@@ -1224,7 +1588,7 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
         
         // Ensure line1->id < line2->id (normalize pair representation)
         // This ensures we always represent pairs as (minId, maxId) regardless of order
-        if (line1->id >= line2->id) {
+        if (line1->id >= line2Id) {
           #ifdef DEBUG_PHASE8
           debugPairsSkippedOrder++;
           if (traceThisPair) {
@@ -1236,7 +1600,7 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
         }
         
         // Bounds check for seenPairs matrix
-        if (line2->id > maxLineId) {
+        if (line2Id > maxLineId) {
           // line2->id is out of bounds for seenPairs matrix - skip it
           #ifdef DEBUG_PHASE8
           debugPairsSkippedBounds++;
@@ -1252,7 +1616,7 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
         // (line2 might appear in multiple cells, or we might process lines in different order)
         // Use min/max IDs to access upper triangular matrix
         unsigned int minId = line1->id;
-        unsigned int maxId = line2->id;
+        unsigned int maxId = line2Id;
         if (maxId > maxLineId) {
           // This shouldn't happen, but handle gracefully
           #ifdef DEBUG_PHASE8
@@ -1321,6 +1685,22 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
         // Successfully marked as seen (old value was false, now it's true)
         // Now we can safely add it to the candidate list
         
+        // Packed leaves: run the narrow phase here, on the leaf's copy of
+        // line2, and keep only pairs that intersect
+        IntersectionType intersectionType = NO_INTERSECTION;
+        if (packedLeaves) {
+          const QuadLeafGeometry* packed = cell->packed;
+          intersectionType = intersectGeometry(
+              line1->p1, line1->p2, line1->velocity,
+              (Vec){.x = packed->p1x[j], .y = packed->p1y[j]},
+              (Vec){.x = packed->p2x[j], .y = packed->p2y[j]},
+              (Vec){.x = packed->vx[j], .y = packed->vy[j]},
+              tree->buildTimeStep);
+          if (intersectionType == NO_INTERSECTION) {
+            continue;
+          }
+        }
+        
         // PHASE 8: Thread-safe append to candidateList
         // Get index atomically (capacity already checked above, but might have changed)
         // atomic_fetch_add returns the OLD value before incrementing, so we get a valid index
@@ -1345,6 +1725,7 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
         // Add candidate pair (line1.id < line2.id is guaranteed by check above)
         candidateList->pairs[myIndex].line1 = line1;
         candidateList->pairs[myIndex].line2 = line2;
+        candidateList->pairs[myIndex].intersectionType = intersectionType;
         totalPairsFound++;
         #ifdef DEBUG_PHASE8
         debugPairsAdded++;
@@ -1412,6 +1793,8 @@ QuadTreeError QuadTree_findCandidatePairs(QuadTree* tree,
     fprintf(stderr, "Actual ratio: %.2f%%\n", actualRatio);
     fprintf(stderr, "Ratio gap: %.1fx (actual/expected)\n", ratioGap);
     fprintf(stderr, "Average cells per line: %.2f\n", avgCellsPerLine);
+    fprintf(stderr, "Cell entries rejected by quantized boxes: %u\n",
+            totalPairsQuantizedOut);
     fprintf(stderr, "======================================================\n");
   }
   #endif
@@ -1496,6 +1879,7 @@ QuadTreeError QuadTreeCandidateList_init(QuadTreeCandidateList* list,
   
   list->count = 0;
   list->capacity = capacity;
+  list->tested = false;
   
   return QUADTREE_SUCCESS;
 }
@@ -1514,6 +1898,468 @@ void QuadTreeCandidateList_destroy(QuadTreeCandidateList* list) {
   list->capacity = 0;
 }
 
+// ============================================================================
+// Spatial Queries
+// ============================================================================
+
+/**
+ * Room the traversal stack needs for a tree of the given maximum depth.
+ * A depth-first walk leaves at most three unvisited siblings on the stack
+ * per level, plus the four children of the node being expanded.
+ */
+static unsigned int queryStackCapacity(unsigned int maxDepth) {
+  return 3 * maxDepth + 4;
+}
+
+/**
+ * Start a new query: advance the context's epoch so that every line reads
+ * as unvisited. The marks are only cleared when the epoch wraps around.
+ *
+ * @return QUADTREE_SUCCESS, or an error if the context is too small for tree
+ */
+static QuadTreeError beginQuery(const QuadTree* tree,
+                                QuadTreeQueryContext* context) {
+  if (tree == NULL || context == NULL) {
+    return QUADTREE_ERROR_NULL_POINTER;
+  }
+  if (tree->root == NULL) {
+    return QUADTREE_ERROR_EMPTY_TREE;
+  }
+  if (context->stackCapacity < queryStackCapacity(tree->config.maxDepth)) {
+    return QUADTREE_ERROR_CONTEXT_TOO_SMALL;
+  }
+  context->epoch++;
+  if (context->epoch == 0) {
+    memset(context->stamps, 0, context->stampCapacity * sizeof(unsigned int));
+    context->epoch = 1;
+  }
+  context->cellsChecked = 0;
+  return QUADTREE_SUCCESS;
+}
+
+/**
+ * Mark a line as visited by the current query.
+ *
+ * @return true the first time the line is seen in this query, false if it
+ *         was already examined in another leaf
+ */
+static bool markLine(QuadTreeQueryContext* context, const Line* line) {
+  if (context->stamps[line->id] == context->epoch) {
+    return false;
+  }
+  context->stamps[line->id] = context->epoch;
+  return true;
+}
+
+/**
+ * Check whether a line segment touches a closed rectangle, by clipping the
+ * segment's parameter range [0, 1] against each of the four edges
+ * (Liang-Barsky).
+ */
+static bool segmentIntersectsBox(const Line* line,
+                                 double xmin, double xmax,
+                                 double ymin, double ymax) {
+  double dx = line->p2.x - line->p1.x;
+  double dy = line->p2.y - line->p1.y;
+  double p[4] = {-dx, dx, -dy, dy};
+  double q[4] = {line->p1.x - xmin, xmax - line->p1.x,
+                 line->p1.y - ymin, ymax - line->p1.y};
+  double t0 = 0.0;
+  double t1 = 1.0;
+
+  for (int i = 0; i < 4; i++) {
+    if (p[i] == 0.0) {
+      // Parallel to this edge: inside its half-plane or not at all
+      if (q[i] < 0.0) {
+        return false;
+      }
+      continue;
+    }
+    double r = q[i] / p[i];
+    if (p[i] < 0.0) {
+      if (r > t1) {
+        return false;
+      }
+      t0 = maxDouble(t0, r);
+    } else {
+      if (r < t0) {
+        return false;
+      }
+      t1 = minDouble(t1, r);
+    }
+  }
+  return true;
+}
+
+/**
+ * Squared distance from a point to a line segment.
+ */
+static double pointSegmentDistanceSquared(Vec point, const Line* line) {
+  double ex = line->p2.x - line->p1.x;
+  double ey = line->p2.y - line->p1.y;
+  double wx = point.x - line->p1.x;
+  double wy = point.y - line->p1.y;
+  double lengthSquared = ex * ex + ey * ey;
+
+  // Parameter of the closest point on the segment, clamped to [0, 1]
+  double t = 0.0;
+  if (lengthSquared > 0.0) {
+    t = maxDouble(0.0, minDouble(1.0, (wx * ex + wy * ey) / lengthSquared));
+  }
+  double cx = wx - t * ex;
+  double cy = wy - t * ey;
+  return cx * cx + cy * cy;
+}
+
+/**
+ * Squared distance from a point to a node's cell (0 if inside).
+ */
+static double pointNodeDistanceSquared(Vec point, const QuadNode* node) {
+  double dx = maxDouble(maxDouble(node->xmin - point.x, 0.0),
+                        point.x - node->xmax);
+  double dy = maxDouble(maxDouble(node->ymin - point.y, 0.0),
+                        point.y - node->ymax);
+  return dx * dx + dy * dy;
+}
+
+/**
+ * Ray parameter at which the ray origin + t * direction first hits a line
+ * segment.
+ *
+ * @return true with *t set if the ray hits the segment at some t >= 0
+ */
+static bool raySegmentIntersection(Vec origin, Vec direction,
+                                   const Line* line, double* t) {
+  double ex = line->p2.x - line->p1.x;
+  double ey = line->p2.y - line->p1.y;
+  double wx = line->p1.x - origin.x;
+  double wy = line->p1.y - origin.y;
+  double denom = direction.x * ey - direction.y * ex;
+  double wCrossD = wx * direction.y - wy * direction.x;
+
+  if (denom == 0.0) {
+    // Parallel: only a collinear segment can be hit, first at the nearer
+    // endpoint in front of the origin (or at the origin if it lies on it)
+    if (wCrossD != 0.0) {
+      return false;
+    }
+    double dd = direction.x * direction.x + direction.y * direction.y;
+    double t1 = (wx * direction.x + wy * direction.y) / dd;
+    double t2 = ((wx + ex) * direction.x + (wy + ey) * direction.y) / dd;
+    if (t1 < 0.0 && t2 < 0.0) {
+      return false;
+    }
+    *t = (t1 < 0.0 || t2 < 0.0) ? 0.0 : minDouble(t1, t2);
+    return true;
+  }
+
+  double s = (wx * ey - wy * ex) / denom;     // Along the ray
+  double u = wCrossD / denom;                 // Along the segment
+  if (s < 0.0 || u < 0.0 || u > 1.0) {
+    return false;
+  }
+  *t = s;
+  return true;
+}
+
+/**
+ * Ray parameter at which a ray enters a node's cell (slab test).
+ *
+ * @return true with *tEnter set (0 if the origin is inside) if the ray
+ *         meets the cell at some t >= 0
+ */
+static bool rayNodeEntry(Vec origin, Vec direction, const QuadNode* node,
+                         double* tEnter) {
+  double tmin = 0.0;
+  double tmax = INFINITY;
+  double lo[2] = {node->xmin, node->ymin};
+  double hi[2] = {node->xmax, node->ymax};
+  double o[2] = {origin.x, origin.y};
+  double d[2] = {direction.x, direction.y};
+
+  for (int axis = 0; axis < 2; axis++) {
+    if (d[axis] == 0.0) {
+      if (o[axis] < lo[axis] || o[axis] > hi[axis]) {
+        return false;
+      }
+      continue;
+    }
+    double ta = (lo[axis] - o[axis]) / d[axis];
+    double tb = (hi[axis] - o[axis]) / d[axis];
+    tmin = maxDouble(tmin, minDouble(ta, tb));
+    tmax = minDouble(tmax, maxDouble(ta, tb));
+    if (tmin > tmax) {
+      return false;
+    }
+  }
+  *tEnter = tmin;
+  return true;
+}
+
+/**
+ * Push the children of a node onto the traversal stack, nearest last so
+ * that it is visited first. Children whose key is not below bound are
+ * pruned.
+ *
+ * @param keys Key of each child (distance or ray parameter), or INFINITY
+ *             for children that cannot contain a better answer
+ */
+static void pushChildrenByKey(QuadTreeQueryContext* context,
+                              unsigned int* top,
+                              const QuadNode* node,
+                              const double keys[4],
+                              double bound) {
+  int order[4] = {0, 1, 2, 3};
+  // Sort the four children by decreasing key (insertion sort)
+  for (int i = 1; i < 4; i++) {
+    int child = order[i];
+    int j = i - 1;
+    while (j >= 0 && keys[order[j]] < keys[child]) {
+      order[j + 1] = order[j];
+      j--;
+    }
+    order[j + 1] = child;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (keys[order[i]] < bound) {
+      context->stack[(*top)++] = node->children[order[i]];
+    }
+  }
+}
+
+QuadTreeError QuadTreeQueryContext_init(QuadTreeQueryContext* context) {
+  if (context == NULL) {
+    return QUADTREE_ERROR_NULL_POINTER;
+  }
+  memset(context, 0, sizeof(QuadTreeQueryContext));
+  return QUADTREE_SUCCESS;
+}
+
+QuadTreeError QuadTreeQueryContext_prepare(QuadTreeQueryContext* context,
+                                           const QuadTree* tree) {
+  if (context == NULL || tree == NULL) {
+    return QUADTREE_ERROR_NULL_POINTER;
+  }
+
+  unsigned int stampsNeeded = 1;
+  for (unsigned int i = 0; i < tree->numLines; i++) {
+    if (tree->lines[i] != NULL && tree->lines[i]->id >= stampsNeeded) {
+      stampsNeeded = tree->lines[i]->id + 1;
+    }
+  }
+  if (stampsNeeded > context->stampCapacity) {
+    unsigned int* stamps = realloc(context->stamps,
+                                   stampsNeeded * sizeof(unsigned int));
+    if (stamps == NULL) {
+      return QUADTREE_ERROR_MALLOC_FAILED;
+    }
+    // New marks must not match the current epoch
+    memset(stamps + context->stampCapacity, 0,
+           (stampsNeeded - context->stampCapacity) * sizeof(unsigned int));
+    context->stamps = stamps;
+    context->stampCapacity = stampsNeeded;
+  }
+
+  unsigned int stackNeeded = queryStackCapacity(tree->config.maxDepth);
+  if (stackNeeded > context->stackCapacity) {
+    const QuadNode** stack = realloc(context->stack,
+                                     stackNeeded * sizeof(QuadNode*));
+    if (stack == NULL) {
+      return QUADTREE_ERROR_MALLOC_FAILED;
+    }
+    context->stack = stack;
+    context->stackCapacity = stackNeeded;
+  }
+  return QUADTREE_SUCCESS;
+}
+
+void QuadTreeQueryContext_destroy(QuadTreeQueryContext* context) {
+  if (context == NULL) {
+    return;
+  }
+  free(context->stamps);
+  free(context->stack);
+  memset(context, 0, sizeof(QuadTreeQueryContext));
+}
+
+QuadTreeError QuadTree_queryRange(const QuadTree* tree,
+                                  QuadTreeQueryContext* context,
+                                  double xmin, double xmax,
+                                  double ymin, double ymax,
+                                  Line** results,
+                                  unsigned int maxResults,
+                                  unsigned int* numFound) {
+  if (numFound == NULL || (results == NULL && maxResults > 0)) {
+    return QUADTREE_ERROR_NULL_POINTER;
+  }
+  if (xmin > xmax || ymin > ymax) {
+    return QUADTREE_ERROR_INVALID_BOUNDS;
+  }
+  QuadTreeError error = beginQuery(tree, context);
+  if (error != QUADTREE_SUCCESS) {
+    return error;
+  }
+
+  unsigned int found = 0;
+  unsigned int top = 0;
+  context->stack[top++] = tree->root;
+  while (top > 0) {
+    const QuadNode* node = context->stack[--top];
+    if (!boxesOverlap(xmin, xmax, ymin, ymax,
+                      node->xmin, node->xmax, node->ymin, node->ymax)) {
+      continue;
+    }
+    if (!node->isLeaf) {
+      for (int i = 3; i >= 0; i--) {
+        context->stack[top++] = node->children[i];
+      }
+      continue;
+    }
+
+    context->cellsChecked++;
+    for (unsigned int j = 0; j < node->numLines; j++) {
+      const Line* line = node->lines[j];
+      if (line->id >= context->stampCapacity) {
+        return QUADTREE_ERROR_CONTEXT_TOO_SMALL;
+      }
+      if (!markLine(context, line) ||
+          !segmentIntersectsBox(line, xmin, xmax, ymin, ymax)) {
+        continue;
+      }
+      if (found < maxResults) {
+        results[found] = node->lines[j];
+      }
+      found++;
+    }
+  }
+
+  *numFound = found;
+  return QUADTREE_SUCCESS;
+}
+
+QuadTreeError QuadTree_queryNearest(const QuadTree* tree,
+                                    QuadTreeQueryContext* context,
+                                    Vec point,
+                                    Line** nearest,
+                                    double* distance) {
+  if (nearest == NULL) {
+    return QUADTREE_ERROR_NULL_POINTER;
+  }
+  QuadTreeError error = beginQuery(tree, context);
+  if (error != QUADTREE_SUCCESS) {
+    return error;
+  }
+
+  Line* best = NULL;
+  double bestSquared = INFINITY;
+  unsigned int top = 0;
+  context->stack[top++] = tree->root;
+  while (top > 0) {
+    const QuadNode* node = context->stack[--top];
+    // The bound may have tightened since the node was pushed
+    if (pointNodeDistanceSquared(point, node) >= bestSquared) {
+      continue;
+    }
+    if (!node->isLeaf) {
+      double keys[4];
+      for (int i = 0; i < 4; i++) {
+        keys[i] = pointNodeDistanceSquared(point, node->children[i]);
+      }
+      pushChildrenByKey(context, &top, node, keys, bestSquared);
+      continue;
+    }
+
+    context->cellsChecked++;
+    for (unsigned int j = 0; j < node->numLines; j++) {
+      Line* line = node->lines[j];
+      if (line->id >= context->stampCapacity) {
+        return QUADTREE_ERROR_CONTEXT_TOO_SMALL;
+      }
+      if (!markLine(context, line)) {
+        continue;
+      }
+      double squared = pointSegmentDistanceSquared(point, line);
+      if (squared < bestSquared) {
+        bestSquared = squared;
+        best = line;
+      }
+    }
+  }
+
+  *nearest = best;
+  if (distance != NULL) {
+    *distance = sqrt(bestSquared);
+  }
+  return best != NULL ? QUADTREE_SUCCESS : QUADTREE_ERROR_EMPTY_TREE;
+}
+
+QuadTreeError QuadTree_raycast(const QuadTree* tree,
+                               QuadTreeQueryContext* context,
+                               Vec origin,
+                               Vec direction,
+                               double maxT,
+                               Line** hit,
+                               double* hitT) {
+  if (hit == NULL) {
+    return QUADTREE_ERROR_NULL_POINTER;
+  }
+  QuadTreeError error = beginQuery(tree, context);
+  if (error != QUADTREE_SUCCESS) {
+    return error;
+  }
+
+  *hit = NULL;
+  if (direction.x == 0.0 && direction.y == 0.0) {
+    return QUADTREE_SUCCESS;
+  }
+
+  // Hits farther than the best one so far (initially maxT) are pruned; a
+  // hit exactly at maxT still counts
+  double bestT = maxT;
+  double bound = nextafter(maxT, INFINITY);
+  unsigned int top = 0;
+  context->stack[top++] = tree->root;
+  while (top > 0) {
+    const QuadNode* node = context->stack[--top];
+    double tEnter;
+    if (!rayNodeEntry(origin, direction, node, &tEnter) || tEnter >= bound) {
+      continue;
+    }
+    if (!node->isLeaf) {
+      double keys[4];
+      for (int i = 0; i < 4; i++) {
+        if (!rayNodeEntry(origin, direction, node->children[i], &keys[i])) {
+          keys[i] = INFINITY;
+        }
+      }
+      pushChildrenByKey(context, &top, node, keys, bound);
+      continue;
+    }
+
+    context->cellsChecked++;
+    for (unsigned int j = 0; j < node->numLines; j++) {
+      Line* line = node->lines[j];
+      if (line->id >= context->stampCapacity) {
+        return QUADTREE_ERROR_CONTEXT_TOO_SMALL;
+      }
+      double t;
+      if (!markLine(context, line) ||
+          !raySegmentIntersection(origin, direction, line, &t) ||
+          t >= bound) {
+        continue;
+      }
+      *hit = line;
+      bestT = t;
+      bound = t;
+    }
+  }
+
+  if (hitT != NULL && *hit != NULL) {
+    *hitT = bestT;
+  }
+  return QUADTREE_SUCCESS;
+}
+
 // ============================================================================
 // Utility Functions
 // ============================================================================
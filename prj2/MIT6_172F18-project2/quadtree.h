@@ -112,9 +112,11 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // Include line.h since we use Line types in the public API
 #include "./line.h"
+#include "./intersection_detection.h"
 
 /**
  * Error codes returned by quadtree functions.
@@ -125,7 +127,8 @@ typedef enum {
   QUADTREE_ERROR_INVALID_BOUNDS,   // Invalid bounding box (xmin >= xmax, etc.)
   QUADTREE_ERROR_MALLOC_FAILED,    // Memory allocation failed
   QUADTREE_ERROR_INVALID_CONFIG,   // Invalid configuration parameters
-  QUADTREE_ERROR_EMPTY_TREE        // Operation on empty tree
+  QUADTREE_ERROR_EMPTY_TREE,       // Operation on empty tree
+  QUADTREE_ERROR_CONTEXT_TOO_SMALL // Query context not prepared for tree
 } QuadTreeError;
 
 /**
@@ -150,6 +153,18 @@ typedef struct {
   // Enable debug statistics collection (slight performance overhead).
   // When true, tree tracks node counts, line distributions, etc.
   bool enableDebugStats;
+
+  // Reject candidate pairs whose 16-bit quantized bounding boxes do not
+  // overlap before they reach the pair-tracking matrix. Quantization is
+  // rounded outward, so it can only admit extra pairs, never drop one the
+  // full-precision boxes would keep.
+  bool useQuantizedBoxes;
+
+  // Copy each leaf's line geometry into packed per-leaf arrays and run the
+  // narrow phase (intersectGeometry) inside QuadTree_findCandidatePairs on
+  // that copy. The candidate list then holds only pairs that actually
+  // intersect, with their IntersectionType.
+  bool usePackedLeaves;
 } QuadTreeConfig;
 
 /**
@@ -173,6 +188,23 @@ typedef struct {
   unsigned int emptyCells;            // Cells with no lines
 } QuadTreeDebugStats;
 
+/**
+ * Packed copy of a leaf's line geometry (see usePackedLeaves).
+ * Entry j mirrors node->lines[j], one array per field, so the narrow phase
+ * streams through contiguous leaf-local memory instead of dereferencing a
+ * Line* scattered across the heap for every pair.
+ */
+typedef struct {
+  double* p1x;          // First endpoint
+  double* p1y;
+  double* p2x;          // Second endpoint
+  double* p2y;
+  double* vx;           // Velocity
+  double* vy;
+  unsigned int* ids;    // Line ID
+  unsigned int capacity;  // Allocated length of each array
+} QuadLeafGeometry;
+
 /**
  * Internal quadtree node structure.
  * Represents a square region of space that may contain line segments.
@@ -201,6 +233,19 @@ typedef struct QuadNode {
   // Node metadata
   bool isLeaf;    // True if this node has no children (leaf node)
   int depth;      // Depth of this node in the tree (0 = root)
+
+  // Quantized bounding boxes of lines[] (leaves only, NULL until the first
+  // query with useQuantizedBoxes). Coordinates are 16-bit fixed point
+  // relative to this cell, stored SoA so one vector compares many boxes.
+  uint16_t* qxmin;
+  uint16_t* qxmax;
+  uint16_t* qymin;
+  uint16_t* qymax;
+  unsigned int qcapacity;    // Allocated length of each q* array
+
+  // Packed geometry of lines[] (leaves only, NULL until the first query
+  // with usePackedLeaves)
+  QuadLeafGeometry* packed;
 } QuadNode;
 
 /**
@@ -292,6 +337,7 @@ typedef struct {
 typedef struct {
   Line* line1;   // First line (guaranteed: line1->id < line2->id)
   Line* line2;   // Second line
+  IntersectionType intersectionType;  // Result, if the list is tested
 } QuadTreeCandidatePair;
 
 /**
@@ -308,8 +354,35 @@ typedef struct {
   QuadTreeCandidatePair* pairs;  // Array of candidate pairs
   unsigned int count;            // Number of pairs
   unsigned int capacity;         // Allocated capacity
+
+  // True if the query already ran the narrow phase (usePackedLeaves):
+  // every pair intersects and carries its intersectionType, so the caller
+  // must not call intersect() again.
+  bool tested;
 } QuadTreeCandidateList;
 
+/**
+ * Per-thread scratch state for the spatial queries (QuadTree_queryRange,
+ * QuadTree_queryNearest, QuadTree_raycast).
+ *
+ * A line spanning several leaves is stored in each of them, so a query
+ * marks every line it examines to look at it only once, and walks the tree
+ * with an explicit stack instead of recursion. Both live here, sized once
+ * by QuadTreeQueryContext_prepare(), so that a query itself never
+ * allocates.
+ *
+ * The queries only read the tree. Any number of threads may query the same
+ * built tree at once, as long as each uses its own context.
+ */
+typedef struct {
+  unsigned int* stamps;         // Per line ID: epoch of the last visit
+  unsigned int stampCapacity;   // Entries in stamps (largest line ID + 1)
+  unsigned int epoch;           // Mark of the current query
+  const QuadNode** stack;       // Traversal stack
+  unsigned int stackCapacity;   // Entries in stack
+  unsigned int cellsChecked;    // Leaves examined by the last query
+} QuadTreeQueryContext;
+
 // ============================================================================
 // Configuration Functions
 // ============================================================================
@@ -329,7 +402,8 @@ QuadTreeConfig QuadTreeConfig_default(void);
  * @param maxLinesPerNode Lines per node before subdividing (must be > 0)
  * @param minCellSize Minimum cell size (must be > 0)
  * @param enableDebugStats Whether to collect debug statistics
- * @return Configuration structure
+ * @return Configuration structure (useQuantizedBoxes and usePackedLeaves
+ *         are left false)
  */
 QuadTreeConfig QuadTreeConfig_create(unsigned int maxDepth,
                                      unsigned int maxLinesPerNode,
@@ -511,6 +585,112 @@ QuadTreeError QuadTreeCandidateList_init(QuadTreeCandidateList* list,
  */
 void QuadTreeCandidateList_destroy(QuadTreeCandidateList* list);
 
+// ============================================================================
+// Spatial Query Functions
+// ============================================================================
+//
+// General-purpose queries against the current (not future) positions of
+// the lines in a built tree. Each walks the tree from the root and skips
+// every node whose cell cannot contain an answer: cells outside the range,
+// cells farther than the nearest line found so far, cells the ray enters
+// after its nearest hit so far. Children are visited nearest first, so the
+// bound tightens early.
+
+/**
+ * Initialize an empty query context. No memory is allocated until
+ * QuadTreeQueryContext_prepare().
+ *
+ * @param context Context to initialize
+ * @return QUADTREE_SUCCESS on success, error code otherwise
+ */
+QuadTreeError QuadTreeQueryContext_init(QuadTreeQueryContext* context);
+
+/**
+ * Size a query context for a built tree. The context only grows, so a
+ * context prepared for one frame's tree needs no new memory for the next
+ * frame's unless the tree got deeper or line IDs got larger.
+ *
+ * @param context Context initialized with QuadTreeQueryContext_init
+ * @param tree Built tree the context will be used with
+ * @return QUADTREE_SUCCESS on success, error code otherwise
+ */
+QuadTreeError QuadTreeQueryContext_prepare(QuadTreeQueryContext* context,
+                                           const QuadTree* tree);
+
+/**
+ * Free the memory of a query context.
+ *
+ * @param context Context to destroy (can be NULL, no-op)
+ */
+void QuadTreeQueryContext_destroy(QuadTreeQueryContext* context);
+
+/**
+ * Find every line whose segment touches the closed rectangle
+ * [xmin, xmax] x [ymin, ymax].
+ *
+ * Each line is reported once, in no particular order. If more than
+ * maxResults lines match, only the first maxResults are stored, but
+ * numFound still counts all of them, so the caller can retry with a larger
+ * array.
+ *
+ * @param tree Built quadtree
+ * @param context Query context prepared for tree
+ * @param xmin, xmax, ymin, ymax Rectangle to search
+ * @param results Output array of matching lines (can be NULL if maxResults
+ *                is 0)
+ * @param maxResults Capacity of results
+ * @param numFound Output parameter for the number of matching lines
+ * @return QUADTREE_SUCCESS on success, error code otherwise
+ */
+QuadTreeError QuadTree_queryRange(const QuadTree* tree,
+                                  QuadTreeQueryContext* context,
+                                  double xmin, double xmax,
+                                  double ymin, double ymax,
+                                  Line** results,
+                                  unsigned int maxResults,
+                                  unsigned int* numFound);
+
+/**
+ * Find the line segment closest to a point.
+ *
+ * @param tree Built quadtree
+ * @param context Query context prepared for tree
+ * @param point Point to search from
+ * @param nearest Output parameter for the closest line (NULL if the tree
+ *                has no lines)
+ * @param distance Output parameter for its distance (can be NULL)
+ * @return QUADTREE_SUCCESS on success, QUADTREE_ERROR_EMPTY_TREE if the
+ *         tree has no lines, other error code otherwise
+ */
+QuadTreeError QuadTree_queryNearest(const QuadTree* tree,
+                                    QuadTreeQueryContext* context,
+                                    Vec point,
+                                    Line** nearest,
+                                    double* distance);
+
+/**
+ * Find the first line segment hit by the ray origin + t * direction,
+ * 0 <= t <= maxT. The direction need not be normalized; t is measured in
+ * multiples of it. A zero direction hits nothing.
+ *
+ * @param tree Built quadtree
+ * @param context Query context prepared for tree
+ * @param origin Start of the ray
+ * @param direction Direction of the ray
+ * @param maxT Largest ray parameter to consider (INFINITY for no limit)
+ * @param hit Output parameter for the first line hit (NULL if none)
+ * @param hitT Output parameter for the ray parameter of the hit (can be
+ *             NULL; left unchanged if nothing is hit)
+ * @return QUADTREE_SUCCESS on success (hit or no hit), error code otherwise
+ */
+QuadTreeError QuadTree_raycast(const QuadTree* tree,
+                               QuadTreeQueryContext* context,
+                               Vec origin,
+                               Vec direction,
+                               double maxT,
+                               Line** hit,
+                               double* hitT);
+
 // ============================================================================
 // Debug and Statistics Functions
 // ============================================================================
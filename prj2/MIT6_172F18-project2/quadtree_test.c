@@ -0,0 +1,369 @@
+/**
+ * quadtree_test.c -- checks the quadtree spatial queries against brute force
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+// Builds random scenes, runs QuadTree_queryRange, QuadTree_queryNearest and
+// QuadTree_raycast on each, and compares every answer with a linear scan
+// over all lines. Exits nonzero on the first mismatch.
+//
+// Usage: quadtree_test [numScenes] [seed]
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./line.h"
+#include "./quadtree.h"
+#include "./vec.h"
+
+#define MAX_LINES 400
+#define QUERIES_PER_SCENE 50
+
+// Slack for comparing distances and ray parameters computed two ways
+#define TOLERANCE 1e-9
+
+static double randomDouble(double lo, double hi) {
+  return lo + (hi - lo) * ((double) rand() / RAND_MAX);
+}
+
+// A random point, mostly inside the box but sometimes a little outside it
+static Vec randomPoint(void) {
+  double marginX = 0.1 * (BOX_XMAX - BOX_XMIN);
+  double marginY = 0.1 * (BOX_YMAX - BOX_YMIN);
+  return Vec_make(randomDouble(BOX_XMIN - marginX, BOX_XMAX + marginX),
+                  randomDouble(BOX_YMIN - marginY, BOX_YMAX + marginY));
+}
+
+// Fill lines with a random scene of short and long segments, some of them
+// degenerate (zero length)
+static void randomScene(Line* lines, Line** linePointers,
+                        unsigned int numLines) {
+  for (unsigned int i = 0; i < numLines; i++) {
+    Line* line = &lines[i];
+    memset(line, 0, sizeof(Line));
+    line->p1 = randomPoint();
+    double reach = (rand() % 4 == 0) ? 0.3 : 0.02;
+    if (rand() % 50 == 0) {
+      line->p2 = line->p1;
+    } else {
+      line->p2 = Vec_make(line->p1.x + randomDouble(-reach, reach),
+                          line->p1.y + randomDouble(-reach, reach));
+    }
+    line->velocity = Vec_make(randomDouble(-1e-3, 1e-3),
+                              randomDouble(-1e-3, 1e-3));
+    line->color = RED;
+    line->id = i;
+    line->cachedLength = Vec_length(Vec_subtract(line->p2, line->p1));
+    line->cachedVelocityMagnitude = Vec_length(line->velocity);
+    linePointers[i] = line;
+  }
+}
+
+// ============================================================================
+// Brute-force reference answers
+// ============================================================================
+
+// Twice the signed area of the triangle (a, b, c)
+static double orientation(Vec a, Vec b, Vec c) {
+  return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+static bool pointInBox(Vec p, double xmin, double xmax,
+                       double ymin, double ymax) {
+  return p.x >= xmin && p.x <= xmax && p.y >= ymin && p.y <= ymax;
+}
+
+// Whether segments (a, b) and (c, d) cross, ignoring collinear overlap
+static bool segmentsCross(Vec a, Vec b, Vec c, Vec d) {
+  double o1 = orientation(a, b, c);
+  double o2 = orientation(a, b, d);
+  double o3 = orientation(c, d, a);
+  double o4 = orientation(c, d, b);
+  return ((o1 <= 0 && o2 >= 0) || (o1 >= 0 && o2 <= 0)) &&
+         ((o3 <= 0 && o4 >= 0) || (o3 >= 0 && o4 <= 0));
+}
+
+// A segment touches a box if an endpoint is inside it or it crosses an edge
+static bool bruteSegmentInBox(const Line* line, double xmin, double xmax,
+                              double ymin, double ymax) {
+  if (pointInBox(line->p1, xmin, xmax, ymin, ymax) ||
+      pointInBox(line->p2, xmin, xmax, ymin, ymax)) {
+    return true;
+  }
+  Vec corners[4] = {Vec_make(xmin, ymin), Vec_make(xmax, ymin),
+                    Vec_make(xmax, ymax), Vec_make(xmin, ymax)};
+  for (int i = 0; i < 4; i++) {
+    if (segmentsCross(line->p1, line->p2, corners[i], corners[(i + 1) % 4])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static double bruteDistance(Vec point, const Line* line) {
+  Vec edge = Vec_subtract(line->p2, line->p1);
+  double lengthSquared = Vec_dotProduct(edge, edge);
+  if (lengthSquared == 0.0) {
+    return Vec_length(Vec_subtract(point, line->p1));
+  }
+  double t = Vec_dotProduct(Vec_subtract(point, line->p1), edge) /
+             lengthSquared;
+  t = fmax(0.0, fmin(1.0, t));
+  Vec closest = Vec_add(line->p1, Vec_multiply(edge, t));
+  return Vec_length(Vec_subtract(point, closest));
+}
+
+// Ray parameter of the first point of the segment on the ray, or INFINITY.
+// Collinear rays are not generated, so parallel segments are never hit.
+static double bruteRayParameter(Vec origin, Vec direction, const Line* line) {
+  Vec edge = Vec_subtract(line->p2, line->p1);
+  Vec w = Vec_subtract(line->p1, origin);
+  double denom = direction.x * edge.y - direction.y * edge.x;
+  if (denom == 0.0) {
+    return INFINITY;
+  }
+  double s = (w.x * edge.y - w.y * edge.x) / denom;
+  double u = (w.x * direction.y - w.y * direction.x) / denom;
+  if (s < 0.0 || u < 0.0 || u > 1.0) {
+    return INFINITY;
+  }
+  return s;
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static bool checkRange(const QuadTree* tree, QuadTreeQueryContext* context,
+                       Line* lines, unsigned int numLines) {
+  Vec a = randomPoint();
+  Vec b = randomPoint();
+  double xmin = fmin(a.x, b.x);
+  double xmax = fmax(a.x, b.x);
+  double ymin = fmin(a.y, b.y);
+  double ymax = fmax(a.y, b.y);
+
+  Line* results[MAX_LINES];
+  unsigned int numFound;
+  QuadTreeError error = QuadTree_queryRange(tree, context, xmin, xmax,
+                                            ymin, ymax, results, MAX_LINES,
+                                            &numFound);
+  if (error != QUADTREE_SUCCESS) {
+    printf("queryRange: %s\n", QuadTree_errorString(error));
+    return false;
+  }
+
+  bool reported[MAX_LINES] = {false};
+  for (unsigned int i = 0; i < numFound; i++) {
+    unsigned int id = results[i]->id;
+    if (reported[id]) {
+      printf("queryRange: line %u reported twice\n", id);
+      return false;
+    }
+    reported[id] = true;
+  }
+  for (unsigned int i = 0; i < numLines; i++) {
+    if (reported[i] != bruteSegmentInBox(&lines[i], xmin, xmax, ymin, ymax)) {
+      printf("queryRange: line %u %s but should%s be\n", i,
+             reported[i] ? "reported" : "missed", reported[i] ? " not" : "");
+      return false;
+    }
+  }
+
+  // A truncated query still counts every match
+  unsigned int truncatedFound;
+  error = QuadTree_queryRange(tree, context, xmin, xmax, ymin, ymax,
+                              NULL, 0, &truncatedFound);
+  if (error != QUADTREE_SUCCESS || truncatedFound != numFound) {
+    printf("queryRange: counted %u lines without results, %u with\n",
+           truncatedFound, numFound);
+    return false;
+  }
+  return true;
+}
+
+static bool checkNearest(const QuadTree* tree, QuadTreeQueryContext* context,
+                         Line* lines, unsigned int numLines) {
+  Vec point = randomPoint();
+  Line* nearest;
+  double distance;
+  QuadTreeError error = QuadTree_queryNearest(tree, context, point,
+                                              &nearest, &distance);
+  if (error != QUADTREE_SUCCESS) {
+    printf("queryNearest: %s\n", QuadTree_errorString(error));
+    return false;
+  }
+
+  double best = INFINITY;
+  for (unsigned int i = 0; i < numLines; i++) {
+    best = fmin(best, bruteDistance(point, &lines[i]));
+  }
+  // Ties may pick either line, so compare distances
+  if (fabs(distance - best) > TOLERANCE ||
+      fabs(bruteDistance(point, nearest) - best) > TOLERANCE) {
+    printf("queryNearest: distance %.17g (line %u), expected %.17g\n",
+           distance, nearest->id, best);
+    return false;
+  }
+  return true;
+}
+
+static bool checkRaycast(const QuadTree* tree, QuadTreeQueryContext* context,
+                         Line* lines, unsigned int numLines) {
+  Vec origin = randomPoint();
+  double angle = randomDouble(0.0, 2.0 * M_PI);
+  double scale = randomDouble(0.5, 2.0);
+  Vec direction = Vec_make(scale * cos(angle), scale * sin(angle));
+  double maxT = (rand() % 2 == 0) ? INFINITY : randomDouble(0.0, 0.5);
+
+  Line* hit;
+  double hitT = -1.0;
+  QuadTreeError error = QuadTree_raycast(tree, context, origin, direction,
+                                         maxT, &hit, &hitT);
+  if (error != QUADTREE_SUCCESS) {
+    printf("raycast: %s\n", QuadTree_errorString(error));
+    return false;
+  }
+
+  double best = INFINITY;
+  for (unsigned int i = 0; i < numLines; i++) {
+    best = fmin(best, bruteRayParameter(origin, direction, &lines[i]));
+  }
+  if (best > maxT) {
+    best = INFINITY;
+  }
+
+  if (hit == NULL || best == INFINITY) {
+    if (hit != NULL || best != INFINITY) {
+      printf("raycast: %s, expected %s\n", hit ? "hit" : "no hit",
+             best != INFINITY ? "a hit" : "no hit");
+      return false;
+    }
+    return true;
+  }
+  if (fabs(hitT - best) > TOLERANCE ||
+      fabs(bruteRayParameter(origin, direction, hit) - best) > TOLERANCE) {
+    printf("raycast: hit line %u at t = %.17g, expected t = %.17g\n",
+           hit->id, hitT, best);
+    return false;
+  }
+  return true;
+}
+
+// Build one scene and run every query against it
+static bool checkScene(QuadTreeQueryContext* context, unsigned int scene) {
+  static Line lines[MAX_LINES];
+  static Line* linePointers[MAX_LINES];
+  unsigned int numLines = 1 + rand() % MAX_LINES;
+  randomScene(lines, linePointers, numLines);
+
+  // Alternate between the default tree and a deep, finely split one
+  QuadTreeConfig config = (scene % 2 == 0)
+      ? QuadTreeConfig_default()
+      : QuadTreeConfig_create(10, 2, 1e-4, false);
+  QuadTreeError error;
+  QuadTree* tree = QuadTree_create(BOX_XMIN, BOX_XMAX, BOX_YMIN, BOX_YMAX,
+                                   &config, &error);
+  if (tree == NULL) {
+    printf("scene %u: create: %s\n", scene, QuadTree_errorString(error));
+    return false;
+  }
+  error = QuadTree_build(tree, linePointers, numLines, 0.5);
+  if (error == QUADTREE_SUCCESS) {
+    error = QuadTreeQueryContext_prepare(context, tree);
+  }
+  if (error != QUADTREE_SUCCESS) {
+    printf("scene %u: %s\n", scene, QuadTree_errorString(error));
+    QuadTree_destroy(tree);
+    return false;
+  }
+
+  bool ok = true;
+  for (int q = 0; ok && q < QUERIES_PER_SCENE; q++) {
+    ok = checkRange(tree, context, lines, numLines) &&
+         checkNearest(tree, context, lines, numLines) &&
+         checkRaycast(tree, context, lines, numLines);
+  }
+  if (!ok) {
+    printf("scene %u: %u lines\n", scene, numLines);
+  }
+  QuadTree_destroy(tree);
+  return ok;
+}
+
+// Queries on a tree without lines find nothing
+static bool checkEmptyTree(QuadTreeQueryContext* context) {
+  QuadTreeError error;
+  QuadTree* tree = QuadTree_create(BOX_XMIN, BOX_XMAX, BOX_YMIN, BOX_YMAX,
+                                   NULL, &error);
+  if (tree == NULL) {
+    printf("empty tree: create: %s\n", QuadTree_errorString(error));
+    return false;
+  }
+  bool ok = true;
+  if (QuadTree_build(tree, NULL, 0, 0.5) == QUADTREE_SUCCESS &&
+      QuadTreeQueryContext_prepare(context, tree) == QUADTREE_SUCCESS) {
+    Line* line = NULL;
+    unsigned int numFound = 1;
+    error = QuadTree_queryNearest(tree, context, Vec_make(0.75, 0.75),
+                                  &line, NULL);
+    ok = ok && error == QUADTREE_ERROR_EMPTY_TREE && line == NULL;
+    error = QuadTree_raycast(tree, context, Vec_make(0.75, 0.75),
+                             Vec_make(1.0, 0.0), INFINITY, &line, NULL);
+    ok = ok && (error == QUADTREE_ERROR_EMPTY_TREE ||
+                (error == QUADTREE_SUCCESS && line == NULL));
+    error = QuadTree_queryRange(tree, context, BOX_XMIN, BOX_XMAX,
+                                BOX_YMIN, BOX_YMAX, NULL, 0, &numFound);
+    ok = ok && (error == QUADTREE_ERROR_EMPTY_TREE ||
+                (error == QUADTREE_SUCCESS && numFound == 0));
+    if (!ok) {
+      printf("empty tree: a query found a line\n");
+    }
+  }
+  QuadTree_destroy(tree);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  unsigned int numScenes = (argc > 1) ? (unsigned int) atoi(argv[1]) : 200;
+  unsigned int seed = (argc > 2) ? (unsigned int) atoi(argv[2]) : 6172;
+  srand(seed);
+
+  QuadTreeQueryContext context;
+  QuadTreeQueryContext_init(&context);
+
+  bool ok = checkEmptyTree(&context);
+  for (unsigned int scene = 0; ok && scene < numScenes; scene++) {
+    ok = checkScene(&context, scene);
+  }
+  QuadTreeQueryContext_destroy(&context);
+
+  if (!ok) {
+    printf("FAIL (seed %u)\n", seed);
+    return 1;
+  }
+  printf("PASS: %u scenes, %u queries of each kind\n", numScenes,
+         numScenes * QUERIES_PER_SCENE);
+  return 0;
+}
@@ -0,0 +1,404 @@
+/** 
+ * LineDemo.c -- main driver for the line simulation
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./scene_parser.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./parallel.h"
+#include "./vec.h"
+
+// Target size of the chunks parsed in parallel. Chunks end at the first
+// newline at or after each multiple of this size.
+#define SCENE_PARSER_CHUNK_BYTES (1 << 20)
+
+// Longest number handed to strtod() by the slow path.
+#define SCENE_PARSER_MAX_TOKEN 64
+
+// One newline-aligned piece of the file body.
+typedef struct {
+  const char* begin;
+  const char* end;
+  unsigned int numRecords;   // Non-blank lines in the chunk
+  unsigned int numNewlines;  // For error line numbers
+  unsigned int firstRecord;  // ID of the chunk's first line
+  unsigned int badLine;      // 0, or the chunk-relative number of a bad line
+} SceneChunk;
+
+// Powers of ten that are exact in a double.
+static const double kExactPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static const char* skipBlanks(const char* p, const char* end) {
+  while (p < end && isBlank(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// Skip blanks, then consume c.
+static bool expectChar(const char** cursor, const char* end, char c) {
+  const char* p = skipBlanks(*cursor, end);
+  if (p == end || *p != c) {
+    return false;
+  }
+  *cursor = p + 1;
+  return true;
+}
+
+// Parse the number at token with strtod(), which accepts everything
+// fscanf("%lf") does. The mapping is not NUL-terminated, so at most
+// SCENE_PARSER_MAX_TOKEN - 1 bytes are copied out first.
+static bool parseDoubleSlow(const char** cursor, const char* token,
+                            const char* end, double* out) {
+  char buffer[SCENE_PARSER_MAX_TOKEN];
+  size_t length = (size_t)(end - token);
+  if (length >= sizeof(buffer)) {
+    length = sizeof(buffer) - 1;
+  }
+  memcpy(buffer, token, length);
+  buffer[length] = '\0';
+  char* stop;
+  double value = strtod(buffer, &stop);
+  if (stop == buffer) {
+    return false;
+  }
+  *out = value;
+  *cursor = token + (stop - buffer);
+  return true;
+}
+
+// Parse a decimal number such as "-00.208073" or "1.5e3".
+//
+// With at most 15 significant digits and a decimal exponent of at most 22
+// in magnitude, both the digits and the power of ten are exact doubles, so
+// one IEEE multiply or divide gives the correctly rounded value, the same
+// one strtod() returns. Everything else, including the inf, nan and hex
+// float tokens the decimal syntax does not cover, goes to strtod().
+static bool parseDouble(const char** cursor, const char* end, double* out) {
+  const char* p = skipBlanks(*cursor, end);
+  const char* token = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int significantDigits = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  while (p < end && isDigit(*p)) {
+    if (mantissa != 0 || *p != '0') {
+      significantDigits++;
+    }
+    if (significantDigits <= 19) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    } else {
+      exponent++;
+    }
+    anyDigits = true;
+    p++;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && isDigit(*p)) {
+      if (mantissa != 0 || *p != '0') {
+        significantDigits++;
+      }
+      if (significantDigits <= 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        exponent--;
+      }
+      anyDigits = true;
+      p++;
+    }
+  }
+  if (!anyDigits) {
+    return parseDoubleSlow(cursor, token, end, out);
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negativeExponent = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      negativeExponent = (*q == '-');
+      q++;
+    }
+    if (q < end && isDigit(*q)) {
+      int value = 0;
+      while (q < end && isDigit(*q)) {
+        if (value < 100000) {
+          value = value * 10 + (*q - '0');
+        }
+        q++;
+      }
+      exponent += negativeExponent ? -value : value;
+      p = q;
+    }
+  }
+
+  // A letter right after the digits ("0x1p3") means a token the decimal
+  // syntax does not cover.
+  if (p < end && isalpha((unsigned char)*p)) {
+    return parseDoubleSlow(cursor, token, end, out);
+  }
+  if (significantDigits <= 15 && exponent >= -22 && exponent <= 22) {
+    double value = (double)mantissa;
+    if (exponent < 0) {
+      value /= kExactPowersOfTen[-exponent];
+    } else {
+      value *= kExactPowersOfTen[exponent];
+    }
+    *out = negative ? -value : value;
+    *cursor = p;
+    return true;
+  }
+  if ((size_t)(p - token) >= SCENE_PARSER_MAX_TOKEN) {
+    return false;
+  }
+  return parseDoubleSlow(cursor, token, end, out);
+}
+
+// Parse a decimal int. A value out of int's range is rejected, as strtol()
+// would report it with ERANGE.
+static bool parseInt(const char** cursor, const char* end, int* out) {
+  const char* p = skipBlanks(*cursor, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  if (p == end || !isDigit(*p)) {
+    return false;
+  }
+  // INT_MIN has no positive counterpart, so allow one more when negative.
+  const int64_t limit = (int64_t)INT_MAX + (negative ? 1 : 0);
+  int64_t value = 0;
+  while (p < end && isDigit(*p)) {
+    value = value * 10 + (*p - '0');
+    if (value > limit) {
+      return false;
+    }
+    p++;
+  }
+  *out = (int)(negative ? -value : value);
+  *cursor = p;
+  return true;
+}
+
+// Parse one "(x1, y1), (x2, y2), vx, vy, isGray" record spanning
+// [begin, end) into line, the same way LineDemo_createLines() does.
+static bool parseRecord(const char* begin, const char* end, Line* line,
+                        unsigned int id) {
+  const char* p = begin;
+  window_dimension px1, py1, px2, py2, vx, vy;
+  int isGray;
+  if (!(expectChar(&p, end, '(') && parseDouble(&p, end, &px1) &&
+        expectChar(&p, end, ',') && parseDouble(&p, end, &py1) &&
+        expectChar(&p, end, ')') && expectChar(&p, end, ',') &&
+        expectChar(&p, end, '(') && parseDouble(&p, end, &px2) &&
+        expectChar(&p, end, ',') && parseDouble(&p, end, &py2) &&
+        expectChar(&p, end, ')') && expectChar(&p, end, ',') &&
+        parseDouble(&p, end, &vx) && expectChar(&p, end, ',') &&
+        parseDouble(&p, end, &vy) && expectChar(&p, end, ',') &&
+        parseInt(&p, end, &isGray))) {
+    return false;
+  }
+  if (skipBlanks(p, end) != end) {
+    return false;
+  }
+
+  windowToBox(&line->p1.x, &line->p1.y, px1, py1);
+  windowToBox(&line->p2.x, &line->p2.y, px2, py2);
+  velocityWindowToBox(&line->velocity.x, &line->velocity.y, vx, vy);
+  line->color = (Color) isGray;
+  line->id = id;
+  line->cachedLength = Vec_length(Vec_subtract(line->p1, line->p2));
+  line->cachedVelocityMagnitude = Vec_length(line->velocity);
+  return true;
+}
+
+// End of the line starting at p (the newline, or end).
+static const char* lineEnd(const char* p, const char* end) {
+  const char* newline = memchr(p, '\n', (size_t)(end - p));
+  return (newline != NULL) ? newline : end;
+}
+
+// Pass 1: count the records and newlines of a chunk.
+static void countChunk(SceneChunk* chunk) {
+  unsigned int records = 0;
+  unsigned int newlines = 0;
+  const char* p = chunk->begin;
+  while (p < chunk->end) {
+    const char* eol = lineEnd(p, chunk->end);
+    if (skipBlanks(p, eol) != eol) {
+      records++;
+    }
+    if (eol == chunk->end) {
+      break;
+    }
+    newlines++;
+    p = eol + 1;
+  }
+  chunk->numRecords = records;
+  chunk->numNewlines = newlines;
+}
+
+// Pass 2: parse the records of a chunk into lines[firstRecord...].
+static void parseChunk(SceneChunk* chunk, Line* lines) {
+  unsigned int id = chunk->firstRecord;
+  unsigned int lineNumber = 0;
+  const char* p = chunk->begin;
+  while (p < chunk->end) {
+    const char* eol = lineEnd(p, chunk->end);
+    lineNumber++;
+    if (skipBlanks(p, eol) != eol) {
+      if (!parseRecord(p, eol, &lines[id], id)) {
+        chunk->badLine = lineNumber;
+        return;
+      }
+      id++;
+    }
+    if (eol == chunk->end) {
+      break;
+    }
+    p = eol + 1;
+  }
+}
+
+SceneParserStatus SceneParser_parseFile(const char* path, Line** lines,
+                                        unsigned int* numLines) {
+  *lines = NULL;
+  *numLines = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return SCENE_PARSER_UNMAPPABLE;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return SCENE_PARSER_UNMAPPABLE;
+  }
+  size_t size = (size_t)info.st_size;
+  void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return SCENE_PARSER_UNMAPPABLE;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  const char* text = (const char*)mapping;
+  const char* end = text + size;
+
+  // The header line holds the line count; the body is parsed as found.
+  const char* body = lineEnd(text, end);
+  body = (body < end) ? body + 1 : end;
+
+  // Split the body into newline-aligned chunks.
+  size_t bodySize = (size_t)(end - body);
+  unsigned int numChunks = (unsigned int)(bodySize / SCENE_PARSER_CHUNK_BYTES) + 1;
+  SceneChunk* chunks = calloc(numChunks, sizeof(SceneChunk));
+  if (chunks == NULL) {
+    munmap(mapping, size);
+    return SCENE_PARSER_MALLOC_FAILED;
+  }
+  const char* start = body;
+  for (unsigned int c = 0; c < numChunks; c++) {
+    const char* stop = end;
+    if (c + 1 < numChunks) {
+      stop = body + (size_t)(c + 1) * SCENE_PARSER_CHUNK_BYTES;
+      stop = (stop < start) ? start : stop;
+      stop = lineEnd(stop, end);
+      stop = (stop < end) ? stop + 1 : end;
+    }
+    chunks[c].begin = start;
+    chunks[c].end = stop;
+    start = stop;
+  }
+
+  parallel_for(schedule(dynamic, 1)) (unsigned int c = 0; c < numChunks; c++) {
+    countChunk(&chunks[c]);
+  }
+
+  // Line IDs follow file order: each chunk starts where the previous ended.
+  unsigned int total = 0;
+  for (unsigned int c = 0; c < numChunks; c++) {
+    chunks[c].firstRecord = total;
+    total += chunks[c].numRecords;
+  }
+
+  SceneParserStatus status = SCENE_PARSER_OK;
+  Line* storage = NULL;
+  if (total > 0) {
+    storage = malloc(total * sizeof(Line));
+    if (storage == NULL) {
+      status = SCENE_PARSER_MALLOC_FAILED;
+    }
+  }
+
+  if (storage != NULL) {
+    parallel_for(schedule(dynamic, 1))
+        (unsigned int c = 0; c < numChunks; c++) {
+      parseChunk(&chunks[c], storage);
+    }
+
+    // Report the first bad line in file order (line 1 is the header).
+    unsigned int linesBefore = 1;
+    for (unsigned int c = 0; c < numChunks; c++) {
+      if (chunks[c].badLine != 0) {
+        free(storage);
+        storage = NULL;
+        status = SCENE_PARSER_MALFORMED;
+        total = linesBefore + chunks[c].badLine;
+        break;
+      }
+      linesBefore += chunks[c].numNewlines;
+    }
+  }
+
+  free(chunks);
+  munmap(mapping, size);
+  *lines = storage;
+  *numLines = (status == SCENE_PARSER_OK || status == SCENE_PARSER_MALFORMED)
+              ? total : 0;
+  return status;
+}
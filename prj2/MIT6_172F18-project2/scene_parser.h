@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+
+// scene_parser.h -- parallel loader for .in scene files
+#ifndef SCENEPARSER_H_
+#define SCENEPARSER_H_
+
+#include "./line.h"
+
+typedef enum {
+  SCENE_PARSER_OK,
+  SCENE_PARSER_UNMAPPABLE,     // File could not be opened or mmapped
+  SCENE_PARSER_MALFORMED,      // A line does not match the .in format
+  SCENE_PARSER_MALLOC_FAILED   // Line storage could not be allocated
+} SceneParserStatus;
+
+// Parse a scene file in the .in text format:
+//
+//   <number of lines>
+//   (x1, y1), (x2, y2), vx, vy, isGray
+//   ...
+//
+// The file is mmapped and split at newline boundaries into chunks that are
+// parsed in parallel, straight into one contiguous array of lines. Line i of
+// the body gets ID i, and its coordinates are converted from window to box
+// space exactly as LineDemo_createLines() does. Numbers are read with a
+// fast decimal parser that falls back to strtod() whenever it could not
+// round exactly or does not recognize the token (inf, nan, hex floats), so
+// the values match fscanf("%lf") bit for bit. A color that does not fit in
+// an int makes the line malformed.
+//
+// On SCENE_PARSER_OK, *lines is a malloc'd array of *numLines lines (NULL
+// if the body is empty) owned by the caller. On SCENE_PARSER_MALFORMED,
+// *numLines holds the 1-based file line number of the first bad line.
+SceneParserStatus SceneParser_parseFile(const char* path, Line** lines,
+                                        unsigned int* numLines);
+
+#endif  // SCENEPARSER_H_
@@ -23,10 +23,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <cilk/cilk.h>
 
 
-#include "./fasttime.h"
+#include "bench.h"
+#include "fasttime.h"
 #include "./line.h"
 #include "./line_demo.h"
 #include "./cilktool.h"
@@ -49,6 +49,66 @@ void lineMain(LineDemo *lineDemo) {
   }
 }
 
+// Simulation settings selectable through the benchmark argument.
+typedef struct {
+  bool useQuadtree;
+  unsigned int reorderInterval;
+} BenchConfig;
+
+static BenchConfig kBruteForce = {false, 0};
+static BenchConfig kQuadtree = {true, 0};
+static BenchConfig kQuadtreeMorton = {true, 16};
+
+// Benchmark kernel: state->iterations simulation frames on a scene freshly
+// loaded from input_file_path.  Loading the scene is not timed.
+static void bench_frames(bench_state_t* state) {
+  bench_pause(state);
+  LineDemo* lineDemo = LineDemo_new();
+  LineDemo_setInputFile(input_file_path);
+  LineDemo_initLine(lineDemo);
+  LineDemo_setNumFrames(lineDemo, state->iterations);
+  const BenchConfig* config = (const BenchConfig*)state->arg;
+  LineDemo_setUseQuadtree(lineDemo, config->useQuadtree);
+  LineDemo_setReorderInterval(lineDemo, config->reorderInterval);
+  bench_resume(state);
+
+  lineMain(lineDemo);
+
+  bench_pause(state);
+  LineDemo_delete(lineDemo);
+  bench_resume(state);
+}
+
+// Benchmark kernel: state->iterations line replacements on a scene loaded
+// from input_file_path.  Each removes a pseudo-randomly chosen line and
+// inserts a copy, which gets the freed ID back.
+static void bench_churn(bench_state_t* state) {
+  bench_pause(state);
+  LineDemo* lineDemo = LineDemo_new();
+  LineDemo_setInputFile(input_file_path);
+  LineDemo_initLine(lineDemo);
+  CollisionWorld* collisionWorld = lineDemo->collisionWorld;
+  unsigned int seed = 1;
+  bench_resume(state);
+
+  for (int64_t i = 0; i < state->iterations; i++) {
+    unsigned int numLines = CollisionWorld_getNumOfLines(collisionWorld);
+    Line* victim = CollisionWorld_getLine(collisionWorld,
+                                          rand_r(&seed) % numLines);
+    Line* line = malloc(sizeof(Line));
+    *line = *victim;
+    CollisionWorld_removeLine(collisionWorld, victim->id);
+    unsigned int id;
+    if (!CollisionWorld_insertLine(collisionWorld, line, &id)) {
+      free(line);
+    }
+  }
+
+  bench_pause(state);
+  LineDemo_delete(lineDemo);
+  bench_resume(state);
+}
+
 int main(int argc, char *argv[]) {
   int optchar;
 #ifndef PROFILE_BUILD
@@ -57,11 +117,14 @@ int main(int argc, char *argv[]) {
   // Flag to indicate whether to use quadtree-based collision detection.
   // Set to true if -q command-line flag is provided.
   bool useQuadtree = false;
+  // Reorder line storage by Morton code every this many frames (-r).
+  unsigned int reorderInterval = 0;
+  bool benchFlag = false;
   unsigned int numFrames = 1;
   extern int optind;
 
   // Process command line options.
-  while ((optchar = getopt(argc, argv, "giq")) != -1) {
+  while ((optchar = getopt(argc, argv, "giqr:b")) != -1) {
     switch (optchar) {
     case 'g':
 #ifndef PROFILE_BUILD
@@ -73,6 +136,12 @@ int main(int argc, char *argv[]) {
       // This flag will be passed to the LineDemo after initialization.
       useQuadtree = true;
       break;
+    case 'r':
+      reorderInterval = (unsigned int)atoi(optarg);
+      break;
+    case 'b':
+      benchFlag = true;
+      break;
     default:
       printf("Ignoring unrecognized option: %c\n", optchar);
       continue;
@@ -85,11 +154,30 @@ int main(int argc, char *argv[]) {
     argv[i] = argv[i + optind - 1];
   }
 
+  // -b times single frames of both collision detectors, and line removal
+  // plus insertion, through the shared benchmark driver; the only
+  // positional argument is the input file.
+  if (benchFlag) {
+    input_file_path = (remaining_args > 0) ? argv[1] : DEFAULT_INPUT_FILE_PATH;
+    printf("Input file path is: %s\n", input_file_path);
+    const bench_options_t opts = bench_options_from_env();
+    bench_register("frame_bruteforce", bench_frames, &kBruteForce, 1);
+    bench_register("frame_quadtree", bench_frames, &kQuadtree, 1);
+    bench_register("frame_quadtree_morton", bench_frames, &kQuadtreeMorton, 1);
+    bench_register("line_churn", bench_churn, NULL, 1);
+    bench_run_all(&opts);
+    return 0;
+  }
+
   // Check to make sure number of arguments is correct.
   if (remaining_args < 1) {
-    printf("Usage: %s [-q] [-g] <numFrames> [inputfile]\n", argv[0]);
+    printf("Usage: %s [-q] [-r K] [-g] <numFrames> [inputfile]\n", argv[0]);
+    printf("       %s -b [inputfile]\n", argv[0]);
     printf("  -q : detect collision using quadtree\n");
+    printf("  -r : reorder line storage by Morton code every K frames\n");
     printf("  -g : show graphics\n");
+    printf("  -b : benchmark one frame of each collision detector and"
+           " line churn\n");
     exit(-1);
   }
 
@@ -118,6 +206,10 @@ int main(int argc, char *argv[]) {
   } else {
     printf("Using brute-force collision detection.\n");
   }
+  if (reorderInterval > 0) {
+    LineDemo_setReorderInterval(lineDemo, reorderInterval);
+    printf("Reordering line storage every %u frames.\n", reorderInterval);
+  }
 
   const fasttime_t start_time = gettime();
 